@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * SHA-1 and SHA-256 using the ARMv8 Crypto Extensions
+ *
+ * The extensions are optional, so the CPU is checked on every call and the
+ * generic code is used if it does not implement them.
+ */
+
+#include <common.h>
+#include <linux/errno.h>
+#include <u-boot/sha1.h>
+#include <u-boot/sha256.h>
+
+/* ID_AA64ISAR0_EL1 fields */
+#define ID_AA64ISAR0_SHA1_SHIFT		8
+#define ID_AA64ISAR0_SHA2_SHIFT		12
+
+void sha1_armv8_ce_process(uint32_t state[5], const unsigned char *data,
+			   unsigned int blocks);
+void sha256_armv8_ce_process(uint32_t state[8], const uint8_t *data,
+			     unsigned int blocks);
+
+static bool armv8_ce_has(int shift)
+{
+	u64 isar0;
+
+	asm volatile("mrs %0, id_aa64isar0_el1" : "=r" (isar0));
+
+	return (isar0 >> shift) & 0xf;
+}
+
+#ifdef CONFIG_ARMV8_CE_SHA1
+int sha1_ce_process(sha1_context *ctx, const unsigned char *data,
+		    unsigned int blocks)
+{
+	uint32_t state[5];
+	int i;
+
+	if (!armv8_ce_has(ID_AA64ISAR0_SHA1_SHIFT))
+		return -ENOSYS;
+	if (!blocks)
+		return 0;
+
+	/* The context keeps the state in longs */
+	for (i = 0; i < 5; i++)
+		state[i] = ctx->state[i];
+	sha1_armv8_ce_process(state, data, blocks);
+	for (i = 0; i < 5; i++)
+		ctx->state[i] = state[i];
+
+	return 0;
+}
+#endif
+
+#ifdef CONFIG_ARMV8_CE_SHA256
+int sha256_ce_process(sha256_context *ctx, const uint8_t *data,
+		      unsigned int blocks)
+{
+	if (!armv8_ce_has(ID_AA64ISAR0_SHA2_SHIFT))
+		return -ENOSYS;
+	if (blocks)
+		sha256_armv8_ce_process(ctx->state, data, blocks);
+
+	return 0;
+}
+#endif
@@ -958,9 +958,15 @@ static struct fs_header_v1_0 one_fsh;	/* Buffer for one F&S header */
 static void *validate_addr = NULL;
 static void *final_addr;
 static bool keep_fs_header;
+static bool crc_streaming;		/* CRC32 is computed while loading */
+static u32 crc_start;			/* CRC32 before the image data */
+static u32 crc_computed;		/* CRC32 computed so far */
 
 #define MAX_NEST_LEVEL 8
 
+/* Load image data in chunks of this size to compute CRC32 while in cache */
+#define FSIMG_LOAD_CHUNK 0x4000
+
 static struct fsimg {
 	unsigned int size;		/* Size of the main image data */
 	unsigned int remaining;		/* Remaining bytes in this level */
@@ -974,8 +980,13 @@ struct flash_info_spl {
 	struct blk_desc *blk_desc;	/* Handle to MMC block device */
 	u8 hwpart[2];			/* hwpart for each copy */
 #endif
-	/* Function to load a chunk of data from any offset */
-	int (*load)(uint32_t offs, uint size, void *buf);
+	/*
+	 * Function to load a chunk of data from any offset. If skip is not
+	 * NULL, the data is loaded from offs + *skip and the size of all bad
+	 * blocks skipped on the way is added to *skip. If buf is NULL, only
+	 * the bad blocks are accounted for.
+	 */
+	int (*load)(uint32_t offs, uint size, void *buf, uint *skip);
 
 	/* Function to set the hwpart for given copy */
 	int (*set_hwpart)(struct flash_info_spl *fi, int copy);
@@ -1054,6 +1065,54 @@ static void fs_image_enter(unsigned int size, enum fsimg_state new_state)
 	fs_image_next_header(new_state);
 }
 
+#ifndef CONFIG_FS_SECURE_BOOT
+/* Start computing the CRC32 of the image in one_fsh while it is loaded */
+static void fs_image_crc_start(void)
+{
+	u32 *pcs = (u32 *)&one_fsh.type[12];
+	u32 expected_cs;
+
+	crc_start = 0;
+	if (one_fsh.info.flags & FSH_FLAGS_SECURE) {
+		/* CRC32 is in type[12..15]; temporarily set to 0 */
+		expected_cs = *pcs;
+		*pcs = 0;
+		crc_start = crc32(0, (unsigned char *)&one_fsh, FSH_SIZE);
+		*pcs = expected_cs;
+	}
+	crc_computed = crc_start;
+	crc_streaming = !!(one_fsh.info.flags & FSH_FLAGS_CRC32);
+}
+
+/* Check the CRC32 computed while loading; same results as check_crc32 */
+static int fs_image_crc_result(void)
+{
+	int ret = 0;
+
+	if (one_fsh.info.flags & FSH_FLAGS_SECURE)
+		ret |= 1;
+	if (one_fsh.info.flags & FSH_FLAGS_CRC32)
+		ret |= 2;
+	if (ret && (crc_computed != *(u32 *)&one_fsh.type[12]))
+		return -EILSEQ;
+
+	return ret;
+}
+#endif
+
+/* Add a chunk of image data that was just loaded to the CRC32 */
+static void fs_image_crc_update(void *buf, unsigned int size)
+{
+	if (crc_streaming)
+		crc_computed = crc32(crc_computed, buf, size);
+}
+
+/* Return true if the CRC32 of the image data loaded so far is OK */
+static bool fs_image_crc_ok(void)
+{
+	return !crc_streaming || (crc_computed == *(u32 *)&one_fsh.type[12]);
+}
+
 /* State machine: Load data of given size to given address, go to new state */
 static void fs_image_copy(void *final, void *validate, unsigned int size,
 			  bool keep)
@@ -1062,24 +1121,26 @@ static void fs_image_copy(void *final, void *validate, unsigned int size,
 	count = size;
 	mode = FSIMG_MODE_IMAGE;
 	keep_fs_header = keep;
+	crc_streaming = false;
 
 #ifndef CONFIG_FS_SECURE_BOOT
-	/* No CRC32 active in image, copy directly to final address */
-	if (!(one_fsh.info.flags & (FSH_FLAGS_SECURE | FSH_FLAGS_CRC32))) {
-		if (keep) {
-			memcpy(final, &one_fsh, FSH_SIZE);
-			final += FSH_SIZE;
-		}
-		validate_addr = NULL;
-		debug("Loading 0x%x bytes directly to 0x%08lx\n", size,
-		      (ulong)final);
-		return;
+	/*
+	 * Without secure boot, images are never signed. Load them directly to
+	 * the final address and compute the CRC32 (if any) as the data comes
+	 * in. This avoids a temporary copy of the image.
+	 */
+	fs_image_crc_start();
+	if (keep) {
+		memcpy(final, &one_fsh, FSH_SIZE);
+		final += FSH_SIZE;
 	}
-#endif
-
+	validate_addr = NULL;
+	addr = final;
+	debug("Loading 0x%x bytes directly to 0x%08lx\n", size, (ulong)final);
+#else
 	/*
-	 * The image is either signed or has CRC32. Load image to validation
-	 * address first and copy to final address later after validation.
+	 * The image may be signed. Load image to validation address first and
+	 * copy to final address later after validation.
 	 */
 	final_addr = final;
 	if (!validate)
@@ -1090,6 +1151,7 @@ static void fs_image_copy(void *final, void *validate, unsigned int size,
 	addr = validate;
 	debug("Loading 0x%x bytes to temp 0x%08lx for validation\n",
 	      size, (ulong)addr);
+#endif
 }
 
 /* State machine: Skip data of given size */
@@ -1145,19 +1207,42 @@ static int fs_image_match_check(const struct fs_header_v1_0 *fsh,
 	return true;
 }
 
+/* Show result of a CRC32 check, return true if OK */
+static bool fs_image_crc32_ok(int ret, const char *type, const char *descr)
+{
+	switch (ret) {
+	case 0:
+		debug(", no CRC32 (OK)\n");
+		break;
+	case 1:
+		debug(", CRC32 header only OK\n");
+		break;
+	case 2:
+		debug(", CRC32 image only OK\n");
+		break;
+	case 3:
+		debug(", CRC32 header+image OK\n");
+		break;
+	default:
+		printf("\nError: CRC32 of %s (%s) FAILED!\n", type, descr);
+		return false;
+	}
+
+	return true;
+}
+
 static bool fs_image_validate_spl(const char *type, const char *descr)
 {
 	struct fs_header_v1_0 *fsh = validate_addr;
 	unsigned int size;
 
-
 	debug("Got %s (%s), ", type, descr);
 
 #ifndef CONFIG_FS_SECURE_BOOT
-	/* Image without CRC32 that was loaded directly to the final address */
+	/* Image was loaded directly to the final address, CRC32 is known */
 	if (!fsh) {
-		debug("no CRC32 check\n");
-		return true;
+		debug("unsigned");
+		return fs_image_crc32_ok(fs_image_crc_result(), type, descr);
 	}
 #endif
 
@@ -1186,24 +1271,9 @@ static bool fs_image_validate_spl(const char *type, const char *descr)
 		}
 #endif
 
-		switch (fs_image_check_crc32(validate_addr)) {
-		case 0:
-			debug(", no CRC32 (OK)\n");
-			break;
-			case 1:
-				debug(", CRC32 header only OK\n");
-				break;
-		case 2:
-			debug(", CRC32 image only OK\n");
-			break;
-		case 3:
-			debug(", CRC32 header+image OK\n");
-			break;
-		default:
-			printf("\nError: CRC32 of %s (%s) FAILED!\n",
-			       type, descr);
+		if (!fs_image_crc32_ok(fs_image_check_crc32(validate_addr),
+				       type, descr))
 			return false;
-		}
 
 		if (!keep_fs_header) {
 			size -= FSH_SIZE;
@@ -1508,6 +1578,8 @@ static void fs_image_sdp_rx_data(u8 *data_buf, int data_len)
 		chunk = min((unsigned int)data_len, count);
 		if ((mode == FSIMG_MODE_IMAGE) || (mode == FSIMG_MODE_HEADER))
 			memcpy(addr, data_buf, chunk);
+		if (mode == FSIMG_MODE_IMAGE)
+			fs_image_crc_update(addr, chunk);
 
 		addr += chunk;
 		data_buf += chunk;
@@ -1569,7 +1641,7 @@ static int fs_image_get_flash_info_spl_nand(struct flash_info_spl *fi)
 	fi->offs[1] = CONFIG_FUS_BOARDCFG_NAND1;
 
 	/* Set access functions */
-	fi->load = nand_spl_load_image;
+	fi->load = nand_spl_load_image_skip;
 	fi->set_hwpart = fs_image_set_hwpart_nand;
 
 	fi->layout = "nand";
@@ -1579,8 +1651,12 @@ static int fs_image_get_flash_info_spl_nand(struct flash_info_spl *fi)
 #endif /* CONFIG_NAND_MXS */
 
 #ifdef CONFIG_MMC
-/* Load MMC data from arbitrary offsets, not necessarily MMC block aligned */
-static int fs_image_gen_load_mmc(uint32_t offs, unsigned int size, void *buf)
+/*
+ * Load MMC data from arbitrary offsets, not necessarily MMC block aligned.
+ * There are no bad blocks on MMC, so skip is never changed.
+ */
+static int fs_image_gen_load_mmc(uint32_t offs, unsigned int size, void *buf,
+				 unsigned int *skip)
 {
 	unsigned long n;
 	unsigned int chunk_offs;
@@ -1591,6 +1667,9 @@ static int fs_image_gen_load_mmc(uint32_t offs, unsigned int size, void *buf)
 	unsigned long blksz;
 //###	int err;
 
+	if (!buf)
+		return 0;
+
 	mmc = find_mmc_device(0);
 #if 0 //### we can skip initialization, already done in fs_image_load_system()
 	if (!mmc) {
@@ -1729,10 +1808,85 @@ static int fs_image_get_flash_info_spl_mmc(struct flash_info_spl *fi)
 }
 #endif /* CONFIG_MMC */
 
+/*
+ * Load image data from flash and compute the CRC32 of each chunk right after
+ * it was read, while it is still in the cache. The bytes skipped for bad
+ * blocks are passed on in skip from chunk to chunk.
+ */
+static int fs_image_load_image(struct flash_info_spl *fi, unsigned int offs,
+			       unsigned int size, void *buf, unsigned int *skip)
+{
+	unsigned int chunk;
+	int err;
+
+	if (!crc_streaming)
+		return fi->load(offs, size, buf, skip);
+
+	/* Chunk boundaries are aligned, so no page/block is read twice */
+	while (size) {
+		chunk = FSIMG_LOAD_CHUNK - (offs % FSIMG_LOAD_CHUNK);
+		if (chunk > size)
+			chunk = size;
+		err = fi->load(offs, chunk, buf, skip);
+		if (err)
+			return err;
+		fs_image_crc_update(buf, chunk);
+		offs += chunk;
+		buf += chunk;
+		size -= chunk;
+	}
+
+	return 0;
+}
+
+/*
+ * The CRC32 of an image failed. Both copies of NBOOT have the same layout, so
+ * load just this image again from the same offset in the other copy instead
+ * of starting all over. If the other copy holds a different version, the
+ * CRC32 from the header will not match and the image is rejected as before.
+ */
+static int fs_image_load_image_other(struct flash_info_spl *fi, int copy,
+				     unsigned int offs, unsigned int size,
+				     void *buf)
+{
+	int other = 1 - copy;
+	unsigned int skip = 0;
+	int err, ret;
+
+	printf("CRC32 error in copy %d, loading image from copy %d\n",
+	       copy, other);
+	crc_computed = crc_start;
+	err = fi->set_hwpart(fi, other);
+
+	/* The other copy has its own bad blocks, count them up to the image */
+	if (!err)
+		err = fi->load(fi->offs[other], offs - fi->offs[copy], NULL,
+			       &skip);
+	if (!err) {
+		offs += fi->offs[other] - fi->offs[copy];
+		err = fs_image_load_image(fi, offs, size, buf, &skip);
+		if (!err && !fs_image_crc_ok()) {
+			printf("CRC32 error in copy %d, too\n", other);
+			err = -EILSEQ;
+		}
+	}
+
+	/* Do not leave bad data behind that might be taken for valid */
+	if (err)
+		memset(buf, 0, size);
+
+	/* Always switch back, the rest is loaded from the current copy */
+	ret = fi->set_hwpart(fi, copy);
+
+	return err ? err : ret;
+}
+
 /* Load FIRMWARE from MMC/NAND using state machine */
 static int fs_image_loop(struct flash_info_spl *fi, struct fs_header_v1_0 *cfg,
-			 unsigned int start)
+			 int copy)
 {
+	unsigned int start = fi->offs[copy];
+	unsigned int skip = 0;
 	int err;
 	unsigned int end;
 	void *fdt;
@@ -1764,13 +1918,15 @@ static int fs_image_loop(struct flash_info_spl *fi, struct fs_header_v1_0 *cfg,
 	end = start + nboot_size;
 	start += board_cfg_size;
 
+	/* Account for bad blocks within the BOARD-CFG region */
+	err = fi->load(fi->offs[copy], board_cfg_size, NULL, &skip);
+	if (err)
+		return err;
+
 	/*
-	 * ### TODO: Handle (=skip) bad blocks in case of NAND (if load ==
-	 * nand_spl_load_image) Basic idea: nand_spl_load_image() already
-	 * skips bad blocks. So when incrementing offs, check the region for
-	 * bad blocks and increase offs again according to the number of
-	 * bad blocks in the region. Problem: we do not have info about NAND
-	 * here like block sizes, so maybe have such a function in NAND driver.
+	 * In case of NAND, skip tells how many bytes of bad blocks were
+	 * skipped so far. It is passed to every load, also for data that is
+	 * not loaded, so that the next load starts at the right place.
 	 */
 	do {
 		if (count) {
@@ -1778,10 +1934,24 @@ static int fs_image_loop(struct flash_info_spl *fi, struct fs_header_v1_0 *cfg,
 			    || (mode == FSIMG_MODE_HEADER)) {
 				if (start + count >= end)
 					return -EFBIG;
-				err = fi->load(start, count, addr);
+				if (mode == FSIMG_MODE_HEADER)
+					err = fi->load(start, count, addr,
+						       &skip);
+				else {
+					err = fs_image_load_image(fi, start,
+							count, addr, &skip);
+					if (!err && !fs_image_crc_ok())
+						err = fs_image_load_image_other(
+							fi, copy, start, count,
+							addr);
+				}
 				if (err)
 					return err;
 				addr += count;
+			} else {
+				err = fi->load(start, count, NULL, &skip);
+				if (err)
+					return err;
 			}
 			start += count;
 		}
@@ -1828,9 +1998,10 @@ int fs_image_load_system(enum boot_device boot_dev, bool secondary,
 
 		/* Load BOARD-CFG to OCRAM (normal load) and validate */
 		if (!fi.set_hwpart(&fi, copy)
-		    && !fi.load(start, FSH_SIZE, &one_fsh)
+		    && !fi.load(start, FSH_SIZE, &one_fsh, NULL)
 		    && fs_image_match(&one_fsh, "BOARD-CFG", NULL)
-		    && !fi.load(start, fs_image_get_size(&one_fsh, true), cfg)
+		    && !fi.load(start, fs_image_get_size(&one_fsh, true), cfg,
+				NULL)
 		    && fs_image_is_ocram_cfg_valid())
  		{
 			/* BOARD-CFG successfully loaded */
@@ -1844,7 +2015,7 @@ int fs_image_load_system(enum boot_device boot_dev, bool secondary,
 			/* Try to load FIRMWARE (with state machine) */
 			fs_image_start(FSH_SIZE, FSIMG_FW_JOBS, basic_init,
 				       fi.layout);
-			if (!fs_image_loop(&fi, cfg, start) && !jobs)
+			if (!fs_image_loop(&fi, cfg, copy) && !jobs)
 				return 0;
 		}
 
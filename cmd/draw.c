@@ -14,6 +14,8 @@
 #include <stdio_dev.h>			  /* stdio_dev, stdio_register(), ... */
 #include <linux/ctype.h>		  /* isdigit(), toupper() */
 #include <watchdog.h>			  /* WATCHDOG_RESET */
+#include <console.h>			  /* ctrlc() */
+#include <time.h>			  /* get_ticks() */
 
 #if defined(CONFIG_XLCD_PNG) \
 	|| defined(CONFIG_XLCD_BMP) \
@@ -79,6 +81,9 @@ enum DRAW_INDEX {
 #endif
 #if (CONFIG_XLCD_DRAW & XLCD_DRAW_TEST) && defined(CONFIG_CMD_DRAW)
 	DI_TEST,
+#endif
+#if CONFIG_XLCD_DRAW & XLCD_DRAW_BENCH
+	DI_BENCH,
 #endif
 	DI_CLIP,
 	DI_ORIGIN,
@@ -140,6 +145,9 @@ static kwinfo_t const draw_kw[] = {
 #endif
 #if (CONFIG_XLCD_DRAW & XLCD_DRAW_TEST) && defined(CONFIG_CMD_DRAW)
 	[DI_TEST] =   {0, 1, 0, 9, "test"},   /* [n] */
+#endif
+#if CONFIG_XLCD_DRAW & XLCD_DRAW_BENCH
+	[DI_BENCH] =  {1, 9, 0, 9, "bench"},  /* n [cmd [args]] */
 #endif
 	[DI_CLIP] =   {4, 4, 2, 9, "clip"},   /* x1 y1 x2 y2 */
 	[DI_ORIGIN] = {2, 2, 1, 9, "origin"}, /* x1 y1 */
@@ -855,9 +863,10 @@ void lcd_rrect(const wininfo_t *pwi, XYPOS x1, XYPOS y1, XYPOS x2, XYPOS y2,
    partly outside of the framebuffer, it is not drawn at all. If you need
    partly visible characters, use a larger framebuffer and show only the part
    with the partly visible characters in a window. */
-void lcd_text(const wininfo_t *pwi, XYPOS x, XYPOS y, char *s,
+void lcd_text(wininfo_t *pwi, XYPOS x, XYPOS y, char *s,
 	      const colinfo_t *pci_fg, const colinfo_t *pci_bg)
 {
+	XYPOS xstart;
 	XYPOS len = (XYPOS)strlen(s);
 	XYPOS width = VIDEO_FONT_WIDTH;
 	XYPOS height = VIDEO_FONT_HEIGHT;
@@ -934,6 +943,7 @@ void lcd_text(const wininfo_t *pwi, XYPOS x, XYPOS y, char *s,
 	}
 
 	/* At least one character is within the framebuffer */
+	xstart = x;
 	for (;;) {
 		char c = *s++;
 
@@ -955,6 +965,10 @@ void lcd_text(const wininfo_t *pwi, XYPOS x, XYPOS y, char *s,
 #endif
 		x += width;
 	}
+
+	/* Mark the drawn characters as changed */
+	if (x > xstart)
+		lcd_add_dirty(pwi, xstart, y, x - 1, y + height - 1);
 }
 #endif
 
@@ -1277,7 +1291,7 @@ static u_long lcd_scan_bitmap(u_long addr)
 
 
 /* Draw bitmap from address addr at (x, y) with alignment/attribute a */
-const char *lcd_bitmap(const wininfo_t *pwi, XYPOS x, XYPOS y, u_long addr)
+const char *lcd_bitmap(wininfo_t *pwi, XYPOS x, XYPOS y, u_long addr)
 {
 	imginfo_t ii;
 	XYPOS hres, vres;
@@ -1285,8 +1299,10 @@ const char *lcd_bitmap(const wininfo_t *pwi, XYPOS x, XYPOS y, u_long addr)
 	int xpos;
 	u_int attr;
 
-	/* Do a quick scan if bitmap integrity is OK */
-	if (!lcd_scan_bitmap(addr))
+	/* Do a quick scan if bitmap integrity is OK; decoders must not read
+	   beyond the end found here */
+	ii.end = lcd_scan_bitmap(addr);
+	if (!ii.end)
 		return "Unknown bitmap type\n";
 
 	/* Get bitmap info */
@@ -1371,6 +1387,7 @@ const char *lcd_bitmap(const wininfo_t *pwi, XYPOS x, XYPOS y, u_long addr)
 	ii.trans_rgba = 0x000000FF;	  /* No transparent color set yet */
 	ii.hash_rgba = 0x000000FF;	  /* Preload hash color */
 	ii.hash_col = pwi->ppi->rgba2col(pwi, 0x000000FF);
+	ii.palci = NULL;		  /* Computed on first use */
 
 	ii.ypix = 0;
 	ii.yend = vres;
@@ -1378,6 +1395,9 @@ const char *lcd_bitmap(const wininfo_t *pwi, XYPOS x, XYPOS y, u_long addr)
 	if (ii.yend + y > ymax)
 		ii.yend = ymax - y;
 
+	/* Mark the bitmap area as changed */
+	lcd_add_dirty(pwi, x, y, x + ii.xend - ii.xpix - 1, y + ii.yend - 1);
+
 	/* Actually draw the bitmap */
 	return bmtype_tab[ii.bi.type].draw_bm(&ii, addr);
 }
@@ -1778,6 +1798,64 @@ static int lcd_test(const wininfo_t *pwi, u_int pattern)
 #endif /* (CONFIG_XLCD_DRAW & XLCD_DRAW_TEST) && defined(CONFIG_CMD_DRAW) */
 
 
+#if (CONFIG_XLCD_DRAW & XLCD_DRAW_BENCH) && (CONFIG_XLCD_DRAW & XLCD_DRAW_FILL)
+/************************************************************************/
+/* Built-in benchmark							*/
+/************************************************************************/
+
+/* The fill and blend paths of the low-level layer; each entry fills the
+   clipping region once per run. Entries with ATTR_ALPHA use the adraw
+   functions with an opaque, a half transparent and a fully transparent
+   color. Bitmaps can be measured with "draw bench n bm ...". */
+static const struct benchinfo {
+	char *name;			  /* Name to show */
+	u_int attr;			  /* 0 or ATTR_ALPHA */
+	RGBA rgba;			  /* Fill color */
+} bench_suite[] = {
+	{"draw fill",         0,          0x336699FF},
+#ifdef CONFIG_CMD_ADRAW
+	{"adraw fill #..FF", ATTR_ALPHA, 0x336699FF},
+	{"adraw fill #..80", ATTR_ALPHA, 0x33669980},
+	{"adraw fill #..00", ATTR_ALPHA, 0x33669900},
+#endif
+};
+
+/* Run each entry of the benchmark suite n times */
+static void lcd_bench_suite(wininfo_t *pwi, u_int n)
+{
+	const struct benchinfo *pbi;
+	RGBA fg = pwi->fg.rgba;
+	u_int i;
+	ulong start;
+	uint64_t ticks;
+
+	for (pbi = bench_suite; pbi < bench_suite + ARRAY_SIZE(bench_suite);
+	     pbi++) {
+		pwi->attr = pbi->attr;
+		lcd_set_fg(pwi, pbi->rgba);
+		start = get_timer(0);
+		ticks = get_ticks();
+		for (i = 0; i < n; i++) {
+			lcd_fill(pwi, &pwi->fg);
+			WATCHDOG_RESET();
+		}
+		ticks = get_ticks() - ticks;
+		start = get_timer(start);
+		printf("%-17s %lu ms, %llu ticks per run\n", pbi->name, start,
+		       (unsigned long long)ticks / n);
+	}
+	printf("%u runs of (%d, %d) - (%d, %d), %lu ticks/s\n", n,
+	       pwi->clip_left, pwi->clip_top, pwi->clip_right,
+	       pwi->clip_bottom, get_tbclk());
+
+	/* Restore FG color and show the result */
+	lcd_set_fg(pwi, fg);
+	lcd_add_dirty(pwi, pwi->clip_left, pwi->clip_top,
+		      pwi->clip_right, pwi->clip_bottom);
+}
+#endif /* (CONFIG_XLCD_DRAW & XLCD_DRAW_BENCH) && (... & XLCD_DRAW_FILL) */
+
+
 /************************************************************************/
 /* Command draw								*/
 /************************************************************************/
@@ -1911,6 +1989,7 @@ static int do_draw(cmd_tbl_t *cmdtp, int flag, int argc, char *const argv[])
 	case DI_PIXEL:			  /* Draw pixel */
 		lcd_set_fg(pwi, rgba1);
 		lcd_pixel(pwi, x1, y1, &pwi->fg);
+		lcd_add_dirty(pwi, x1, y1, x1, y1);
 		break;
 #endif
 
@@ -1918,12 +1997,15 @@ static int do_draw(cmd_tbl_t *cmdtp, int flag, int argc, char *const argv[])
 	case DI_LINE:			  /* Draw line */
 		lcd_set_fg(pwi, rgba1);
 		lcd_line(pwi, x1, y1, x2, y2, &pwi->fg);
+		lcd_add_dirty(pwi, min(x1, x2), min(y1, y2),
+			      max(x1, x2), max(y1, y2));
 		break;
 #endif
 
 #if CONFIG_XLCD_DRAW & XLCD_DRAW_RECT
 	case DI_RECT:			  /* Draw filled rectangle */
 	case DI_FRAME:			  /* Draw rectangle outline */
+		lcd_add_dirty(pwi, x1, y1, x2, y2);
 		lcd_set_fg(pwi, rgba1);
 		if (sc == DI_RECT) {
 			lcd_rect(pwi, x1, y1, x2, y2, &pwi->fg);
@@ -1941,6 +2023,7 @@ static int do_draw(cmd_tbl_t *cmdtp, int flag, int argc, char *const argv[])
 		XYPOS r;
 
 		r = (XYPOS)simple_strtol(argv[6], NULL, 0); /* Parse radius */
+		lcd_add_dirty(pwi, x1, y1, x2, y2);
 		lcd_set_fg(pwi, rgba1);
 		if (sc == DI_RRECT) {
 			lcd_rrect(pwi, x1, y1, x2, y2, r, &pwi->fg);
@@ -1957,6 +2040,7 @@ static int do_draw(cmd_tbl_t *cmdtp, int flag, int argc, char *const argv[])
 		XYPOS r;
 
 		r = (XYPOS)simple_strtol(argv[4], NULL, 0); /* Parse radius */
+		lcd_add_dirty(pwi, x1 - r, y1 - r, x1 + r, y1 + r);
 		lcd_set_fg(pwi, rgba1);
 		if (sc == DI_DISC) {
 			lcd_rrect(pwi, x1-r, y1-r, x1+r, y1+r, r, &pwi->fg);
@@ -2028,6 +2112,9 @@ static int do_draw(cmd_tbl_t *cmdtp, int flag, int argc, char *const argv[])
 
 #if CONFIG_XLCD_DRAW & XLCD_DRAW_TURTLE
 	case DI_TURTLE:			  /* Draw turtle graphics */
+		/* The extent is not known in advance, use clipping region */
+		lcd_add_dirty(pwi, pwi->clip_left, pwi->clip_top,
+			      pwi->clip_right, pwi->clip_bottom);
 		lcd_set_fg(pwi, rgba1);
 		if (lcd_turtle(pwi, &x1, &y1, argv[4], 0) < 0)
 			puts(" in argument string\n");
@@ -2038,6 +2125,8 @@ static int do_draw(cmd_tbl_t *cmdtp, int flag, int argc, char *const argv[])
 	case DI_FILL:			  /* Fill window with FG color */
 		lcd_set_fg(pwi, rgba1);
 		lcd_fill(pwi, &pwi->fg);
+		lcd_add_dirty(pwi, pwi->clip_left, pwi->clip_top,
+			      pwi->clip_right, pwi->clip_bottom);
 		break;
 
 	case DI_CLEAR:			  /* Fill window with BG color */
@@ -2045,6 +2134,8 @@ static int do_draw(cmd_tbl_t *cmdtp, int flag, int argc, char *const argv[])
 		    return 1;
 		lcd_set_bg(pwi, rgba2);
 		lcd_fill(pwi, &pwi->bg);
+		lcd_add_dirty(pwi, pwi->clip_left, pwi->clip_top,
+			      pwi->clip_right, pwi->clip_bottom);
 		break;
 #endif
 
@@ -2081,6 +2172,8 @@ static int do_draw(cmd_tbl_t *cmdtp, int flag, int argc, char *const argv[])
 			pwi->pbi.prog = percent;
 		}
 		lcd_progbar(pwi);
+		lcd_add_dirty(pwi, pwi->pbi.x1, pwi->pbi.y1,
+			      pwi->pbi.x2, pwi->pbi.y2);
 		break;
 	}
 #endif
@@ -2106,10 +2199,68 @@ static int do_draw(cmd_tbl_t *cmdtp, int flag, int argc, char *const argv[])
 			printf("Window too small\n");
 			return 1;
 		}
+		lcd_add_dirty(pwi, pwi->clip_left, pwi->clip_top,
+			      pwi->clip_right, pwi->clip_bottom);
 		break;
 	}
 #endif
 
+#if CONFIG_XLCD_DRAW & XLCD_DRAW_BENCH
+	case DI_BENCH: {		  /* Run draw command n times */
+		char *bargv[9];
+		u_int n, i;
+		int bargc;
+		ulong start;
+		uint64_t ticks;
+
+		/* Argument 1: number of runs */
+		n = simple_strtoul(argv[2], NULL, 0);
+		if (!n)
+			n = 1;
+
+		/* Without a command, run the built-in suite */
+		if (argc < 4) {
+#if CONFIG_XLCD_DRAW & XLCD_DRAW_FILL
+			lcd_bench_suite(pwi, n);
+			break;
+#else
+			puts("Missing argument\n");
+			return 1;
+#endif
+		}
+
+		/* Remaining arguments: the draw command to measure; keep
+		   argv[0] so that adraw is still detected */
+		bargc = argc - 2;
+		bargv[0] = argv[0];
+		for (i = 1; i < bargc; i++)
+			bargv[i] = argv[i + 2];
+		sc = parse_sc(bargc, bargv[1], DI_HELP, draw_kw,
+			      ARRAY_SIZE(draw_kw));
+		if ((sc == DI_HELP) || (sc == DI_BENCH)) {
+			printf("Invalid draw command '%s'\n", bargv[1]);
+			return 1;
+		}
+
+		start = get_timer(0);
+		ticks = get_ticks();
+		for (i = 0; i < n; i++) {
+			if (do_draw(cmdtp, flag, bargc, bargv))
+				return 1;
+			WATCHDOG_RESET();
+			if (ctrlc()) {
+				n = i + 1;
+				break;
+			}
+		}
+		ticks = get_ticks() - ticks;
+		start = get_timer(start);
+		printf("%u runs in %lu ms, %llu ticks per run (%lu ticks/s)\n",
+		       n, start, (unsigned long long)ticks / n, get_tbclk());
+		return 0;
+	}
+#endif
+
 	case DI_CLIP:			  /* Set new clipping region */
 		if (x1 < 0)
 			x1 = 0;
@@ -2135,13 +2286,18 @@ static int do_draw(cmd_tbl_t *cmdtp, int flag, int argc, char *const argv[])
 		return 1;
 	}
 
+	/* When drawing to the visible buffer, write back changes right now;
+	   otherwise this is done when the buffers are flipped */
+	if (pwi->fbdraw == pwi->fbshow)
+		lcd_sync(pwi);
+
 	return 0;
 }
 
 #if defined(CONFIG_CMD_DRAW) || defined(CONFIG_CMD_ADRAW)
 /* If only CONFIG_CMD_ADRAW and not CONFIG_CMD_DRAW is set, call as "draw" */
 U_BOOT_CMD(
-	draw, 9, 1, do_draw,
+	draw, 11, 1, do_draw,
 	"draw to selected window",
 	"color #rgba [#rgba]\n"
 	"    - set FG (and BG) color\n"
@@ -2211,6 +2367,12 @@ U_BOOT_CMD(
 #endif
 	"]\n"
 	"    - draw test pattern\n"
+#endif
+#if CONFIG_XLCD_DRAW & XLCD_DRAW_BENCH
+	"draw bench n [cmd [args]]\n"
+	"    - run draw command cmd n times and show the time per run; draw\n"
+	"      to a hidden buffer to leave out the write back to the display;\n"
+	"      without cmd, measure filling the clipping region (with alpha)\n"
 #endif
 	"draw clip x1 y1 x2 y2\n"
 	"    - define clipping region from (x1, y1) to (x2, y2)\n"
@@ -2227,7 +2389,7 @@ U_BOOT_CMD(
 #if defined(CONFIG_CMD_DRAW) && defined(CONFIG_CMD_ADRAW)
 /* If both types of draw commands are active, use draw and adraw */
 U_BOOT_CMD(
-	adraw, 8, 1, do_draw,
+	adraw, 10, 1, do_draw,
 	"draw to selected window, directly applying alpha",
 	"arguments\n"
 	"    - see 'help draw' for a description of the 'adraw' arguments\n"
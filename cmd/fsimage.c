@@ -198,6 +198,7 @@ struct sub_info {
 	unsigned int size;		/* Size of image */
 	unsigned int offset;		/* Offset of image within si */
 	unsigned int flags;		/* See SUB_* above */
+	u32 crc;			/* CRC32 of image when saving */
 };
 
 struct region_info {
@@ -257,6 +258,13 @@ struct flash_info {
 	enum boot_device boot_dev;	/* Device to boot from */
 	const char *boot_dev_name;	/* Boot device as string */
 	struct flash_ops *ops;		/* Access functions for NAND/MMC */
+	ulong time_crc;			/* Time for computing CRC32 (ms) */
+	ulong time_erase;		/* Time for erasing/invalidating (ms) */
+	ulong time_write;		/* Time for writing (ms) */
+	ulong time_verify;		/* Time for reading back (ms) */
+	bool changed_only;		/* Skip region copies that are equal */
+	unsigned int saved;		/* Number of region copies saved */
+	unsigned int skipped;		/* Number of region copies skipped */
 };
 
 /* Info table for secondary SPL (MMC) */
@@ -275,6 +283,9 @@ union any_header {
 	struct fdt_header fdt;
 };
 
+/* Buffer size for reading back data after saving; multiple of page size */
+#define VERIFY_BUF_SIZE 0x10000
+
 /* Argument of option -e in fsimage save */
 static unsigned int early_support_index;
 
@@ -709,6 +720,18 @@ static int fs_image_show_save_status(int failed, const char *type)
 	return CMD_RET_FAILURE;
 }
 
+/* Show the time needed for the different phases of saving */
+static void fs_image_show_save_timing(struct flash_info *fi)
+{
+	if (fi->changed_only) {
+		printf("\nSkipped %u of %u region copies (unchanged)\n",
+		       fi->skipped, fi->saved + fi->skipped);
+	}
+	printf("\nTime: CRC32 %lu ms, erase %lu ms, write %lu ms,"
+	       " verify %lu ms\n", fi->time_crc, fi->time_erase,
+	       fi->time_write, fi->time_verify);
+}
+
 static int fs_image_confirm(void)
 {
 	int yes;
@@ -1483,6 +1506,85 @@ static int fs_image_save_sub(struct flash_info *fi, uint offs, uint size,
 	return 0;
 }
 
+/*
+ * Read back all sub-images of the given region and compare the CRC32 with the
+ * CRC32 of the images in RAM. The data is read in chunks of VERIFY_BUF_SIZE
+ * and the CRC32 is computed on the fly, so no RAM is needed for a full copy
+ * of the read-back data. If show is false, nothing is printed and checking
+ * stops at the first difference.
+ */
+static int fs_image_verify_region(struct flash_info *fi, int copy,
+				  struct region_info *ri, bool show)
+{
+	int err = 0;
+	struct sub_info *s;
+	struct storage_info *si = ri->si;
+	unsigned int lim = si->start[copy] + si->size;
+	unsigned int chunk_mask = fi->temp_size - 1;
+	unsigned int offs;
+	unsigned int read_pos;
+	unsigned int chunk_size;
+	unsigned int remaining;
+	ulong start;
+	u32 crc;
+	u8 *buf;
+
+	buf = malloc(VERIFY_BUF_SIZE);
+	if (!buf) {
+		puts("  Cannot allocate verify buffer\n");
+		return -ENOMEM;
+	}
+
+	fi->bb_extra_offs = 0;
+	for (s = ri->sub; s < ri->sub + ri->count; s++) {
+		offs = si->start[copy] + s->offset;
+		remaining = s->size;
+		if (show) {
+			printf("  Verifying %s at offset 0x%08x size 0x%x...",
+			       s->type, offs, remaining);
+		}
+		debug("\n");
+
+		/* Reads must start on a page/block boundary */
+		read_pos = offs & chunk_mask;
+		offs -= read_pos;
+
+		start = get_timer(0);
+		crc = 0;
+		while (remaining) {
+			chunk_size = ALIGN(read_pos + remaining, fi->temp_size);
+			if (chunk_size > VERIFY_BUF_SIZE)
+				chunk_size = VERIFY_BUF_SIZE;
+			err = fi->ops->read(fi, offs, chunk_size, lim, s->flags,
+					    buf);
+			if (err)
+				break;
+			offs += chunk_size;
+			chunk_size -= read_pos;
+			if (chunk_size > remaining)
+				chunk_size = remaining;
+			crc = crc32(crc, buf + read_pos, chunk_size);
+			remaining -= chunk_size;
+			read_pos = 0;
+		}
+		fi->time_verify += get_timer(start);
+
+		if (!err && (crc != s->crc)) {
+			debug("  - CRC32 0x%08x, expected 0x%08x\n",
+			      crc, s->crc);
+			err = -EILSEQ;
+		}
+		if (show)
+			fs_image_show_sub_status(err);
+		if (err)
+			break;
+	}
+
+	free(buf);
+
+	return err;
+}
+
 /* Save the given region to flash */
 static int fs_image_save_region(struct flash_info *fi, int copy,
 				struct region_info *ri)
@@ -1497,16 +1599,37 @@ static int fs_image_save_region(struct flash_info *fi, int copy,
 	unsigned int temp_size = fi->temp_size;
 	bool pass2;
 	const char *action;
+	ulong start;
 
 	err = fi->ops->prepare_region(fi, copy, si);
 	if (err)
 		return err;
 
+	/*
+	 * Compute the CRC32 of all sub-images for the read-back check. This
+	 * is done again for each copy, because some images are modified
+	 * between the copies, e.g. the copy number in SPL on eMMC.
+	 */
+	start = get_timer(0);
+	for (s = ri->sub; s < ri->sub + ri->count; s++)
+		s->crc = crc32(0, s->img, s->size);
+	fi->time_crc += get_timer(start);
+
+	/* If the content in flash is already the same, do not write again */
+	if (fi->changed_only && !fs_image_verify_region(fi, copy, ri, false)) {
+		printf("  %s unchanged, skipping\n", si->type);
+		fi->skipped++;
+		return 0;
+	}
+	fi->saved++;
+
 repeat:
 	/* Clear the temp buffer (write cache) */
 	fs_image_drop_temp(fi);
 
+	start = get_timer(0);
 	err = fi->ops->invalidate(fi, copy, si);
+	fi->time_erase += get_timer(start);
 	if (err)
 		return err;
 
@@ -1563,8 +1686,10 @@ repeat:
 			printf("  %s %s at offset 0x%08x size 0x%x...",
 			       action, s->type, offset, size);
 
+			start = get_timer(0);
 			err = fs_image_save_sub(fi, offset, size, lim,
 						s->flags, buf);
+			fi->time_write += get_timer(start);
 			fs_image_show_sub_status(err);
 			if (err == 1) {
 				/* We had new bad blocks when writing */
@@ -1577,7 +1702,8 @@ repeat:
 		pass2 = !pass2;
 	} while (pass2);
 
-	return 0;
+	/* Check the written data */
+	return fs_image_verify_region(fi, copy, ri, true);
 }
 
 static int fs_image_save_uboot(struct flash_info *fi, struct region_info *ri)
@@ -2097,7 +2223,7 @@ static int fs_image_write_nand(struct flash_info *fi, uint offs, uint size,
 	debug("  -> nand_write to offs 0x%llx size 0x%x maxsize 0x%llx\n",
 	      woffs, size, maxsize);
 	err = nand_write_skip_bad(fi->mtd, woffs, &wsize, &actual,
-				  maxsize, buf, WITH_WR_VERIFY);
+				  maxsize, buf, 0);
 	if (flags & SUB_IS_FCB) {
 		debug("  - Switch back to normal ECC\n");
 		mxs_nand_mode_normal(fi->mtd);
@@ -3113,7 +3239,7 @@ static void fs_image_put_flash_info(struct flash_info *fi)
 
 
 /* Handle fsimage save if loaded image is a U-Boot image */
-static int do_fsimage_save_uboot(ulong addr, bool force)
+static int do_fsimage_save_uboot(ulong addr, bool force, bool changed_only)
 {
 	void *fdt;
 	struct sub_info sub;
@@ -3129,6 +3255,8 @@ static int do_fsimage_save_uboot(ulong addr, bool force)
 	    || fs_image_get_nboot_info(&fi, fdt, &ni, -1, false))
 		return CMD_RET_FAILURE;
 
+	fi.changed_only = changed_only;
+
 	fs_image_region_create(&ri, &ni.uboot, &sub);
 	flags = SUB_SYNC;
 	if (ni.flags & NI_UBOOT_WITH_FSH)
@@ -3146,6 +3274,7 @@ static int do_fsimage_save_uboot(ulong addr, bool force)
 
 	/* ### TODO: set copy depending on Set A or B (or redundant copy) */
 	failed = fs_image_save_uboot(&fi, &ri);
+	fs_image_show_save_timing(&fi);
 	fs_image_put_flash_info(&fi);
 
 	return fs_image_show_save_status(failed, "U-Boot");
@@ -3410,6 +3539,7 @@ static int do_fsimage_save(struct cmd_tbl *cmdtp, int flag, int argc,
 	int failed;
 	unsigned long addr;
 	bool force = false;
+	bool changed_only = false;
 	unsigned int woffset;
 
 	early_support_index = 0;
@@ -3439,6 +3569,11 @@ static int do_fsimage_save(struct cmd_tbl *cmdtp, int flag, int argc,
 			force = true;
 			argv++;
 			argc--;
+		} else if (!strcmp(argv[1], "-c")
+			   || !strcmp(argv[1], "--changed-only")) {
+			changed_only = true;
+			argv++;
+			argc--;
 		} else
 			return CMD_RET_USAGE;
 	}
@@ -3450,7 +3585,7 @@ static int do_fsimage_save(struct cmd_tbl *cmdtp, int flag, int argc,
 
 	/* If this is an U-Boot image, handle separately */
 	if (fs_image_match((void *)addr, "U-BOOT", NULL))
-		return do_fsimage_save_uboot(addr, force);
+		return do_fsimage_save_uboot(addr, force, changed_only);
 
 	/* Handle NBoot image */
 	ret = fs_image_find_board_cfg(addr, force, "save",
@@ -3475,6 +3610,7 @@ static int do_fsimage_save(struct cmd_tbl *cmdtp, int flag, int argc,
 	if (fs_image_get_flash_info(&fi, fdt)
 	    || fs_image_get_nboot_info(&fi, fdt, &ni, boot_hwpart, false))
 		return CMD_RET_FAILURE;
+	fi.changed_only = changed_only;
 
 	ret = fs_image_check_boot_dev_fuses(fi.boot_dev, "save");
 	if (ret < 0)
@@ -3685,6 +3821,7 @@ static int do_fsimage_save(struct cmd_tbl *cmdtp, int flag, int argc,
 			failed = nboot_failed;
 	}
 
+	fs_image_show_save_timing(&fi);
 	fs_image_put_flash_info(&fi);
 
 	ret = fs_image_show_save_status(failed, "NBoot");
@@ -3946,7 +4083,7 @@ static struct cmd_tbl cmd_fsimage_sub[] = {
 	U_BOOT_CMD_MKENT(boot, 1, 1, do_fsimage_boot, "", ""),
 	U_BOOT_CMD_MKENT(list, 1, 1, do_fsimage_list, "", ""),
 	U_BOOT_CMD_MKENT(load, 2, 1, do_fsimage_load, "", ""),
-	U_BOOT_CMD_MKENT(save, 4, 0, do_fsimage_save, "", ""),
+	U_BOOT_CMD_MKENT(save, 7, 0, do_fsimage_save, "", ""),
 	U_BOOT_CMD_MKENT(fuse, 2, 0, do_fsimage_fuse, "", ""),
 	U_BOOT_CMD_MKENT(checksum, 3, 1, do_fsimage_checksum, "", ""),
 };
@@ -4001,7 +4138,7 @@ static int do_fsimage(struct cmd_tbl *cmdtp, int flag, int argc,
 	return cp->cmd(cmdtp, flag, argc, argv);
 }
 
-U_BOOT_CMD(fsimage, 5, 1, do_fsimage,
+U_BOOT_CMD(fsimage, 8, 1, do_fsimage,
 	   "Handle F&S board configuration and F&S images, e.g. U-Boot, NBOOT",
 	   "arch\n"
 	   "    - Show F&S architecture\n"
@@ -4017,7 +4154,7 @@ U_BOOT_CMD(fsimage, 5, 1, do_fsimage,
 	   "    - List the content of the F&S image at <addr>\n"
 	   "fsimage load [-f] [uboot | nboot] [<addr>]\n"
 	   "    - Verify the current NBoot or U-Boot and load to <addr>\n"
-	   "fsimage save [-f] [-e <n>] [-b <n>] [<addr>]\n"
+	   "fsimage save [-f] [-c] [-e <n>] [-b <n>] [<addr>]\n"
 	   "    - Save the F&S image at the right place (NBoot, U-Boot)\n"
 	   "fsimage fuse [-f] [<addr> | stored]\n"
 	   "    - Program fuses according to the current BOARD-CFG.\n"
@@ -4030,7 +4167,9 @@ U_BOOT_CMD(fsimage, 5, 1, do_fsimage,
 	   "continue without showing any confirmation queries. This is meant\n"
 	   "for non-interactive installation procedures. Option -b also sets\n"
 	   "the eMMC hwpart to boot from: 0: User, 1: Boot1, 2: Boot2. This\n"
-	   "option is ignored on NAND. Option -e supports handling early\n"
+	   "option is ignored on NAND. Option -c (--changed-only) compares\n"
+	   "each region copy in flash with the new data first and skips it\n"
+	   "if it is unchanged. Option -e supports handling early\n"
 	   "NBoot versions. If the environment is not found when updating\n"
 	   "from a pre 2023.08 NBoot version, try increasing <n> until it\n"
 	   "works. Be careful when storing such an old NBoot, you need to\n"
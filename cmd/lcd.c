@@ -132,6 +132,9 @@
 #include <serial.h>			  /* serial_putc(), serial_puts() */
 #include <linux/ctype.h>		  /* isdigit() */
 #include <video_font.h>			  /* Get font data, width and height */
+#include <cpu_func.h>			  /* flush_dcache_range() */
+#include <malloc.h>			  /* free() */
+#include <asm/cache.h>			  /* ARCH_DMA_MINALIGN */
 
 #if defined(CONFIG_S3C64XX)
 #include <s3c64xx_xlcd.h>		  /* s3c64xx_xlcd_init() */
@@ -644,10 +647,11 @@ void console_update(wininfo_t *pwi, RGBA fg, RGBA bg)
 #endif /* CONFIG_XLCD_CONSOLE_MULTI */
 
 /* Clear the console window with given color */
-void console_cls(const wininfo_t *pwi, COLOR32 col)
+void console_cls(wininfo_t *pwi, COLOR32 col)
 {
 	memset32((unsigned *)pwi->pfbuf[pwi->fbdraw], col2col32(pwi, col),
 		 pwi->fbsize/4);
+	lcd_add_dirty(pwi, 0, 0, pwi->fbhres - 1, pwi->fbvres - 1);
 }
 
 
@@ -668,6 +672,8 @@ static void console_putc(wininfo_t *pwi, coninfo_t *pci, char c)
 		xtab = ((x / TABWIDTH) + 1) * TABWIDTH;
 		while ((x + VIDEO_FONT_WIDTH <= fbhres) && (x < xtab)) {
 			draw_ll_char(pwi, x, y, ' ', fg, bg);
+			lcd_add_dirty(pwi, x, y, x + VIDEO_FONT_WIDTH - 1,
+				      y + VIDEO_FONT_HEIGHT - 1);
 			x += VIDEO_FONT_WIDTH;
 		};
 		goto CHECKNEWLINE;
@@ -680,10 +686,14 @@ static void console_putc(wininfo_t *pwi, coninfo_t *pci, char c)
 			x = (fbhres/VIDEO_FONT_WIDTH-1) * VIDEO_FONT_WIDTH;
 		}
 		draw_ll_char(pwi, x, y, ' ', fg, bg);
+		lcd_add_dirty(pwi, x, y, x + VIDEO_FONT_WIDTH - 1,
+			      y + VIDEO_FONT_HEIGHT - 1);
 		break;
 
 	default:			  /* Character */
 		draw_ll_char(pwi, x, y, c, fg, bg);
+		lcd_add_dirty(pwi, x, y, x + VIDEO_FONT_WIDTH - 1,
+			      y + VIDEO_FONT_HEIGHT - 1);
 		x += VIDEO_FONT_WIDTH;
 	CHECKNEWLINE:
 		/* Check if there is room on the row for another character */
@@ -698,8 +708,9 @@ static void console_putc(wininfo_t *pwi, coninfo_t *pci, char c)
 			u_long fbuf = pwi->pfbuf[pwi->fbdraw];
 			u_long linelen = pwi->linelen;
 
-			/* Scroll everything up */
-			memcpy((void *)fbuf,
+			/* Scroll everything up; source and destination
+			   overlap, so use memmove() */
+			memmove((void *)fbuf,
 			       (void *)fbuf + linelen * VIDEO_FONT_HEIGHT,
 			       (fbvres - VIDEO_FONT_HEIGHT) * linelen);
 
@@ -707,6 +718,7 @@ static void console_putc(wininfo_t *pwi, coninfo_t *pci, char c)
 			   background color */
 			memset32((unsigned *)(fbuf + y*linelen), bg,
 				 (fbvres - y)*linelen/4);
+			lcd_add_dirty(pwi, 0, 0, fbhres - 1, fbvres - 1);
 		}
 		/* Fall through to case '\r' */
 
@@ -728,9 +740,11 @@ void lcd_putc(const struct stdio_dev *pdev, const char c)
 	wininfo_t *pwi = (wininfo_t *)pdev->priv;
 	vidinfo_t *pvi = pwi->pvi;
 
-	if (pvi->is_enabled && pwi->active)
+	if (pvi->is_enabled && pwi->active) {
 		console_putc(pwi, &pwi->ci, c);
-	else
+		if (pwi->fbdraw == pwi->fbshow)
+			lcd_sync(pwi);
+	} else
 		serial_putc(NULL, c);
 }
 #else
@@ -739,9 +753,11 @@ void lcd_putc(const struct stdio_dev *pdev, const char c)
 	wininfo_t *pwi = console_pwi;
 	vidinfo_t *pvi = pwi->pvi;
 
-	if (pvi->is_enabled && pwi->active)
+	if (pvi->is_enabled && pwi->active) {
 		console_putc(pwi, &coninfo, c);
-	else
+		if (pwi->fbdraw == pwi->fbshow)
+			lcd_sync(pwi);
+	} else
 		serial_putc(NULL, c);
 }
 #endif /*CONFIG_XLCD_CONSOLE_MULTI*/
@@ -764,6 +780,8 @@ void lcd_puts(const struct stdio_dev *pdev, const char *s)
 				break;
 			console_putc(pwi, pci, c);
 		}
+		if (pwi->fbdraw == pwi->fbshow)
+			lcd_sync(pwi);
 	} else
 		serial_puts(NULL, s);
 }
@@ -783,6 +801,8 @@ void lcd_puts(const struct stdio_dev *pdev, const char *s)
 				break;
 			console_putc(pwi, pci, c);
 		}
+		if (pwi->fbdraw == pwi->fbshow)
+			lcd_sync(pwi);
 	} else
 		serial_puts(NULL, s);
 }
@@ -1461,6 +1481,12 @@ int setfbuf(wininfo_t *pwi, XYPOS hres, XYPOS vres,
 	pwi->fbsize = fbsize;
 	pwi->fbdraw = 0;
 	pwi->fbshow = 0;
+	pwi->dirtycount = 0;
+
+	/* The glyph cache is rebuilt on the next text output, if needed */
+	free(pwi->pgc);
+	pwi->pgc = NULL;
+
 	if (pwi->pix != pix) {
 		/* New pixel format: set default bg + fg */
 		pwi->pix = pix;
@@ -1543,6 +1569,185 @@ void set_wininfo(const wininfo_t *pwi)
 }
 
 
+/************************************************************************/
+/* DIRTY REGION TRACKING						*/
+/************************************************************************/
+
+/* Mark region as changed in the draw buffer; the region is clipped to the
+   framebuffer, coordinates must be sorted (x1 <= x2, y1 <= y2). Up to
+   XLCD_DIRTY_RECTS separate regions are kept. A region that overlaps or
+   touches an existing region is merged with it. If all entries are in use,
+   the region is merged with the entry that grows least by doing so. */
+void lcd_add_dirty(wininfo_t *pwi, XYPOS x1, XYPOS y1, XYPOS x2, XYPOS y2)
+{
+	dirtyrect_t *pdr, *pbest;
+	u_long best;
+	u_int i;
+
+	/* Clip to framebuffer, return if nothing remains */
+	if (x1 < 0)
+		x1 = 0;
+	if (y1 < 0)
+		y1 = 0;
+	if (x2 >= pwi->fbhres)
+		x2 = pwi->fbhres - 1;
+	if (y2 >= pwi->fbvres)
+		y2 = pwi->fbvres - 1;
+	if ((x1 > x2) || (y1 > y2))
+		return;
+
+	/* Check for an overlapping or adjacent region */
+	pdr = pwi->dirty;
+	for (i = 0; i < pwi->dirtycount; i++, pdr++) {
+		if ((x1 <= pdr->right + 1) && (x2 + 1 >= pdr->left)
+		    && (y1 <= pdr->bottom + 1) && (y2 + 1 >= pdr->top))
+			goto MERGE;
+	}
+
+	/* Add as separate region if there is a free entry */
+	if (pwi->dirtycount < XLCD_DIRTY_RECTS) {
+		pdr->left = x1;
+		pdr->top = y1;
+		pdr->right = x2;
+		pdr->bottom = y2;
+		pwi->dirtycount++;
+		return;
+	}
+
+	/* Find the region with the smallest growth when merged */
+	best = ~0UL;
+	pdr = pwi->dirty;
+	pbest = pdr;
+	for (i = 0; i < XLCD_DIRTY_RECTS; i++, pdr++) {
+		u_long w, h, grow;
+
+		w = max(x2, pdr->right) - min(x1, pdr->left) + 1;
+		h = max(y2, pdr->bottom) - min(y1, pdr->top) + 1;
+		grow = w * h - (u_long)(pdr->right - pdr->left + 1)
+			* (pdr->bottom - pdr->top + 1);
+		if (grow < best) {
+			best = grow;
+			pbest = pdr;
+		}
+	}
+	pdr = pbest;
+
+MERGE:
+	if (x1 < pdr->left)
+		pdr->left = x1;
+	if (y1 < pdr->top)
+		pdr->top = y1;
+	if (x2 > pdr->right)
+		pdr->right = x2;
+	if (y2 > pdr->bottom)
+		pdr->bottom = y2;
+}
+
+
+/* Write back the given region of image buffer buf from the data cache */
+static void lcd_flush_region(const wininfo_t *pwi, u_char buf,
+			     const dirtyrect_t *pdr)
+{
+	u_long linelen = pwi->linelen;
+	u_int bpp_shift = pwi->ppi->bpp_shift;
+	u_long fbuf, start, end;
+	XYPOS y;
+
+	/* Get the byte range of the region within a line (full words) */
+	start = ((pdr->left << bpp_shift) >> 5) << 2;
+	end = (((pdr->right << bpp_shift) >> 5) + 1) << 2;
+
+	fbuf = pwi->pfbuf[buf] + pdr->top * linelen;
+	if (end - start >= linelen / 2) {
+		/* Wide region, flush all lines in one go */
+		start += fbuf;
+		end += fbuf + (pdr->bottom - pdr->top) * linelen;
+		flush_dcache_range(start & ~(ARCH_DMA_MINALIGN - 1),
+				   ALIGN(end, ARCH_DMA_MINALIGN));
+		return;
+	}
+
+	/* Narrow region, flush each line separately */
+	for (y = pdr->top; y <= pdr->bottom; y++) {
+		flush_dcache_range((fbuf + start) & ~(ARCH_DMA_MINALIGN - 1),
+				   ALIGN(fbuf + end, ARCH_DMA_MINALIGN));
+		fbuf += linelen;
+	}
+}
+
+
+/* Copy the given region from image buffer from to image buffer to */
+static void lcd_copy_region(const wininfo_t *pwi, u_char from, u_char to,
+			    const dirtyrect_t *pdr)
+{
+	u_long linelen = pwi->linelen;
+	u_int bpp_shift = pwi->ppi->bpp_shift;
+	u_long offs, start, len;
+	XYPOS y;
+
+	/* Copy full words; the additional pixels at the left and right edge
+	   are outside of any dirty region and thus equal in both buffers */
+	start = ((pdr->left << bpp_shift) >> 5) << 2;
+	len = ((((pdr->right << bpp_shift) >> 5) + 1) << 2) - start;
+	offs = pdr->top * linelen + start;
+	if (len == linelen) {
+		/* Full lines, copy everything in one go */
+		memcpy((void *)(pwi->pfbuf[to] + offs),
+		       (void *)(pwi->pfbuf[from] + offs),
+		       (pdr->bottom - pdr->top + 1) * linelen);
+		return;
+	}
+
+	for (y = pdr->top; y <= pdr->bottom; y++) {
+		memcpy((void *)(pwi->pfbuf[to] + offs),
+		       (void *)(pwi->pfbuf[from] + offs), len);
+		offs += linelen;
+	}
+}
+
+
+/* Write back all changed regions of the draw buffer to memory; this is
+   required before the display controller can see the new content */
+void lcd_sync(wininfo_t *pwi)
+{
+	u_int i;
+
+	for (i = 0; i < pwi->dirtycount; i++)
+		lcd_flush_region(pwi, pwi->fbdraw, &pwi->dirty[i]);
+	pwi->dirtycount = 0;
+}
+
+
+/* Show buffer fbshow and continue drawing to buffer fbdraw. Only the
+   regions that were changed in the old draw buffer since the last flip are
+   written back. If the draw buffer changes, these regions are also copied
+   to the new draw buffer, so that it continues with the same content. This
+   is what makes double buffering cheap for small updates like progress
+   bars and status text. */
+void lcd_flip(wininfo_t *pwi, u_char fbshow, u_char fbdraw)
+{
+	u_char oldraw = pwi->fbdraw;
+	u_int i;
+
+	/* Make the changes visible to the display controller */
+	for (i = 0; i < pwi->dirtycount; i++)
+		lcd_flush_region(pwi, oldraw, &pwi->dirty[i]);
+
+	pwi->fbshow = fbshow;
+	set_wininfo(pwi);
+
+	/* Bring new draw buffer up to date */
+	if (fbdraw != oldraw) {
+		for (i = 0; i < pwi->dirtycount; i++) {
+			lcd_copy_region(pwi, oldraw, fbdraw, &pwi->dirty[i]);
+			lcd_flush_region(pwi, fbdraw, &pwi->dirty[i]);
+		}
+		pwi->fbdraw = fbdraw;
+	}
+	pwi->dirtycount = 0;
+}
+
+
 /* Get a pointer to the wininfo structure */
 wininfo_t *lcd_get_wininfo_p(const vidinfo_t *pvi, WINDOW win)
 {
@@ -1835,6 +2040,7 @@ void drv_lcd_init(void)
 			lcd_set_col(pwi, DEFAULT_BG, &pwi->pbi.text_bg);
 			pwi->pbi.attr = ATTR_HFOLLOW | ATTR_VCENTER;
 			pwi->pbi.prog = 0;
+			pwi->pgc = NULL;
 
 			/* Alpha and color keying information */
 			pwi->ai[0].alpha = DEFAULT_ALPHA0;
@@ -40,3 +40,35 @@ U_BOOT_CMD(sqfsload, 7, 0, do_sqfs_load,
 	   "      ARCH_DMA_MINALIGN then a misaligned buffer warning will\n"
 	   "      be printed and performance will suffer for the load."
 );
+
+static int do_sqfs_cache(struct cmd_tbl *cmdtp, int flag, int argc,
+			 char * const argv[])
+{
+	struct sqfs_cache_stats stats;
+
+	if (argc != 2)
+		return CMD_RET_USAGE;
+
+	if (!strcmp(argv[1], "flush")) {
+		sqfs_cache_flush();
+		return 0;
+	}
+
+	if (strcmp(argv[1], "show"))
+		return CMD_RET_USAGE;
+
+	sqfs_cache_stats(&stats);
+	printf("hits: %lu\n"
+	       "misses: %lu\n"
+	       "entries: %u\n"
+	       "max cache entries: %u\n",
+	       stats.hits, stats.misses, stats.entries, stats.max_entries);
+
+	return 0;
+}
+
+U_BOOT_CMD(sqfscache, 2, 0, do_sqfs_cache,
+	   "SquashFS data and fragment block cache",
+	   "show - show and reset statistics\n"
+	   "sqfscache flush - drop all cached blocks\n"
+);
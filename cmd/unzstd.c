@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Zstandard decompression commands
+ */
+
+#include <common.h>
+#include <command.h>
+#include <env.h>
+#include <image.h>			/* parse_loadaddr(), ... */
+#include <mapmem.h>
+#include <part.h>
+#include <zstd.h>
+
+static int do_unzstd(struct cmd_tbl *cmdtp, int flag, int argc,
+		     char *const argv[])
+{
+	unsigned long src, dst;
+	unsigned long src_len, dst_len = ~0UL;
+	size_t len;
+	int ret;
+
+	switch (argc) {
+	case 5:
+		dst_len = simple_strtoul(argv[4], NULL, 16);
+		/* fall through */
+	case 4:
+		src = parse_loadaddr(argv[1], NULL);
+		src_len = simple_strtoul(argv[2], NULL, 16);
+		dst = parse_loadaddr(argv[3], NULL);
+		break;
+	default:
+		return CMD_RET_USAGE;
+	}
+
+	set_fileaddr(dst);
+	ret = zstd_decompress(map_sysmem(dst, dst_len), dst_len,
+			      map_sysmem(src, src_len), src_len, &len);
+	if (ret)
+		return CMD_RET_FAILURE;
+
+	printf("Uncompressed size: %zu = 0x%zX\n", len, len);
+	env_set_fileinfo(len);
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	unzstd,	5,	1,	do_unzstd,
+	"zstd uncompress a memory region",
+	"srcaddr srcsize dstaddr [dstsize]\n"
+	"\tsrcsize is the exact size of the compressed data (hex bytes)"
+);
+
+static int do_zstdwrite(struct cmd_tbl *cmdtp, int flag,
+			int argc, char *const argv[])
+{
+	struct blk_desc *bdev;
+	int ret;
+	unsigned long addr;
+	unsigned long length;
+	unsigned long writebuf = 1 << 20;
+	u64 startoffs = 0;
+	u64 szexpected = 0;
+
+	if (argc < 5)
+		return CMD_RET_USAGE;
+	ret = blk_get_device_by_str(argv[1], argv[2], &bdev);
+	if (ret < 0)
+		return CMD_RET_FAILURE;
+
+	addr = simple_strtoul(argv[3], NULL, 16);
+	length = simple_strtoul(argv[4], NULL, 16);
+
+	if (5 < argc) {
+		writebuf = simple_strtoul(argv[5], NULL, 16);
+		if (6 < argc) {
+			startoffs = simple_strtoull(argv[6], NULL, 16);
+			if (7 < argc)
+				szexpected = simple_strtoull(argv[7],
+							     NULL, 16);
+		}
+	}
+
+	ret = zstdwrite(map_sysmem(addr, length), length, bdev, writebuf,
+			startoffs, szexpected);
+
+	return ret ? CMD_RET_FAILURE : CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	zstdwrite, 8, 0, do_zstdwrite,
+	"zstd uncompress and write memory to block device",
+	"<interface> <dev> <addr> length [wbuf=1M [offs=0 [outsize=0]]]\n"
+	"\twbuf is the size in bytes (hex) of write buffer\n"
+	"\t\tand should be padded to erase size for SSDs\n"
+	"\toffs is the output start offset in bytes (hex)\n"
+	"\toutsize is the size of the expected output (hex bytes)\n"
+	"\t\tand should be given if the frames do not record\n"
+	"\t\ttheir content size"
+);
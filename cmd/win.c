@@ -37,6 +37,7 @@
 enum WIN_INDEX {
 	WI_FBRES,
 	WI_SHOW,
+	WI_FLIP,
 	WI_RES,
 	WI_OFFS,
 	WI_POS,
@@ -67,6 +68,7 @@ enum WIN_INDEX {
 static kwinfo_t const win_kw[] = {
 	[WI_FBRES] =  {1, 4, 0, 0, "fbres"}, /* fbhres fbvres [pix [fbcount]] */
 	[WI_SHOW] =   {1, 2, 0, 0, "show"},  /* fbshow [fbdraw] */
+	[WI_FLIP] =   {1, 2, 0, 0, "flip"},  /* fbshow [fbdraw] */
 	[WI_RES] =    {2, 2, 0, 0, "res"},   /* hres vres */
 	[WI_OFFS] =   {2, 2, 0, 0, "offs"},  /* hoffs voffs */
 	[WI_POS] =    {2, 2, 0, 0, "pos"},   /* hpos vpos */
@@ -162,6 +164,12 @@ static void show_wininfo(const wininfo_t *pwi)
 			       pwi->pfbuf[buf], pwi->pfbuf[buf]+pwi->fbsize-1);
 		}
 	}
+	for (buf = 0; buf < pwi->dirtycount; buf++) {
+		const dirtyrect_t *pdr = &pwi->dirty[buf];
+
+		printf("\n\t\tchanged: (%d, %d) - (%d, %d)", pdr->left,
+		       pdr->top, pdr->right, pdr->bottom);
+	}
 	printf("\nPixel Format:\t#%u, %u/%u bpp, %s\n", pwi->pix,
 	       pwi->ppi->depth, 1 << pwi->ppi->bpp_shift, pwi->ppi->name);
 	printf("Window:\t\t%u x %u pixels, from offset (%d, %d)"
@@ -328,8 +336,10 @@ static int do_win(cmd_tbl_t *cmdtp, int flag, int argc, char *const argv[])
 		break;
 	}
 
-	case WI_SHOW: {
+	case WI_SHOW:
+	case WI_FLIP: {
 		u_char fbshow;
+		u_char fbdraw = pwi->fbdraw;
 
 		/* Argument 1: buffer number to show */
 		fbshow = (u_char)simple_strtoul(argv[2], NULL, 0);
@@ -340,17 +350,24 @@ static int do_win(cmd_tbl_t *cmdtp, int flag, int argc, char *const argv[])
 
 		/* Argument 2: buffer number to draw to */
 		if (argc > 3) {
-			u_char fbdraw;
-
 			fbdraw = (u_char)simple_strtoul(argv[3], NULL, 0);
 			if (fbdraw >= pwi->fbcount) {
 				printf("Bad image buffer '%u'\n", fbdraw);
 				return 1;
 			}
-			pwi->fbdraw = fbdraw;
 		}
 
-		/* Set new values */
+		if (sc == WI_FLIP) {
+			/* Show new buffer; the changed regions of the old
+			   draw buffer are copied to the new draw buffer */
+			lcd_flip(pwi, fbshow, fbdraw);
+			break;
+		}
+
+		/* Make pending changes visible, then set new values; the
+		   buffer contents are not touched */
+		lcd_sync(pwi);
+		pwi->fbdraw = fbdraw;
 		pwi->fbshow = fbshow;
 		set_wininfo(pwi);
 		break;
@@ -488,6 +505,9 @@ U_BOOT_CMD(
 	"    - Select window n\n"
 	"show fbshow [fbdraw]\n"
 	"    - Set the buffer to show and to draw to\n"
+	"win flip fbshow [fbdraw]\n"
+	"    - Like show, but copy the regions changed since the last flip\n"
+	"      from the old draw buffer to the new draw buffer\n"
 	"win fbres [fbhres fbvres [pix [fbcount]]]\n"
 	"    - Set virtual framebuffer resolution, pixel format, buffer count\n"
 	"win res [hres vres]\n"
@@ -29,6 +29,7 @@
 
 #include <hash.h>
 #include <image.h>
+#include <watchdog.h>
 #include <u-boot/crc.h>
 #include <u-boot/sha1.h>
 #include <u-boot/sha256.h>
@@ -176,7 +177,8 @@ static int hash_finish_crc16_ccitt(struct hash_algo *algo, void *ctx,
 	if (size < algo->digest_size)
 		return -1;
 
-	*((uint16_t *)dest_buf) = *((uint16_t *)ctx);
+	/* Same byte order as crc16_ccitt_wd_buf() */
+	*((uint16_t *)dest_buf) = cpu_to_be16(*((uint16_t *)ctx));
 	free(ctx);
 	return 0;
 }
@@ -202,7 +204,8 @@ static int hash_finish_crc32(struct hash_algo *algo, void *ctx, void *dest_buf,
 	if (size < algo->digest_size)
 		return -1;
 
-	*((uint32_t *)dest_buf) = *((uint32_t *)ctx);
+	/* Same byte order as crc32_wd_buf() */
+	*((uint32_t *)dest_buf) = cpu_to_be32(*((uint32_t *)ctx));
 	free(ctx);
 	return 0;
 }
@@ -362,6 +365,143 @@ int hash_progressive_lookup_algo(const char *algo_name,
 	return -EPROTONOSUPPORT;
 }
 
+/* Get rid of all contexts, hash_finish() is the only way to free them */
+static int hash_multi_release(struct hash_multi_ctx *mctx)
+{
+	uint8_t scratch[HASH_MAX_DIGEST_SIZE];
+	int i;
+
+	for (i = 0; i < mctx->count; i++) {
+		if (mctx->ctx[i])
+			mctx->algos[i]->hash_finish(mctx->algos[i],
+						    mctx->ctx[i], scratch,
+						    sizeof(scratch));
+	}
+	mctx->count = 0;
+
+	return -EIO;
+}
+
+int hash_multi_init(struct hash_multi_ctx *mctx,
+		    struct hash_algo *const algos[], int count)
+{
+	int i;
+
+	mctx->count = 0;
+	if (count < 1 || count > HASH_MULTI_MAX)
+		return -EINVAL;
+
+	for (i = 0; i < count; i++) {
+		if (!algos[i]->hash_init)
+			return -EPROTONOSUPPORT;
+	}
+
+#ifdef CONFIG_SHA_PROG_HW_ACCEL
+	/* The hash engine holds one context only */
+	if (count > 1)
+		return -EBUSY;
+#endif
+
+	for (i = 0; i < count; i++) {
+		mctx->algos[i] = algos[i];
+		mctx->ctx[i] = NULL;
+	}
+	mctx->count = count;
+
+	for (i = 0; i < count; i++) {
+		if (algos[i]->hash_init(algos[i], &mctx->ctx[i])) {
+			mctx->ctx[i] = NULL;
+			return hash_multi_release(mctx);
+		}
+	}
+
+	return 0;
+}
+
+int hash_multi_update(struct hash_multi_ctx *mctx, const void *data,
+		      unsigned int len, int is_last)
+{
+	const uint8_t *buf = data;
+	unsigned int chunk;
+	int i;
+
+	if (!mctx->count)
+		return -EINVAL;
+
+	do {
+		chunk = len > HASH_MULTI_BLOCK ? HASH_MULTI_BLOCK : len;
+		for (i = 0; i < mctx->count; i++) {
+			struct hash_algo *algo = mctx->algos[i];
+
+			if (algo->hash_update(algo, mctx->ctx[i], buf, chunk,
+					      is_last && chunk == len)) {
+				/* The context is already freed */
+				mctx->ctx[i] = NULL;
+				return hash_multi_release(mctx);
+			}
+		}
+		buf += chunk;
+		len -= chunk;
+		WATCHDOG_RESET();
+	} while (len);
+
+	return 0;
+}
+
+int hash_multi_finish(struct hash_multi_ctx *mctx, uint8_t *const outputs[])
+{
+	struct hash_algo *algo;
+	void *ctx;
+	int i;
+
+	if (!mctx->count)
+		return -EINVAL;
+
+	if (!outputs) {
+		hash_multi_release(mctx);
+		return 0;
+	}
+
+	for (i = 0; i < mctx->count; i++) {
+		algo = mctx->algos[i];
+		ctx = mctx->ctx[i];
+		mctx->ctx[i] = NULL;
+		if (algo->hash_finish(algo, ctx, outputs[i], algo->digest_size))
+			return hash_multi_release(mctx);
+	}
+	mctx->count = 0;
+
+	return 0;
+}
+
+int hash_multi(struct hash_algo *const algos[], int count, const void *data,
+	       unsigned int len, uint8_t *const outputs[])
+{
+	struct hash_multi_ctx mctx;
+	int ret;
+
+	if (count < 1 || count > HASH_MULTI_MAX)
+		return -EINVAL;
+
+#ifdef CONFIG_SHA_PROG_HW_ACCEL
+	/* The hash engine holds one context only, do one after the other */
+	while (count > 1) {
+		count--;
+		ret = hash_multi(&algos[count], 1, data, len, &outputs[count]);
+		if (ret)
+			return ret;
+	}
+#endif
+
+	ret = hash_multi_init(&mctx, algos, count);
+	if (!ret)
+		ret = hash_multi_update(&mctx, data, len, 1);
+	if (!ret)
+		ret = hash_multi_finish(&mctx, outputs);
+
+	return ret;
+}
+
 #ifndef USE_HOSTCC
 int hash_parse_string(const char *algo_name, const char *str, uint8_t *result)
 {
@@ -527,6 +667,56 @@ static void hash_show(struct hash_algo *algo, ulong addr, ulong len, uint8_t *ou
 		printf("%02x", output[i]);
 }
 
+/**
+ * hash_command_multi: Show the digests of several algorithms over one area
+ *
+ * @algo_list:		Comma-separated list of algorithm names
+ * @addr:		Start address of the area
+ * @len:		Length of the area in bytes
+ * @return CMD_RET_... value
+ */
+static int hash_command_multi(const char *algo_list, ulong addr, ulong len)
+{
+	struct hash_algo *algos[HASH_MULTI_MAX];
+	uint8_t output[HASH_MULTI_MAX][HASH_MAX_DIGEST_SIZE];
+	uint8_t *outputs[HASH_MULTI_MAX];
+	char name[32];
+	const char *p, *end;
+	int count = 0;
+	void *buf;
+	int i, ret;
+
+	for (p = algo_list; *p; p = *end ? end + 1 : end) {
+		end = strchrnul(p, ',');
+		if (count == HASH_MULTI_MAX || end - p >= sizeof(name)) {
+			printf("Too many hash algorithms or name too long\n");
+			return CMD_RET_USAGE;
+		}
+		strlcpy(name, p, end - p + 1);
+		if (hash_progressive_lookup_algo(name, &algos[count])) {
+			printf("Unknown hash algorithm '%s'\n", name);
+			return CMD_RET_USAGE;
+		}
+		outputs[count] = output[count];
+		count++;
+	}
+
+	buf = map_sysmem(addr, len);
+	ret = hash_multi(algos, count, buf, len, outputs);
+	unmap_sysmem(buf);
+	if (ret) {
+		printf("Hashing failed (err=%d)\n", ret);
+		return CMD_RET_FAILURE;
+	}
+
+	for (i = 0; i < count; i++) {
+		hash_show(algos[i], addr, len, outputs[i]);
+		printf("\n");
+	}
+
+	return 0;
+}
+
 int hash_command(const char *algo_name, int flags, struct cmd_tbl *cmdtp,
 		 int flag, int argc, char *const argv[])
 {
@@ -544,6 +734,15 @@ int hash_command(const char *algo_name, int flags, struct cmd_tbl *cmdtp,
 		uint8_t vsum[HASH_MAX_DIGEST_SIZE];
 		void *buf;
 
+		/* Several algorithms are computed in one pass over the data */
+		if (strchr(algo_name, ',')) {
+			if (argc > 2) {
+				puts("Can only store or verify one algorithm\n");
+				return CMD_RET_USAGE;
+			}
+			return hash_command_multi(algo_name, addr, len);
+		}
+
 		if (hash_lookup_algo(algo_name, &algo)) {
 			printf("Unknown hash algorithm '%s'\n", algo_name);
 			return CMD_RET_USAGE;
@@ -1244,8 +1244,77 @@ int calculate_hash(const void *data, int data_len, const char *algo,
 	return 0;
 }
 
+/*
+ * Find the hash nodes of an image that common/hash.c can compute together.
+ * Nodes that are left out are handled by calculate_hash() later, which also
+ * reports any errors.
+ */
+static int fit_image_hash_nodes(const void *fit, int image_noffset,
+				struct hash_algo **algos,
+				struct fit_hash_result *res)
+{
+	int noffset, count = 0;
+	char *algo;
+	int ignore;
+
+	if (!FIT_IMAGE_ENABLE_MULTI_HASH)
+		return 0;
+
+	fdt_for_each_subnode(noffset, fit, image_noffset) {
+		const char *name = fit_get_name(fit, noffset, NULL);
+
+		if (count == FIT_MULTI_HASH_MAX)
+			break;
+		if (strncmp(name, FIT_HASH_NODENAME, strlen(FIT_HASH_NODENAME)))
+			continue;
+		if (fit_image_hash_get_algo(fit, noffset, &algo))
+			continue;
+		if (IMAGE_ENABLE_IGNORE) {
+			fit_image_hash_get_ignore(fit, noffset, &ignore);
+			if (ignore)
+				continue;
+		}
+		if (hash_progressive_lookup_algo(algo, &algos[count]) ||
+		    algos[count]->digest_size > FIT_MAX_HASH_LEN)
+			continue;
+		res[count].noffset = noffset;
+		res[count].len = algos[count]->digest_size;
+		count++;
+	}
+
+	return count;
+}
+
+int fit_image_hash_start(const void *fit, int image_noffset,
+			 struct fit_load_hash *lh)
+{
+	struct hash_algo *algos[FIT_MULTI_HASH_MAX];
+
+	lh->count = fit_image_hash_nodes(fit, image_noffset, algos, lh->res);
+	if (lh->count && hash_multi_init(&lh->mctx, algos, lh->count))
+		lh->count = 0;
+
+	return lh->count;
+}
+
+void fit_image_hash_update(struct fit_load_hash *lh, const void *data,
+			   size_t len, int is_last)
+{
+	/* On failure, fit_image_hash_verify() computes everything itself */
+	if (lh->count && hash_multi_update(&lh->mctx, data, len, is_last))
+		lh->count = 0;
+}
+
+void fit_image_hash_abort(struct fit_load_hash *lh)
+{
+	if (lh->count)
+		hash_multi_finish(&lh->mctx, NULL);
+	lh->count = 0;
+}
+
 static int fit_image_check_hash(const void *fit, int noffset, const void *data,
-				size_t size, char **err_msgp)
+				size_t size, const struct fit_hash_result *res,
+				char **err_msgp)
 {
 	uint8_t value[FIT_MAX_HASH_LEN];
 	int value_len;
@@ -1276,7 +1345,10 @@ static int fit_image_check_hash(const void *fit, int noffset, const void *data,
 		return -1;
 	}
 
-	if (calculate_hash(data, size, algo, value, &value_len)) {
+	if (res) {
+		value_len = res->len;
+		memcpy(value, res->value, value_len);
+	} else if (calculate_hash(data, size, algo, value, &value_len)) {
 		*err_msgp = "Unsupported hash algorithm";
 		return -1;
 	}
@@ -1292,16 +1364,28 @@ static int fit_image_check_hash(const void *fit, int noffset, const void *data,
 	return 0;
 }
 
-int fit_image_verify_with_data(const void *fit, int image_noffset,
-			       const void *data, size_t size)
+/* Parts of an image checked by fit_image_verify_res() */
+#define FIT_VERIFY_SIGS		1
+#define FIT_VERIFY_HASHES	2
+#define FIT_VERIFY_ALL		(FIT_VERIFY_SIGS | FIT_VERIFY_HASHES)
+
+/*
+ * Check the hashes and/or signatures of an image, as selected by @what. The
+ * digests in @res (if any) have been computed already, all other hash nodes
+ * are computed here.
+ */
+static int fit_image_verify_res(const void *fit, int image_noffset,
+				const void *data, size_t size,
+				const struct fit_hash_result *res,
+				int res_count, int what)
 {
 	int		noffset = 0;
 	char		*err_msg = "";
-	int verify_all = 1;
-	int ret;
+	int verify_all = what & FIT_VERIFY_SIGS;
+	int ret, i;
 
 	/* Verify all required signatures */
-	if (FIT_IMAGE_ENABLE_VERIFY &&
+	if (FIT_IMAGE_ENABLE_VERIFY && (what & FIT_VERIFY_SIGS) &&
 	    fit_image_verify_required_sigs(fit, image_noffset, data, size,
 					   gd_fdt_blob(), &verify_all)) {
 		err_msg = "Unable to verify required signature";
@@ -1311,15 +1395,21 @@ int fit_image_verify_with_data(const void *fit, int image_noffset,
 	/* Process all hash subnodes of the component image node */
 	fdt_for_each_subnode(noffset, fit, image_noffset) {
 		const char *name = fit_get_name(fit, noffset, NULL);
+		const struct fit_hash_result *r = NULL;
 
 		/*
 		 * Check subnode name, must be equal to "hash".
 		 * Multiple hash nodes require unique unit node
 		 * names, e.g. hash-1, hash-2, etc.
 		 */
-		if (!strncmp(name, FIT_HASH_NODENAME,
+		if ((what & FIT_VERIFY_HASHES) &&
+		    !strncmp(name, FIT_HASH_NODENAME,
 			     strlen(FIT_HASH_NODENAME))) {
-			if (fit_image_check_hash(fit, noffset, data, size,
+			for (i = 0; i < res_count; i++) {
+				if (res[i].noffset == noffset)
+					r = &res[i];
+			}
+			if (fit_image_check_hash(fit, noffset, data, size, r,
 						 &err_msg))
 				goto error;
 			puts("+ ");
@@ -1356,6 +1446,48 @@ error:
 	return 0;
 }
 
+static int fit_image_hash_finish(const void *fit, int image_noffset,
+				 struct fit_load_hash *lh, const void *data,
+				 size_t size, int what)
+{
+	uint8_t *outputs[FIT_MULTI_HASH_MAX];
+	int i;
+
+	for (i = 0; i < lh->count; i++)
+		outputs[i] = lh->res[i].value;
+	if (lh->count && hash_multi_finish(&lh->mctx, outputs))
+		lh->count = 0;
+
+	return fit_image_verify_res(fit, image_noffset, data, size, lh->res,
+				    lh->count, what);
+}
+
+int fit_image_hash_verify(const void *fit, int image_noffset,
+			  struct fit_load_hash *lh, const void *data,
+			  size_t size)
+{
+	return fit_image_hash_finish(fit, image_noffset, lh, data, size,
+				     FIT_VERIFY_ALL);
+}
+
+int fit_image_verify_with_data(const void *fit, int image_noffset,
+			       const void *data, size_t size)
+{
+	struct fit_load_hash lh;
+
+	/*
+	 * Images often carry several hash nodes, e.g. crc32 and sha256.
+	 * Instead of reading the data once per node, compute them in one
+	 * pass. A single node is just as fast on its own.
+	 */
+	if (fit_image_hash_start(fit, image_noffset, &lh) > 1)
+		fit_image_hash_update(&lh, data, size, 1);
+	else
+		fit_image_hash_abort(&lh);
+
+	return fit_image_hash_verify(fit, image_noffset, &lh, data, size);
+}
+
 /**
  * fit_image_verify - verify data integrity
  * @fit: pointer to the FIT format image header
@@ -1901,6 +2033,56 @@ static int fit_image_select(const void *fit, int rd_noffset, int verify)
 	return 0;
 }
 
+/*
+ * Check the hashes and signatures of an image that was selected without
+ * verification. If @dst is not NULL, the signatures are checked first and
+ * the image is only copied there if they are fine. It is copied piece by
+ * piece, and each piece of the source is hashed right after the copy while
+ * it is still in the cache. This saves reading the whole image once more
+ * just for the hashes. The copy must not be used unless this returns 0; if
+ * the hashes do not match, it is cleared again. Without @dst, everything is
+ * checked in place in a single pass.
+ */
+static int fit_image_verify_copy(const void *fit, int noffset, void *dst,
+				 const void *src, size_t len)
+{
+	struct fit_load_hash lh;
+	size_t pos, chunk;
+	int ok;
+
+	bootstage_start(BOOTSTAGE_ID_ACCUM_FIT_LOAD, "fit_load");
+	puts("   Verifying Hash Integrity ... ");
+	if (dst) {
+		ok = fit_image_verify_res(fit, noffset, src, len, NULL, 0,
+					  FIT_VERIFY_SIGS);
+		if (ok) {
+			fit_image_hash_start(fit, noffset, &lh);
+			for (pos = 0; pos < len; pos += chunk) {
+				chunk = len - pos;
+				if (chunk > FIT_HASH_CHUNK_SIZE)
+					chunk = FIT_HASH_CHUNK_SIZE;
+				memcpy(dst + pos, src + pos, chunk);
+				fit_image_hash_update(&lh, src + pos, chunk,
+						      pos + chunk == len);
+			}
+			ok = fit_image_hash_finish(fit, noffset, &lh, src, len,
+						   FIT_VERIFY_HASHES);
+			if (!ok)
+				memset(dst, 0, len);
+		}
+	} else {
+		ok = fit_image_verify_with_data(fit, noffset, src, len);
+	}
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_FIT_LOAD);
+	if (!ok) {
+		puts("Bad Data Hash\n");
+		return -EACCES;
+	}
+	puts("OK\n");
+
+	return 0;
+}
+
 int fit_get_node_from_config(bootm_headers_t *images, const char *prop_name,
 			ulong addr)
 {
@@ -1981,6 +2163,7 @@ int fit_image_load(bootm_headers_t *images, ulong addr,
 	uint8_t os_arch;
 #endif
 	const char *prop_name;
+	bool verify_late;
 	int ret;
 
 	fit = map_sysmem(addr, 0);
@@ -2055,7 +2238,17 @@ int fit_image_load(bootm_headers_t *images, ulong addr,
 
 	printf("   Trying '%s' %s subimage\n", fit_uname, prop_name);
 
-	ret = fit_image_select(fit, noffset, images->verify);
+	/*
+	 * Check the hashes while the image is copied to its load address,
+	 * unless the data is changed before that. Signatures are checked
+	 * before anything is written to the load address.
+	 */
+	verify_late = images->verify &&
+		      !(IS_ENABLED(CONFIG_FIT_CIPHER) && IMAGE_ENABLE_DECRYPT) &&
+		      !(!host_build() &&
+			IS_ENABLED(CONFIG_FIT_IMAGE_POST_PROCESS));
+
+	ret = fit_image_select(fit, noffset, images->verify && !verify_late);
 	if (ret) {
 		bootstage_error(bootstage_id + BOOTSTAGE_SUB_HASH);
 		return ret;
@@ -2175,6 +2368,12 @@ int fit_image_load(bootm_headers_t *images, ulong addr,
 	      image_type == IH_TYPE_KERNEL_NOLOAD ||
 	      image_type == IH_TYPE_RAMDISK)) {
 		ulong max_decomp_len = len * 20;
+
+		if (verify_late &&
+		    fit_image_verify_copy(fit, noffset, NULL, buf, len)) {
+			bootstage_error(bootstage_id + BOOTSTAGE_SUB_HASH);
+			return -EACCES;
+		}
 		if (load == data) {
 			loadbuf = malloc(max_decomp_len);
 			load = map_to_sysmem(loadbuf);
@@ -2188,6 +2387,15 @@ int fit_image_load(bootm_headers_t *images, ulong addr,
 			return -ENOEXEC;
 		}
 		len = load_end - load;
+	} else if (verify_late) {
+		if (load != data)
+			loadbuf = map_sysmem(load, len);
+		if (fit_image_verify_copy(fit, noffset,
+					  load != data ? loadbuf : NULL,
+					  buf, len)) {
+			bootstage_error(bootstage_id + BOOTSTAGE_SUB_HASH);
+			return -EACCES;
+		}
 	} else if (load != data) {
 		loadbuf = map_sysmem(load, len);
 		memcpy(loadbuf, buf, len);
@@ -5,6 +5,7 @@
  */
 
 #include <common.h>
+#include <bootstage.h>
 #include <errno.h>
 #include <fpga.h>
 #include <gzip.h>
@@ -223,6 +224,46 @@ static int get_aligned_image_size(struct spl_load_info *info, int data_size,
 	return (data_size + info->bl_len - 1) / info->bl_len;
 }
 
+/*
+ * Read the external data of an image and hash it on the way. Raw devices
+ * are read in pieces of FIT_HASH_CHUNK_SIZE and each piece is hashed right
+ * after it arrived, while it is still in the cache. Filesystems are read
+ * in one go, as each read would have to look up the file again.
+ */
+static int spl_fit_read_hashed(struct spl_load_info *info, ulong sector,
+			       int nr_sectors, void *buf, ulong overhead,
+			       size_t length, struct fit_load_hash *lh)
+{
+	ulong start, end;
+	int chunk, done, n;
+
+	if (info->filename) {
+		if (info->read(info, sector, nr_sectors, buf) != nr_sectors)
+			return -EIO;
+		fit_image_hash_update(lh, buf + overhead, length, 1);
+
+		return 0;
+	}
+
+	chunk = max(FIT_HASH_CHUNK_SIZE / info->bl_len, 1);
+	for (done = 0; done < nr_sectors; done += n) {
+		n = min(nr_sectors - done, chunk);
+		if (info->read(info, sector + done, n,
+			       buf + done * info->bl_len) != n)
+			return -EIO;
+
+		/* Only hash what belongs to the image, not the padding */
+		start = max_t(ulong, done * info->bl_len, overhead);
+		end = min_t(ulong, (done + n) * info->bl_len,
+			    overhead + length);
+		if (end > start)
+			fit_image_hash_update(lh, buf + start, end - start,
+					      end == overhead + length);
+	}
+
+	return 0;
+}
+
 #if defined(CONFIG_DUAL_BOOTLOADER) && defined(CONFIG_IMX_TRUSTY_OS)
 __weak int get_tee_load(ulong *load)
 {
@@ -263,6 +304,9 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 	const void *data;
 	const void *fit = ctx->fit;
 	bool external_data = false;
+	struct fit_load_hash lh;
+	bool hashing = false;
+	int ret;
 
 	if (IS_ENABLED(CONFIG_SPL_FPGA) ||
 	    (IS_ENABLED(CONFIG_SPL_OS_BOOT) && IS_ENABLED(CONFIG_SPL_GZIP))) {
@@ -295,6 +339,7 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 	}
 #endif
 
+	bootstage_start(BOOTSTAGE_ID_ACCUM_FIT_LOAD, "fit_load");
 	if (!fit_image_get_data_position(fit, node, &offset)) {
 		external_data = true;
 	} else if (!fit_image_get_data_offset(fit, node, &offset)) {
@@ -304,8 +349,10 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 
 	if (external_data) {
 		/* External data */
-		if (fit_image_get_data_size(fit, node, &len))
-			return -ENOENT;
+		if (fit_image_get_data_size(fit, node, &len)) {
+			ret = -ENOENT;
+			goto out;
+		}
 
 		load_ptr = (load_addr + align_len) & ~align_len;
 		length = len;
@@ -313,10 +360,22 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 		overhead = get_aligned_image_overhead(info, offset);
 		nr_sectors = get_aligned_image_size(info, length, offset);
 
-		if (info->read(info,
-			       sector + get_aligned_image_offset(info, offset),
-			       nr_sectors, (void *)load_ptr) != nr_sectors)
-			return -EIO;
+		sector += get_aligned_image_offset(info, offset);
+		if (CONFIG_IS_ENABLED(FIT_SIGNATURE))
+			hashing = fit_image_hash_start(fit, node, &lh) > 0;
+		if (hashing) {
+			ret = spl_fit_read_hashed(info, sector, nr_sectors,
+						  (void *)load_ptr, overhead,
+						  length, &lh);
+			if (ret) {
+				fit_image_hash_abort(&lh);
+				goto out;
+			}
+		} else if (info->read(info, sector, nr_sectors,
+				      (void *)load_ptr) != nr_sectors) {
+			ret = -EIO;
+			goto out;
+		}
 
 		debug("External data: dst=%lx, offset=%x, size=%lx\n",
 		      load_ptr, offset, (unsigned long)length);
@@ -325,7 +384,8 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 		/* Embedded data */
 		if (fit_image_get_data(fit, node, &data, &length)) {
 			puts("Cannot get image data/size\n");
-			return -ENOENT;
+			ret = -ENOENT;
+			goto out;
 		}
 		debug("Embedded data: dst=%lx, size=%lx\n", load_addr,
 		      (unsigned long)length);
@@ -335,8 +395,14 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 	if (CONFIG_IS_ENABLED(FIT_SIGNATURE)) {
 		printf("## Checking hash(es) for Image %s ... ",
 		       fit_get_name(fit, node, NULL));
-		if (!fit_image_verify_with_data(fit, node, src, length))
-			return -EPERM;
+		if (hashing)
+			ret = fit_image_hash_verify(fit, node, &lh, src, length);
+		else
+			ret = fit_image_verify_with_data(fit, node, src, length);
+		if (!ret) {
+			ret = -EPERM;
+			goto out;
+		}
 		puts("OK\n");
 	}
 
@@ -348,12 +414,20 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 		if (gunzip((void *)load_addr, CONFIG_SYS_BOOTM_LEN,
 			   src, &size)) {
 			puts("Uncompressing error\n");
-			return -EIO;
+			ret = -EIO;
+			goto out;
 		}
 		length = size;
 	} else {
 		memcpy((void *)load_addr, src, length);
 	}
+	ret = 0;
+
+out:
+	/* The time is accounted for on all paths, also if loading failed */
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_FIT_LOAD);
+	if (ret)
+		return ret;
 
 	if (image_info) {
 		ulong entry_point;
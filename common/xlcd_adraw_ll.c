@@ -18,6 +18,161 @@
 #include <video_font.h>			 /* Get font data, width and height */
 
 
+/************************************************************************/
+/* DEFINITIONS								*/
+/************************************************************************/
+
+/* Within a COLOR32 word, the first pixel is stored in the most significant
+   bits. When accessing 8bpp or 16bpp pixels directly by address, the pixel
+   index has to be mirrored within the word on little endian CPUs. */
+#ifdef __LITTLE_ENDIAN
+#define PIX_INDEX(x, bpp) ((x) ^ ((32 / (bpp)) - 1))
+#else
+#define PIX_INDEX(x, bpp) (x)
+#endif
+
+/* A fully transparent color does not change the framebuffer at all */
+#define ADRAW_TRANSPARENT(pci) ((pci)->A256 == 256)
+
+/* A fully opaque color simply replaces the old pixel, unless the pixel
+   format has an alpha channel; then apply_alpha() keeps the old alpha */
+#define ADRAW_OPAQUE(pwi, pci) \
+	(((pci)->A256 == 1) && !((pwi)->ppi->flags & PIF_ALPHA))
+
+/* Template for a function that applies alpha to a rectangle in a framebuffer
+   with 8, 16 or 32 bpp. Pixels are accessed directly without any shifting or
+   masking. As a rectangle usually covers large areas of the same color, the
+   result of the last apply_alpha() call is remembered and reused. */
+#define ADRAW_LL_RECT_BPP(bpp, type)					\
+static void adraw_ll_rect_##bpp(const wininfo_t *pwi, XYPOS x1, XYPOS y1, \
+				XYPOS x2, XYPOS y2, const colinfo_t *pci) \
+{									\
+	u_long fbuf = pwi->linelen * y1 + pwi->pfbuf[pwi->fbdraw];	\
+	COLOR32 oldcol = 0;						\
+	COLOR32 newcol;							\
+									\
+	if (ADRAW_OPAQUE(pwi, pci)) {					\
+		/* Constant color, no blending required */		\
+		do {							\
+			type *p = (type *)fbuf;				\
+			XYPOS x;					\
+									\
+			for (x = x1; x <= x2; x++)			\
+				p[PIX_INDEX(x, bpp)] = (type)pci->col;	\
+			fbuf += pwi->linelen;				\
+		} while (++y1 <= y2);					\
+		return;							\
+	}								\
+									\
+	newcol = pwi->ppi->apply_alpha(pwi, pci, 0);			\
+	do {								\
+		type *p = (type *)fbuf;					\
+		XYPOS x;						\
+									\
+		for (x = x1; x <= x2; x++) {				\
+			type *pix = p + PIX_INDEX(x, bpp);		\
+			COLOR32 col = *pix;				\
+									\
+			if (col != oldcol) {				\
+				oldcol = col;				\
+				newcol = pwi->ppi->apply_alpha(pwi, pci, col); \
+			}						\
+			*pix = (type)newcol;				\
+		}							\
+		fbuf += pwi->linelen;					\
+	} while (++y1 <= y2);						\
+}
+
+/* Template for a function that draws a bitmap row with alpha to a 32bpp
+   framebuffer without horizontal scaling. The template gets the size of a
+   bitmap pixel and a statement that loads the RGBA value from prow. The row
+   is handled in spans: fully transparent pixels are skipped, opaque pixels
+   are stored directly (with the last conversion cached) and only the
+   remaining pixels are blended. */
+#define ADRAW_LL_ROW_32(name, pixsize, get_rgba)			\
+void adraw_ll_row_##name##_32(imginfo_t *pii, COLOR32 *p)		\
+{									\
+	const wininfo_t *pwi = pii->pwi;				\
+	u_char *prow = pii->prow;					\
+	RGBA hash_rgba = pii->hash_rgba;				\
+	COLOR32 hash_col = pii->hash_col;				\
+	int opaque = !(pwi->ppi->flags & PIF_ALPHA);			\
+	int count = pii->xend - pii->xpix;				\
+									\
+	for (; count > 0; count--, p++, prow += pixsize) {		\
+		RGBA rgba;						\
+		colinfo_t ci;						\
+									\
+		get_rgba;						\
+		if (!(rgba & 0xFF))					\
+			continue;		  /* Transparent */	\
+		if (opaque && ((rgba & 0xFF) == 0xFF)) {		\
+			if (rgba != hash_rgba) {			\
+				hash_rgba = rgba;			\
+				hash_col = pwi->ppi->rgba2col(pwi, rgba); \
+			}						\
+			*p = hash_col;				  	\
+			continue;					\
+		}							\
+		adraw_ll_premul(&ci, rgba);				\
+		*p = pwi->ppi->apply_alpha(pwi, &ci, *p);		\
+	}								\
+	pii->hash_rgba = hash_rgba;					\
+	pii->hash_col = hash_col;					\
+}
+
+
+/************************************************************************/
+/* LOCAL VARIABLES							*/
+/************************************************************************/
+
+#if defined(CONFIG_XLCD_PNG) || defined(CONFIG_XLCD_BMP)
+/* Pre-multiplied palette, only computed once per bitmap */
+static colinfo_t palci[256];
+#endif
+
+
+/************************************************************************/
+/* HELPER FUNCTIONS							*/
+/************************************************************************/
+
+/* Pre-multiply color with its alpha value for apply_alpha(); as each product
+   fits into 16 bits, R and B are multiplied together in one 32 bit word */
+static inline void adraw_ll_premul(colinfo_t *pci, RGBA rgba)
+{
+	RGBA alpha1 = (rgba & 0xFF) + 1;
+	RGBA RB = ((rgba >> 8) & 0x00FF00FF) * alpha1;
+
+	pci->A256 = 257 - alpha1;
+	pci->RA1 = RB >> 16;
+	pci->GA1 = ((rgba >> 16) & 0xFF) * alpha1;
+	pci->BA1 = RB & 0xFFFF;
+}
+
+#if defined(CONFIG_XLCD_PNG) || defined(CONFIG_XLCD_BMP)
+/* Get the pre-multiplied palette; it is computed when the first row of the
+   bitmap is drawn, because then the palette is complete */
+static const colinfo_t *adraw_ll_get_palci(imginfo_t *pii)
+{
+	if (!pii->palci) {
+		const wininfo_t *pwi = pii->pwi;
+		u_int i;
+
+		for (i = 0; i <= pii->rowmask; i++) {
+			RGBA rgba = pii->palette[i];
+
+			adraw_ll_premul(&palci[i], rgba);
+			palci[i].rgba = rgba;
+			palci[i].col = pwi->ppi->rgba2col(pwi, rgba);
+		}
+		pii->palci = palci;
+	}
+
+	return pii->palci;
+}
+#endif
+
+
 /************************************************************************/
 /* DRAWING GRAPHICS PRIMITIVES						*/
 /************************************************************************/
@@ -38,6 +193,9 @@ void adraw_ll_pixel(const wininfo_t *pwi, XYPOS x, XYPOS y,
 	u_int shift = 32 - (xpos & 31) - bpp;
 	COLOR32 col;
 
+	if (ADRAW_TRANSPARENT(pci))
+		return;
+
 	/* Compute framebuffer address of the pixel */
 	fbuf = pwi->linelen * y + pwi->pfbuf[pwi->fbdraw];
 
@@ -54,6 +212,10 @@ void adraw_ll_pixel(const wininfo_t *pwi, XYPOS x, XYPOS y,
 
 #if CONFIG_XLCD_DRAW \
 	& (XLCD_DRAW_RECT | XLCD_DRAW_CIRC | XLCD_DRAW_PROG | XLCD_DRAW_FILL)
+ADRAW_LL_RECT_BPP(8, u8)
+ADRAW_LL_RECT_BPP(16, u16)
+ADRAW_LL_RECT_BPP(32, u32)
+
 /* Draw filled rectangle, applying alpha; given region is definitely valid and
    x and y are sorted (x1 <= x2, y1 <= y2) */
 void adraw_ll_rect(const wininfo_t *pwi, XYPOS x1, XYPOS y1,
@@ -67,6 +229,23 @@ void adraw_ll_rect(const wininfo_t *pwi, XYPOS x1, XYPOS y1,
 	u_int shift;
 	int ycount, xcount;
 	int xpos;
+	int opaque = ADRAW_OPAQUE(pwi, pci);
+
+	if (ADRAW_TRANSPARENT(pci))
+		return;
+
+	/* Pixels of at least one byte can be accessed directly */
+	switch (bpp_shift) {
+	case 3:
+		adraw_ll_rect_8(pwi, x1, y1, x2, y2, pci);
+		return;
+	case 4:
+		adraw_ll_rect_16(pwi, x1, y1, x2, y2, pci);
+		return;
+	case 5:
+		adraw_ll_rect_32(pwi, x1, y1, x2, y2, pci);
+		return;
+	}
 
 	xcount = x2 - x1 + 1;
 	ycount = y2 - y1 + 1;
@@ -85,7 +264,10 @@ void adraw_ll_rect(const wininfo_t *pwi, XYPOS x1, XYPOS y1,
 		for (;;) {
 			COLOR32 col;
 			s -= bpp;
-			col = pwi->ppi->apply_alpha(pwi, pci, val >> s);
+			if (opaque)
+				col = pci->col;
+			else
+				col = pwi->ppi->apply_alpha(pwi, pci, val >> s);
 			val &= ~(mask << s);
 			val |= col << s;
 			if (!--c)
@@ -121,6 +303,10 @@ void adraw_ll_char(const wininfo_t *pwi, XYPOS x, XYPOS y, char c,
 	COLOR32 mask = (1 << bpp) - 1;	  /* This also works for bpp==32! */
 	u_int shift = 32 - (xpos & 31);
 
+	/* A transparent background is the same as no background */
+	if (ADRAW_TRANSPARENT(pci_bg))
+		attr |= ATTR_NO_BG;
+
 	/* Compute framebuffer address of the pixel */
 	fbuf = linelen * y + ((xpos >> 5) << 2) + pwi->pfbuf[pwi->fbdraw];
 
@@ -218,31 +404,24 @@ void adraw_ll_row_PAL(imginfo_t *pii, COLOR32 *p)
 
 	u_int rowshift = pii->rowshift;
 	const wininfo_t *pwi = pii->pwi;
+	const colinfo_t *pal = adraw_ll_get_palci(pii);
 
 	val = *p;
 	for (;;) {
-		RGBA rgba;
-		RGBA alpha1;
-		colinfo_t ci;
+		const colinfo_t *pci;
 
 		rowshift -= pii->rowbitdepth;
-		rgba = pii->palette[(*prow >> rowshift) & pii->rowmask];
+		pci = &pal[(*prow >> rowshift) & pii->rowmask];
 		if (!rowshift) {
 			prow++;
 			rowshift = 8;
 		}
-		alpha1 = rgba & 0xFF;
-		ci.A256 = 256 - alpha1;
-		alpha1++;
-		ci.RA1 = (rgba >> 24) * alpha1;
-		ci.GA1 = ((rgba >> 16) & 0xFF) * alpha1;
-		ci.BA1 = ((rgba >> 8) & 0xFF) * alpha1;
 		do {
 			shift -= pii->bpp;
-			if (alpha1 != 1) {
+			if (!ADRAW_TRANSPARENT(pci)) {
 				COLOR32 col;
 
-				col = pwi->ppi->apply_alpha(pwi, &ci,
+				col = pwi->ppi->apply_alpha(pwi, pci,
 							    val >> shift);
 				val &= ~(pii->mask << shift);
 				val |= col << shift;
@@ -271,27 +450,20 @@ void adraw_ll_row_PAL8(imginfo_t *pii, COLOR32 *p)
 
 	u_int rowshift = pii->rowshift;
 	const wininfo_t *pwi = pii->pwi;
+	const colinfo_t *pal = adraw_ll_get_palci(pii);
 
 	val = *p;
 	for (;;) {
-		RGBA rgba;
-		RGBA alpha1;
-		colinfo_t ci;
+		const colinfo_t *pci;
 
 		rowshift -= pii->rowbitdepth;
-		rgba = pii->palette[*prow++];
-		alpha1 = rgba & 0xFF;
-		ci.A256 = 256 - alpha1;
-		alpha1++;
-		ci.RA1 = (rgba >> 24) * alpha1;
-		ci.GA1 = ((rgba >> 16) & 0xFF) * alpha1;
-		ci.BA1 = ((rgba >> 8) & 0xFF) * alpha1;
+		pci = &pal[*prow++];
 		do {
 			shift -= pii->bpp;
-			if (alpha1 != 1) {
+			if (!ADRAW_TRANSPARENT(pci)) {
 				COLOR32 col;
 
-				col = pwi->ppi->apply_alpha(pwi, &ci,
+				col = pwi->ppi->apply_alpha(pwi, pci,
 							    val >> shift);
 				val &= ~(pii->mask << shift);
 				val |= col << shift;
@@ -311,7 +483,7 @@ DONE:
 #endif /* CONFIG_XLCD_PNG || CONFIG_XLCD_BMP */
 
 
-#ifdef CONFIG_XLCD_PNG
+#if defined(CONFIG_XLCD_PNG) || defined(CONFIG_XLCD_JPG)
 void adraw_ll_row_GA(imginfo_t *pii, COLOR32 *p)
 {
 	int xpix = pii->xpix;
@@ -322,18 +494,12 @@ void adraw_ll_row_GA(imginfo_t *pii, COLOR32 *p)
 
 	val = *p;
 	for (;;) {
-		RGBA alpha1;
 		colinfo_t ci;
 
-		alpha1 = prow[1];
-		ci.A256 = 256 - alpha1;
-		alpha1++;
-		ci.RA1 = prow[0] * alpha1;
-		ci.GA1 = ci.RA1;
-		ci.BA1 = ci.GA1;
+		adraw_ll_premul(&ci, prow[0] * 0x01010100 | prow[1]);
 		do {
 			shift -= pii->bpp;
-			if (alpha1 != 1) {
+			if (!ADRAW_TRANSPARENT(&ci)) {
 				COLOR32 col;
 
 				col = pwi->ppi->apply_alpha(pwi, &ci,
@@ -407,18 +573,13 @@ void adraw_ll_row_RGBA(imginfo_t *pii, COLOR32 *p)
 
 	val = *p;
 	for (;;) {
-		RGBA alpha1;
 		colinfo_t ci;
 
-		alpha1 = prow[3];
-		ci.A256 = 256 - alpha1;
-		alpha1++;
-		ci.RA1 = prow[0] * alpha1;
-		ci.GA1 = prow[1] * alpha1;
-		ci.BA1 = prow[2] * alpha1;
+		adraw_ll_premul(&ci, (prow[0] << 24) | (prow[1] << 16)
+				| (prow[2] << 8) | prow[3]);
 		do {
 			shift -= pii->bpp;
-			if (alpha1 != 1) {
+			if (!ADRAW_TRANSPARENT(&ci)) {
 				COLOR32 col;
 
 				col = pwi->ppi->apply_alpha(pwi, &ci,
@@ -439,7 +600,7 @@ void adraw_ll_row_RGBA(imginfo_t *pii, COLOR32 *p)
 DONE:
 	*p = val; /* Store final value */
 }
-#endif /* CONFIG_XLCD_PNG */
+#endif /* CONFIG_XLCD_PNG || CONFIG_XLCD_JPG */
 
 
 #ifdef CONFIG_XLCD_BMP
@@ -494,18 +655,13 @@ void adraw_ll_row_BGRA(imginfo_t *pii, COLOR32 *p)
 
 	val = *p;
 	for (;;) {
-		RGBA alpha1;
 		colinfo_t ci;
 
-		alpha1 = prow[3];
-		ci.A256 = 256 - alpha1;
-		alpha1++;
-		ci.RA1 = prow[2] * alpha1;
-		ci.GA1 = prow[1] * alpha1;
-		ci.BA1 = prow[0] * alpha1;
+		adraw_ll_premul(&ci, (prow[2] << 24) | (prow[1] << 16)
+				| (prow[0] << 8) | prow[3]);
 		do {
 			shift -= pii->bpp;
-			if (alpha1 != 1) {
+			if (!ADRAW_TRANSPARENT(&ci)) {
 				COLOR32 col;
 
 				col = pwi->ppi->apply_alpha(pwi, &ci,
@@ -527,3 +683,46 @@ DONE:
 	*p = val;			  /* Store final value */
 }
 #endif /* CONFIG_XLCD_BMP */
+
+
+/************************************************************************/
+/* DRAWING BITMAP ROWS (32BPP)						*/
+/************************************************************************/
+
+#if defined(CONFIG_XLCD_PNG) || defined(CONFIG_XLCD_BMP)
+/* Palette version, uses the pre-multiplied palette */
+void adraw_ll_row_PAL8_32(imginfo_t *pii, COLOR32 *p)
+{
+	const wininfo_t *pwi = pii->pwi;
+	const colinfo_t *pal = adraw_ll_get_palci(pii);
+	u_char *prow = pii->prow;
+	int opaque = !(pwi->ppi->flags & PIF_ALPHA);
+	int count = pii->xend - pii->xpix;
+
+	for (; count > 0; count--, p++) {
+		const colinfo_t *pci = &pal[*prow++];
+
+		if (ADRAW_TRANSPARENT(pci))
+			continue;
+		if (opaque && (pci->A256 == 1))
+			*p = pci->col;
+		else
+			*p = pwi->ppi->apply_alpha(pwi, pci, *p);
+	}
+}
+#endif
+
+#if defined(CONFIG_XLCD_PNG) || defined(CONFIG_XLCD_JPG)
+ADRAW_LL_ROW_32(GA, 2,
+		rgba = prow[0] * 0x01010100 | prow[1])
+
+ADRAW_LL_ROW_32(RGBA, 4,
+		rgba = (prow[0] << 24) | (prow[1] << 16) | (prow[2] << 8)
+			| prow[3])
+#endif
+
+#ifdef CONFIG_XLCD_BMP
+ADRAW_LL_ROW_32(BGRA, 4,
+		rgba = (prow[2] << 24) | (prow[1] << 16) | (prow[0] << 8)
+			| prow[3])
+#endif
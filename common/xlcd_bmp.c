@@ -137,6 +137,28 @@ const char *draw_bmp(imginfo_t *pii, u_long addr)
 		draw_row = draw_row_tab[pii->applyalpha][temp];
 #else
 		draw_row = draw_row_tab[0][temp];
+#endif
+#ifdef CONFIG_CMD_DRAW
+		/* Use specialized row writers for the most common case of a
+		   32bpp framebuffer without horizontal scaling */
+		if (!pii->applyalpha && (pii->bpp == 32)
+		    && (pii->multiwidth == 1)) {
+			if (temp == CT_GRAY)
+				draw_row = draw_ll_row_PAL8_32;
+			else if (temp == CT_TRUECOL)
+				draw_row = draw_ll_row_BGR_32;
+			else if (temp == CT_TRUECOL_ALPHA)
+				draw_row = draw_ll_row_BGRA_32;
+		}
+#endif
+#ifdef CONFIG_CMD_ADRAW
+		if (pii->applyalpha && (pii->bpp == 32)
+		    && (pii->multiwidth == 1)) {
+			if (temp == CT_GRAY)
+				draw_row = adraw_ll_row_PAL8_32;
+			else if (temp == CT_TRUECOL_ALPHA)
+				draw_row = adraw_ll_row_BGRA_32;
+		}
 #endif
 	}
 
@@ -16,6 +16,72 @@
 #include <xlcd_draw_ll.h>		 /* Own interface */
 #include <cmd_lcd.h>			 /* wininfo_t */
 
+/************************************************************************/
+/* DEFINITIONS								*/
+/************************************************************************/
+
+/* Within a COLOR32 word, the first pixel is stored in the most significant
+   bits. When accessing 8bpp or 16bpp pixels directly by address, the pixel
+   index has to be mirrored within the word on little endian CPUs. */
+#ifdef __LITTLE_ENDIAN
+#define PIX_INDEX(x, bpp) ((x) ^ ((32 / (bpp)) - 1))
+#else
+#define PIX_INDEX(x, bpp) (x)
+#endif
+
+/* Template for a function that sets a pixel in a framebuffer with 8, 16 or
+   32 bpp by directly storing the pixel, without any shifting or masking */
+#define DRAW_LL_PIXEL_BPP(bpp, type)					\
+static void draw_ll_pixel_##bpp(const wininfo_t *pwi, XYPOS x, XYPOS y,	\
+				COLOR32 col)				\
+{									\
+	type *p = (type *)(pwi->linelen * y + pwi->pfbuf[pwi->fbdraw]);	\
+									\
+	p[PIX_INDEX(x, bpp)] = (type)col;				\
+}
+
+
+/************************************************************************/
+/* HELPER FUNCTIONS							*/
+/************************************************************************/
+
+#if CONFIG_XLCD_DRAW & (XLCD_DRAW_RECT | XLCD_DRAW_CIRC | XLCD_DRAW_PROG \
+			| XLCD_DRAW_FILL | XLCD_DRAW_TEST)
+/* Fill count words at p with color (color is repeated to fill the whole 32
+   bits); the aligned part is filled with 64 bit stores, as most CPUs can
+   store these as fast as 32 bit words */
+static void draw_ll_fill_words(COLOR32 *p, COLOR32 color, u_long count)
+{
+	u64 color64;
+	u64 *p64;
+
+	if (!count)
+		return;
+	if ((u_long)p & 4) {
+		*p++ = color;
+		count--;
+	}
+
+	color64 = ((u64)color << 32) | color;
+	p64 = (u64 *)p;
+	while (count >= 8) {
+		p64[0] = color64;
+		p64[1] = color64;
+		p64[2] = color64;
+		p64[3] = color64;
+		p64 += 4;
+		count -= 8;
+	}
+	while (count >= 2) {
+		*p64++ = color64;
+		count -= 2;
+	}
+	if (count)
+		*(COLOR32 *)p64 = color;
+}
+#endif
+
+
 /************************************************************************/
 /* DRAWING GRAPHICS PRIMITIVES						*/
 /************************************************************************/
@@ -23,6 +89,10 @@
 /* draw_ll_pixel() is also called by some test patterns */
 #if CONFIG_XLCD_DRAW & (XLCD_DRAW_PIXEL | XLCD_DRAW_LINE | XLCD_DRAW_CIRC \
 			| XLCD_DRAW_TURTLE | XLCD_DRAW_TEST)
+DRAW_LL_PIXEL_BPP(8, u8)
+DRAW_LL_PIXEL_BPP(16, u16)
+DRAW_LL_PIXEL_BPP(32, u32)
+
 /* Draw pixel by replacing with new color; pixel is definitely valid */
 void draw_ll_pixel(const wininfo_t *pwi, XYPOS x, XYPOS y, COLOR32 col)
 {
@@ -34,6 +104,19 @@ void draw_ll_pixel(const wininfo_t *pwi, XYPOS x, XYPOS y, COLOR32 col)
 	COLOR32 *p;
 	u_int shift = 32 - (xpos & 31) - bpp;
 
+	/* Pixels of at least one byte can be stored directly */
+	switch (bpp_shift) {
+	case 3:
+		draw_ll_pixel_8(pwi, x, y, col);
+		return;
+	case 4:
+		draw_ll_pixel_16(pwi, x, y, col);
+		return;
+	case 5:
+		draw_ll_pixel_32(pwi, x, y, col);
+		return;
+	}
+
 	/* Compute framebuffer address of the pixel */
 	fbuf = pwi->linelen * y + pwi->pfbuf[pwi->fbdraw];
 
@@ -64,8 +147,8 @@ void draw_ll_rect(const wininfo_t *pwi, XYPOS x1, XYPOS y1,
 	color = col2col32(pwi, color);
 
 	xpos = x2 << bpp_shift;
-	maskright = 0xFFFFFFFF >> (xpos & 31);
-	maskright = ~(maskright >> bpp);
+	/* Shift left, a right shift by 32 would be undefined for 32bpp */
+	maskright = 0xFFFFFFFF << (32 - (xpos & 31) - bpp);
 	x2 = xpos >> 5;
 
 	xpos = x1 << bpp_shift;
@@ -79,17 +162,19 @@ void draw_ll_rect(const wininfo_t *pwi, XYPOS x1, XYPOS y1,
 
 	count = y2 - y1 + 1;
 	x2 -= x1;
-	if (x2) {
+	if ((maskleft == 0xFFFFFFFF) && (maskright == 0xFFFFFFFF)
+	    && ((x2 + 1) == linelen)) {
+		/* Rectangle covers full lines (e.g. clear): fill as one big
+		   block of words */
+		draw_ll_fill_words(p, color, count * linelen);
+	} else if (x2) {
 		/* Fill rectangle consisting of several words per row */
 		do {
-			int i;
-
 			/* Handle leftmost word in row */
 			p[0] = (p[0] & ~maskleft) | (color & maskleft);
 
 			/* Fill all middle words without masking */
-			for (i = 1; i < x2; i++)
-				p[i] = color;
+			draw_ll_fill_words(p + 1, color, x2 - 1);
 
 			/* Handle rightmost word in row */
 			p[x2] = (p[x2] & ~maskright) | (color & maskright);
@@ -196,7 +281,7 @@ DONE:
 #endif /* CONFIG_XLCD_PNG || CONFIG_XLCD_BMP */
 
 
-#ifdef CONFIG_XLCD_PNG
+#if defined(CONFIG_XLCD_PNG) || defined(CONFIG_XLCD_JPG)
 void draw_ll_row_GA(imginfo_t *pii, COLOR32 *p)
 
 {
@@ -308,7 +393,8 @@ void draw_ll_row_RGBA(imginfo_t *pii, COLOR32 *p)
 DONE:
 	*p = val; /* Store final value */
 }
-#endif /* CONFIG_XLCD_PNG */
+
+#endif /* CONFIG_XLCD_PNG || CONFIG_XLCD_JPG */
 
 
 #ifdef CONFIG_XLCD_BMP
@@ -386,3 +472,77 @@ DONE:
 	*p = val; /* Store final value */
 }
 #endif /* CONFIG_XLCD_BMP */
+
+
+/************************************************************************/
+/* DRAWING BITMAP ROWS (32BPP)						*/
+/************************************************************************/
+
+#if defined(CONFIG_XLCD_PNG) || defined(CONFIG_XLCD_BMP) \
+	|| defined(CONFIG_XLCD_JPG)
+/* Specialized versions for 32bpp framebuffers without horizontal scaling;
+   each pixel is one full word, so no shifting and masking is required. As
+   neighbouring pixels often have the same color, remember the last RGBA
+   value and its COLOR32 value to avoid calling rgba2col() for each pixel.
+   The template gets the size of a bitmap pixel and a statement that loads
+   the RGBA value from prow. */
+#define DRAW_LL_ROW_32(name, pixsize, get_rgba)			\
+void draw_ll_row_##name##_32(imginfo_t *pii, COLOR32 *p)		\
+{									\
+	const wininfo_t *pwi = pii->pwi;				\
+	u_char *prow = pii->prow;					\
+	RGBA hash_rgba = pii->hash_rgba;				\
+	COLOR32 hash_col = pii->hash_col;				\
+	int count = pii->xend - pii->xpix;				\
+									\
+	while (count-- > 0) {						\
+		RGBA rgba;						\
+									\
+		get_rgba;						\
+		if (rgba != hash_rgba) {				\
+			hash_rgba = rgba;				\
+			hash_col = pwi->ppi->rgba2col(pwi, rgba);	\
+		}							\
+		*p++ = hash_col;					\
+		prow += pixsize;					\
+	}								\
+	pii->hash_rgba = hash_rgba;					\
+	pii->hash_col = hash_col;					\
+}
+
+/* Palette already holds COLOR32 values */
+void draw_ll_row_PAL8_32(imginfo_t *pii, COLOR32 *p)
+{
+	u_char *prow = pii->prow;
+	const RGBA *palette = pii->palette;
+	int count = pii->xend - pii->xpix;
+
+	while (count-- > 0)
+		*p++ = (COLOR32)palette[*prow++];
+}
+#endif
+
+#if defined(CONFIG_XLCD_PNG) || defined(CONFIG_XLCD_JPG)
+DRAW_LL_ROW_32(GA, 2,
+	       rgba = prow[0] * 0x01010100 | prow[1])
+
+DRAW_LL_ROW_32(RGB, 3,
+	       rgba = (prow[0] << 24) | (prow[1] << 16) | (prow[2] << 8);
+	       if (rgba != pii->trans_rgba)
+		       rgba |= 0xFF)
+
+DRAW_LL_ROW_32(RGBA, 4,
+	       rgba = (prow[0] << 24) | (prow[1] << 16) | (prow[2] << 8)
+		       | prow[3])
+#endif
+
+#ifdef CONFIG_XLCD_BMP
+DRAW_LL_ROW_32(BGR, 3,
+	       rgba = (prow[2] << 24) | (prow[1] << 16) | (prow[0] << 8);
+	       if (rgba != pii->trans_rgba)
+		       rgba |= 0xFF)
+
+DRAW_LL_ROW_32(BGRA, 4,
+	       rgba = (prow[2] << 24) | (prow[1] << 16) | (prow[0] << 8)
+		       | prow[3])
+#endif
@@ -18,35 +18,76 @@
 #include <video_font.h>			 /* Get font data, width and height */
 #include <video_font_data.h>		 /* video_fontdata */
 
+#include <malloc.h>			 /* malloc(), free() */
+#include <linux/bug.h>			 /* BUILD_BUG_ON() */
+#include <linux/log2.h>			 /* is_power_of_2() */
+
 #if defined(CONFIG_XLCD_CONSOLE) \
 	|| (CONFIG_XLCD_DRAW & (XLCD_DRAW_TEXT | XLCD_DRAW_PROG))
-/* Draw a character, replacing pixels with new color; character area is
-   definitely valid */
-void draw_ll_char(const wininfo_t *pwi, XYPOS x, XYPOS y, char c,
-		  COLOR32 fg, COLOR32 bg)
+
+/************************************************************************/
+/* DEFINITIONS								*/
+/************************************************************************/
+
+/* Attributes that change the look of a glyph row; vertical scaling only
+   repeats rows and is done when copying the glyph to the framebuffer */
+#define GLYPH_ATTR_MASK \
+	(ATTR_HS_MASK | ATTR_BOLD | ATTR_INVERSE | ATTR_UNDERL | ATTR_STRIKE)
+
+
+/************************************************************************/
+/* TYPES AND STRUCTURES							*/
+/************************************************************************/
+
+#if CONFIG_XLCD_GLYPHCACHE > 0
+/* One glyph in the glyph cache; the glyph is stored with all its pixels
+   already expanded to the pixel format of the window, i.e. each glyph row is
+   a sequence of complete COLOR32 words that can simply be copied to the
+   framebuffer. */
+typedef struct glyph {
+	COLOR32 fg;			  /* Foreground color */
+	COLOR32 bg;			  /* Background color */
+	u_short attr;			  /* Attributes (GLYPH_ATTR_MASK) */
+	u_char c;			  /* Character */
+	u_char bpp_shift;		  /* Pixel size, 0xFF: entry unused */
+} glyph_t;
+
+/* Glyph cache of a window (pwi->pgc); the glyph data follows directly after
+   the structure, each glyph uses VIDEO_FONT_HEIGHT * rowwords words. */
+struct glyphcache {
+	u_int rowwords;			  /* Words per glyph row */
+	glyph_t glyph[CONFIG_XLCD_GLYPHCACHE];
+};
+#endif /* CONFIG_XLCD_GLYPHCACHE > 0 */
+
+
+/************************************************************************/
+/* HELPER FUNCTIONS							*/
+/************************************************************************/
+
+/* Draw the given character rows bit by bit to fbuf. If line_count is 0, the
+   vertical scaling from attr is used, otherwise each row is drawn line_count
+   times. */
+static void draw_ll_char_rows(u_long fbuf, u_long linelen, u_int shift,
+			      u_int bpp, u_int attr, u_int line_count, char c,
+			      COLOR32 fg, COLOR32 bg)
 {
-	u_int bpp_shift = pwi->ppi->bpp_shift;
-	u_int bpp = 1 << bpp_shift;
-	int xpos = x << bpp_shift;
-	u_long fbuf;
-	u_long linelen = pwi->linelen;
-	u_int attr = pwi->attr;
 	XYPOS underl = (attr & ATTR_UNDERL) ? VIDEO_FONT_UNDERL : -1;
 	XYPOS strike = (attr & ATTR_STRIKE) ? VIDEO_FONT_STRIKE : -1;
 	const VIDEO_FONT_TYPE *pfont;
-	COLOR32 mask = (1 << bpp) - 1;	  /* This also works for bpp==32! */
-	u_int shift = 32 - (xpos & 31);
+	COLOR32 mask = 0xFFFFFFFF >> (32 - bpp);
+	XYPOS y;
 
-	/* Compute framebuffer address of the pixel */
-	fbuf = linelen * y + ((xpos >> 5) << 2) + pwi->pfbuf[pwi->fbdraw];
+	if (!line_count)
+		line_count = ((attr & ATTR_VS_MASK) >> 6) + 1;
 
 	/* Compute start of character within font data */
 	pfont = video_fontdata;
-	pfont += sizeof(VIDEO_FONT_TYPE) * VIDEO_FONT_HEIGHT * c;
+	pfont += sizeof(VIDEO_FONT_TYPE) * VIDEO_FONT_HEIGHT * (u_char)c;
 
 	for (y = 0; y < VIDEO_FONT_HEIGHT; y++) {
 		VIDEO_FONT_TYPE fd;	  /* Font data (one character row) */
-		unsigned line_count;	  /* Loop twice if double height */
+		unsigned count;		  /* Loop twice if double height */
 
 		/* If underline or strike-through line is reached, use fully
 		   set pixel, otherwise get character pixel data and apply
@@ -63,7 +104,7 @@ void draw_ll_char(const wininfo_t *pwi, XYPOS x, XYPOS y, char c,
 		pfont++;		  /* Next character row */
 
 		/* Loop up to four times if multiple height */
-		line_count = ((attr & ATTR_VS_MASK) >> 6) + 1;
+		count = line_count;
 		do {
 			COLOR32 *p = (COLOR32 *)fbuf;
 			u_int s = shift;
@@ -108,7 +149,127 @@ void draw_ll_char(const wininfo_t *pwi, XYPOS x, XYPOS y, char c,
 
 			/* Go to next line */
 			fbuf += linelen;
-		} while (--line_count);
+		} while (--count);
+	}
+}
+
+#if CONFIG_XLCD_GLYPHCACHE > 0
+/* Return the pre-rendered glyph for the character from the glyph cache of the
+   window; render it to the cache if it is not yet there. Return NULL if the
+   cache is not available. */
+static const COLOR32 *draw_ll_get_glyph(const wininfo_t *pwi, u_int rowwords,
+					char c, COLOR32 fg, COLOR32 bg,
+					u_int attr)
+{
+	struct glyphcache *pgc = pwi->pgc;
+	u_int bpp_shift = pwi->ppi->bpp_shift;
+	u_int index;
+	u_long glyphsize;
+	glyph_t *pg;
+	COLOR32 *data;
+
+	/* The index is masked with CONFIG_XLCD_GLYPHCACHE - 1 below */
+	BUILD_BUG_ON(!is_power_of_2(CONFIG_XLCD_GLYPHCACHE));
+
+	/* Allocate the cache on first use; if glyphs get bigger (e.g. due to
+	   double width or a different pixel format), start over with bigger
+	   entries. The additional word at the end is needed because
+	   draw_ll_char_rows() reads and writes back the word after a row. */
+	if (!pgc || (pgc->rowwords < rowwords)) {
+		free(pgc);
+		glyphsize = VIDEO_FONT_HEIGHT * rowwords * sizeof(COLOR32);
+		pgc = malloc(sizeof(struct glyphcache)
+			     + CONFIG_XLCD_GLYPHCACHE * glyphsize
+			     + sizeof(COLOR32));
+		((wininfo_t *)pwi)->pgc = pgc;
+		if (!pgc)
+			return NULL;
+		pgc->rowwords = rowwords;
+		for (index = 0; index < CONFIG_XLCD_GLYPHCACHE; index++)
+			pgc->glyph[index].bpp_shift = 0xFF;
 	}
+
+	/* Look up the glyph; the hash mostly depends on the character so that
+	   the glyphs of one color combination do not collide */
+	index = (u_char)c ^ (fg >> 3) ^ (bg >> 7) ^ (attr >> 4);
+	index &= CONFIG_XLCD_GLYPHCACHE - 1;
+	pg = &pgc->glyph[index];
+	glyphsize = VIDEO_FONT_HEIGHT * pgc->rowwords;
+	data = (COLOR32 *)(pgc + 1) + index * glyphsize;
+	if ((pg->c == (u_char)c) && (pg->bpp_shift == bpp_shift)
+	    && (pg->fg == fg) && (pg->bg == bg) && (pg->attr == attr))
+		return data;
+
+	/* Not found, render glyph to the cache, replacing the old entry */
+	draw_ll_char_rows((u_long)data, pgc->rowwords * sizeof(COLOR32), 32,
+			  1 << bpp_shift, attr, 1, c, fg, bg);
+	pg->c = (u_char)c;
+	pg->bpp_shift = bpp_shift;
+	pg->fg = fg;
+	pg->bg = bg;
+	pg->attr = attr;
+
+	return data;
+}
+#endif /* CONFIG_XLCD_GLYPHCACHE > 0 */
+
+
+/************************************************************************/
+/* EXPORTED FUNCTIONS							*/
+/************************************************************************/
+
+/* Draw a character, replacing pixels with new color; character area is
+   definitely valid */
+void draw_ll_char(const wininfo_t *pwi, XYPOS x, XYPOS y, char c,
+		  COLOR32 fg, COLOR32 bg)
+{
+	u_int bpp_shift = pwi->ppi->bpp_shift;
+	int xpos = x << bpp_shift;
+	u_long fbuf;
+	u_long linelen = pwi->linelen;
+	u_int attr = pwi->attr;
+
+	/* Compute framebuffer address of the pixel */
+	fbuf = linelen * y + ((xpos >> 5) << 2) + pwi->pfbuf[pwi->fbdraw];
+
+#if CONFIG_XLCD_GLYPHCACHE > 0
+	/* If the character starts on a word boundary, covers complete words
+	   and has a background, copy the pre-rendered glyph row by row */
+	if (!(attr & ATTR_NO_BG) && !(xpos & 31)) {
+		u_int rowbits;
+		const COLOR32 *pglyph;
+
+		rowbits = VIDEO_FONT_WIDTH * (((attr & ATTR_HS_MASK) >> 4) + 1);
+		rowbits <<= bpp_shift;
+		if (!(rowbits & 31)) {
+			u_int rowwords = rowbits >> 5;
+
+			pglyph = draw_ll_get_glyph(pwi, rowwords, c, fg, bg,
+						   attr & GLYPH_ATTR_MASK);
+			if (pglyph) {
+				u_int line_count;
+				u_int rowbytes = rowwords * sizeof(COLOR32);
+				u_int rowstep = pwi->pgc->rowwords;
+
+				line_count = ((attr & ATTR_VS_MASK) >> 6) + 1;
+				for (y = 0; y < VIDEO_FONT_HEIGHT; y++) {
+					u_int count = line_count;
+
+					do {
+						memcpy((void *)fbuf, pglyph,
+						       rowbytes);
+						fbuf += linelen;
+					} while (--count);
+					pglyph += rowstep;
+				}
+				return;
+			}
+		}
+	}
+#endif /* CONFIG_XLCD_GLYPHCACHE > 0 */
+
+	/* Draw character bit by bit */
+	draw_ll_char_rows(fbuf, linelen, 32 - (xpos & 31), 1 << bpp_shift,
+			  attr, 0, c, fg, bg);
 }
 #endif
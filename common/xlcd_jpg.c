@@ -1,5 +1,5 @@
 /*
- * Hardware independent LCD support for BMP files
+ * Hardware independent LCD support for JPG files
  *
  * (C) Copyright 2012
  * Hartmut Keller, F&S Elektronik Systeme GmbH, keller@fs-net.de
@@ -11,6 +11,7 @@
 #include <common.h>
 #include <cmd_lcd.h>			  /* wininfo_t, pixinfo_t */
 #include <xlcd_bitmap.h>		  /* bminfo_t, CT_*, ... */
+#include <malloc.h>			  /* malloc(), free() */
 #include <watchdog.h>			  /* WATCHDOG_RESET() */
 
 #ifdef CONFIG_CMD_DRAW
@@ -27,34 +28,1330 @@
 /* DEFINITIONS								*/
 /************************************************************************/
 
+/* JPG markers (second byte after 0xFF) */
+#define MARKER_SOF0 0xC0		  /* Baseline DCT */
+#define MARKER_SOF1 0xC1		  /* Extended sequential DCT */
+#define MARKER_SOF2 0xC2		  /* Progressive DCT */
+#define MARKER_DHT  0xC4		  /* Define Huffman table */
+#define MARKER_JPG  0xC8		  /* Reserved for extensions */
+#define MARKER_DAC  0xCC		  /* Define arithmetic coding */
+#define MARKER_RST0 0xD0		  /* Restart marker 0..7 */
+#define MARKER_RST7 0xD7
+#define MARKER_SOI  0xD8		  /* Start of image */
+#define MARKER_EOI  0xD9		  /* End of image */
+#define MARKER_SOS  0xDA		  /* Start of scan */
+#define MARKER_DQT  0xDB		  /* Define quantization table */
+#define MARKER_DRI  0xDD		  /* Define restart interval */
+#define MARKER_APP14 0xEE		  /* Adobe color transform info */
+
+/* Number of bits resolved in one step by the Huffman lookup table */
+#define JPG_FAST_BITS 9
+
+/* Fixed point IDCT (Loeffler/Ligtenberg/Moschytz, as in jidctint.c); the
+   constants are scaled by 2^13, intermediate results by 2^2 */
+#define CONST_BITS 13
+#define PASS1_BITS 2
+
+#define FIX_0_298631336  2446
+#define FIX_0_390180644  3196
+#define FIX_0_541196100  4433
+#define FIX_0_765366865  6270
+#define FIX_0_899976223  7373
+#define FIX_1_175875602  9633
+#define FIX_1_501321110 12299
+#define FIX_1_847759065 15137
+#define FIX_1_961570560 16069
+#define FIX_2_053119869 16819
+#define FIX_2_562915447 20995
+#define FIX_3_072711026 25172
+
+/* YCbCr to RGB conversion factors, scaled by 2^16 */
+#define YCC_CR_R  91881			  /* 1.40200 */
+#define YCC_CB_G  22554			  /* 0.34414 */
+#define YCC_CR_G  46802			  /* 0.71414 */
+#define YCC_CB_B 116130			  /* 1.77200 */
+#define YCC_ROUND (1 << 15)
+
+
+/************************************************************************/
+/* TYPES AND STRUCTURES							*/
+/************************************************************************/
+
+/* Huffman table, prepared for fast decoding */
+struct jpg_huff {
+	u_char fast[1 << JPG_FAST_BITS];  /* Symbol index or 255 if longer */
+	u_char size[257];		  /* Code length of each symbol */
+	u_short code[256];		  /* Code of each symbol */
+	u_char values[256];		  /* Symbols */
+	u_int maxcode[18];		  /* Largest code of each length */
+	int delta[17];			  /* Code to symbol index offset */
+};
+
+/* Image component (Y, Cb or Cr) */
+struct jpg_comp {
+	u_char id;			  /* Component ID from SOF */
+	u_char h;			  /* Horizontal sampling factor */
+	u_char v;			  /* Vertical sampling factor */
+	u_char tq;			  /* Quantization table index */
+	u_char td;			  /* DC Huffman table in current scan */
+	u_char ta;			  /* AC Huffman table in current scan */
+	u_char hshift;			  /* log2(hmax/h) */
+	u_char vshift;			  /* log2(vmax/v) */
+	int dc_pred;			  /* DC predictor */
+	u_int bw;			  /* Blocks per row (full MCUs) */
+	u_int bh;			  /* Blocks per column (full MCUs) */
+	u_int nbw;			  /* Blocks per row (non-interleaved) */
+	u_int nbh;			  /* Blocks per column (non-interleaved) */
+	u_int stride;			  /* Bytes per plane row */
+	u_char *plane;			  /* Samples of one MCU row */
+	short *coeffs;			  /* All coefficients (if buffered) */
+};
+
+/* Decoder state */
+struct jpg_dec {
+	/* Entropy decoder */
+	u_char *p;			  /* Next byte of entropy coded data */
+	u_char *end;			  /* End of the JPG data */
+	u_int bitbuf;			  /* Bit buffer, MSB aligned */
+	int bits;			  /* Valid bits in bitbuf */
+	int marker;			  /* 1: hit a marker, feed zeroes */
+	u_int eobrun;			  /* End of band run (progressive) */
+	u_int restart_interval;		  /* MCUs between RST markers */
+	u_int todo;			  /* MCUs left until next RST */
+
+	/* Frame info */
+	u_int width;
+	u_int height;
+	u_int ncomp;
+	u_int hmax;
+	u_int vmax;
+	u_int mcux;			  /* Number of MCUs per row */
+	u_int mcuy;			  /* Number of MCU rows */
+	int progressive;		  /* 1: SOF2 */
+	int buffered;			  /* 1: keep all coefficients */
+	int rgb;			  /* 1: components are R, G, B */
+	struct jpg_comp comp[3];
+
+	/* Scan info */
+	u_int scan_ncomp;
+	u_char scan_comp[3];		  /* Component indexes in scan */
+	u_char ss, se;			  /* Spectral selection */
+	u_char ah, al;			  /* Successive approximation */
+
+	/* Tables */
+	u_short qt[4][64];		  /* Quantization, natural order */
+	struct jpg_huff huff_dc[4];
+	struct jpg_huff huff_ac[4];
+
+	/* Output */
+	imginfo_t *pii;
+	draw_row_func_t draw_row;
+	u_char *rgbrow;			  /* One row as RGB triples */
+	int rowpos;			  /* Bit position of first pixel */
+};
+
+
 /************************************************************************/
 /* LOCAL VARIABLES							*/
 /************************************************************************/
 
+/* Position of the n-th coefficient (zig-zag order) in the 8x8 block; the
+   extra 15 entries catch corrupt run lengths without range checks */
+static const u_char jpg_zigzag[64 + 15] = {
+	 0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+	63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63
+};
+
+
 /************************************************************************/
 /* Local Helper Functions						*/
 /************************************************************************/
 
+/* Get a big endian 16 bit number from address p (may be unaligned) */
+static u_short get_be16(u_char *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+/* Limit value to 0..255 */
+static inline u_char jpg_clamp(int x)
+{
+	if ((u_int)x > 255)
+		x = (x < 0) ? 0 : 255;
+	return (u_char)x;
+}
+
+/* Go to the next marker; return pointer to the 0xFF of the marker or NULL
+   if there is none before end. Fill bytes (0xFF 0xFF), stuffed zeroes (0xFF
+   0x00) and RST markers belong to the entropy coded data and are skipped. */
+static u_char *jpg_next_marker(u_char *p, u_char *end)
+{
+	while (p < end) {
+		if (*p++ != 0xFF)
+			continue;
+		while ((p < end) && (*p == 0xFF))
+			p++;
+		if (p >= end)
+			break;
+		if (*p && ((*p < MARKER_RST0) || (*p > MARKER_RST7)))
+			return p - 1;
+	}
+
+	return NULL;
+}
+
+/* Build Huffman lookup tables from the DHT segment data */
+static int jpg_build_huff(struct jpg_huff *ph, u_char *counts)
+{
+	u_int i, j, k;
+	u_int code;
+
+	/* Collect code lengths */
+	for (i = 0, k = 0; i < 16; i++) {
+		for (j = 0; j < counts[i]; j++) {
+			if (k >= 256)
+				return 1;
+			ph->size[k++] = (u_char)(i + 1);
+		}
+	}
+	ph->size[k] = 0;
+
+	/* Compute canonical codes and the offsets per code length */
+	code = 0;
+	k = 0;
+	for (j = 1; j <= 16; j++) {
+		ph->delta[j] = k - code;
+		if (ph->size[k] == j) {
+			while (ph->size[k] == j)
+				ph->code[k++] = (u_short)(code++);
+			if (code - 1 >= (1u << j))
+				return 1; /* Bad code lengths */
+		}
+		ph->maxcode[j] = code << (16 - j);
+		code <<= 1;
+	}
+	ph->maxcode[17] = 0xFFFFFFFF;
+
+	/* Fill the fast table for all codes up to JPG_FAST_BITS bits */
+	memset(ph->fast, 255, sizeof(ph->fast));
+	for (i = 0; i < k; i++) {
+		u_int s = ph->size[i];
+
+		if (s <= JPG_FAST_BITS) {
+			u_int c = ph->code[i] << (JPG_FAST_BITS - s);
+			u_int m = 1 << (JPG_FAST_BITS - s);
+
+			for (j = 0; j < m; j++)
+				ph->fast[c + j] = (u_char)i;
+		}
+	}
+
+	return 0;
+}
+
+/* Refill the bit buffer so that it holds at least 25 bits; after a marker
+   or at the end of the data, only zero bits are supplied */
+static void jpg_fill(struct jpg_dec *jd)
+{
+	while (jd->bits <= 24) {
+		u_int b = 0;
+
+		if (!jd->marker && (jd->p + 1 < jd->end)) {
+			b = *jd->p;
+			if (b != 0xFF)
+				jd->p++;
+			else if (jd->p[1] == 0)
+				jd->p += 2;	  /* Stuffed zero byte */
+			else {
+				jd->marker = 1;	  /* Leave p at the marker */
+				b = 0;
+			}
+		}
+		jd->bitbuf |= b << (24 - jd->bits);
+		jd->bits += 8;
+	}
+}
+
+/* Get n bits (1 <= n <= 16) as unsigned value */
+static inline u_int jpg_getbits(struct jpg_dec *jd, int n)
+{
+	u_int val;
+
+	if (jd->bits < n)
+		jpg_fill(jd);
+	val = jd->bitbuf >> (32 - n);
+	jd->bitbuf <<= n;
+	jd->bits -= n;
+
+	return val;
+}
+
+/* Get n bits (0 <= n <= 16) and sign-extend them as described in F.2.2.1 */
+static inline int jpg_extend(struct jpg_dec *jd, int n)
+{
+	int val;
+
+	if (!n)
+		return 0;
+	val = (int)jpg_getbits(jd, n);
+	if (val < (1 << (n - 1)))
+		val -= (1 << n) - 1;
+
+	return val;
+}
+
+/* Decode one Huffman coded symbol; return -1 on error */
+static int jpg_decode(struct jpg_dec *jd, const struct jpg_huff *ph)
+{
+	u_int temp;
+	int k, s;
+
+	if (jd->bits < 16)
+		jpg_fill(jd);
+
+	/* Most codes are short and can be looked up directly */
+	k = ph->fast[jd->bitbuf >> (32 - JPG_FAST_BITS)];
+	if (k < 255) {
+		s = ph->size[k];
+		jd->bitbuf <<= s;
+		jd->bits -= s;
+		return ph->values[k];
+	}
+
+	/* Search the code length for longer codes */
+	temp = jd->bitbuf >> 16;
+	for (s = JPG_FAST_BITS + 1; temp >= ph->maxcode[s]; s++)
+		;
+	if (s > 16)
+		return -1;		  /* Invalid code */
+	k = (int)(jd->bitbuf >> (32 - s)) + ph->delta[s];
+	if ((u_int)k > 255)
+		return -1;
+	jd->bitbuf <<= s;
+	jd->bits -= s;
+
+	return ph->values[k];
+}
+
+/* Reset the entropy decoder and the predictors after a RST marker */
+static int jpg_restart(struct jpg_dec *jd)
+{
+	u_char *p = jd->p;
+	u_int i;
+
+	/* The padding bits of the last byte are simply dropped; the bit reader
+	   stops in front of the marker, so we should find it right at p. If
+	   the interval ends with the last MCU of the scan, there is no RST
+	   marker but the next segment; leave it for the segment parser. */
+	for (;;) {
+		if (p + 1 >= jd->end)
+			return 1;	  /* No marker found */
+		if ((p[0] == 0xFF) && (p[1] >= MARKER_RST0)
+		    && (p[1] <= MARKER_RST7)) {
+			p += 2;
+			break;
+		}
+		if ((p[0] == 0xFF) && p[1] && (p[1] != 0xFF))
+			break;
+		p++;
+	}
+	jd->p = p;
+	jd->bitbuf = 0;
+	jd->bits = 0;
+	jd->marker = 0;
+	jd->eobrun = 0;
+	jd->todo = jd->restart_interval;
+	for (i = 0; i < jd->ncomp; i++)
+		jd->comp[i].dc_pred = 0;
+
+	return 0;
+}
+
+/* Check for restart interval after each MCU */
+static int jpg_check_restart(struct jpg_dec *jd)
+{
+	if (!jd->restart_interval || --jd->todo)
+		return 0;
+
+	return jpg_restart(jd);
+}
+
+
+/************************************************************************/
+/* Block decoding							*/
+/************************************************************************/
+
+/* Decode a sequential (baseline) block; coefficients are stored in natural
+   order, not yet dequantized */
+static int jpg_decode_block(struct jpg_dec *jd, struct jpg_comp *pc,
+			    short *data)
+{
+	const struct jpg_huff *hac = &jd->huff_ac[pc->ta];
+	int t, k;
+
+	memset(data, 0, 64 * sizeof(short));
+
+	t = jpg_decode(jd, &jd->huff_dc[pc->td]);
+	if ((t < 0) || (t > 16))
+		return 1;
+	pc->dc_pred += jpg_extend(jd, t);
+	data[0] = (short)pc->dc_pred;
+
+	k = 1;
+	do {
+		int rs = jpg_decode(jd, hac);
+		int r, s;
+
+		if (rs < 0)
+			return 1;
+		r = rs >> 4;
+		s = rs & 15;
+		if (!s) {
+			if (rs != 0xF0)
+				break;		  /* End of block */
+			k += 16;		  /* Run of 16 zeroes */
+		} else {
+			k += r;
+			if (k > 63)
+				return 1;
+			data[jpg_zigzag[k++]] = (short)jpg_extend(jd, s);
+		}
+	} while (k < 64);
+
+	return 0;
+}
+
+/* Decode DC coefficient of a progressive block, first or refining scan */
+static int jpg_decode_dc_prog(struct jpg_dec *jd, struct jpg_comp *pc,
+			      short *data)
+{
+	int t;
+
+	if (jd->ah) {
+		/* Refinement: one more bit of the DC value */
+		if (jpg_getbits(jd, 1))
+			data[0] |= (short)(1 << jd->al);
+		return 0;
+	}
+
+	t = jpg_decode(jd, &jd->huff_dc[pc->td]);
+	if ((t < 0) || (t > 16))
+		return 1;
+	pc->dc_pred += jpg_extend(jd, t);
+	data[0] = (short)(pc->dc_pred * (1 << jd->al));
+
+	return 0;
+}
+
+/* Decode AC coefficients of a progressive block, first or refining scan */
+static int jpg_decode_ac_prog(struct jpg_dec *jd, struct jpg_comp *pc,
+			      short *data)
+{
+	const struct jpg_huff *hac = &jd->huff_ac[pc->ta];
+	int k = jd->ss;
+	int se = jd->se;
+
+	if (!jd->ah) {
+		/* First scan of this band */
+		if (jd->eobrun) {
+			jd->eobrun--;
+			return 0;
+		}
+		do {
+			int rs = jpg_decode(jd, hac);
+			int r, s;
+
+			if (rs < 0)
+				return 1;
+			r = rs >> 4;
+			s = rs & 15;
+			if (!s) {
+				if (r < 15) {
+					/* End of band run */
+					jd->eobrun = 1 << r;
+					if (r)
+						jd->eobrun += jpg_getbits(jd, r);
+					jd->eobrun--;
+					break;
+				}
+				k += 16;
+			} else {
+				k += r;
+				if (k > 63)
+					return 1;
+				data[jpg_zigzag[k++]] =
+					(short)(jpg_extend(jd, s) * (1 << jd->al));
+			}
+		} while (k <= se);
+
+		return 0;
+	}
+
+	/* Refinement scan: add one bit to each nonzero coefficient, place new
+	   coefficients of magnitude 1 in the zero positions */
+	{
+		short bit = (short)(1 << jd->al);
+
+		if (jd->eobrun) {
+			jd->eobrun--;
+			for (; k <= se; k++) {
+				short *p = &data[jpg_zigzag[k]];
+
+				if (*p && jpg_getbits(jd, 1) && !(*p & bit))
+					*p += (*p > 0) ? bit : -bit;
+			}
+			return 0;
+		}
+
+		do {
+			int rs = jpg_decode(jd, hac);
+			int r, s;
+
+			if (rs < 0)
+				return 1;
+			r = rs >> 4;
+			s = rs & 15;
+			if (!s) {
+				if (r < 15) {
+					jd->eobrun = (1 << r) - 1;
+					if (r)
+						jd->eobrun += jpg_getbits(jd, r);
+					r = 64;	  /* Only refine the rest */
+				}
+				/* else: ZRL, skip 16 zero coefficients */
+			} else {
+				if (s != 1)
+					return 1;
+				s = jpg_getbits(jd, 1) ? bit : -bit;
+			}
+
+			while (k <= se) {
+				short *p = &data[jpg_zigzag[k++]];
+
+				if (*p) {
+					if (jpg_getbits(jd, 1) && !(*p & bit))
+						*p += (*p > 0) ? bit : -bit;
+				} else {
+					if (!r) {
+						*p = (short)s;
+						break;
+					}
+					r--;
+				}
+			}
+		} while (k <= se);
+	}
+
+	return 0;
+}
+
+
+/************************************************************************/
+/* IDCT and color conversion						*/
+/************************************************************************/
+
+/* Dequantize and transform one 8x8 block into 8x8 samples at out. Both
+   passes have no data dependent branches and work on eight independent
+   columns/rows, so the compiler can map them to vector registers. */
+static void jpg_idct(const short *in, const u_short *qt, u_char *out,
+		     u_int stride)
+{
+	int ws[64];
+	int i;
+
+	/* Pass 1: columns; results are scaled up by 2^PASS1_BITS */
+	for (i = 0; i < 8; i++) {
+		int tmp0, tmp1, tmp2, tmp3;
+		int tmp10, tmp11, tmp12, tmp13;
+		int z1, z2, z3, z4, z5;
+
+		/* Even part */
+		z2 = in[i + 16] * qt[i + 16];
+		z3 = in[i + 48] * qt[i + 48];
+		z1 = (z2 + z3) * FIX_0_541196100;
+		tmp2 = z1 - z3 * FIX_1_847759065;
+		tmp3 = z1 + z2 * FIX_0_765366865;
+
+		z2 = in[i] * qt[i];
+		z3 = in[i + 32] * qt[i + 32];
+		tmp0 = (z2 + z3) * (1 << CONST_BITS);
+		tmp1 = (z2 - z3) * (1 << CONST_BITS);
+
+		tmp10 = tmp0 + tmp3;
+		tmp13 = tmp0 - tmp3;
+		tmp11 = tmp1 + tmp2;
+		tmp12 = tmp1 - tmp2;
+
+		/* Odd part */
+		tmp0 = in[i + 56] * qt[i + 56];
+		tmp1 = in[i + 40] * qt[i + 40];
+		tmp2 = in[i + 24] * qt[i + 24];
+		tmp3 = in[i + 8] * qt[i + 8];
+
+		z1 = tmp0 + tmp3;
+		z2 = tmp1 + tmp2;
+		z3 = tmp0 + tmp2;
+		z4 = tmp1 + tmp3;
+		z5 = (z3 + z4) * FIX_1_175875602;
+
+		tmp0 *= FIX_0_298631336;
+		tmp1 *= FIX_2_053119869;
+		tmp2 *= FIX_3_072711026;
+		tmp3 *= FIX_1_501321110;
+		z1 *= -FIX_0_899976223;
+		z2 *= -FIX_2_562915447;
+		z3 = z3 * -FIX_1_961570560 + z5;
+		z4 = z4 * -FIX_0_390180644 + z5;
+
+		tmp0 += z1 + z3;
+		tmp1 += z2 + z4;
+		tmp2 += z2 + z3;
+		tmp3 += z1 + z4;
+
+#define DESCALE1(x) (((x) + (1 << (CONST_BITS - PASS1_BITS - 1))) \
+		     >> (CONST_BITS - PASS1_BITS))
+		ws[i] = DESCALE1(tmp10 + tmp3);
+		ws[i + 56] = DESCALE1(tmp10 - tmp3);
+		ws[i + 8] = DESCALE1(tmp11 + tmp2);
+		ws[i + 48] = DESCALE1(tmp11 - tmp2);
+		ws[i + 16] = DESCALE1(tmp12 + tmp1);
+		ws[i + 40] = DESCALE1(tmp12 - tmp1);
+		ws[i + 24] = DESCALE1(tmp13 + tmp0);
+		ws[i + 32] = DESCALE1(tmp13 - tmp0);
+#undef DESCALE1
+	}
+
+	/* Pass 2: rows; remove scaling, add level shift of 128 and clamp */
+	for (i = 0; i < 8; i++, out += stride) {
+		const int *w = &ws[i * 8];
+		int tmp0, tmp1, tmp2, tmp3;
+		int tmp10, tmp11, tmp12, tmp13;
+		int z1, z2, z3, z4, z5;
+
+		/* Even part; the rounding and the level shift are folded into
+		   the DC term */
+		z2 = w[2];
+		z3 = w[6];
+		z1 = (z2 + z3) * FIX_0_541196100;
+		tmp2 = z1 - z3 * FIX_1_847759065;
+		tmp3 = z1 + z2 * FIX_0_765366865;
+
+		z2 = w[0] + ((128 << (PASS1_BITS + 3))
+			     + (1 << (PASS1_BITS + 2)));
+		z3 = w[4];
+		tmp0 = (z2 + z3) * (1 << CONST_BITS);
+		tmp1 = (z2 - z3) * (1 << CONST_BITS);
+
+		tmp10 = tmp0 + tmp3;
+		tmp13 = tmp0 - tmp3;
+		tmp11 = tmp1 + tmp2;
+		tmp12 = tmp1 - tmp2;
+
+		/* Odd part */
+		tmp0 = w[7];
+		tmp1 = w[5];
+		tmp2 = w[3];
+		tmp3 = w[1];
+
+		z1 = tmp0 + tmp3;
+		z2 = tmp1 + tmp2;
+		z3 = tmp0 + tmp2;
+		z4 = tmp1 + tmp3;
+		z5 = (z3 + z4) * FIX_1_175875602;
+
+		tmp0 *= FIX_0_298631336;
+		tmp1 *= FIX_2_053119869;
+		tmp2 *= FIX_3_072711026;
+		tmp3 *= FIX_1_501321110;
+		z1 *= -FIX_0_899976223;
+		z2 *= -FIX_2_562915447;
+		z3 = z3 * -FIX_1_961570560 + z5;
+		z4 = z4 * -FIX_0_390180644 + z5;
+
+		tmp0 += z1 + z3;
+		tmp1 += z2 + z4;
+		tmp2 += z2 + z3;
+		tmp3 += z1 + z4;
+
+#define DESCALE2(x) jpg_clamp((x) >> (CONST_BITS + PASS1_BITS + 3))
+		out[0] = DESCALE2(tmp10 + tmp3);
+		out[7] = DESCALE2(tmp10 - tmp3);
+		out[1] = DESCALE2(tmp11 + tmp2);
+		out[6] = DESCALE2(tmp11 - tmp2);
+		out[2] = DESCALE2(tmp12 + tmp1);
+		out[5] = DESCALE2(tmp12 - tmp1);
+		out[3] = DESCALE2(tmp13 + tmp0);
+		out[4] = DESCALE2(tmp13 - tmp0);
+#undef DESCALE2
+	}
+}
+
+/* Convert row r of the current MCU row to RGB; chroma is upsampled by
+   replicating samples */
+static void jpg_color_row(struct jpg_dec *jd, u_int r)
+{
+	struct jpg_comp *pc = jd->comp;
+	u_char *py = pc[0].plane + (r >> pc[0].vshift) * pc[0].stride;
+	u_char *out = jd->rgbrow;
+	u_int width = jd->width;
+	u_int x;
+
+	if (jd->ncomp == 1) {
+		for (x = 0; x < width; x++, out += 3) {
+			out[0] = py[x];
+			out[1] = py[x];
+			out[2] = py[x];
+		}
+	} else if (jd->rgb) {
+		u_char *pg = pc[1].plane + (r >> pc[1].vshift) * pc[1].stride;
+		u_char *pb = pc[2].plane + (r >> pc[2].vshift) * pc[2].stride;
+
+		for (x = 0; x < width; x++, out += 3) {
+			out[0] = py[x >> pc[0].hshift];
+			out[1] = pg[x >> pc[1].hshift];
+			out[2] = pb[x >> pc[2].hshift];
+		}
+	} else {
+		u_char *pcb = pc[1].plane + (r >> pc[1].vshift) * pc[1].stride;
+		u_char *pcr = pc[2].plane + (r >> pc[2].vshift) * pc[2].stride;
+		u_int ys = pc[0].hshift;
+		u_int cbs = pc[1].hshift;
+		u_int crs = pc[2].hshift;
+
+		for (x = 0; x < width; x++, out += 3) {
+			int y = py[x >> ys] << 16;
+			int cb = pcb[x >> cbs] - 128;
+			int cr = pcr[x >> crs] - 128;
+
+			y += YCC_ROUND;
+			out[0] = jpg_clamp((y + YCC_CR_R * cr) >> 16);
+			out[1] = jpg_clamp((y - YCC_CB_G * cb - YCC_CR_G * cr)
+					   >> 16);
+			out[2] = jpg_clamp((y + YCC_CB_B * cb) >> 16);
+		}
+	}
+}
+
+/* Draw all image rows of the given MCU row; return 1 if the last row of the
+   visible bitmap area was drawn */
+static int jpg_draw_mcu_row(struct jpg_dec *jd, u_int mcu_y)
+{
+	imginfo_t *pii = jd->pii;
+	u_int rows = jd->vmax * 8;
+	u_int r;
+
+	if ((mcu_y + 1) * rows > jd->height)
+		rows = jd->height - mcu_y * rows;
+
+	for (r = 0; r < rows; r++) {
+		jpg_color_row(jd, r);
+
+		/* If row is in framebuffer range, draw it */
+		do {
+			XYPOS y = pii->y + pii->ypix;
+			if (y >= 0) {
+				u_long fbuf;
+
+				fbuf = y*pii->pwi->linelen + pii->fbuf;
+				pii->rowshift = 8 - (jd->rowpos & 7);
+				pii->prow = jd->rgbrow + (jd->rowpos >> 3);
+				jd->draw_row(pii, (COLOR32 *)fbuf);
+			}
+			if (++pii->ypix >= pii->yend)
+				return 1;
+		} while (pii->ypix % pii->multiheight);
+		WATCHDOG_RESET();
+	}
+
+	return 0;
+}
+
+
+/************************************************************************/
+/* Segment and scan handling						*/
+/************************************************************************/
+
+/* Read DQT segment; it may hold several tables */
+static const char *jpg_read_dqt(struct jpg_dec *jd, u_char *p, u_char *end)
+{
+	while (p < end) {
+		u_int pq = p[0] >> 4;
+		u_int tq = p[0] & 15;
+		u_int i;
+
+		if ((tq > 3) || (end - p < 1 + 64 * (pq ? 2 : 1)))
+			return "Invalid JPG quantization table\n";
+		p++;
+		for (i = 0; i < 64; i++) {
+			u_int val;
+
+			if (pq) {
+				val = get_be16(p);
+				p += 2;
+			} else
+				val = *p++;
+			jd->qt[tq][jpg_zigzag[i]] = (u_short)val;
+		}
+	}
+
+	return NULL;
+}
+
+/* Read DHT segment; it may hold several tables */
+static const char *jpg_read_dht(struct jpg_dec *jd, u_char *p, u_char *end)
+{
+	while (p < end) {
+		u_int tc = p[0] >> 4;
+		u_int th = p[0] & 15;
+		struct jpg_huff *ph;
+		u_int i, n;
+
+		if ((tc > 1) || (th > 3) || (end - p < 17))
+			return "Invalid JPG Huffman table\n";
+		ph = tc ? &jd->huff_ac[th] : &jd->huff_dc[th];
+		for (i = 0, n = 0; i < 16; i++)
+			n += p[1 + i];
+		if ((n > 256) || (end - p < 17 + n)
+		    || jpg_build_huff(ph, p + 1))
+			return "Invalid JPG Huffman table\n";
+		memcpy(ph->values, p + 17, n);
+		p += 17 + n;
+	}
+
+	return NULL;
+}
+
+/* Read SOF segment and prepare component geometry */
+static const char *jpg_read_sof(struct jpg_dec *jd, u_char *p, u_char *end)
+{
+	u_int i;
+
+	if ((end - p < 6) || (end - p < 6 + 3 * p[5]))
+		return "Invalid JPG frame header\n";
+	if (p[0] != 8)
+		return "Unsupported JPG bit depth\n";
+	jd->height = get_be16(p + 1);
+	jd->width = get_be16(p + 3);
+	jd->ncomp = p[5];
+	if (!jd->width || !jd->height)
+		return "Invalid JPG image size\n";
+	if ((jd->ncomp != 1) && (jd->ncomp != 3))
+		return "Unsupported JPG color space\n";
+
+	p += 6;
+	jd->hmax = 1;
+	jd->vmax = 1;
+	for (i = 0; i < jd->ncomp; i++, p += 3) {
+		struct jpg_comp *pc = &jd->comp[i];
+
+		pc->id = p[0];
+		pc->h = p[1] >> 4;
+		pc->v = p[1] & 15;
+		pc->tq = p[2] & 3;
+		if ((pc->h != 1) && (pc->h != 2) && (pc->h != 4))
+			return "Unsupported JPG sampling factors\n";
+		if ((pc->v != 1) && (pc->v != 2) && (pc->v != 4))
+			return "Unsupported JPG sampling factors\n";
+		if (jd->ncomp == 1)
+			pc->h = pc->v = 1; /* Non-interleaved: MCU = block */
+		if (pc->h > jd->hmax)
+			jd->hmax = pc->h;
+		if (pc->v > jd->vmax)
+			jd->vmax = pc->v;
+	}
+
+	/* Some encoders store RGB directly and mark it by component IDs */
+	if ((jd->ncomp == 3) && (jd->comp[0].id == 'R')
+	    && (jd->comp[1].id == 'G') && (jd->comp[2].id == 'B'))
+		jd->rgb = 1;
+
+	jd->mcux = (jd->width + jd->hmax * 8 - 1) / (jd->hmax * 8);
+	jd->mcuy = (jd->height + jd->vmax * 8 - 1) / (jd->vmax * 8);
+	for (i = 0; i < jd->ncomp; i++) {
+		struct jpg_comp *pc = &jd->comp[i];
+		u_int cw, ch;
+
+		pc->hshift = ffs(jd->hmax / pc->h) - 1;
+		pc->vshift = ffs(jd->vmax / pc->v) - 1;
+		if ((pc->h << pc->hshift != jd->hmax)
+		    || (pc->v << pc->vshift != jd->vmax))
+			return "Unsupported JPG sampling factors\n";
+		cw = (jd->width * pc->h + jd->hmax - 1) / jd->hmax;
+		ch = (jd->height * pc->v + jd->vmax - 1) / jd->vmax;
+		pc->nbw = (cw + 7) / 8;
+		pc->nbh = (ch + 7) / 8;
+		pc->bw = jd->mcux * pc->h;
+		pc->bh = jd->mcuy * pc->v;
+		pc->stride = pc->bw * 8;
+		pc->plane = malloc(pc->stride * pc->v * 8);
+		if (!pc->plane)
+			return "Can't allocate decode buffer for JPG data\n";
+	}
+
+	jd->rgbrow = malloc(jd->width * 3);
+	if (!jd->rgbrow)
+		return "Can't allocate decode buffer for JPG data\n";
+
+	return NULL;
+}
+
+/* Read SOS segment header */
+static const char *jpg_read_sos(struct jpg_dec *jd, u_char *p, u_char *end)
+{
+	u_int i, j;
+
+	if (p >= end)
+		return "Invalid JPG scan\n";
+	jd->scan_ncomp = *p++;
+	if (!jd->scan_ncomp || (jd->scan_ncomp > jd->ncomp)
+	    || (end - p < 2 * jd->scan_ncomp + 3))
+		return "Invalid JPG scan\n";
+	for (i = 0; i < jd->scan_ncomp; i++, p += 2) {
+		struct jpg_comp *pc;
+
+		for (j = 0; j < jd->ncomp; j++) {
+			if (jd->comp[j].id == p[0])
+				break;
+		}
+		if (j >= jd->ncomp)
+			return "Invalid JPG scan\n";
+		pc = &jd->comp[j];
+		pc->td = (p[1] >> 4) & 3;
+		pc->ta = p[1] & 3;
+		jd->scan_comp[i] = (u_char)j;
+	}
+	jd->ss = p[0];
+	jd->se = p[1];
+	jd->ah = p[2] >> 4;
+	jd->al = p[2] & 15;
+
+	if (jd->progressive) {
+		if ((jd->ss > jd->se) || (jd->se > 63) || (jd->al > 13))
+			return "Invalid JPG progressive scan\n";
+		if (jd->ss && (jd->scan_ncomp != 1))
+			return "Invalid JPG progressive scan\n";
+		if (!jd->ss && jd->se)
+			return "Invalid JPG progressive scan\n";
+	}
+
+	return NULL;
+}
+
+/* Decode one block in buffered mode */
+static int jpg_decode_buffered(struct jpg_dec *jd, struct jpg_comp *pc,
+			       short *data)
+{
+	if (!jd->progressive)
+		return jpg_decode_block(jd, pc, data);
+	if (!jd->ss)
+		return jpg_decode_dc_prog(jd, pc, data);
+	return jpg_decode_ac_prog(jd, pc, data);
+}
+
+/* Decode a scan into the coefficient buffers (progressive images or
+   sequential images with separate scans per component) */
+static const char *jpg_scan_buffered(struct jpg_dec *jd)
+{
+	u_int mx, my;
+
+	if (jd->scan_ncomp == 1) {
+		/* Non-interleaved: MCU is a single block */
+		struct jpg_comp *pc = &jd->comp[jd->scan_comp[0]];
+
+		for (my = 0; my < pc->nbh; my++) {
+			for (mx = 0; mx < pc->nbw; mx++) {
+				short *data = pc->coeffs;
+
+				data += (my * pc->bw + mx) * 64;
+				if (jpg_decode_buffered(jd, pc, data))
+					return "Corrupt JPG data\n";
+				if (jpg_check_restart(jd))
+					return "Corrupt JPG data\n";
+			}
+			WATCHDOG_RESET();
+		}
+		return NULL;
+	}
+
+	/* Interleaved: each MCU holds h x v blocks of each component */
+	for (my = 0; my < jd->mcuy; my++) {
+		for (mx = 0; mx < jd->mcux; mx++) {
+			u_int i, bx, by;
+
+			for (i = 0; i < jd->scan_ncomp; i++) {
+				struct jpg_comp *pc;
+
+				pc = &jd->comp[jd->scan_comp[i]];
+				for (by = 0; by < pc->v; by++) {
+					for (bx = 0; bx < pc->h; bx++) {
+						short *data = pc->coeffs;
+						u_int row = my * pc->v + by;
+						u_int col = mx * pc->h + bx;
+
+						data += (row * pc->bw + col)*64;
+						if (jpg_decode_buffered(jd, pc,
+									data))
+							return "Corrupt JPG "
+								"data\n";
+					}
+				}
+			}
+			if (jpg_check_restart(jd))
+				return "Corrupt JPG data\n";
+		}
+		WATCHDOG_RESET();
+	}
+
+	return NULL;
+}
+
+/* Decode an interleaved sequential scan and draw each MCU row as soon as it
+   is complete; return 1 in *done if all visible rows are drawn */
+static const char *jpg_scan_streaming(struct jpg_dec *jd, int *done)
+{
+	short data[64];
+	u_int mx, my;
+
+	for (my = 0; my < jd->mcuy; my++) {
+		for (mx = 0; mx < jd->mcux; mx++) {
+			u_int i, bx, by;
+
+			for (i = 0; i < jd->scan_ncomp; i++) {
+				struct jpg_comp *pc;
+
+				pc = &jd->comp[jd->scan_comp[i]];
+				for (by = 0; by < pc->v; by++) {
+					for (bx = 0; bx < pc->h; bx++) {
+						u_char *out = pc->plane;
+
+						if (jpg_decode_block(jd, pc,
+								     data))
+							return "Corrupt JPG "
+								"data\n";
+						out += by * 8 * pc->stride;
+						out += (mx * pc->h + bx) * 8;
+						jpg_idct(data, jd->qt[pc->tq],
+							 out, pc->stride);
+					}
+				}
+			}
+			if (jpg_check_restart(jd))
+				return "Corrupt JPG data\n";
+		}
+		if (jpg_draw_mcu_row(jd, my)) {
+			*done = 1;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/* Transform and draw the buffered coefficients after the last scan */
+static void jpg_draw_buffered(struct jpg_dec *jd)
+{
+	u_int my, i, bx, by;
+
+	for (my = 0; my < jd->mcuy; my++) {
+		for (i = 0; i < jd->ncomp; i++) {
+			struct jpg_comp *pc = &jd->comp[i];
+
+			for (by = 0; by < pc->v; by++) {
+				short *data = pc->coeffs;
+				u_char *out = pc->plane + by * 8 * pc->stride;
+
+				data += (my * pc->v + by) * pc->bw * 64;
+				for (bx = 0; bx < pc->bw; bx++) {
+					jpg_idct(data, jd->qt[pc->tq],
+						 out, pc->stride);
+					data += 64;
+					out += 8;
+				}
+			}
+		}
+		if (jpg_draw_mcu_row(jd, my))
+			break;
+	}
+}
+
+/* Allocate coefficient buffers for buffered mode */
+static const char *jpg_alloc_coeffs(struct jpg_dec *jd)
+{
+	u_int i;
+
+	for (i = 0; i < jd->ncomp; i++) {
+		struct jpg_comp *pc = &jd->comp[i];
+		u_int size = pc->bw * pc->bh * 64 * sizeof(short);
+
+		pc->coeffs = malloc(size);
+		if (!pc->coeffs)
+			return "Can't allocate coefficient buffer for JPG\n";
+		memset(pc->coeffs, 0, size);
+	}
+	jd->buffered = 1;
+
+	return NULL;
+}
+
+/* Free all buffers of the decoder */
+static void jpg_free(struct jpg_dec *jd)
+{
+	u_int i;
+
+	for (i = 0; i < ARRAY_SIZE(jd->comp); i++) {
+		free(jd->comp[i].plane);
+		free(jd->comp[i].coeffs);
+	}
+	free(jd->rgbrow);
+	free(jd);
+}
+
+
 /************************************************************************/
 /* Exported functions							*/
 /************************************************************************/
 
-/* Draw JPG image */
+/* Draw JPG image. A JPG image is a sequence of segments, each starting with a
+   marker (0xFF followed by the marker type). Most segments have a 16 bit
+   length after the marker. The image starts with SOI and ends with EOI. In
+   between there are tables (DQT, DHT, DRI), the frame header (SOFn) and one
+   or more scans (SOS). Each scan is followed by the entropy coded data.
+
+   The image is divided into 8x8 blocks of each color component (Y, Cb, Cr),
+   where the chroma components may be subsampled. A minimum coded unit (MCU)
+   holds the blocks of all components that cover the same image area. Each
+   block is transmitted as Huffman coded DCT coefficients.
+
+   For baseline images, all components are interleaved in a single scan.
+   Here we can decode one row of MCUs, transform it and draw the rows
+   immediately, so only one MCU row needs to be buffered. Progressive images
+   and images with separate scans per component spread the coefficients of
+   each block over several scans. Then we keep all coefficients in RAM and
+   transform and draw the image after the last scan.
+
+   We do not support arithmetic coding, lossless and hierarchical JPG images,
+   12 bit precision or CMYK images. These make no sense for splash screens on
+   embedded hardware. */
 const char *draw_jpg(imginfo_t *pii, u_long addr)
 {
-	/* TODO: add JPG support; don't forget to trigger the watchdog with
-	   WATCHDOG_RESET() after each row. */
-	return "JPG images not yet supported";
+	struct jpg_dec *jd;
+	const char *errmsg = NULL;
+	u_char *p;
+	int done = 0;
+	int have_frame = 0;
+	static const draw_row_func_t draw_row_tab[] = {
+#ifdef CONFIG_CMD_DRAW
+		draw_ll_row_RGB,	  /* ATTR_ALPHA = 0 */
+#endif
+#ifdef CONFIG_CMD_ADRAW
+		adraw_ll_row_RGB,	  /* ATTR_ALPHA = 1 */
+#endif
+	};
+
+	jd = malloc(sizeof(struct jpg_dec));
+	if (!jd)
+		return "Can't allocate decode buffer for JPG data\n";
+	memset(jd, 0, sizeof(struct jpg_dec));
+
+	/* We always decode to RGB; grayscale is expanded */
+	jd->pii = pii;
+#if defined(CONFIG_CMD_DRAW) && defined(CONFIG_CMD_ADRAW)
+	jd->draw_row = draw_row_tab[pii->applyalpha];
+#else
+	jd->draw_row = draw_row_tab[0];
+#endif
+#ifdef CONFIG_CMD_DRAW
+	if (!pii->applyalpha && (pii->bpp == 32) && (pii->multiwidth == 1))
+		jd->draw_row = draw_ll_row_RGB_32;
+#endif
+	jd->rowpos = (pii->xpix / pii->multiwidth) * 24;
+	pii->rowmask = 0xFF;
+	pii->rowbitdepth = 8;
+
+	WATCHDOG_RESET();
+
+	/* Parse the segments; lcd_scan_bitmap() has found the end of the
+	   image, but the data in between may still be corrupt, so never read
+	   beyond the end */
+	jd->end = (u_char *)pii->end;
+	p = (u_char *)addr + 2;		  /* Skip SOI */
+	while (!errmsg && !done) {
+		u_char marker;
+		u_char *seg;
+		u_char *next;
+
+		while ((p < jd->end) && (*p == 0xFF))
+			p++;
+		if (p >= jd->end) {
+			errmsg = "Corrupt JPG data\n";
+			break;
+		}
+		marker = *p++;
+		if (marker == MARKER_EOI)
+			break;
+		if ((marker >= MARKER_RST0) && (marker <= MARKER_RST7))
+			continue;	  /* Stray RST marker, no length */
+		if (jd->end - p < 2) {
+			errmsg = "Corrupt JPG data\n";
+			break;
+		}
+		seg = p + 2;
+		next = p + get_be16(p);
+		if ((next < seg) || (next > jd->end)) {
+			errmsg = "Corrupt JPG data\n";
+			break;
+		}
+		p = next;
+
+		switch (marker) {
+		case MARKER_DQT:
+			errmsg = jpg_read_dqt(jd, seg, next);
+			break;
+
+		case MARKER_DHT:
+			errmsg = jpg_read_dht(jd, seg, next);
+			break;
+
+		case MARKER_DRI:
+			if (next - seg < 2) {
+				errmsg = "Corrupt JPG data\n";
+				break;
+			}
+			jd->restart_interval = get_be16(seg);
+			break;
+
+		case MARKER_APP14:
+			/* Adobe marker, transform 0 means RGB (or CMYK) */
+			if ((next - seg >= 12) && !memcmp(seg, "Adobe", 5)
+			    && !seg[11])
+				jd->rgb = 1;
+			break;
+
+		case MARKER_SOF0:
+		case MARKER_SOF1:
+		case MARKER_SOF2:
+			if (have_frame) {
+				errmsg = "Invalid JPG image\n";
+				break;
+			}
+			have_frame = 1;
+			jd->progressive = (marker == MARKER_SOF2);
+			errmsg = jpg_read_sof(jd, seg, next);
+			break;
+
+		case MARKER_SOS:
+			if (!have_frame) {
+				errmsg = "Invalid JPG image\n";
+				break;
+			}
+			errmsg = jpg_read_sos(jd, seg, next);
+			if (errmsg)
+				break;
+
+			/* Start entropy decoder */
+			jd->bitbuf = 0;
+			jd->bits = 0;
+			jd->marker = 0;
+			jd->eobrun = 0;
+			jd->todo = jd->restart_interval;
+			{
+				u_int i;
+
+				for (i = 0; i < jd->ncomp; i++)
+					jd->comp[i].dc_pred = 0;
+			}
+
+			/* A single interleaved sequential scan can be drawn
+			   while decoding, everything else must be buffered */
+			if (!jd->buffered && !jd->progressive
+			    && (jd->scan_ncomp == jd->ncomp)) {
+				jd->p = next;
+				errmsg = jpg_scan_streaming(jd, &done);
+				if (!errmsg)
+					done = 1;
+				break;
+			}
+			if (!jd->buffered)
+				errmsg = jpg_alloc_coeffs(jd);
+			if (errmsg)
+				break;
+			jd->p = next;
+			errmsg = jpg_scan_buffered(jd);
+			if (errmsg)
+				break;
+			p = jpg_next_marker(jd->p, jd->end);
+			if (!p)
+				errmsg = "Corrupt JPG data\n";
+			break;
+
+		default:
+			/* Lossless, hierarchical and arithmetic coding */
+			if (((marker & 0xF0) == 0xC0) && (marker != MARKER_JPG))
+				errmsg = "Unsupported JPG coding method\n";
+			/* Ignore all other segments (APPn, COM, ...) */
+			break;
+		}
+	}
+
+	if (!errmsg && jd->buffered)
+		jpg_draw_buffered(jd);
+
+	jpg_free(jd);
+
+	return errmsg;
 }
 
 
 /* Get a bminfo structure with JPG bitmap information */
 int get_bminfo_jpg(bminfo_t *pbi, u_long addr)
 {
-	if (1)
+	u_char *p = (u_char *)addr;
+
+	/* Check for SOI marker followed by another marker */
+	if ((p[0] != 0xFF) || (p[1] != MARKER_SOI) || (p[2] != 0xFF))
 		return 0;
 
-	/* TODO: add JPG support */
+	/* Find the frame header; it must come before the first scan */
+	p += 2;
+	for (;;) {
+		u_char marker;
+
+		while (*p == 0xFF)
+			p++;
+		marker = *p++;
+		if ((marker == MARKER_SOS) || (marker == MARKER_EOI))
+			return 0;
+		if (get_be16(p) < 2)
+			return 0;
+		if (((marker & 0xF0) == 0xC0) && (marker != MARKER_DHT)
+		    && (marker != MARKER_JPG) && (marker != MARKER_DAC))
+			break;
+		p += get_be16(p);
+	}
+	if (get_be16(p) < 8)
+		return 0;
+
+	/* The SOF structure consists of
+	     Offset 0: length (2 bytes)
+	     Offset 2: sample precision (1 byte)
+	     Offset 3: height (2 bytes)
+	     Offset 5: width (2 bytes)
+	     Offset 7: number of components (1 byte)
+	   followed by 3 bytes for each component. We only show progressive
+	   images as interlaced here. */
+	pbi->type = BT_JPG;
+	pbi->colortype = (p[7] == 1) ? CT_GRAY :
+		(p[7] == 3) ? CT_TRUECOL : CT_UNKNOWN;
+	pbi->bitdepth = p[2];
+	pbi->flags = BF_COMPRESSED;
+	if (p[-1] == MARKER_SOF2)
+		pbi->flags |= BF_INTERLACED;
+	pbi->hres = (XYPOS)get_be16(p + 5);
+	pbi->vres = (XYPOS)get_be16(p + 3);
+
 	return 1;
 }
 
@@ -62,11 +1359,44 @@ int get_bminfo_jpg(bminfo_t *pbi, u_long addr)
 /* Scan integrity of a JPG bitmap and return end address */
 u_long scan_jpg(u_long addr)
 {
-	if (1)
+	u_char *p = (u_char *)addr;
+
+	/* Check for SOI marker followed by another marker */
+	if ((p[0] != 0xFF) || (p[1] != MARKER_SOI) || (p[2] != 0xFF))
 		return 0;
 
-	/* TODO: Add support for scanning a JPG bitmap */
-	return addr;
+	/* Walk the segments until EOI is encountered; after each SOS we have
+	   to skip the entropy coded data, which has no length field. */
+	p += 2;
+	for (;;) {
+		u_char marker;
+		u_int len;
+
+		if (*p != 0xFF)
+			return 0;	  /* Invalid segment header */
+		while (*p == 0xFF)
+			p++;
+		marker = *p++;
+		if (marker == MARKER_EOI)
+			break;
+		if (!marker || (marker == MARKER_SOI))
+			return 0;
+		if ((marker >= MARKER_RST0) && (marker <= MARKER_RST7))
+			continue;
+		len = get_be16(p);
+		if (len < 2)
+			return 0;
+		p += len;
+		if (marker == MARKER_SOS) {
+			/* The caller gives no size, so we can only rely on
+			   the structure of the data to find the end */
+			p = jpg_next_marker(p, (u_char *)ULONG_MAX);
+			if (!p)
+				return 0;
+		}
+	}
+
+	return (u_long)p;
 }
 
 #endif /* CONFIG_XLCD_DRAW & XLCD_DRAW_BITMAP */
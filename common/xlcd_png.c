@@ -26,10 +26,6 @@
 
 #if CONFIG_XLCD_DRAW & XLCD_DRAW_BITMAP
 
-extern void *zalloc(void *, unsigned, unsigned);
-extern void zfree(void *, void *, unsigned);
-
-
 /************************************************************************/
 /* DEFINITIONS								*/
 /************************************************************************/
@@ -54,6 +50,14 @@ extern void zfree(void *, void *, unsigned);
 #define CHUNK_pHYs 0x70485973		  /* "pHYs" Physical pixel size */
 #define CHUNK_sPLT 0x73504C54		  /* "sPLT" Suggested palette */
 
+/* Constants for byte-wise arithmetic on whole words */
+#define PNG_LOBITS (~0UL / 0xFF)	  /* 0x0101...01 */
+#define PNG_HIBITS (PNG_LOBITS * 0x80)	  /* 0x8080...80 */
+
+/* Each row in the ring buffer is preceded by PNG_ROW_HDR bytes, the last of
+   them holds the filter type; this keeps the row data word aligned */
+#define PNG_ROW_HDR 8
+
 
 /************************************************************************/
 /* LOCAL VARIABLES							*/
@@ -84,25 +88,129 @@ static u_short get_be16(u_char *p)
 	return (p[0] << 8) | p[1];
 }
 
-/* Special so-called paeth predictor for PNG line filtering */
-static u_char paeth(u_char a, u_char b, u_char c)
+/* Add the bytes of two words, without carry from one byte to the next */
+static inline u_long png_addb(u_long a, u_long b)
 {
-	int p = a + b - c;
-	int pa = p - a;
-	int pb = p - b;
-	int pc = p - c;
-	if (pa < 0)
-		pa = -pa;
-	if (pb < 0)
-		pb = -pb;
-	if (pc < 0)
-		pc = -pc;
-
-	if ((pa <= pb) && (pa <= pc))
-		return a;
-	if (pb <= pc)
-		return b;
-	return c;
+	return ((a & ~PNG_HIBITS) + (b & ~PNG_HIBITS)) ^ ((a ^ b) & PNG_HIBITS);
+}
+
+/* Same for 32 bit words, i.e. one RGBA pixel */
+static inline u32 png_addb32(u32 a, u32 b)
+{
+	return ((a & 0x7F7F7F7F) + (b & 0x7F7F7F7F)) ^ ((a ^ b) & 0x80808080);
+}
+
+/* Average of the bytes of two 32 bit words, rounded down */
+static inline u32 png_avgb32(u32 a, u32 b)
+{
+	return (a & b) + (((a ^ b) & 0xFEFEFEFE) >> 1);
+}
+
+/* Special so-called paeth predictor for PNG line filtering; the
+   differences p-a, p-b and p-c can be computed directly from a, b and c. The
+   selection is written so that it compiles to conditional moves instead of
+   (badly predictable) branches. */
+static inline u_char paeth(int a, int b, int c)
+{
+	int pa = abs(b - c);
+	int pb = abs(a - c);
+	int pc = abs(a + b - 2*c);
+	int bc = (pb <= pc) ? b : c;
+
+	if (pc < pb)
+		pb = pc;
+	return (pa <= pb) ? a : bc;
+}
+
+/* Undo the PNG row filter. Rows in the ring buffer are word aligned and
+   padded to a multiple of 8 bytes, so the kernels may process whole words;
+   pc is the current row, pp the previous row and fsize the size of one
+   filter unit (bytes per full pixel, at least 1). */
+static void png_unfilter(u_char filtertype, u_char *pc, const u_char *pp,
+			 u_int rowlen, u_int fsize)
+{
+	u_int i;
+
+	switch (filtertype) {
+	case 0:				  /* none */
+		break;
+
+	case 1:				  /* sub */
+		if (fsize == 4) {
+			/* One RGBA pixel per word, all bytes in parallel */
+			u32 *wc = (u32 *)pc;
+			u32 left = 0;
+
+			for (i = 0; i < rowlen/4; i++)
+				left = wc[i] = png_addb32(wc[i], left);
+		} else {
+			for (i = fsize; i < rowlen; i++)
+				pc[i] += pc[i-fsize];
+		}
+		break;
+
+	case 2:				  /* up */
+	{
+		u_long *wc = (u_long *)pc;
+		const u_long *wp = (const u_long *)pp;
+		u_int words = (rowlen + sizeof(u_long) - 1) / sizeof(u_long);
+
+		for (i = 0; i < words; i++)
+			wc[i] = png_addb(wc[i], wp[i]);
+		break;
+	}
+
+	case 3:				  /* average */
+		if (fsize == 4) {
+			u32 *wc = (u32 *)pc;
+			const u32 *wp = (const u32 *)pp;
+			u32 left = 0;
+
+			for (i = 0; i < rowlen/4; i++) {
+				left = png_avgb32(left, wp[i]);
+				left = wc[i] = png_addb32(wc[i], left);
+			}
+		} else {
+			for (i = 0; i < fsize; i++)
+				pc[i] += pp[i]/2;
+			for (; i < rowlen; i++)
+				pc[i] += (pc[i-fsize] + pp[i])/2;
+		}
+		break;
+
+	case 4:				  /* paeth */
+		/* paeth(0, b, 0) is always b */
+		for (i = 0; i < fsize; i++)
+			pc[i] += pp[i];
+		switch (fsize) {
+		case 3:
+			for (; i < rowlen; i += 3) {
+				pc[i] += paeth(pc[i-3], pp[i], pp[i-3]);
+				pc[i+1] += paeth(pc[i-2], pp[i+1],
+						 pp[i-2]);
+				pc[i+2] += paeth(pc[i-1], pp[i+2],
+						 pp[i-1]);
+			}
+			break;
+		case 4:
+			for (; i < rowlen; i += 4) {
+				pc[i] += paeth(pc[i-4], pp[i], pp[i-4]);
+				pc[i+1] += paeth(pc[i-3], pp[i+1],
+						 pp[i-3]);
+				pc[i+2] += paeth(pc[i-2], pp[i+2],
+						 pp[i-2]);
+				pc[i+3] += paeth(pc[i-1], pp[i+3],
+						 pp[i-1]);
+			}
+			break;
+		default:
+			for (; i < rowlen; i++)
+				pc[i] += paeth(pc[i-fsize], pp[i],
+					       pp[i-fsize]);
+			break;
+		}
+		break;
+	}
 }
 
 
@@ -133,6 +241,11 @@ static u_char paeth(u_char a, u_char b, u_char c)
    pixel, or (if pixels are smaller than 1 byte) on full bytes. This makes
    applying the reverse filter here during decoding rather simple.
 
+   We inflate each row directly into a ring buffer of two rows, the current
+   row and the previous row that is needed as reference by the filters. The
+   filters are undone with word-wide kernels where possible and the rows are
+   drawn immediately, so the whole image is never kept in RAM.
+
    We do not support images with 16 bits per color channel and we don't
    support interlaced images. These image types make no sense with our
    embedded hardware. If you have such bitmaps, you have to convert them
@@ -141,7 +254,8 @@ const char *draw_png(imginfo_t *pii, u_long addr)
 {
 	u_char colortype;
 	u_char bitdepth;
-	int current;
+	u_int current;			  /* Offset of current row slot */
+	u_int slotlen;			  /* Size of one row slot */
 	u_int pixelsize;		  /* Size of one full pixel (bits) */
 	u_int fsize;			  /* Size of one filter unit */
 	u_int rowlen;
@@ -206,9 +320,10 @@ const char *draw_png(imginfo_t *pii, u_long addr)
 		pixelsize = bitdepth;	  /* index or gray */
 	rowlen = (pii->bi.hres * pixelsize + 7) / 8; /* round to bytes */
 
-	/* Allocate row buffer for decoding two rows of the bitmap; we need
-	   one additional byte per row for the filter type */
-	prow = malloc(2*rowlen+2);
+	/* Allocate ring buffer for decoding two rows of the bitmap; each slot
+	   has a header for the filter type and is padded to whole words */
+	slotlen = ALIGN(rowlen, 8) + PNG_ROW_HDR;
+	prow = malloc(2*slotlen);
 	if (!prow)
 		return "Can't allocate decode buffer for PNG data";
 
@@ -228,6 +343,32 @@ const char *draw_png(imginfo_t *pii, u_long addr)
 		draw_row = draw_row_tab[pii->applyalpha][temp];
 #else
 		draw_row = draw_row_tab[0][temp];
+#endif
+#ifdef CONFIG_CMD_DRAW
+		/* Use specialized row writers for the most common case of a
+		   32bpp framebuffer without horizontal scaling */
+		if (!pii->applyalpha && (pii->bpp == 32)
+		    && (pii->multiwidth == 1)) {
+			if (temp == CT_GRAY)
+				draw_row = draw_ll_row_PAL8_32;
+			else if (temp == CT_GRAY_ALPHA)
+				draw_row = draw_ll_row_GA_32;
+			else if (temp == CT_TRUECOL)
+				draw_row = draw_ll_row_RGB_32;
+			else if (temp == CT_TRUECOL_ALPHA)
+				draw_row = draw_ll_row_RGBA_32;
+		}
+#endif
+#ifdef CONFIG_CMD_ADRAW
+		if (pii->applyalpha && (pii->bpp == 32)
+		    && (pii->multiwidth == 1)) {
+			if (temp == CT_GRAY)
+				draw_row = adraw_ll_row_PAL8_32;
+			else if (temp == CT_GRAY_ALPHA)
+				draw_row = adraw_ll_row_GA_32;
+			else if (temp == CT_TRUECOL_ALPHA)
+				draw_row = adraw_ll_row_RGBA_32;
+		}
 #endif
 	}
 
@@ -257,23 +398,26 @@ const char *draw_png(imginfo_t *pii, u_long addr)
 	}
 
 	/* Fill reference row (for UP and PAETH filter) with 0 */
-	current = rowlen + 1;
-	memset(prow, 0, rowlen+1);
+	current = slotlen;
+	memset(prow, 0, slotlen);
 
-	/* Init zlib decompression */
-	zs.zalloc = zalloc;
-	zs.zfree = zfree;
+	/* Init zlib decompression; inflate directly into the current slot,
+	   starting with the filter type byte in front of the row data */
+	zs.zalloc = gzalloc;
+	zs.zfree = gzfree;
 	zs.next_in = Z_NULL;
 	zs.avail_in = 0;
-	zs.next_out = prow + current;
+	zs.next_out = prow + current + PNG_ROW_HDR - 1;
 	zs.avail_out = rowlen+1;	  /* +1 for filter type */
 #if defined(CONFIG_HW_WATCHDOG) || defined(CONFIG_WATCHDOG)
 	zs.outcb = (cb_func)WATCHDOG_RESET;
 #else
 	zs.outcb = Z_NULL;
 #endif	/* CONFIG_HW_WATCHDOG */
-	if (inflateInit(&zs) != Z_OK)
+	if (inflateInit(&zs) != Z_OK) {
+		free(prow);
 		return "Can't initialize zlib\n";
+	}
 
 	WATCHDOG_RESET();
 
@@ -392,46 +536,14 @@ const char *draw_png(imginfo_t *pii, u_long addr)
 				break;
 			}
 			if (zs.avail_out == 0) {
-				int i;
-
 				/* Current row */
-				u_char *pc = prow + current;
+				u_char *pc = prow + current + PNG_ROW_HDR;
 				/* Previous row */
-				u_char *pp = prow + (rowlen+2) - current;
-				u_char filtertype = *pc++;
+				u_char *pp = prow + slotlen - current
+					+ PNG_ROW_HDR;
 
 				/* Apply the filter on this row */
-				switch (filtertype) {
-				case 0:			  /* none */
-					break;
-
-				case 1:			  /* sub */
-					for (i=fsize; i<rowlen; i++)
-						pc[i] += pc[i-fsize];
-					break;
-
-				case 2:			  /* up */
-					for (i=0; i<rowlen; i++)
-						pc[i] += pp[i];
-					break;
-
-				case 3:			  /* average */
-					for (i=0; i<fsize; i++)
-						pc[i] += pp[i]/2;
-					for (; i<rowlen; i++)
-						pc[i] += (pc[i-fsize]+pp[i])/2;
-					break;
-
-				case 4:			  /* paeth */
-					for (i=0; i<fsize; i++)
-						//pc[i] += paeth(0, pp[i], 0);
-						pc[i] += pp[i];
-					for (; i<rowlen; i++)
-						pc[i] += paeth(pc[i-fsize],
-							       pp[i],
-							       pp[i-fsize]);
-					break;
-				}
+				png_unfilter(pc[-1], pc, pp, rowlen, fsize);
 
 				/* If row is in framebuffer range, draw it */
 				do {
@@ -442,7 +554,8 @@ const char *draw_png(imginfo_t *pii, u_long addr)
 						fbuf = y*pii->pwi->linelen;
 						fbuf += pii->fbuf;
 						pii->rowshift = 8-(rowpos & 7);
-						pii->prow = prow + current + 1
+						pii->prow = prow + current
+							+ PNG_ROW_HDR
 							+ (rowpos>>3);
 						draw_row(pii, (COLOR32 *)fbuf);
 					}
@@ -450,9 +563,9 @@ const char *draw_png(imginfo_t *pii, u_long addr)
 						goto DONE;
 				} while (pii->ypix % pii->multiheight);
 
-				/* Toggle current between 0 and rowlen+1 */
-				current = rowlen + 1 - current;
-				zs.next_out = prow + current;
+				/* Toggle current between 0 and slotlen */
+				current = slotlen - current;
+				zs.next_out = prow + current + PNG_ROW_HDR - 1;
 				zs.avail_out = rowlen + 1;
 			}
 			WATCHDOG_RESET();
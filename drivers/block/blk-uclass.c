@@ -432,25 +432,204 @@ int blk_get_device(int if_type, int devnum, struct udevice **devp)
 	return device_probe(*devp);
 }
 
+/* Read blocks from the device, bypassing the block cache */
+static ulong blk_read_dev(struct blk_desc *block_dev, lbaint_t start,
+			  lbaint_t blkcnt, void *buffer)
+{
+	struct udevice *dev = block_dev->bdev;
+
+	return blk_get_ops(dev)->read(dev, start, blkcnt, buffer);
+}
+
+/* Asynchronous requests that are in flight or waiting for their callback */
+static LIST_HEAD(blk_reqs);
+
+/*
+ * Check whether a request goes to the same queue as a device. Block devices
+ * of one controller, e.g. the namespaces of an NVMe device, share its command
+ * queue, so a request on one of them also keeps the others busy.
+ */
+static bool blk_req_shares_queue(struct blk_req *req, struct udevice *dev)
+{
+	struct udevice *bdev = req->desc->bdev;
+
+	return (bdev == dev) || (dev_get_parent(bdev) == dev_get_parent(dev));
+}
+
+/* Check whether no earlier request on the same queue is in flight */
+static bool blk_req_is_first(struct blk_req *req)
+{
+	struct blk_req *other;
+
+	list_for_each_entry(other, &blk_reqs, node) {
+		if (other == req)
+			break;
+		if (blk_req_shares_queue(other, req->desc->bdev) &&
+		    (other->state != BLK_REQ_DONE))
+			return false;
+	}
+
+	return true;
+}
+
+/* Try to start a queued request on the device */
+static void blk_req_start(struct blk_req *req)
+{
+	struct blk_desc *desc = req->desc;
+	struct udevice *dev = desc->bdev;
+	int ret;
+
+	ret = blk_get_ops(dev)->submit(dev, req);
+	if (ret == -EBUSY)
+		return;
+	if (ret == -ENOSYS) {
+		/* Execute synchronously when the device is idle */
+		if (!blk_req_is_first(req))
+			return;
+		if (req->write)
+			req->result = blk_get_ops(dev)->write(dev, req->start,
+							     req->blkcnt,
+							     req->buffer);
+		else
+			req->result = blkcache_miss(desc, req->start,
+						    req->blkcnt, req->buffer,
+						    blk_read_dev);
+		req->state = BLK_REQ_DONE;
+	} else if (ret) {
+		req->result = ret;
+		req->state = BLK_REQ_DONE;
+	} else {
+		req->state = BLK_REQ_ACTIVE;
+	}
+}
+
+/* Check whether an active request is complete */
+static void blk_req_check(struct blk_req *req)
+{
+	struct blk_desc *desc = req->desc;
+	struct udevice *dev = desc->bdev;
+	long ret;
+
+	ret = blk_get_ops(dev)->poll(dev, req);
+	if (ret == -EINPROGRESS)
+		return;
+
+	if (req->write)
+		blkcache_invalidate(desc->if_type, desc->devnum);
+	else if (ret == req->blkcnt)
+		blkcache_fill(desc->if_type, desc->devnum, req->start,
+			      req->blkcnt, desc->blksz, req->buffer);
+	req->result = ret;
+	req->state = BLK_REQ_DONE;
+}
+
+static void blk_req_advance(struct blk_req *req)
+{
+	if (req->state == BLK_REQ_QUEUED)
+		blk_req_start(req);
+	else if (req->state == BLK_REQ_ACTIVE)
+		blk_req_check(req);
+}
+
+/*
+ * Complete all asynchronous requests on the queue of a device before it is
+ * accessed synchronously. Callbacks are left to blk_poll() as we may be called
+ * from one.
+ */
+static void blk_drain(struct udevice *dev)
+{
+	struct blk_req *req;
+	bool busy;
+
+	do {
+		busy = false;
+		list_for_each_entry(req, &blk_reqs, node) {
+			if (!blk_req_shares_queue(req, dev))
+				continue;
+			blk_req_advance(req);
+			if (req->state != BLK_REQ_DONE)
+				busy = true;
+		}
+	} while (busy);
+}
+
+int blk_submit(struct blk_req *req)
+{
+	struct blk_desc *desc = req->desc;
+	struct udevice *dev = desc->bdev;
+	const struct blk_ops *ops = blk_get_ops(dev);
+
+	if (req->write ? !ops->write : !ops->read)
+		return -ENOSYS;
+
+	list_add_tail(&req->node, &blk_reqs);
+	if (!ops->submit) {
+		/* Legacy driver, execute synchronously */
+		if (req->write)
+			req->result = blk_dwrite(desc, req->start, req->blkcnt,
+						 req->buffer);
+		else
+			req->result = blk_dread(desc, req->start, req->blkcnt,
+						req->buffer);
+		req->state = BLK_REQ_DONE;
+	} else if (!req->write &&
+		   blkcache_read(desc->if_type, desc->devnum, req->start,
+				 req->blkcnt, desc->blksz, req->buffer)) {
+		req->result = req->blkcnt;
+		req->state = BLK_REQ_DONE;
+	} else {
+		if (req->write)
+			blkcache_invalidate(desc->if_type, desc->devnum);
+		req->state = BLK_REQ_QUEUED;
+		blk_req_start(req);
+	}
+
+	return 0;
+}
+
+int blk_poll(void)
+{
+	struct blk_req *req, *next;
+	int pending = 0;
+
+	list_for_each_entry_safe(req, next, &blk_reqs, node) {
+		blk_req_advance(req);
+		if (req->state != BLK_REQ_DONE) {
+			pending++;
+			continue;
+		}
+		list_del_init(&req->node);
+		if (req->done)
+			req->done(req);
+	}
+
+	return pending;
+}
+
+long blk_wait(struct blk_req *req)
+{
+	while (!list_empty(&req->node))
+		blk_poll();
+
+	return req->result;
+}
+
 unsigned long blk_dread(struct blk_desc *block_dev, lbaint_t start,
 			lbaint_t blkcnt, void *buffer)
 {
 	struct udevice *dev = block_dev->bdev;
 	const struct blk_ops *ops = blk_get_ops(dev);
-	ulong blks_read;
 
 	if (!ops->read)
 		return -ENOSYS;
 
+	if (ops->submit)
+		blk_drain(dev);
 	if (blkcache_read(block_dev->if_type, block_dev->devnum,
 			  start, blkcnt, block_dev->blksz, buffer))
 		return blkcnt;
-	blks_read = ops->read(dev, start, blkcnt, buffer);
-	if (blks_read == blkcnt)
-		blkcache_fill(block_dev->if_type, block_dev->devnum,
-			      start, blkcnt, block_dev->blksz, buffer);
 
-	return blks_read;
+	return blkcache_miss(block_dev, start, blkcnt, buffer, blk_read_dev);
 }
 
 unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
@@ -462,6 +641,8 @@ unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 	if (!ops->write)
 		return -ENOSYS;
 
+	if (ops->submit)
+		blk_drain(dev);
 	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
 	return ops->write(dev, start, blkcnt, buffer);
 }
@@ -475,6 +656,8 @@ unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
 	if (!ops->erase)
 		return -ENOSYS;
 
+	if (ops->submit)
+		blk_drain(dev);
 	blkcache_invalidate(block_dev->if_type, block_dev->devnum);
 	return ops->erase(dev, start, blkcnt);
 }
@@ -656,9 +839,39 @@ static int blk_post_probe(struct udevice *dev)
 	return 0;
 }
 
+static int blk_pre_remove(struct udevice *dev)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	struct blk_req *req, *next;
+
+	/* Requests that were not started fail, wait for the others */
+	list_for_each_entry(req, &blk_reqs, node) {
+		if (req->desc->bdev == dev && req->state == BLK_REQ_QUEUED) {
+			req->result = -ENODEV;
+			req->state = BLK_REQ_DONE;
+		}
+	}
+	blk_drain(dev);
+
+	/* Requests must not refer to the device after it is gone */
+	list_for_each_entry_safe(req, next, &blk_reqs, node) {
+		if (req->desc->bdev != dev)
+			continue;
+		list_del_init(&req->node);
+		if (req->done)
+			req->done(req);
+	}
+
+	/* A new device with the same number must not see our cached data */
+	blkcache_invalidate(desc->if_type, desc->devnum);
+
+	return 0;
+}
+
 UCLASS_DRIVER(blk) = {
 	.id		= UCLASS_BLK,
 	.name		= "blk",
 	.post_probe	= blk_post_probe,
+	.pre_remove	= blk_pre_remove,
 	.per_device_plat_auto	= sizeof(struct blk_desc),
 };
@@ -8,178 +8,363 @@
 #include <blk.h>
 #include <log.h>
 #include <malloc.h>
+#include <memalign.h>
 #include <part.h>
-#include <asm/global_data.h>
 #include <linux/ctype.h>
-#include <linux/list.h>
+#include <linux/log2.h>
 
-#ifdef CONFIG_NEEDS_MANUAL_RELOC
-DECLARE_GLOBAL_DATA_PTR;
-#endif
+/*
+ * The cache holds lines of max_blocks_per_entry consecutive blocks, aligned
+ * to the line size. A line is found by hashing device and line number to a
+ * set of BLKCACHE_WAYS lines. Within a set, lines are replaced with the
+ * CLOCK algorithm: each hit sets a reference bit, the victim is the next
+ * line without reference bit, clearing the bits while searching.
+ */
+#define BLKCACHE_WAYS		4
+
+/* Requests of more lines than this bypass the cache (file data) */
+#define BLKCACHE_MAX_LINES	4
 
-struct block_cache_node {
-	struct list_head lh;
+struct block_cache_line {
 	int iftype;
 	int devnum;
-	lbaint_t start;
-	lbaint_t blkcnt;
+	lbaint_t start;			/* First block of line */
 	unsigned long blksz;
-	char *cache;
+	unsigned long bufsize;		/* Allocated size of data */
+	bool valid;
+	bool ref;			/* Reference bit for CLOCK */
+	bool ahead;			/* Filled by read-ahead, not used yet */
+	char *data;
 };
 
-static LIST_HEAD(block_cache);
+static struct block_cache_line *lines;
+static unsigned char *hands;		/* CLOCK hand for each set */
+static unsigned int sets;
+static unsigned int ways;
+static unsigned int line_shift;		/* log2 of blocks per line */
+
+/* Sequential access detection for read-ahead */
+static struct {
+	int iftype;
+	int devnum;
+	lbaint_t next;			/* Block following the last access */
+} stream = { .iftype = -1 };
+
+/* Bounce buffer for reads that are extended to whole lines */
+static char *bounce;
+static unsigned long bounce_size;
 
 static struct block_cache_stats _stats = {
 	.max_blocks_per_entry = 8,
-	.max_entries = 32
+	.max_entries = 32,
+	.readahead = 2,
 };
 
 #ifdef CONFIG_NEEDS_MANUAL_RELOC
 int blkcache_init(void)
 {
-	struct list_head *head = &block_cache;
+	/* Nothing to relocate, all pointers are allocated at runtime */
+	return 0;
+}
+#endif
 
-	head->next = (uintptr_t)head->next + gd->reloc_off;
-	head->prev = (uintptr_t)head->prev + gd->reloc_off;
+static void cache_free(void)
+{
+	unsigned int i;
+
+	if (lines) {
+		for (i = 0; i < sets * ways; i++)
+			free(lines[i].data);
+	}
+	free(lines);
+	free(hands);
+	lines = NULL;
+	hands = NULL;
+	_stats.entries = 0;
+}
+
+static int cache_alloc(void)
+{
+	if (lines)
+		return 0;
+
+	line_shift = ilog2(_stats.max_blocks_per_entry);
+	ways = min(_stats.max_entries, (unsigned int)BLKCACHE_WAYS);
+	sets = _stats.max_entries / ways;
+	lines = calloc(sets * ways, sizeof(*lines));
+	hands = calloc(sets, sizeof(*hands));
+	if (!lines || !hands) {
+		cache_free();
+		return -ENOMEM;
+	}
 
 	return 0;
 }
-#endif
 
-static struct block_cache_node *cache_find(int iftype, int devnum,
-					   lbaint_t start, lbaint_t blkcnt,
+static struct block_cache_line *cache_set(int iftype, int devnum,
+					  lbaint_t start)
+{
+	u32 hash = (u32)(start >> line_shift);
+
+	hash ^= (u32)((u64)start >> 32) ^ (hash >> 11);
+	hash ^= devnum * 0x9e37 + iftype * 0x79b9;
+
+	return &lines[(hash % sets) * ways];
+}
+
+static struct block_cache_line *cache_find(int iftype, int devnum,
+					   lbaint_t start,
 					   unsigned long blksz)
 {
-	struct block_cache_node *node;
-
-	list_for_each_entry(node, &block_cache, lh)
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum) &&
-		    (node->blksz == blksz) &&
-		    (node->start <= start) &&
-		    (node->start + node->blkcnt >= start + blkcnt)) {
-			if (block_cache.next != &node->lh) {
-				/* maintain MRU ordering */
-				list_del(&node->lh);
-				list_add(&node->lh, &block_cache);
-			}
-			return node;
+	struct block_cache_line *line = cache_set(iftype, devnum, start);
+	unsigned int i;
+
+	for (i = 0; i < ways; i++, line++) {
+		if (line->valid && (line->start == start) &&
+		    (line->devnum == devnum) && (line->iftype == iftype) &&
+		    (line->blksz == blksz))
+			return line;
+	}
+
+	return NULL;
+}
+
+static struct block_cache_line *cache_victim(int iftype, int devnum,
+					     lbaint_t start)
+{
+	struct block_cache_line *set = cache_set(iftype, devnum, start);
+	unsigned char *hand = &hands[(set - lines) / ways];
+	struct block_cache_line *line;
+	unsigned int i;
+
+	/* Prefer a free line */
+	for (i = 0; i < ways; i++) {
+		if (!set[i].valid) {
+			_stats.entries++;
+			return &set[i];
 		}
-	return 0;
+	}
+
+	for (;;) {
+		line = &set[*hand];
+		*hand = (*hand + 1) % ways;
+		if (!line->ref)
+			return line;
+		line->ref = false;
+	}
 }
 
 int blkcache_read(int iftype, int devnum,
 		  lbaint_t start, lbaint_t blkcnt,
 		  unsigned long blksz, void *buffer)
 {
-	struct block_cache_node *node = cache_find(iftype, devnum, start,
-						   blkcnt, blksz);
-	if (node) {
-		const char *src = node->cache + (start - node->start) * blksz;
-		memcpy(buffer, src, blksz * blkcnt);
-		debug("hit: start " LBAF ", count " LBAFU "\n",
-		      start, blkcnt);
-		++_stats.hits;
-		return 1;
+	lbaint_t bpl = (lbaint_t)1 << line_shift;
+	struct block_cache_line *line;
+	lbaint_t first, count;
+
+	if (!_stats.max_entries ||
+	    (blkcnt > BLKCACHE_MAX_LINES * _stats.max_blocks_per_entry))
+		return 0;
+
+	/* Nothing was cached so far */
+	if (!lines) {
+		++_stats.misses;
+		return 0;
 	}
 
-	debug("miss: start " LBAF ", count " LBAFU "\n",
-	      start, blkcnt);
-	++_stats.misses;
-	return 0;
+	while (blkcnt) {
+		first = start & ~(bpl - 1);
+		line = cache_find(iftype, devnum, first, blksz);
+		if (!line) {
+			debug("miss: start " LBAF ", count " LBAFU "\n",
+			      start, blkcnt);
+			++_stats.misses;
+			return 0;
+		}
+		line->ref = true;
+		if (line->ahead) {
+			line->ahead = false;
+			++_stats.ra_used;
+		}
+		count = min(blkcnt, first + bpl - start);
+		memcpy(buffer, line->data + (start - first) * blksz,
+		       count * blksz);
+		buffer += count * blksz;
+		start += count;
+		blkcnt -= count;
+	}
+
+	debug("hit: start " LBAF "\n", start);
+	++_stats.hits;
+	stream.iftype = iftype;
+	stream.devnum = devnum;
+	stream.next = start;
+
+	return 1;
+}
+
+static void cache_fill(int iftype, int devnum, lbaint_t start,
+		       lbaint_t blkcnt, unsigned long blksz,
+		       void const *buffer, lbaint_t ahead)
+{
+	lbaint_t bpl = (lbaint_t)1 << line_shift;
+	unsigned long bytes = bpl * blksz;
+	struct block_cache_line *line;
+	lbaint_t first, offs;
+
+	/* Only whole lines are stored */
+	first = (start + bpl - 1) & ~(bpl - 1);
+	offs = first - start;
+	for (; offs + bpl <= blkcnt; first += bpl, offs += bpl) {
+		line = cache_find(iftype, devnum, first, blksz);
+		if (!line)
+			line = cache_victim(iftype, devnum, first);
+		if (line->bufsize < bytes) {
+			free(line->data);
+			line->data = malloc_cache_aligned(bytes);
+			if (!line->data) {
+				line->bufsize = 0;
+				line->valid = false;
+				_stats.entries--;
+				return;
+			}
+			line->bufsize = bytes;
+		}
+
+		debug("fill: start " LBAF "\n", first);
+		line->iftype = iftype;
+		line->devnum = devnum;
+		line->start = first;
+		line->blksz = blksz;
+		line->valid = true;
+		line->ref = false;
+		line->ahead = (offs >= blkcnt - ahead);
+		if (line->ahead)
+			++_stats.ra_lines;
+		memcpy(line->data, buffer + offs * blksz, bytes);
+	}
 }
 
 void blkcache_fill(int iftype, int devnum,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer)
 {
-	lbaint_t bytes;
-	struct block_cache_node *node;
-
 	/* don't cache big stuff */
-	if (blkcnt > _stats.max_blocks_per_entry)
+	if (blkcnt > BLKCACHE_MAX_LINES * _stats.max_blocks_per_entry)
 		return;
 
-	if (_stats.max_entries == 0)
+	if (!_stats.max_entries || cache_alloc())
 		return;
 
-	bytes = blksz * blkcnt;
-	if (_stats.max_entries <= _stats.entries) {
-		/* pop LRU */
-		node = (struct block_cache_node *)block_cache.prev;
-		list_del(&node->lh);
-		_stats.entries--;
-		debug("drop: start " LBAF ", count " LBAFU "\n",
-		      node->start, node->blkcnt);
-		if (node->blkcnt * node->blksz < bytes) {
-			free(node->cache);
-			node->cache = 0;
-		}
-	} else {
-		node = malloc(sizeof(*node));
-		if (!node)
-			return;
-		node->cache = 0;
+	cache_fill(iftype, devnum, start, blkcnt, blksz, buffer, 0);
+}
+
+ulong blkcache_miss(struct blk_desc *block_dev, lbaint_t start,
+		    lbaint_t blkcnt, void *buffer, blkcache_read_t read)
+{
+	int iftype = block_dev->if_type;
+	int devnum = block_dev->devnum;
+	unsigned long blksz = block_dev->blksz;
+	lbaint_t bpl = _stats.max_blocks_per_entry;
+	lbaint_t first, end, ahead = 0;
+	ulong blks_read;
+
+	if (!_stats.max_entries || (blkcnt > BLKCACHE_MAX_LINES * bpl) ||
+	    cache_alloc())
+		return read(block_dev, start, blkcnt, buffer);
+
+	/* Extend to whole lines, add read-ahead if access is sequential */
+	first = start & ~(bpl - 1);
+	end = (start + blkcnt + bpl - 1) & ~(bpl - 1);
+	if ((stream.iftype == iftype) && (stream.devnum == devnum) &&
+	    (stream.next == start)) {
+		ahead = _stats.readahead * bpl;
+		end += ahead;
+	}
+	if (block_dev->lba && (end > block_dev->lba)) {
+		ahead -= min(ahead, end - block_dev->lba);
+		end = block_dev->lba;
+	}
+	stream.iftype = iftype;
+	stream.devnum = devnum;
+	stream.next = start + blkcnt;
+
+	if ((first == start) && (end == start + blkcnt)) {
+		/* Request is already aligned, read directly */
+		blks_read = read(block_dev, start, blkcnt, buffer);
+		if (blks_read == blkcnt)
+			cache_fill(iftype, devnum, start, blkcnt, blksz,
+				   buffer, 0);
+		return blks_read;
 	}
 
-	if (!node->cache) {
-		node->cache = malloc(bytes);
-		if (!node->cache) {
-			free(node);
-			return;
+	if (end < start + blkcnt)
+		return read(block_dev, start, blkcnt, buffer);
+
+	if (bounce_size < (end - first) * blksz) {
+		free(bounce);
+		bounce_size = (end - first) * blksz;
+		bounce = malloc_cache_aligned(bounce_size);
+		if (!bounce) {
+			bounce_size = 0;
+			return read(block_dev, start, blkcnt, buffer);
 		}
 	}
 
-	debug("fill: start " LBAF ", count " LBAFU "\n",
-	      start, blkcnt);
-
-	node->iftype = iftype;
-	node->devnum = devnum;
-	node->start = start;
-	node->blkcnt = blkcnt;
-	node->blksz = blksz;
-	memcpy(node->cache, buffer, bytes);
-	list_add(&node->lh, &block_cache);
-	_stats.entries++;
+	debug("read: start " LBAF ", count " LBAFU ", ahead " LBAFU "\n",
+	      first, end - first, ahead);
+	blks_read = read(block_dev, first, end - first, bounce);
+	if (blks_read != end - first)
+		return read(block_dev, start, blkcnt, buffer);
+
+	cache_fill(iftype, devnum, first, end - first, blksz, bounce, ahead);
+	memcpy(buffer, bounce + (start - first) * blksz, blkcnt * blksz);
+
+	return blkcnt;
 }
 
 void blkcache_invalidate(int iftype, int devnum)
 {
-	struct list_head *entry, *n;
-	struct block_cache_node *node;
-
-	list_for_each_safe(entry, n, &block_cache) {
-		node = (struct block_cache_node *)entry;
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum)) {
-			list_del(entry);
-			free(node->cache);
-			free(node);
+	unsigned int i;
+
+	if ((stream.iftype == iftype) && (stream.devnum == devnum))
+		stream.iftype = -1;
+
+	if (!lines)
+		return;
+
+	for (i = 0; i < sets * ways; i++) {
+		if (lines[i].valid && (lines[i].iftype == iftype) &&
+		    (lines[i].devnum == devnum)) {
+			lines[i].valid = false;
 			--_stats.entries;
 		}
 	}
 }
 
-void blkcache_configure(unsigned blocks, unsigned entries)
+void blkcache_configure(unsigned blocks, unsigned entries, unsigned readahead)
 {
-	struct block_cache_node *node;
+	/* Lines must be a power of two blocks */
+	if (blocks)
+		blocks = 1 << ilog2(blocks);
+	else
+		entries = 0;
+
 	if ((blocks != _stats.max_blocks_per_entry) ||
 	    (entries != _stats.max_entries)) {
 		/* invalidate cache */
-		while (!list_empty(&block_cache)) {
-			node = (struct block_cache_node *)block_cache.next;
-			list_del(&node->lh);
-			free(node->cache);
-			free(node);
-		}
-		_stats.entries = 0;
+		cache_free();
 	}
 
 	_stats.max_blocks_per_entry = blocks;
 	_stats.max_entries = entries;
+	_stats.readahead = readahead;
+	stream.iftype = -1;
 
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.ra_lines = 0;
+	_stats.ra_used = 0;
 }
 
 void blkcache_stats(struct block_cache_stats *stats)
@@ -187,4 +372,6 @@ void blkcache_stats(struct block_cache_stats *stats)
 	memcpy(stats, &_stats, sizeof(*stats));
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.ra_lines = 0;
+	_stats.ra_used = 0;
 }
@@ -243,9 +243,44 @@ int sandbox_host_unbind(struct udevice *dev)
 	return 0;
 }
 
+/* Number of requests that the host device takes at a time */
+#define HOST_QUEUE_DEPTH	4
+
+/*
+ * Requests are started immediately but only transferred when they are
+ * polled, like a device that completes them in the background.
+ */
+static int host_block_submit(struct udevice *dev, struct blk_req *req)
+{
+	struct host_block_dev *host_dev = dev_get_plat(dev);
+	struct blk_desc *block_dev = dev_get_uclass_plat(dev);
+
+	if (req->start + req->blkcnt > block_dev->lba)
+		return -EINVAL;
+	if (host_dev->active >= HOST_QUEUE_DEPTH)
+		return -EBUSY;
+	host_dev->active++;
+
+	return 0;
+}
+
+static long host_block_poll(struct udevice *dev, struct blk_req *req)
+{
+	struct host_block_dev *host_dev = dev_get_plat(dev);
+
+	host_dev->active--;
+	if (req->write)
+		return host_block_write(dev, req->start, req->blkcnt,
+					req->buffer);
+
+	return host_block_read(dev, req->start, req->blkcnt, req->buffer);
+}
+
 static const struct blk_ops sandbox_host_blk_ops = {
 	.read	= host_block_read,
 	.write	= host_block_write,
+	.submit	= host_block_submit,
+	.poll	= host_block_poll,
 };
 
 U_BOOT_DRIVER(sandbox_host_blk) = {
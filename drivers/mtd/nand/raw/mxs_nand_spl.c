@@ -226,7 +226,14 @@ void nand_init(void)
 	mxs_nand_setup_ecc(mtd);
 }
 
-int nand_spl_load_image(uint32_t offs, unsigned int size, void *buf)
+/*
+ * Load data like nand_spl_load_image(), but start at offs + *skip and add the
+ * size of all bad blocks that are skipped on the way to *skip. So loading a
+ * region in several pieces gives the same result as loading it in one go. If
+ * buf is NULL, nothing is copied, only the bad blocks are accounted for.
+ */
+int nand_spl_load_image_skip(uint32_t offs, unsigned int size, void *buf,
+			     unsigned int *skip)
 {
 	struct nand_chip *chip;
 	unsigned int page;
@@ -240,6 +247,9 @@ int nand_spl_load_image(uint32_t offs, unsigned int size, void *buf)
 	if (!chip->numchips)
 		return -ENODEV;
 
+	if (skip)
+		offs += *skip;
+
 	/*
 	 * Use the same buffer where the regular mxs_nand driver loads the
 	 * data anyway, so the memcpy() there in mxs_nand_ecc_read_page() is
@@ -257,20 +267,21 @@ int nand_spl_load_image(uint32_t offs, unsigned int size, void *buf)
 	debug("%s offset:0x%08x len:%d page:%x\n", __func__, offs, size, page);
 
 	while (size) {
-		err = mxs_read_page_ecc(mtd, page_buf, page);
-		if (err < 0)
-			return err;
-
 		if (size > (mtd->writesize - page_off))
 			sz = (mtd->writesize - page_off);
 		else
 			sz = size;
 
-		memcpy(buf, page_buf + page_off, sz);
+		if (buf) {
+			err = mxs_read_page_ecc(mtd, page_buf, page);
+			if (err < 0)
+				return err;
+			memcpy(buf, page_buf + page_off, sz);
+			buf += (mtd->writesize - page_off);
+		}
 
 		offs += mtd->writesize;
 		page++;
-		buf += (mtd->writesize - page_off);
 		page_off = 0;
 		size -= sz;
 
@@ -286,6 +297,8 @@ int nand_spl_load_image(uint32_t offs, unsigned int size, void *buf)
 			while (is_badblock(mtd, offs, 1)) {
 				page = page + nand_page_per_block;
 				offs += mtd->erasesize;
+				if (skip)
+					*skip += mtd->erasesize;
 				/* Check i we've reached the end of flash. */
 				if (page >= mtd->size >> chip->page_shift)
 					return -ENOMEM;
@@ -296,6 +309,11 @@ int nand_spl_load_image(uint32_t offs, unsigned int size, void *buf)
 	return 0;
 }
 
+int nand_spl_load_image(uint32_t offs, unsigned int size, void *buf)
+{
+	return nand_spl_load_image_skip(offs, size, buf, NULL);
+}
+
 int nand_default_bbt(struct mtd_info *mtd)
 {
 	return 0;
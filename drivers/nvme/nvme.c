@@ -18,7 +18,7 @@
 #include <linux/compat.h>
 #include "nvme.h"
 
-#define NVME_Q_DEPTH		2
+#define NVME_Q_DEPTH		8
 #define NVME_AQ_DEPTH		2
 #define NVME_SQ_SIZE(depth)	(depth * sizeof(struct nvme_command))
 #define NVME_CQ_SIZE(depth)	(depth * sizeof(struct nvme_completion))
@@ -34,6 +34,22 @@ enum nvme_queue_id {
 	NVME_Q_NUM,
 };
 
+/*
+ * An I/O command started by nvme_blk_submit(). There is one slot for each
+ * entry of the I/O submission queue that may be in use. A slot stays busy
+ * until the controller has completed its command; if the command timed out,
+ * req is NULL then and the completion only frees the slot.
+ */
+struct nvme_async {
+	struct blk_req *req;
+	u64 *prp_list;		/* One page of PRP entries, allocated on demand */
+	ulong start;		/* Time of submission in us */
+	u16 cmdid;
+	u16 status;
+	bool busy;
+	bool done;
+};
+
 /*
  * An NVM Express queue. Each device has at least two (one for admin
  * commands and one for I/O commands).
@@ -180,13 +196,34 @@ static void nvme_submit_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd)
 	nvmeq->sq_tail = tail;
 }
 
+/* Record the completion of an asynchronous command in its slot */
+static void nvme_async_complete(struct nvme_dev *dev, u16 cmdid, u16 status)
+{
+	int i;
+
+	if (!dev->async)
+		return;
+
+	for (i = 0; i < dev->q_depth - 1; i++) {
+		struct nvme_async *slot = &dev->async[i];
+
+		if (slot->busy && !slot->done && slot->cmdid == cmdid) {
+			slot->status = status;
+			slot->done = true;
+			if (!slot->req)
+				slot->busy = false;
+			break;
+		}
+	}
+}
+
 static int nvme_submit_sync_cmd(struct nvme_queue *nvmeq,
 				struct nvme_command *cmd,
 				u32 *result, unsigned timeout)
 {
 	u16 head = nvmeq->cq_head;
 	u16 phase = nvmeq->cq_phase;
-	u16 status;
+	u16 status, cmdid;
 	ulong start_time;
 	ulong timeout_us = timeout * 100000;
 
@@ -197,8 +234,25 @@ static int nvme_submit_sync_cmd(struct nvme_queue *nvmeq,
 
 	for (;;) {
 		status = nvme_read_completion_status(nvmeq, head);
-		if ((status & 0x01) == phase)
-			break;
+		if ((status & 0x01) == phase) {
+			cmdid = readw(&(nvmeq->cqes[head].command_id));
+			if (cmdid == cmd->common.command_id)
+				break;
+
+			/* Not ours, e.g. a late asynchronous command */
+			if (nvmeq->qid != NVME_ADMIN_Q)
+				nvme_async_complete(nvmeq->dev,
+						    le16_to_cpu(cmdid),
+						    status >> 1);
+			if (++head == nvmeq->q_depth) {
+				head = 0;
+				phase = !phase;
+			}
+			writel(head, nvmeq->q_db + nvmeq->dev->db_stride);
+			nvmeq->cq_head = head;
+			nvmeq->cq_phase = phase;
+			continue;
+		}
 		if (timeout_us > 0 && (timer_get_us() - start_time)
 		    >= timeout_us)
 			return -ETIMEDOUT;
@@ -808,9 +862,166 @@ static ulong nvme_blk_write(struct udevice *udev, lbaint_t blknr,
 	return nvme_blk_rw(udev, blknr, blkcnt, (void *)buffer, false);
 }
 
+static int nvme_blk_submit(struct udevice *udev, struct blk_req *req)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	struct nvme_dev *dev = ns->dev;
+	struct nvme_async *slot;
+	struct nvme_command c;
+	u32 page_size = dev->page_size;
+	ulong buffer = (ulong)req->buffer;
+	ulong total_len = req->blkcnt << ns->lba_shift;
+	ulong dma_addr;
+	u64 prp2 = 0;
+	long length;
+	int i, nprps;
+
+	/* Requests that need more than one command are done synchronously */
+	if (!dev->async || !req->blkcnt ||
+	    req->blkcnt > (1U << (dev->max_transfer_shift - ns->lba_shift)))
+		return -ENOSYS;
+
+	for (i = 0; i < dev->q_depth - 1; i++) {
+		if (!dev->async[i].busy)
+			break;
+	}
+	if (i == dev->q_depth - 1) {
+		/* Do not wait for slots that only hold timed out commands */
+		for (i = 0; i < dev->q_depth - 1; i++) {
+			if (dev->async[i].req)
+				return -EBUSY;
+		}
+		return -ETIMEDOUT;
+	}
+	slot = &dev->async[i];
+
+	/* Like nvme_setup_prps(), but each slot needs its own PRP list */
+	dma_addr = buffer + page_size - (buffer & (page_size - 1));
+	length = total_len - (dma_addr - buffer);
+	if (length > page_size) {
+		nprps = DIV_ROUND_UP(length, page_size);
+		if (nprps > (page_size >> 3))
+			return -ENOSYS;
+		if (!slot->prp_list) {
+			slot->prp_list = memalign(page_size, page_size);
+			if (!slot->prp_list)
+				return -ENOSYS;
+		}
+		for (i = 0; i < nprps; i++, dma_addr += page_size)
+			slot->prp_list[i] = cpu_to_le64(dma_addr);
+		flush_dcache_range((ulong)slot->prp_list,
+				   (ulong)slot->prp_list + page_size);
+		prp2 = (ulong)slot->prp_list;
+	} else if (length > 0) {
+		prp2 = dma_addr;
+	}
+
+	flush_dcache_range(buffer, buffer + total_len);
+
+	memset(&c, 0, sizeof(c));
+	c.rw.opcode = req->write ? nvme_cmd_write : nvme_cmd_read;
+	c.rw.nsid = cpu_to_le32(ns->ns_id);
+	c.rw.slba = cpu_to_le64(req->start);
+	c.rw.length = cpu_to_le16(req->blkcnt - 1);
+	c.rw.prp1 = cpu_to_le64(buffer);
+	c.rw.prp2 = cpu_to_le64(prp2);
+	c.common.command_id = nvme_get_cmd_id();
+
+	slot->req = req;
+	slot->cmdid = le16_to_cpu(c.common.command_id);
+	slot->busy = true;
+	slot->done = false;
+	slot->start = timer_get_us();
+	req->drv_data = slot - dev->async;
+	nvme_submit_cmd(dev->queues[NVME_IO_Q], &c);
+
+	return 0;
+}
+
+/* Collect the completions of asynchronous commands in any order */
+static void nvme_async_reap(struct nvme_dev *dev)
+{
+	struct nvme_queue *nvmeq = dev->queues[NVME_IO_Q];
+	u16 head = nvmeq->cq_head;
+	u16 phase = nvmeq->cq_phase;
+	bool seen = false;
+	u16 status, cmdid;
+
+	for (;;) {
+		status = nvme_read_completion_status(nvmeq, head);
+		if ((status & 0x01) != phase)
+			break;
+		cmdid = le16_to_cpu(readw(&(nvmeq->cqes[head].command_id)));
+		nvme_async_complete(dev, cmdid, status >> 1);
+		if (++head == nvmeq->q_depth) {
+			head = 0;
+			phase = !phase;
+		}
+		seen = true;
+	}
+
+	if (seen) {
+		writel(head, nvmeq->q_db + dev->db_stride);
+		nvmeq->cq_head = head;
+		nvmeq->cq_phase = phase;
+	}
+}
+
+/*
+ * Ask the controller to abort a command that timed out. The controller may
+ * still access the buffer until the command completes, so the slot is kept
+ * busy until then; only the request is released.
+ */
+static void nvme_async_abort(struct nvme_dev *dev, struct nvme_async *slot)
+{
+	struct nvme_command c;
+
+	memset(&c, 0, sizeof(c));
+	c.abort.opcode = nvme_admin_abort_cmd;
+	c.abort.sqid = cpu_to_le16(dev->queues[NVME_IO_Q]->qid);
+	c.abort.cid = cpu_to_le16(slot->cmdid);
+	nvme_submit_admin_cmd(dev, &c, NULL);
+
+	slot->req = NULL;
+	nvme_async_reap(dev);
+}
+
+static long nvme_blk_poll(struct udevice *udev, struct blk_req *req)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	struct nvme_dev *dev = ns->dev;
+	struct nvme_async *slot = &dev->async[req->drv_data];
+	ulong buffer = (ulong)req->buffer;
+	ulong total_len = req->blkcnt << ns->lba_shift;
+
+	nvme_async_reap(dev);
+	if (!slot->done) {
+		if (timer_get_us() - slot->start < IO_TIMEOUT * 1000000)
+			return -EINPROGRESS;
+		printf("ERROR: timeout, block " LBAF "\n", req->start);
+		nvme_async_abort(dev, slot);
+		return -ETIMEDOUT;
+	}
+
+	slot->req = NULL;
+	slot->busy = false;
+	if (slot->status) {
+		printf("ERROR: status = %x, block " LBAF "\n", slot->status,
+		       req->start);
+		return -EIO;
+	}
+
+	if (!req->write)
+		invalidate_dcache_range(buffer, buffer + total_len);
+
+	return req->blkcnt;
+}
+
 static const struct blk_ops nvme_blk_ops = {
 	.read	= nvme_blk_read,
 	.write	= nvme_blk_write,
+	.submit	= nvme_blk_submit,
+	.poll	= nvme_blk_poll,
 };
 
 U_BOOT_DRIVER(nvme_blk) = {
@@ -877,6 +1088,9 @@ static int nvme_probe(struct udevice *udev)
 	if (ret)
 		goto free_queue;
 
+	/* Without slots, all I/O is done synchronously */
+	ndev->async = calloc(ndev->q_depth - 1, sizeof(*ndev->async));
+
 	nvme_get_info_from_identify(ndev);
 
 	return 0;
@@ -887,11 +1101,35 @@ free_nvme:
 	return ret;
 }
 
+static int nvme_remove(struct udevice *udev)
+{
+	struct nvme_dev *ndev = dev_get_priv(udev);
+	int ret;
+	int i;
+
+	/*
+	 * The block devices have drained their requests already. Stop the
+	 * controller, so that commands that timed out can no longer access
+	 * the PRP lists.
+	 */
+	ret = nvme_disable_ctrl(ndev);
+
+	if (ndev->async) {
+		for (i = 0; i < ndev->q_depth - 1; i++)
+			free(ndev->async[i].prp_list);
+		free(ndev->async);
+		ndev->async = NULL;
+	}
+
+	return ret;
+}
+
 U_BOOT_DRIVER(nvme) = {
 	.name	= "nvme",
 	.id	= UCLASS_NVME,
 	.bind	= nvme_bind,
 	.probe	= nvme_probe,
+	.remove	= nvme_remove,
 	.priv_auto	= sizeof(struct nvme_dev),
 };
 
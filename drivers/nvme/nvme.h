@@ -594,6 +594,8 @@ enum {
 	NVME_CSTS_SHST_MASK	= 3 << 2,
 };
 
+struct nvme_async;
+
 /* Represents an NVM Express device. Each nvme_dev is a PCI function. */
 struct nvme_dev {
 	struct list_head node;
@@ -619,6 +621,7 @@ struct nvme_dev {
 	u64 *prp_pool;
 	u32 prp_entry_num;
 	u32 nn;
+	struct nvme_async *async;	/* Slots for asynchronous I/O */
 };
 
 /*
@@ -22,7 +22,9 @@
 #include <env.h>
 #include <log.h>
 #include <malloc.h>
+#include <time.h>
 
+#include <linux/math64.h>
 #include <linux/usb/ch9.h>
 #include <linux/usb/gadget.h>
 #include <linux/usb/composite.h>
@@ -76,6 +78,16 @@ struct hid_report {
 
 #define SDP_COMMAND_LEN		16
 
+/*
+ * In stream mode, received file data is queued in a small ring of buffers and
+ * handed to the stream callback from sdp_handle(). So the USB transfer of the
+ * next report can already start while the previous data is processed. The
+ * ring is only allocated in stream mode, as struct f_sdp comes from the small
+ * early malloc area in SPL.
+ */
+#define SDP_RX_BUFFERS		3
+#define SDP_RX_BUF_SIZE		1024	/* Payload of HID report 2 */
+
 struct sdp_command {
 	u16 cmd;
 	u32 addr;
@@ -98,6 +110,11 @@ enum sdp_state {
 	SDP_STATE_JUMP,
 };
 
+struct sdp_rx_buf {
+	int				len;
+	u8				data[SDP_RX_BUF_SIZE];
+};
+
 struct f_sdp {
 	struct usb_function		usb_function;
 
@@ -121,6 +138,15 @@ struct f_sdp {
 	struct usb_request		*in_req;
 
 	bool				configuration_done;
+
+	/* Receive buffers in stream mode, see sdp_rx_queue() */
+	struct sdp_rx_buf		*rx_buf;	/* NULL: not in stream mode */
+	unsigned int			rx_head;	/* Next buffer to fill */
+	unsigned int			rx_tail;	/* Next buffer to process */
+
+	/* Statistics for current download */
+	unsigned long			dnl_start_us;
+	unsigned long			dnl_stall_us;
 };
 
 static struct f_sdp *sdp_func;
@@ -322,6 +348,10 @@ static void sdp_rx_command_complete(struct usb_ep *ep, struct usb_request *req)
 		sdp->dnl_bytes_remaining = be32_to_cpu(cmd->cnt);
 		sdp->dnl_bytes = sdp->dnl_bytes_remaining;
 		sdp->next_state = SDP_STATE_IDLE;
+		sdp->rx_head = 0;
+		sdp->rx_tail = 0;
+		sdp->dnl_stall_us = 0;
+		sdp->dnl_start_us = timer_get_us();
 
 		printf("Downloading file of size %d to 0x%08x... ",
 		       sdp->dnl_bytes_remaining, sdp->dnl_address);
@@ -367,6 +397,61 @@ static void sdp_rx_command_complete(struct usb_ep *ep, struct usb_request *req)
 	}
 }
 
+/* Pass the oldest queued receive buffer to the stream callback */
+static void sdp_rx_process(struct f_sdp *sdp)
+{
+	struct sdp_rx_buf *rx = &sdp->rx_buf[sdp->rx_tail % SDP_RX_BUFFERS];
+
+	stream_ops->rx_data(rx->data, rx->len);
+	sdp->rx_tail++;
+}
+
+/* Process all queued buffers; USB is stalled meanwhile, so count the time */
+static void sdp_rx_flush(struct f_sdp *sdp)
+{
+	unsigned long start = timer_get_us();
+
+	while (sdp->rx_tail != sdp->rx_head)
+		sdp_rx_process(sdp);
+	sdp->dnl_stall_us += timer_get_us() - start;
+}
+
+/* Queue received data in stream mode; process directly if no buffer is free */
+static void sdp_rx_queue(struct f_sdp *sdp, u8 *data, int datalen)
+{
+	struct sdp_rx_buf *rx;
+
+	if (!sdp->rx_buf || (datalen > SDP_RX_BUF_SIZE)) {
+		sdp_rx_flush(sdp);
+		stream_ops->rx_data(data, datalen);
+		return;
+	}
+
+	if (sdp->rx_head - sdp->rx_tail >= SDP_RX_BUFFERS) {
+		unsigned long start = timer_get_us();
+
+		sdp_rx_process(sdp);
+		sdp->dnl_stall_us += timer_get_us() - start;
+	}
+
+	rx = &sdp->rx_buf[sdp->rx_head % SDP_RX_BUFFERS];
+	memcpy(rx->data, data, datalen);
+	rx->len = datalen;
+	sdp->rx_head++;
+}
+
+/* Show throughput of the download and the time USB was stalled by us */
+static void sdp_show_stats(struct f_sdp *sdp)
+{
+	unsigned long us = timer_get_us() - sdp->dnl_start_us;
+
+	printf("done, %u bytes in %lu ms", sdp->dnl_bytes, us / 1000);
+	if (us)
+		printf(" (%llu KiB/s)",
+		       div_u64((u64)sdp->dnl_bytes * 1000000, us) >> 10);
+	printf(", stalled %lu ms\n", sdp->dnl_stall_us / 1000);
+}
+
 static void sdp_rx_data_complete(struct usb_ep *ep, struct usb_request *req)
 {
 	struct f_sdp *sdp = req->context;
@@ -397,7 +482,7 @@ static void sdp_rx_data_complete(struct usb_ep *ep, struct usb_request *req)
 
 	if (sdp->state == SDP_STATE_RX_FILE_DATA) {
 		if (stream_ops && stream_ops->rx_data)
-			stream_ops->rx_data(data, datalen);
+			sdp_rx_queue(sdp, data, datalen);
 		else
 			memcpy(sdp_ptr(sdp->dnl_address), data, datalen);
 		sdp->dnl_address += datalen;
@@ -409,7 +494,12 @@ static void sdp_rx_data_complete(struct usb_ep *ep, struct usb_request *req)
 #ifndef CONFIG_SPL_BUILD
 	env_set_hex("filesize", sdp->dnl_bytes);
 #endif
-	printf("done\n");
+	/* All data must be processed before the status is sent */
+	sdp_rx_flush(sdp);
+	if (sdp->state == SDP_STATE_RX_FILE_DATA)
+		sdp_show_stats(sdp);
+	else
+		printf("done\n");
 
 	switch (sdp->state) {
 	case SDP_STATE_RX_FILE_DATA:
@@ -551,6 +641,7 @@ error:
 
 static void sdp_unbind(struct usb_configuration *c, struct usb_function *f)
 {
+	free(sdp_func->rx_buf);
 	free(sdp_func);
 	sdp_func = NULL;
 }
@@ -643,6 +734,8 @@ static int sdp_bind_config(struct usb_configuration *c)
 		sdp_func = memalign(CONFIG_SYS_CACHELINE_SIZE, sizeof(*sdp_func));
 		if (!sdp_func)
 			return -ENOMEM;
+	} else {
+		free(sdp_func->rx_buf);
 	}
 
 	memset(sdp_func, 0, sizeof(*sdp_func));
@@ -861,6 +954,11 @@ void sdp_handle(int controller_index,
 
 	stream_ops = ops;
 
+	/* Without the ring, received data is passed on directly */
+	if (ops && ops->rx_data && !sdp_func->rx_buf)
+		sdp_func->rx_buf = malloc(SDP_RX_BUFFERS *
+					  sizeof(struct sdp_rx_buf));
+
 	printf("SDP: handle requests...\n");
 	while (1) {
 		if (ctrlc()) {
@@ -871,6 +969,10 @@ void sdp_handle(int controller_index,
 		WATCHDOG_RESET();
 		usb_gadget_handle_interrupts(controller_index);
 
+		/* Process received data while USB receives the next report */
+		if (sdp_func->rx_tail != sdp_func->rx_head)
+			sdp_rx_process(sdp_func);
+
 		sdp_handle_in_ep();
 		if (single) {
 			if ((last_state != SDP_STATE_IDLE)
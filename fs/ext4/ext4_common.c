@@ -26,6 +26,7 @@
 #include <malloc.h>
 #include <memalign.h>
 #include <part.h>
+#include <sort.h>
 #include <stddef.h>
 #include <linux/stat.h>
 #include <linux/time.h>
@@ -130,6 +131,15 @@ uint32_t ext4fs_bg_get_free_blocks(const struct ext2_block_group *bg,
 	return free_blocks;
 }
 
+static inline void ext4fs_bg_set_free_blocks(struct ext2_block_group *bg,
+					     const struct ext_filesystem *fs,
+					     uint32_t free_blocks)
+{
+	bg->free_blocks = cpu_to_le16(free_blocks & 0xffff);
+	if (fs->gdsize == 64)
+		bg->free_blocks_high = cpu_to_le16(free_blocks >> 16);
+}
+
 static inline
 uint32_t ext4fs_bg_get_free_inodes(const struct ext2_block_group *bg,
 				   const struct ext_filesystem *fs)
@@ -183,7 +193,64 @@ uint64_t ext4fs_bg_get_inode_table_id(const struct ext2_block_group *bg,
 	return block_nr;
 }
 
+/*
+ * Small LRU cache of filesystem blocks holding group descriptors and inodes,
+ * so that looking up the inodes along a path does not read the same blocks
+ * again and again. Blocks are identified by their first sector.
+ */
+#define EXT4FS_META_CACHE_SIZE	8
+
+static struct ext_block_cache ext4fs_meta_cache[EXT4FS_META_CACHE_SIZE];
+static ulong ext4fs_meta_used[EXT4FS_META_CACHE_SIZE];
+static ulong ext4fs_meta_tick;
+
+static char *ext4fs_read_meta(struct ext2_data *data, lbaint_t sector)
+{
+	struct ext_block_cache *cache = ext4fs_meta_cache;
+	int blksz = EXT2_BLOCK_SIZE(data);
+	int i, victim = 0;
+
+	for (i = 0; i < EXT4FS_META_CACHE_SIZE; i++) {
+		if (cache[i].buf && cache[i].block == sector &&
+		    cache[i].size == blksz) {
+			victim = i;
+			break;
+		}
+		if (ext4fs_meta_used[i] < ext4fs_meta_used[victim])
+			victim = i;
+	}
+
+	if (!ext_cache_read(&cache[victim], sector, blksz))
+		return NULL;
+	ext4fs_meta_used[victim] = ++ext4fs_meta_tick;
+
+	return cache[victim].buf;
+}
+
+static void ext4fs_flush_meta(void)
+{
+	int i;
+
+	for (i = 0; i < EXT4FS_META_CACHE_SIZE; i++)
+		ext_cache_fini(&ext4fs_meta_cache[i]);
+}
+
 #if defined(CONFIG_EXT4_WRITE)
+/* Drops cached blocks overlapping 'count' sectors at 'sector' */
+static void ext4fs_invalidate_meta(lbaint_t sector, lbaint_t count)
+{
+	int log2blksz = get_fs()->dev_desc->log2blksz;
+	struct ext_block_cache *cache;
+	int i;
+
+	for (i = 0; i < EXT4FS_META_CACHE_SIZE; i++) {
+		cache = &ext4fs_meta_cache[i];
+		if (cache->buf && cache->block < sector + count &&
+		    sector < cache->block + (cache->size >> log2blksz))
+			ext_cache_fini(cache);
+	}
+}
+
 uint32_t ext4fs_div_roundup(uint32_t size, uint32_t n)
 {
 	uint32_t res = size / n;
@@ -217,6 +284,9 @@ void put_ext4(uint64_t off, const void *buf, uint32_t size)
 		return;
 	}
 
+	ext4fs_invalidate_meta(off >> log2blksz,
+			       ((remainder + size - 1) >> log2blksz) + 1);
+
 	if (remainder) {
 		blk_dread(fs->dev_desc, startblock, 1, sec_buf);
 		temp_ptr = sec_buf;
@@ -236,6 +306,90 @@ void put_ext4(uint64_t off, const void *buf, uint32_t size)
 	}
 }
 
+static int ext4fs_batch_cmp(const void *a, const void *b)
+{
+	const struct ext4fs_batch_blk *x = a;
+	const struct ext4fs_batch_blk *y = b;
+
+	if (x->blknr != y->blknr)
+		return x->blknr < y->blknr ? -1 : 1;
+
+	return x->seq - y->seq;
+}
+
+void ext4fs_batch_add(struct ext4fs_batch *batch, uint64_t blknr,
+		      const char *buf)
+{
+	struct ext_filesystem *fs = get_fs();
+	struct ext4fs_batch_blk *blks;
+
+	if (batch->count == batch->size) {
+		blks = realloc(batch->blks,
+			       (batch->size + 32) * sizeof(*blks));
+		if (!blks) {
+			/* Keep going unbatched */
+			put_ext4(blknr * fs->blksz, buf, fs->blksz);
+			return;
+		}
+		batch->blks = blks;
+		batch->size += 32;
+	}
+
+	batch->blks[batch->count].blknr = blknr;
+	batch->blks[batch->count].buf = buf;
+	batch->blks[batch->count].seq = batch->count;
+	batch->count++;
+}
+
+void ext4fs_batch_flush(struct ext4fs_batch *batch)
+{
+	struct ext_filesystem *fs = get_fs();
+	struct ext4fs_batch_blk *blks = batch->blks;
+	char *bounce = NULL;
+	int bounce_blks = 0;
+	int i, j, n, k;
+
+	qsort(blks, batch->count, sizeof(*blks), ext4fs_batch_cmp);
+
+	/* Drop all but the latest write of each block */
+	for (i = 0, n = 0; i < batch->count; i++) {
+		if (i + 1 < batch->count && blks[i + 1].blknr == blks[i].blknr)
+			continue;
+		blks[n++] = blks[i];
+	}
+
+	for (i = 0; i < n; i = j) {
+		for (j = i + 1; j < n; j++) {
+			if (blks[j].blknr != blks[j - 1].blknr + 1)
+				break;
+		}
+
+		if (j - i > 1 && j - i > bounce_blks) {
+			free(bounce);
+			bounce = malloc_cache_aligned((j - i) * fs->blksz);
+			bounce_blks = bounce ? j - i : 0;
+		}
+		if (j - i == 1 || !bounce) {
+			for (k = i; k < j; k++)
+				put_ext4(blks[k].blknr * fs->blksz, blks[k].buf,
+					 fs->blksz);
+			continue;
+		}
+
+		for (k = i; k < j; k++)
+			memcpy(bounce + (k - i) * fs->blksz, blks[k].buf,
+			       fs->blksz);
+		put_ext4(blks[i].blknr * fs->blksz, bounce,
+			 (j - i) * fs->blksz);
+	}
+
+	free(bounce);
+	free(batch->blks);
+	batch->blks = NULL;
+	batch->count = 0;
+	batch->size = 0;
+}
+
 static int _get_new_inode_no(unsigned char *buffer)
 {
 	struct ext_filesystem *fs = get_fs();
@@ -304,6 +458,14 @@ static int _get_new_blk_no(unsigned char *buffer)
 	return -1;
 }
 
+static void ext4fs_mark_bg_dirty(int index, unsigned char flags)
+{
+	struct ext_filesystem *fs = get_fs();
+
+	if (fs->bg_dirty)
+		fs->bg_dirty[index] |= flags;
+}
+
 int ext4fs_set_block_bmap(long int blockno, unsigned char *buffer, int index)
 {
 	int i, remainder, status;
@@ -322,6 +484,7 @@ int ext4fs_set_block_bmap(long int blockno, unsigned char *buffer, int index)
 			return -1;
 
 		*ptr = *ptr | operand;
+		ext4fs_mark_bg_dirty(index, EXT4FS_BBMAP_DIRTY);
 		return 0;
 	} else {
 		if (remainder == 0) {
@@ -336,6 +499,7 @@ int ext4fs_set_block_bmap(long int blockno, unsigned char *buffer, int index)
 			return -1;
 
 		*ptr = *ptr | operand;
+		ext4fs_mark_bg_dirty(index, EXT4FS_BBMAP_DIRTY);
 		return 0;
 	}
 }
@@ -349,6 +513,7 @@ void ext4fs_reset_block_bmap(long int blockno, unsigned char *buffer, int index)
 	remainder = blockno % 8;
 	int blocksize = EXT2_BLOCK_SIZE(ext4fs_root);
 
+	ext4fs_mark_bg_dirty(index, EXT4FS_BBMAP_DIRTY);
 	i = i - (index * blocksize);
 	if (blocksize != 1024) {
 		ptr = ptr + i;
@@ -391,6 +556,7 @@ int ext4fs_set_inode_bmap(int inode_no, unsigned char *buffer, int index)
 		return -1;
 
 	*ptr = *ptr | operand;
+	ext4fs_mark_bg_dirty(index, EXT4FS_IBMAP_DIRTY);
 
 	return 0;
 }
@@ -401,6 +567,7 @@ void ext4fs_reset_inode_bmap(int inode_no, unsigned char *buffer, int index)
 	unsigned char *ptr = buffer;
 	unsigned char operand;
 
+	ext4fs_mark_bg_dirty(index, EXT4FS_IBMAP_DIRTY);
 	inode_no -= (index * le32_to_cpu(ext4fs_root->sblock.inodes_per_group));
 	i = inode_no / 8;
 	remainder = inode_no % 8;
@@ -958,7 +1125,7 @@ int ext4fs_filename_unlink(char *filename)
 	return -1;
 }
 
-uint32_t ext4fs_get_new_blk_no(void)
+static long int ext4fs_alloc_blk_no(void)
 {
 	short i;
 	short status;
@@ -996,6 +1163,7 @@ uint32_t ext4fs_get_new_blk_no(void)
 				fs->curr_blkno = fs->curr_blkno +
 						(i * fs->blksz * 8);
 				fs->first_pass_bbmap++;
+				ext4fs_mark_bg_dirty(i, EXT4FS_BBMAP_DIRTY);
 				ext4fs_bg_free_blocks_dec(bgd, fs);
 				ext4fs_sb_free_blocks_dec(fs->sb);
 				status = ext4fs_devread(b_bitmap_blk *
@@ -1087,6 +1255,100 @@ fail:
 	return -1;
 }
 
+/*
+ * Reserve a run of up to @count blocks: the next free block, extended over
+ * the free blocks following it in the same group. The bitmap and the free
+ * block counts are updated once for the whole run.
+ */
+static void ext4fs_reserve_blocks(uint32_t count)
+{
+	struct ext_filesystem *fs = get_fs();
+	struct ext2_sblock *sb = &ext4fs_root->sblock;
+	uint32_t first_data = le32_to_cpu(sb->first_data_block);
+	uint32_t blk_per_grp = le32_to_cpu(sb->blocks_per_group);
+	uint32_t total = le32_to_cpu(sb->total_blocks);
+	struct ext2_block_group *bgd;
+	uint32_t bg_idx, bit, n;
+	unsigned char *bmap;
+	long int blkno;
+
+	blkno = ext4fs_alloc_blk_no();
+	if (blkno == -1)
+		return;
+
+	fs->resv_blkno = blkno;
+	fs->resv_count = 1;
+	bg_idx = (blkno - first_data) / blk_per_grp;
+	bit = (blkno - first_data) % blk_per_grp + 1;
+	bmap = fs->blk_bmaps[bg_idx];
+
+	while (fs->resv_count < count && bit < blk_per_grp &&
+	       blkno + fs->resv_count < total) {
+		if (!(bit & 7) && count - fs->resv_count >= 8 &&
+		    bit + 8 <= blk_per_grp && blkno + fs->resv_count + 8 <= total &&
+		    !bmap[bit >> 3]) {
+			bmap[bit >> 3] = 0xff;
+			n = 8;
+		} else if (!(bmap[bit >> 3] & (1 << (bit & 7)))) {
+			bmap[bit >> 3] |= 1 << (bit & 7);
+			n = 1;
+		} else {
+			break;
+		}
+		bit += n;
+		fs->resv_count += n;
+	}
+
+	/* The first block was accounted by ext4fs_alloc_blk_no() */
+	ext4fs_mark_bg_dirty(bg_idx, EXT4FS_BBMAP_DIRTY);
+	n = fs->resv_count - 1;
+	bgd = ext4fs_get_group_descriptor(fs, bg_idx);
+	ext4fs_bg_set_free_blocks(bgd, fs, ext4fs_bg_get_free_blocks(bgd, fs) - n);
+	ext4fs_sb_set_free_blocks(fs->sb, ext4fs_sb_get_free_blocks(fs->sb) - n);
+	fs->curr_blkno = blkno + fs->resv_count - 1;
+}
+
+/* Give back the reserved blocks that were not used */
+static void ext4fs_release_blocks(void)
+{
+	struct ext_filesystem *fs = get_fs();
+	struct ext2_sblock *sb = &ext4fs_root->sblock;
+	uint32_t first_data = le32_to_cpu(sb->first_data_block);
+	uint32_t blk_per_grp = le32_to_cpu(sb->blocks_per_group);
+	struct ext2_block_group *bgd;
+	uint32_t bg_idx;
+
+	fs->resv_want = 0;
+	if (!fs->resv_count)
+		return;
+
+	bg_idx = (fs->resv_blkno - first_data) / blk_per_grp;
+	bgd = ext4fs_get_group_descriptor(fs, bg_idx);
+	ext4fs_bg_set_free_blocks(bgd, fs, ext4fs_bg_get_free_blocks(bgd, fs) +
+				  fs->resv_count);
+	ext4fs_sb_set_free_blocks(fs->sb, ext4fs_sb_get_free_blocks(fs->sb) +
+				  fs->resv_count);
+	for (; fs->resv_count; fs->resv_count--, fs->resv_blkno++)
+		ext4fs_reset_block_bmap(fs->resv_blkno, fs->blk_bmaps[bg_idx],
+					bg_idx);
+}
+
+uint32_t ext4fs_get_new_blk_no(void)
+{
+	struct ext_filesystem *fs = get_fs();
+
+	if (!fs->resv_count && fs->resv_want)
+		ext4fs_reserve_blocks(fs->resv_want);
+	if (!fs->resv_count)
+		return ext4fs_alloc_blk_no();
+
+	fs->resv_count--;
+	if (fs->resv_want)
+		fs->resv_want--;
+
+	return fs->resv_blkno++;
+}
+
 int ext4fs_get_new_inode_no(void)
 {
 	short i;
@@ -1130,6 +1392,7 @@ int ext4fs_get_new_inode_no(void)
 				fs->curr_inode_no = fs->curr_inode_no +
 							(i * inodes_per_grp);
 				fs->first_pass_ibmap++;
+				ext4fs_mark_bg_dirty(i, EXT4FS_IBMAP_DIRTY);
 				ext4fs_bg_free_inodes_dec(bgd, fs);
 				if (has_gdt_chksum)
 					ext4fs_bg_itable_unused_dec(bgd, fs);
@@ -1212,7 +1475,6 @@ static void alloc_single_indirect_block(struct ext2_inode *file_inode,
 					unsigned int *no_blks_reqd)
 {
 	short i;
-	short status;
 	long int actual_block_no;
 	long int si_blockno;
 	/* si :single indirect */
@@ -1235,12 +1497,6 @@ static void alloc_single_indirect_block(struct ext2_inode *file_inode,
 		(*no_blks_reqd)++;
 		debug("SIPB %ld: %u\n", si_blockno, *total_remaining_blocks);
 
-		status = ext4fs_devread((lbaint_t)si_blockno * fs->sect_perblk,
-					0, fs->blksz, (char *)si_buffer);
-		memset(si_buffer, '\0', fs->blksz);
-		if (status == 0)
-			goto fail;
-
 		for (i = 0; i < (fs->blksz / sizeof(int)); i++) {
 			actual_block_no = ext4fs_get_new_blk_no();
 			if (actual_block_no == -1) {
@@ -1272,7 +1528,6 @@ static void alloc_double_indirect_block(struct ext2_inode *file_inode,
 {
 	short i;
 	short j;
-	short status;
 	long int actual_block_no;
 	/* di:double indirect */
 	long int di_blockno_parent;
@@ -1299,16 +1554,6 @@ static void alloc_double_indirect_block(struct ext2_inode *file_inode,
 		debug("DIPB %ld: %u\n", di_blockno_parent,
 		      *total_remaining_blocks);
 
-		status = ext4fs_devread((lbaint_t)di_blockno_parent *
-					fs->sect_perblk, 0,
-					fs->blksz, (char *)di_parent_buffer);
-
-		if (!status) {
-			printf("%s: Device read error!\n", __func__);
-			goto fail;
-		}
-		memset(di_parent_buffer, '\0', fs->blksz);
-
 		/*
 		 * start:for each double indirect parent
 		 * block create one more block
@@ -1330,16 +1575,6 @@ static void alloc_double_indirect_block(struct ext2_inode *file_inode,
 			debug("DICB %ld: %u\n", di_blockno_child,
 			      *total_remaining_blocks);
 
-			status = ext4fs_devread((lbaint_t)di_blockno_child *
-						fs->sect_perblk, 0,
-						fs->blksz,
-						(char *)di_child_buff);
-
-			if (!status) {
-				printf("%s: Device read error!\n", __func__);
-				goto fail;
-			}
-			memset(di_child_buff, '\0', fs->blksz);
 			/* filling of actual datablocks for each child */
 			for (j = 0; j < (fs->blksz / sizeof(int)); j++) {
 				actual_block_no = ext4fs_get_new_blk_no();
@@ -1493,6 +1728,27 @@ fail:
 	free(ti_gp_buff_start_addr);
 }
 
+/* Number of indirect blocks needed to map @blocks data blocks */
+static uint32_t ext4fs_indirect_blocks(uint32_t blocks)
+{
+	struct ext_filesystem *fs = get_fs();
+	uint32_t per_blk = fs->blksz / sizeof(__le32);
+	uint32_t children;
+
+	if (blocks <= INDIRECT_BLOCKS)
+		return 0;
+	blocks -= INDIRECT_BLOCKS;
+	if (blocks <= per_blk)
+		return 1;
+	blocks -= per_blk;
+	if (blocks <= per_blk * per_blk)
+		return 2 + DIV_ROUND_UP(blocks, per_blk);
+	blocks -= per_blk * per_blk;
+	children = DIV_ROUND_UP(blocks, per_blk);
+
+	return 2 + per_blk + 1 + DIV_ROUND_UP(children, per_blk) + children;
+}
+
 void ext4fs_allocate_blocks(struct ext2_inode *file_inode,
 				unsigned int total_remaining_blocks,
 				unsigned int *total_no_of_block)
@@ -1500,12 +1756,18 @@ void ext4fs_allocate_blocks(struct ext2_inode *file_inode,
 	short i;
 	long int direct_blockno;
 	unsigned int no_blks_reqd = 0;
+	struct ext_filesystem *fs = get_fs();
+
+	/* Data and indirect blocks are reserved in contiguous runs */
+	fs->resv_want = total_remaining_blocks +
+			ext4fs_indirect_blocks(total_remaining_blocks);
 
 	/* allocation of direct blocks */
 	for (i = 0; total_remaining_blocks && i < INDIRECT_BLOCKS; i++) {
 		direct_blockno = ext4fs_get_new_blk_no();
 		if (direct_blockno == -1) {
 			printf("no block left to assign\n");
+			ext4fs_release_blocks();
 			return;
 		}
 		file_inode->b.blocks.dir_blocks[i] = cpu_to_le32(direct_blockno);
@@ -1521,6 +1783,7 @@ void ext4fs_allocate_blocks(struct ext2_inode *file_inode,
 	alloc_triple_indirect_block(file_inode, &total_remaining_blocks,
 				    &no_blks_reqd);
 	*total_no_of_block += no_blks_reqd;
+	ext4fs_release_blocks();
 }
 
 #endif
@@ -1566,6 +1829,228 @@ static struct ext4_extent_header *ext4fs_get_extent_block
 	}
 }
 
+/* Max. depth of an extent tree, as in Linux */
+#define EXT4_EXT_MAX_DEPTH	5
+/* Extents longer than this are unwritten (preallocated) */
+#define EXT4_EXT_INIT_MAX_LEN	32768
+
+static int ext4fs_add_extent(struct ext4_extent_map **mapp, int *count,
+			     int *size, uint32_t block, uint32_t len,
+			     uint64_t start)
+{
+	struct ext4_extent_map *map = *mapp, *last;
+
+	/* Merge with the previous run if logically and physically adjacent */
+	if (*count) {
+		last = &map[*count - 1];
+		if (last->block + last->len == block && last->start && start &&
+		    last->start + last->len == start) {
+			last->len += len;
+			return 0;
+		}
+	}
+
+	if (*count == *size) {
+		*size = *size ? *size * 2 : 16;
+		map = realloc(map, *size * sizeof(*map));
+		if (!map)
+			return -ENOMEM;
+		*mapp = map;
+	}
+
+	map[*count].block = block;
+	map[*count].len = len;
+	map[*count].start = start;
+	(*count)++;
+
+	return 0;
+}
+
+static int ext4fs_walk_extents(struct ext4_extent_header *ext_block,
+			       int space, int depth,
+			       struct ext4_extent_map **mapp, int *count,
+			       int *size)
+{
+	int blksz = EXT2_BLOCK_SIZE(ext4fs_root);
+	int log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root) -
+		get_fs()->dev_desc->log2blksz;
+	struct ext4_extent_header *child;
+	struct ext4_extent_idx *index;
+	struct ext4_extent *extent;
+	uint64_t block;
+	uint32_t len;
+	int i, ret = 0;
+
+	if (le16_to_cpu(ext_block->eh_magic) != EXT4_EXT_MAGIC ||
+	    le16_to_cpu(ext_block->eh_depth) != depth ||
+	    (le16_to_cpu(ext_block->eh_entries) + 1) *
+	    sizeof(struct ext4_extent) > space)
+		return -EINVAL;
+
+	if (!depth) {
+		extent = (struct ext4_extent *)(ext_block + 1);
+		for (i = 0; i < le16_to_cpu(ext_block->eh_entries); i++) {
+			block = le16_to_cpu(extent[i].ee_start_hi);
+			block = (block << 32) +
+				le32_to_cpu(extent[i].ee_start_lo);
+			len = le16_to_cpu(extent[i].ee_len);
+			if (len > EXT4_EXT_INIT_MAX_LEN) {
+				/* Unwritten extents read as zeros */
+				len -= EXT4_EXT_INIT_MAX_LEN;
+				block = 0;
+			}
+			ret = ext4fs_add_extent(mapp, count, size,
+						le32_to_cpu(extent[i].ee_block),
+						len, block);
+			if (ret)
+				return ret;
+		}
+
+		return 0;
+	}
+
+	child = memalign(ARCH_DMA_MINALIGN, blksz);
+	if (!child)
+		return -ENOMEM;
+
+	index = (struct ext4_extent_idx *)(ext_block + 1);
+	for (i = 0; i < le16_to_cpu(ext_block->eh_entries); i++) {
+		block = le16_to_cpu(index[i].ei_leaf_hi);
+		block = (block << 32) + le32_to_cpu(index[i].ei_leaf_lo);
+		if (!ext4fs_devread((lbaint_t)block << log2_blksz, 0, blksz,
+				    (char *)child)) {
+			ret = -EIO;
+			break;
+		}
+		ret = ext4fs_walk_extents(child, blksz, depth - 1, mapp, count,
+					  size);
+		if (ret)
+			break;
+	}
+
+	free(child);
+
+	return ret;
+}
+
+/**
+ * ext4fs_build_extent_map() - decode the extent tree of an inode
+ *
+ * The whole tree is read once and turned into a sorted array of runs of
+ * physically contiguous blocks, merging adjacent extents. Holes are not
+ * listed, unwritten extents are listed with start block 0.
+ *
+ * @inode:	Inode using extents
+ * @mapp:	Returns the allocated map, to be freed by the caller
+ * @return number of entries in the map, or -ve on error
+ */
+int ext4fs_build_extent_map(struct ext2_inode *inode,
+			    struct ext4_extent_map **mapp)
+{
+	struct ext4_extent_header *root;
+	int count = 0, size = 0, depth, ret;
+
+	*mapp = NULL;
+	root = (struct ext4_extent_header *)inode->b.blocks.dir_blocks;
+	depth = le16_to_cpu(root->eh_depth);
+	if (depth > EXT4_EXT_MAX_DEPTH)
+		return -EINVAL;
+
+	ret = ext4fs_walk_extents(root, sizeof(inode->b),
+				  depth, mapp, &count, &size);
+	if (ret) {
+		free(*mapp);
+		*mapp = NULL;
+		return ret;
+	}
+
+	return count;
+}
+
+/**
+ * ext4fs_node_extent_map() - get the extent map of a node
+ *
+ * The map is built on the first call and kept in the node, so repeated
+ * reads of the same file or directory do not walk the extent tree again.
+ * It is freed with the node or by ext4fs_drop_extent_map().
+ *
+ * @node:	Node using extents, with the inode read
+ * @mapp:	Returns the map, owned by the node
+ * @return number of entries in the map, or -ve on error
+ */
+int ext4fs_node_extent_map(struct ext2fs_node *node,
+			   struct ext4_extent_map **mapp)
+{
+	int count;
+
+	if (!node->extent_map) {
+		count = ext4fs_build_extent_map(&node->inode,
+						&node->extent_map);
+		if (count < 0)
+			return count;
+		node->extent_count = count;
+	}
+	*mapp = node->extent_map;
+
+	return node->extent_count;
+}
+
+/* Free the cached extent map of @node, it is rebuilt on the next read */
+void ext4fs_drop_extent_map(struct ext2fs_node *node)
+{
+	free(node->extent_map);
+	node->extent_map = NULL;
+	node->extent_count = 0;
+}
+
+/* Drop the maps of the nodes kept open, after the filesystem was modified */
+void ext4fs_drop_extent_maps(void)
+{
+	if (ext4fs_file)
+		ext4fs_drop_extent_map(ext4fs_file);
+	if (ext4fs_root)
+		ext4fs_drop_extent_map(&ext4fs_root->diropen);
+}
+
+/**
+ * ext4fs_map_block() - look up a logical block in an extent map
+ *
+ * @map:	Map from ext4fs_build_extent_map()
+ * @count:	Number of entries in the map
+ * @fileblock:	Logical block to look up
+ * @len:	Returns the number of blocks from @fileblock on that are
+ *		contiguous on disk, or that are a hole (up to the next
+ *		mapped block, UINT_MAX after the last one)
+ * @return first physical block, or 0 for a hole
+ */
+uint64_t ext4fs_map_block(struct ext4_extent_map *map, int count,
+			  uint32_t fileblock, uint32_t *len)
+{
+	int lo = 0, hi = count;
+	int mid;
+
+	/* Find the first run starting after fileblock */
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (map[mid].block <= fileblock)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo > 0 && fileblock - map[lo - 1].block < map[lo - 1].len) {
+		map += lo - 1;
+		*len = map->len - (fileblock - map->block);
+		if (!map->start)
+			return 0;
+		return map->start + (fileblock - map->block);
+	}
+
+	*len = lo < count ? map[lo].block - fileblock : UINT_MAX;
+
+	return 0;
+}
+
 static int ext4fs_blockgroup
 	(struct ext2_data *data, int group, struct ext2_block_group *blkgrp)
 {
@@ -1573,6 +2058,7 @@ static int ext4fs_blockgroup
 	unsigned int blkoff, desc_per_blk;
 	int log2blksz = get_fs()->dev_desc->log2blksz;
 	int desc_size = get_fs()->gdsize;
+	char *block;
 
 	if (desc_size == 0)
 		return 0;
@@ -1587,9 +2073,13 @@ static int ext4fs_blockgroup
 	debug("ext4fs read %d group descriptor (blkno %ld blkoff %u)\n",
 	      group, blkno, blkoff);
 
-	return ext4fs_devread((lbaint_t)blkno <<
-			      (LOG2_BLOCK_SIZE(data) - log2blksz),
-			      blkoff, desc_size, (char *)blkgrp);
+	block = ext4fs_read_meta(data, (lbaint_t)blkno <<
+				 (LOG2_BLOCK_SIZE(data) - log2blksz));
+	if (!block)
+		return 0;
+	memcpy(blkgrp, block + blkoff, desc_size);
+
+	return 1;
 }
 
 int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
@@ -1601,6 +2091,7 @@ int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
 	int inodes_per_block, status;
 	long int blkno;
 	unsigned int blkoff;
+	char *block;
 
 	/* Allocate blkgrp based on gdsize (for 64-bit support). */
 	blkgrp = zalloc(get_fs()->gdsize);
@@ -1633,11 +2124,11 @@ int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
 	free(blkgrp);
 
 	/* Read the inode. */
-	status = ext4fs_devread((lbaint_t)blkno << (LOG2_BLOCK_SIZE(data) -
-				log2blksz), blkoff,
-				sizeof(struct ext2_inode), (char *)inode);
-	if (status == 0)
+	block = ext4fs_read_meta(data, (lbaint_t)blkno <<
+				 (LOG2_BLOCK_SIZE(data) - log2blksz));
+	if (!block)
 		return 0;
+	memcpy(inode, block + blkoff, sizeof(struct ext2_inode));
 
 	return 1;
 }
@@ -2030,11 +2521,14 @@ void ext4fs_reinit_global(void)
 }
 void ext4fs_close(void)
 {
+	ext4fs_flush_meta();
+
 	if ((ext4fs_file != NULL) && (ext4fs_root != NULL)) {
 		ext4fs_free_node(ext4fs_file, &ext4fs_root->diropen);
 		ext4fs_file = NULL;
 	}
 	if (ext4fs_root != NULL) {
+		ext4fs_drop_extent_map(&ext4fs_root->diropen);
 		free(ext4fs_root);
 		ext4fs_root = NULL;
 	}
@@ -2042,77 +2536,60 @@ void ext4fs_close(void)
 	ext4fs_reinit_global();
 }
 
-int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
+/*
+ * Look for @name in one directory block, or list its entries if @name is
+ * NULL. Returns 1 if found, 0 if not and -1 on a corrupted block.
+ */
+static int ext4fs_iterate_block(struct ext2fs_node *diro, char *block,
+				unsigned int blocklen, char *name,
 				struct ext2fs_node **fnode, int *ftype)
 {
 	unsigned int fpos = 0;
 	int status;
-	loff_t actread;
-	struct ext2fs_node *diro = (struct ext2fs_node *) dir;
-
-#ifdef DEBUG
-	if (name != NULL)
-		printf("Iterate dir %s\n", name);
-#endif /* of DEBUG */
-	if (!diro->inode_read) {
-		status = ext4fs_read_inode(diro->data, diro->ino, &diro->inode);
-		if (status == 0)
-			return 0;
-	}
-	/* Search the file.  */
-	while (fpos < le32_to_cpu(diro->inode.size)) {
-		struct ext2_dirent dirent;
 
-		status = ext4fs_read_file(diro, fpos,
-					   sizeof(struct ext2_dirent),
-					   (char *)&dirent, &actread);
-		if (status < 0)
-			return 0;
+	while (fpos < blocklen) {
+		struct ext2_dirent *dirent = (struct ext2_dirent *)(block + fpos);
+		unsigned int direntlen = le16_to_cpu(dirent->direntlen);
 
-		if (dirent.direntlen == 0) {
+		if (direntlen < sizeof(struct ext2_dirent) + dirent->namelen ||
+		    fpos + direntlen > blocklen) {
 			printf("Failed to iterate over directory %s\n", name);
-			return 0;
+			return -1;
 		}
 
-		if (dirent.namelen != 0) {
-			char filename[dirent.namelen + 1];
+		if (dirent->namelen != 0) {
+			char filename[dirent->namelen + 1];
 			struct ext2fs_node *fdiro;
 			int type = FILETYPE_UNKNOWN;
 
-			status = ext4fs_read_file(diro,
-						  fpos +
-						  sizeof(struct ext2_dirent),
-						  dirent.namelen, filename,
-						  &actread);
-			if (status < 0)
-				return 0;
+			memcpy(filename, dirent + 1, dirent->namelen);
 
 			fdiro = zalloc(sizeof(struct ext2fs_node));
 			if (!fdiro)
-				return 0;
+				return -1;
 
 			fdiro->data = diro->data;
-			fdiro->ino = le32_to_cpu(dirent.inode);
+			fdiro->ino = le32_to_cpu(dirent->inode);
 
-			filename[dirent.namelen] = '\0';
+			filename[dirent->namelen] = '\0';
 
-			if (dirent.filetype != FILETYPE_UNKNOWN) {
+			if (dirent->filetype != FILETYPE_UNKNOWN) {
 				fdiro->inode_read = 0;
 
-				if (dirent.filetype == FILETYPE_DIRECTORY)
+				if (dirent->filetype == FILETYPE_DIRECTORY)
 					type = FILETYPE_DIRECTORY;
-				else if (dirent.filetype == FILETYPE_SYMLINK)
+				else if (dirent->filetype == FILETYPE_SYMLINK)
 					type = FILETYPE_SYMLINK;
-				else if (dirent.filetype == FILETYPE_REG)
+				else if (dirent->filetype == FILETYPE_REG)
 					type = FILETYPE_REG;
 			} else {
 				status = ext4fs_read_inode(diro->data,
 							   le32_to_cpu
-							   (dirent.inode),
+							   (dirent->inode),
 							   &fdiro->inode);
 				if (status == 0) {
 					free(fdiro);
-					return 0;
+					return -1;
 				}
 				fdiro->inode_read = 1;
 
@@ -2144,11 +2621,11 @@ int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 				if (fdiro->inode_read == 0) {
 					status = ext4fs_read_inode(diro->data,
 								 le32_to_cpu(
-								 dirent.inode),
+								 dirent->inode),
 								 &fdiro->inode);
 					if (status == 0) {
 						free(fdiro);
-						return 0;
+						return -1;
 					}
 					fdiro->inode_read = 1;
 				}
@@ -2172,8 +2649,223 @@ int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 			}
 			free(fdiro);
 		}
-		fpos += le16_to_cpu(dirent.direntlen);
+		fpos += direntlen;
+	}
+	return 0;
+}
+
+/* Depth of the index tree of hashed directories with the largedir feature */
+#define EXT4_DX_MAX_LEVELS	3
+
+/* Read block @block of a hashed directory, which must lie within the file */
+static int ext4fs_dx_read(struct ext2fs_node *diro, uint32_t block, char *buf)
+{
+	int blocksize = EXT2_BLOCK_SIZE(diro->data);
+	loff_t pos = (loff_t)block * blocksize;
+	loff_t actread;
+
+	if (pos + blocksize > le32_to_cpu(diro->inode.size))
+		return -1;
+	if (ext4fs_read_file(diro, pos, blocksize, buf, &actread) < 0 ||
+	    actread != blocksize)
+		return -1;
+
+	return 0;
+}
+
+/* Entries of an index node starting at @offset, NULL if they are invalid */
+static struct dx_entry *ext4fs_dx_entries(char *buf, unsigned int offset,
+					  int blocksize, int *count)
+{
+	struct dx_countlimit *countlimit = (struct dx_countlimit *)
+					   (buf + offset);
+	unsigned int limit = le16_to_cpu(countlimit->limit);
+
+	*count = le16_to_cpu(countlimit->count);
+	if (!*count || *count > limit ||
+	    offset + limit * sizeof(struct dx_entry) > blocksize)
+		return NULL;
+
+	return (struct dx_entry *)countlimit;
+}
+
+/*
+ * Find @name in a hashed directory by walking its index tree down to the
+ * leaf block holding the name's hash. Returns 1 if found, 0 if not and -1
+ * if the directory has no usable index and must be scanned linearly.
+ */
+static int ext4fs_dx_lookup(struct ext2fs_node *diro, char *name,
+			    struct ext2fs_node **fnode, int *ftype)
+{
+	struct ext2_sblock *sb = &diro->data->sblock;
+	int blocksize = EXT2_BLOCK_SIZE(diro->data);
+	uint32_t flags = le32_to_cpu(diro->inode.flags);
+	struct dx_entry *entries[EXT4_DX_MAX_LEVELS];
+	struct dx_entry *at[EXT4_DX_MAX_LEVELS];
+	int count[EXT4_DX_MAX_LEVELS];
+	struct dx_entry *p, *q, *m;
+	struct dx_root_info *info;
+	unsigned int offset;
+	int version, levels, level, maxlevels, i, status, ret = -1;
+	u32 seed[4], hash;
+	char *buf, *leaf;
+
+	if (!(le32_to_cpu(sb->feature_compatibility) &
+	      EXT4_FEATURE_COMPAT_DIR_INDEX) || !(flags & EXT4_INDEX_FL) ||
+	    (flags & (EXT4_ENCRYPT_FL | EXT4_CASEFOLD_FL)))
+		return -1;
+
+	/* "." and ".." are not indexed, but come first in block 0 */
+	if (!strcmp(name, ".") || !strcmp(name, ".."))
+		return -1;
+
+	buf = malloc(blocksize * (EXT4_DX_MAX_LEVELS + 1));
+	if (!buf)
+		return -1;
+	leaf = buf + blocksize * EXT4_DX_MAX_LEVELS;
+
+	/* The root info follows the "." and ".." entries of block 0 */
+	if (ext4fs_dx_read(diro, 0, buf))
+		goto out;
+	info = (struct dx_root_info *)(buf + 24);
+	offset = 24 + info->info_length;
+	levels = info->indirect_levels + 1;
+	maxlevels = (le32_to_cpu(sb->feature_incompat) &
+		     EXT4_FEATURE_INCOMPAT_LARGEDIR) ? 3 : 2;
+	if (info->reserved_zero || info->info_length < sizeof(*info) ||
+	    levels > maxlevels)
+		goto out;
+
+	version = info->hash_version;
+	if (version <= DX_HASH_TEA &&
+	    (le32_to_cpu(sb->flags) & EXT2_FLAGS_UNSIGNED_HASH))
+		version += DX_HASH_LEGACY_UNSIGNED;
+	for (i = 0; i < 4; i++)
+		seed[i] = le32_to_cpu(sb->hash_seed[i]);
+	if (ext4fs_dirhash(name, strlen(name), version, seed, &hash))
+		goto out;
+
+	for (level = 0; level < levels; level++) {
+		char *node = buf + level * blocksize;
+
+		/* Interior nodes start with an empty entry over the block */
+		if (level) {
+			if (ext4fs_dx_read(diro, le32_to_cpu(at[level - 1]->block)
+					   & 0x0fffffff, node))
+				goto out;
+			offset = sizeof(struct ext2_dirent);
+		}
+		entries[level] = ext4fs_dx_entries(node, offset, blocksize,
+						   &count[level]);
+		if (!entries[level])
+			goto out;
+
+		/* Last entry with a hash not above ours, the first has none */
+		p = entries[level] + 1;
+		q = entries[level] + count[level] - 1;
+		while (p <= q) {
+			m = p + (q - p) / 2;
+			if (le32_to_cpu(m->hash) > hash)
+				q = m - 1;
+			else
+				p = m + 1;
+		}
+		at[level] = p - 1;
 	}
+
+	for (;;) {
+		if (ext4fs_dx_read(diro, le32_to_cpu(at[levels - 1]->block) &
+				   0x0fffffff, leaf))
+			goto out;
+		status = ext4fs_iterate_block(diro, leaf, blocksize, name,
+					      fnode, ftype);
+		if (status) {
+			ret = status;
+			goto out;
+		}
+
+		/*
+		 * Names with the same hash can continue in the next leaf, its
+		 * index entry then has the hash with the lowest bit set.
+		 */
+		for (level = levels - 1; level >= 0; level--) {
+			if (++at[level] < entries[level] + count[level])
+				break;
+		}
+		if (level < 0 || (le32_to_cpu(at[level]->hash) & ~1) != hash)
+			break;
+
+		for (level++; level < levels; level++) {
+			char *node = buf + level * blocksize;
+
+			if (ext4fs_dx_read(diro, le32_to_cpu(at[level - 1]->block)
+					   & 0x0fffffff, node))
+				goto out;
+			entries[level] = ext4fs_dx_entries(node,
+						sizeof(struct ext2_dirent),
+						blocksize, &count[level]);
+			if (!entries[level])
+				goto out;
+			at[level] = entries[level];
+		}
+	}
+	ret = 0;
+
+out:
+	free(buf);
+	return ret;
+}
+
+int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
+				struct ext2fs_node **fnode, int *ftype)
+{
+	unsigned int fpos = 0;
+	unsigned int size;
+	int blocksize;
+	int status;
+	loff_t actread;
+	struct ext2fs_node *diro = (struct ext2fs_node *) dir;
+	char *block;
+
+#ifdef DEBUG
+	if (name != NULL)
+		printf("Iterate dir %s\n", name);
+#endif /* of DEBUG */
+	if (!diro->inode_read) {
+		status = ext4fs_read_inode(diro->data, diro->ino, &diro->inode);
+		if (status == 0)
+			return 0;
+	}
+
+	if ((name != NULL) && (fnode != NULL) && (ftype != NULL)) {
+		status = ext4fs_dx_lookup(diro, name, fnode, ftype);
+		if (status >= 0)
+			return status;
+	}
+
+	/* Search the file block by block, entries never cross blocks */
+	size = le32_to_cpu(diro->inode.size);
+	blocksize = EXT2_BLOCK_SIZE(diro->data);
+	block = malloc(blocksize);
+	if (!block)
+		return 0;
+
+	while (fpos < size) {
+		unsigned int len = min((unsigned int)blocksize, size - fpos);
+
+		status = ext4fs_read_file(diro, fpos, len, block, &actread);
+		if (status < 0 || actread != len)
+			break;
+
+		status = ext4fs_iterate_block(diro, block, len, name, fnode,
+					      ftype);
+		if (status) {
+			free(block);
+			return status > 0;
+		}
+		fpos += len;
+	}
+	free(block);
 	return 0;
 }
 
@@ -2372,6 +3064,9 @@ int ext4fs_mount(unsigned part_length)
 	if (!data)
 		return 0;
 
+	/* Cached blocks may belong to another device */
+	ext4fs_flush_meta();
+
 	/* Read the superblock. */
 	status = ext4_read_superblock((char *)&data->sblock);
 
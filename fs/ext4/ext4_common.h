@@ -48,16 +48,57 @@ static inline void *zalloc(size_t size)
 	return p;
 }
 
+/* A run of physically contiguous blocks decoded from the extent tree */
+struct ext4_extent_map {
+	uint32_t block;		/* First logical block */
+	uint32_t len;		/* Number of blocks */
+	uint64_t start;		/* First physical block, 0 if unwritten */
+};
+
 int ext4fs_read_inode(struct ext2_data *data, int ino,
 		      struct ext2_inode *inode);
+int ext4fs_build_extent_map(struct ext2_inode *inode,
+			    struct ext4_extent_map **mapp);
+int ext4fs_node_extent_map(struct ext2fs_node *node,
+			   struct ext4_extent_map **mapp);
+void ext4fs_drop_extent_map(struct ext2fs_node *node);
+void ext4fs_drop_extent_maps(void);
+uint64_t ext4fs_map_block(struct ext4_extent_map *map, int count,
+			  uint32_t fileblock, uint32_t *len);
 int ext4fs_read_file(struct ext2fs_node *node, loff_t pos, loff_t len,
 		     char *buf, loff_t *actread);
+int ext4fs_dirhash(const char *name, int len, int version, const u32 *seed,
+		   u32 *hash);
 int ext4fs_find_file(const char *path, struct ext2fs_node *rootnode,
 			struct ext2fs_node **foundnode, int expecttype);
 int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 			struct ext2fs_node **fnode, int *ftype);
 
 #if defined(CONFIG_EXT4_WRITE)
+/* Flags in ext_filesystem.bg_dirty */
+#define EXT4FS_BBMAP_DIRTY	0x01	/* Block bitmap modified */
+#define EXT4FS_IBMAP_DIRTY	0x02	/* Inode bitmap modified */
+
+/*
+ * Filesystem blocks collected to be written in one pass, sorted by block
+ * number so that adjacent blocks go to the device in a single write. The
+ * buffers must stay valid until ext4fs_batch_flush().
+ */
+struct ext4fs_batch_blk {
+	uint64_t blknr;
+	const char *buf;
+	int seq;		/* Order of adding, the latest write wins */
+};
+
+struct ext4fs_batch {
+	struct ext4fs_batch_blk *blks;
+	int count;
+	int size;
+};
+
+void ext4fs_batch_add(struct ext4fs_batch *batch, uint64_t blknr,
+		      const char *buf);
+void ext4fs_batch_flush(struct ext4fs_batch *batch);
 uint32_t ext4fs_div_roundup(uint32_t size, uint32_t n);
 uint16_t ext4fs_checksum_update(unsigned int i);
 int ext4fs_get_parent_inode_num(const char *dirname, char *dname, int flags);
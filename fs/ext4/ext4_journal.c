@@ -90,16 +90,15 @@ fail:
 	return -1;
 }
 
-void ext4fs_dump_metadata(void)
+/* Queue the dirty metadata blocks, they are written by ext4fs_batch_flush() */
+void ext4fs_dump_metadata(struct ext4fs_batch *batch)
 {
-	struct ext_filesystem *fs = get_fs();
 	int i;
 	for (i = 0; i < MAX_JOURNAL_ENTRIES; i++) {
 		if (dirty_block_ptr[i]->blknr == -1)
 			break;
-		put_ext4((uint64_t) ((uint64_t)dirty_block_ptr[i]->blknr *
-				(uint64_t)fs->blksz), dirty_block_ptr[i]->buf,
-								fs->blksz);
+		ext4fs_batch_add(batch, dirty_block_ptr[i]->blknr,
+				 dirty_block_ptr[i]->buf);
 	}
 }
 
@@ -113,6 +113,7 @@ struct revoke_blk_list {
 };
 
 extern struct ext2_data *ext4fs_root;
+struct ext4fs_batch;
 
 int ext4fs_init_journal(void);
 int ext4fs_log_gdt(char *gd_table);
@@ -120,7 +121,7 @@ int ext4fs_check_journal_state(int recovery_flag);
 int ext4fs_log_journal(char *journal_buffer, uint32_t blknr);
 int ext4fs_put_metadata(char *metadata_buffer, uint32_t blknr);
 void ext4fs_update_journal(void);
-void ext4fs_dump_metadata(void);
+void ext4fs_dump_metadata(struct ext4fs_batch *batch);
 void ext4fs_push_revoke_blk(char *buffer);
 void ext4fs_free_journal(void);
 void ext4fs_free_revoke_blks(void);
@@ -73,39 +73,72 @@ static void ext4fs_update(void)
 	ext4fs_update_journal();
 	struct ext_filesystem *fs = get_fs();
 	struct ext2_block_group *bgd = NULL;
+	struct ext4fs_batch batch = { };
 
 	/* update  super block */
 	put_ext4((uint64_t)(SUPERBLOCK_SIZE),
 		 (struct ext2_sblock *)fs->sb, (uint32_t)SUPERBLOCK_SIZE);
 
-	/* update block bitmaps */
+	/* update the block and inode bitmaps that were modified */
 	for (i = 0; i < fs->no_blkgrp; i++) {
 		bgd = ext4fs_get_group_descriptor(fs, i);
 		bgd->bg_checksum = cpu_to_le16(ext4fs_checksum_update(i));
-		uint64_t b_bitmap_blk = ext4fs_bg_get_block_id(bgd, fs);
-		put_ext4(b_bitmap_blk * fs->blksz,
-			 fs->blk_bmaps[i], fs->blksz);
-	}
-
-	/* update inode bitmaps */
-	for (i = 0; i < fs->no_blkgrp; i++) {
-		bgd = ext4fs_get_group_descriptor(fs, i);
-		uint64_t i_bitmap_blk = ext4fs_bg_get_inode_id(bgd, fs);
-		put_ext4(i_bitmap_blk * fs->blksz,
-			 fs->inode_bmaps[i], fs->blksz);
+		if (fs->bg_dirty[i] & EXT4FS_BBMAP_DIRTY)
+			ext4fs_batch_add(&batch, ext4fs_bg_get_block_id(bgd, fs),
+					 (char *)fs->blk_bmaps[i]);
+		if (fs->bg_dirty[i] & EXT4FS_IBMAP_DIRTY)
+			ext4fs_batch_add(&batch, ext4fs_bg_get_inode_id(bgd, fs),
+					 (char *)fs->inode_bmaps[i]);
 	}
+	memset(fs->bg_dirty, 0, fs->no_blkgrp);
 
 	/* update the block group descriptor table */
-	put_ext4((uint64_t)((uint64_t)fs->gdtable_blkno * (uint64_t)fs->blksz),
-		 (struct ext2_block_group *)fs->gdtable,
-		 (fs->blksz * fs->no_blk_pergdt));
+	for (i = 0; i < fs->no_blk_pergdt; i++)
+		ext4fs_batch_add(&batch, fs->gdtable_blkno + i,
+				 fs->gdtable + i * fs->blksz);
 
-	ext4fs_dump_metadata();
+	/* write all of it with the inode and directory blocks, sorted */
+	ext4fs_dump_metadata(&batch);
+	ext4fs_batch_flush(&batch);
 
 	gindex = 0;
 	gd_index = 0;
 }
 
+/*
+ * Read the bitmaps of all groups into one buffer, with a single read for
+ * each run of adjacent bitmap blocks (flex_bg places them together).
+ */
+static int ext4fs_read_bitmaps(unsigned char **bmaps,
+			       uint64_t (*get_blk)(const struct ext2_block_group *,
+						   const struct ext_filesystem *))
+{
+	struct ext_filesystem *fs = get_fs();
+	uint64_t blk;
+	int i, n;
+
+	bmaps[0] = zalloc(fs->no_blkgrp * fs->blksz);
+	if (!bmaps[0])
+		return -ENOMEM;
+	for (i = 1; i < fs->no_blkgrp; i++)
+		bmaps[i] = bmaps[0] + i * fs->blksz;
+
+	for (i = 0; i < fs->no_blkgrp; i += n) {
+		blk = get_blk(ext4fs_get_group_descriptor(fs, i), fs);
+		for (n = 1; i + n < fs->no_blkgrp; n++) {
+			if (get_blk(ext4fs_get_group_descriptor(fs, i + n),
+				    fs) != blk + n ||
+			    (n + 1) * fs->blksz > INT_MAX)
+				break;
+		}
+		if (!ext4fs_devread(blk * fs->sect_perblk, 0, n * fs->blksz,
+				    (char *)bmaps[i]))
+			return -EIO;
+	}
+
+	return 0;
+}
+
 int ext4fs_get_bgdtable(void)
 {
 	int status;
@@ -597,7 +630,6 @@ fail:
 
 int ext4fs_init(void)
 {
-	short status;
 	int i;
 	uint32_t real_free_blocks = 0;
 	struct ext_filesystem *fs = get_fs();
@@ -634,42 +666,19 @@ int ext4fs_init(void)
 	fs->blk_bmaps = zalloc(fs->no_blkgrp * sizeof(char *));
 	if (!fs->blk_bmaps)
 		goto fail;
-	for (i = 0; i < fs->no_blkgrp; i++) {
-		fs->blk_bmaps[i] = zalloc(fs->blksz);
-		if (!fs->blk_bmaps[i])
-			goto fail;
-	}
-
-	for (i = 0; i < fs->no_blkgrp; i++) {
-		struct ext2_block_group *bgd =
-			ext4fs_get_group_descriptor(fs, i);
-		status = ext4fs_devread(ext4fs_bg_get_block_id(bgd, fs) *
-				   fs->sect_perblk, 0,
-				   fs->blksz, (char *)fs->blk_bmaps[i]);
-		if (status == 0)
-			goto fail;
-	}
+	if (ext4fs_read_bitmaps(fs->blk_bmaps, ext4fs_bg_get_block_id))
+		goto fail;
 
 	/* load all the available inode bitmap of the partition */
 	fs->inode_bmaps = zalloc(fs->no_blkgrp * sizeof(unsigned char *));
 	if (!fs->inode_bmaps)
 		goto fail;
-	for (i = 0; i < fs->no_blkgrp; i++) {
-		fs->inode_bmaps[i] = zalloc(fs->blksz);
-		if (!fs->inode_bmaps[i])
-			goto fail;
-	}
+	if (ext4fs_read_bitmaps(fs->inode_bmaps, ext4fs_bg_get_inode_id))
+		goto fail;
 
-	for (i = 0; i < fs->no_blkgrp; i++) {
-		struct ext2_block_group *bgd =
-			ext4fs_get_group_descriptor(fs, i);
-		status = ext4fs_devread(ext4fs_bg_get_inode_id(bgd, fs) *
-					fs->sect_perblk,
-					0, fs->blksz,
-					(char *)fs->inode_bmaps[i]);
-		if (status == 0)
-			goto fail;
-	}
+	fs->bg_dirty = zalloc(fs->no_blkgrp);
+	if (!fs->bg_dirty)
+		goto fail;
 
 	/*
 	 * check filesystem consistency with free blocks of file system
@@ -695,7 +704,6 @@ fail:
 
 void ext4fs_deinit(void)
 {
-	int i;
 	struct ext2_inode inode_journal;
 	struct journal_superblock_t *jsb;
 	uint32_t blknr;
@@ -729,24 +737,22 @@ void ext4fs_deinit(void)
 	free(fs->sb);
 	fs->sb = NULL;
 
+	/* the bitmaps of all groups share the buffer of group 0 */
 	if (fs->blk_bmaps) {
-		for (i = 0; i < fs->no_blkgrp; i++) {
-			free(fs->blk_bmaps[i]);
-			fs->blk_bmaps[i] = NULL;
-		}
+		free(fs->blk_bmaps[0]);
 		free(fs->blk_bmaps);
 		fs->blk_bmaps = NULL;
 	}
 
 	if (fs->inode_bmaps) {
-		for (i = 0; i < fs->no_blkgrp; i++) {
-			free(fs->inode_bmaps[i]);
-			fs->inode_bmaps[i] = NULL;
-		}
+		free(fs->inode_bmaps[0]);
 		free(fs->inode_bmaps);
 		fs->inode_bmaps = NULL;
 	}
 
+	free(fs->bg_dirty);
+	fs->bg_dirty = NULL;
+
 
 	free(fs->gdtable);
 	fs->gdtable = NULL;
@@ -758,6 +764,11 @@ void ext4fs_deinit(void)
 	fs->first_pass_bbmap = 0;
 	fs->curr_inode_no = 0;
 	fs->curr_blkno = 0;
+	fs->resv_count = 0;
+	fs->resv_want = 0;
+
+	/* Extent trees of the open nodes may have changed */
+	ext4fs_drop_extent_maps();
 }
 
 /*
@@ -26,6 +26,7 @@
 #include <ext4fs.h>
 #include "ext4_common.h"
 #include <div64.h>
+#include <linux/sizes.h>
 #include <malloc.h>
 #include <part.h>
 #include <uuid.h>
@@ -40,34 +41,41 @@ struct ext_filesystem *get_fs(void)
 
 void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot)
 {
-	if ((node != &ext4fs_root->diropen) && (node != currroot))
+	if (node && (node != &ext4fs_root->diropen) && (node != currroot)) {
+		free(node->extent_map);
 		free(node);
+	}
 }
 
 /*
  * Taken from openmoko-kernel mailing list: By Andy green
  * Optimized read file API : collects and defers contiguous sector
  * reads into one potentially more efficient larger sequential read action
+ *
+ * Files using extents are mapped run by run from a decoded extent map, so
+ * each physically contiguous run becomes a single read into the buffer.
+ * The map is cached in the node for the following reads.
  */
 int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 		loff_t len, char *buf, loff_t *actread)
 {
 	struct ext_filesystem *fs = get_fs();
-	int i;
-	lbaint_t blockcnt;
+	lbaint_t i, n, blockcnt;
 	int log2blksz = fs->dev_desc->log2blksz;
 	int log2_fs_blocksize = LOG2_BLOCK_SIZE(node->data) - log2blksz;
 	int blocksize = (1 << (log2_fs_blocksize + log2blksz));
 	unsigned int filesize = le32_to_cpu(node->inode.size);
-	lbaint_t previous_block_number = -1;
 	lbaint_t delayed_start = 0;
 	lbaint_t delayed_extent = 0;
 	lbaint_t delayed_skipfirst = 0;
 	lbaint_t delayed_next = 0;
 	char *delayed_buf = NULL;
-	char *start_buf = buf;
-	short status;
+	bool extents = le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL;
+	struct ext4_extent_map *map = NULL;
+	int map_count = 0;
 	struct ext_block_cache cache;
+	/* Limit single reads, fs_devread() takes an int length */
+	lbaint_t max_extent = SZ_1G;
 
 	ext_cache_init(&cache);
 
@@ -80,107 +88,86 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 		return -1;
 	}
 
+	if (extents) {
+		map_count = ext4fs_node_extent_map(node, &map);
+		if (map_count < 0) {
+			printf("invalid extent block\n");
+			goto fail;
+		}
+	}
+
 	blockcnt = lldiv(((len + pos) + blocksize - 1), blocksize);
 
-	for (i = lldiv(pos, blocksize); i < blockcnt; i++) {
+	for (i = lldiv(pos, blocksize); i < blockcnt; i += n) {
 		long int blknr;
-		int blockoff = pos - (blocksize * i);
-		int blockend = blocksize;
-		int skipfirst = 0;
-		blknr = read_allocated_block(&node->inode, i, &cache);
-		if (blknr < 0) {
-			ext_cache_fini(&cache);
-			return -1;
-		}
+		loff_t runstart, runend;
+		lbaint_t skipfirst, extent;
+		uint32_t runlen;
 
-		blknr = blknr << log2_fs_blocksize;
+		if (extents) {
+			blknr = ext4fs_map_block(map, map_count, i, &runlen);
+			n = min((lbaint_t)runlen, blockcnt - i);
+		} else {
+			blknr = read_allocated_block(&node->inode, i, &cache);
+			if (blknr < 0)
+				goto fail;
+			n = 1;
+		}
+		n = min(n, max_extent >> (log2_fs_blocksize + log2blksz));
 
-		/* Last block.  */
-		if (i == blockcnt - 1) {
-			blockend = (len + pos) - (blocksize * i);
+		/* Byte range of the file covered by this run */
+		runstart = max(pos, (loff_t)i * blocksize);
+		runend = min(pos + len, (loff_t)(i + n) * blocksize);
+		skipfirst = runstart - (loff_t)i * blocksize;
+		extent = runend - runstart;
 
-			/* The last portion is exactly blocksize. */
-			if (!blockend)
-				blockend = blocksize;
-		}
+		blknr = blknr << log2_fs_blocksize;
 
-		/* First block. */
-		if (i == lldiv(pos, blocksize)) {
-			skipfirst = blockoff;
-			blockend -= skipfirst;
-		}
 		if (blknr) {
-			int status;
-
-			if (previous_block_number != -1) {
-				if (delayed_next == blknr) {
-					delayed_extent += blockend;
-					delayed_next += blockend >> log2blksz;
-				} else {	/* spill */
-					status = ext4fs_devread(delayed_start,
-							delayed_skipfirst,
-							delayed_extent,
-							delayed_buf);
-					if (status == 0) {
-						ext_cache_fini(&cache);
-						return -1;
-					}
-					previous_block_number = blknr;
-					delayed_start = blknr;
-					delayed_extent = blockend;
-					delayed_skipfirst = skipfirst;
-					delayed_buf = buf;
-					delayed_next = blknr +
-						(blockend >> log2blksz);
-				}
-			} else {
-				previous_block_number = blknr;
-				delayed_start = blknr;
-				delayed_extent = blockend;
-				delayed_skipfirst = skipfirst;
-				delayed_buf = buf;
-				delayed_next = blknr +
-					(blockend >> log2blksz);
+			if (delayed_extent && delayed_next == blknr &&
+			    delayed_extent + extent <= max_extent) {
+				delayed_extent += extent;
+				delayed_next += n << log2_fs_blocksize;
+				continue;
 			}
+
+			/* spill */
+			if (delayed_extent &&
+			    !ext4fs_devread(delayed_start, delayed_skipfirst,
+					    delayed_extent, delayed_buf))
+				goto fail;
+
+			delayed_start = blknr;
+			delayed_extent = extent;
+			delayed_skipfirst = skipfirst;
+			delayed_buf = buf + (runstart - pos);
+			delayed_next = blknr + (n << log2_fs_blocksize);
 		} else {
-			int n;
-			int n_left;
-			if (previous_block_number != -1) {
-				/* spill */
-				status = ext4fs_devread(delayed_start,
-							delayed_skipfirst,
-							delayed_extent,
-							delayed_buf);
-				if (status == 0) {
-					ext_cache_fini(&cache);
-					return -1;
-				}
-				previous_block_number = -1;
-			}
-			/* Zero no more than `len' bytes. */
-			n = blocksize - skipfirst;
-			n_left = len - ( buf - start_buf );
-			if (n > n_left)
-				n = n_left;
-			memset(buf, 0, n);
+			/* spill */
+			if (delayed_extent &&
+			    !ext4fs_devread(delayed_start, delayed_skipfirst,
+					    delayed_extent, delayed_buf))
+				goto fail;
+			delayed_extent = 0;
+
+			/* Holes read as zeros */
+			memset(buf + (runstart - pos), 0, extent);
 		}
-		buf += blocksize - skipfirst;
 	}
-	if (previous_block_number != -1) {
+	if (delayed_extent) {
 		/* spill */
-		status = ext4fs_devread(delayed_start,
-					delayed_skipfirst, delayed_extent,
-					delayed_buf);
-		if (status == 0) {
-			ext_cache_fini(&cache);
-			return -1;
-		}
-		previous_block_number = -1;
+		if (!ext4fs_devread(delayed_start, delayed_skipfirst,
+				    delayed_extent, delayed_buf))
+			goto fail;
 	}
 
 	*actread  = len;
 	ext_cache_fini(&cache);
 	return 0;
+
+fail:
+	ext_cache_fini(&cache);
+	return -1;
 }
 
 int ext4fs_ls(const char *dirname)
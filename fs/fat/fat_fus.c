@@ -69,8 +69,9 @@ static struct fsdata myfsdata;
 /* Buffer to cache directory entries */
 __u8 dir_buffer[CONFIG_SYS_FAT_PRELOAD_DIR] __aligned(ARCH_DMA_MINALIGN);
 
-/* Buffer to cache FAT table entries */
-__u8 fat_buffer[CONFIG_SYS_FAT_PRELOAD_FAT] __aligned(ARCH_DMA_MINALIGN);
+/* Buffer to cache FAT table entries, CONFIG_SYS_FAT_PRELOAD_SLOTS chunks */
+__u8 fat_buffer[CONFIG_SYS_FAT_PRELOAD_SLOTS * CONFIG_SYS_FAT_PRELOAD_FAT]
+	__aligned(ARCH_DMA_MINALIGN);
 
 
 #ifdef CONFIG_SUPPORT_VFAT
@@ -234,7 +235,9 @@ static void get_shortname(char *name, const char *dirname, __u8 lcase)
  * @cluster: Index into FAT table from where to get next value
  *
  * Get the FAT table entry at given index, i.e. return the next cluster in the
- * file; the FAT table may have 12, 16 or 32 bit entries.
+ * file; the FAT table may have 12, 16 or 32 bit entries. The FAT is cached in
+ * CONFIG_SYS_FAT_PRELOAD_SLOTS chunks, the least recently used chunk is
+ * replaced if a new chunk needs to be loaded.
  *
  * Return:
  * Next cluster, or 0 on failure
@@ -243,30 +246,51 @@ static __u32 get_fatent(struct fsdata *mydata, __u32 cluster)
 {
 	__u32 bufnum;
 	__u32 offset;
+	__u32 slot;
 	__u8 *fatentry;
 	__u32 ret = 0;
 
 	bufnum = cluster / mydata->fatbuf_entries;
 	offset = cluster - bufnum * mydata->fatbuf_entries;
 
-	/* Load according chunk of FAT to the cache (if not already loaded) */
-	if (bufnum != mydata->fatbufnum) {
-		__u32 count = mydata->fatbuf_sectors;
-		__u32 sector = bufnum * count;
-		if (sector + count > mydata->fat_length)
-			count = mydata->fat_length - sector;
-		sector += mydata->fat_sect;
+	/* Look for the FAT chunk in the cache, check last used slot first */
+	slot = mydata->fatbuf_last;
+	if (mydata->fatbufnum[slot] != bufnum) {
+		__u32 lru = 0;
 
-		debug("Read FAT bufnum: %d, sector: %u, count: %u\n",
-		      bufnum, sector, count);
-		if (disk_read(sector, count, mydata->fatbuf) != count)
-			return ret;
-
-		mydata->fatbufnum = bufnum;
+		for (slot = 0; slot < CONFIG_SYS_FAT_PRELOAD_SLOTS; slot++) {
+			if (mydata->fatbufnum[slot] == bufnum)
+				break;
+			if (mydata->fatbuf_used[slot]
+			    < mydata->fatbuf_used[lru])
+				lru = slot;
+		}
+		if (slot >= CONFIG_SYS_FAT_PRELOAD_SLOTS) {
+			/* Not cached, load chunk to least recently used slot */
+			__u32 count = mydata->fatbuf_sectors;
+			__u32 sector = bufnum * count;
+
+			if (sector + count > mydata->fat_length)
+				count = mydata->fat_length - sector;
+			sector += mydata->fat_sect;
+
+			slot = lru;
+			debug("Read FAT bufnum: %d, sector: %u, count: %u,"
+			      " slot: %u\n", bufnum, sector, count, slot);
+			mydata->fatbufnum[slot] = (__u32)-1;
+			if (disk_read(sector, count, mydata->fatbuf
+				      + slot * CONFIG_SYS_FAT_PRELOAD_FAT)
+			    != count)
+				return ret;
+
+			mydata->fatbufnum[slot] = bufnum;
+		}
+		mydata->fatbuf_last = slot;
 	}
+	mydata->fatbuf_used[slot] = ++mydata->fatbuf_tick;
 
 	/* Get the actual entry from the table */
-	fatentry = mydata->fatbuf;
+	fatentry = mydata->fatbuf + slot * CONFIG_SYS_FAT_PRELOAD_FAT;
 	switch (mydata->fatsize) {
 	case 32:
 		fatentry += offset * 4;
@@ -292,6 +316,72 @@ static __u32 get_fatent(struct fsdata *mydata, __u32 cluster)
 	return ret;
 }
 
+/**
+ * fat_get_extent() - Get an extent of a file from the extent map
+ * @mydata: Pointer to device specific information
+ * @start:  Start cluster of the file
+ * @index:  Index of the extent
+ *
+ * The extent map holds the runs of consecutive clusters of the file that was
+ * read most recently. It is extended on demand by following the cluster
+ * chain, so each FAT entry of a file is only looked up once, no matter at
+ * which offsets and how often the file is read.
+ *
+ * Return:
+ * Pointer to the extent, or NULL on unexpected EOF or error
+ */
+static struct fat_extent *fat_get_extent(struct fsdata *mydata, __u32 start,
+					 __u32 index)
+{
+	struct fat_extent *ext;
+	__u32 cluster;
+	__u32 prev;
+
+	if (start != mydata->ext_start) {
+		mydata->ext_start = start;
+		mydata->ext_count = 0;
+		mydata->ext_next = start;
+	}
+
+	while (index >= mydata->ext_count) {
+		/* Return on unexpected EOF or invalid cluster */
+		cluster = mydata->ext_next;
+		if ((cluster < 2) || (cluster >= mydata->max_cluster)) {
+			mydata->ext_start = INVALID_CLUSTER;
+			return NULL;
+		}
+
+		if (mydata->ext_count >= mydata->ext_alloc) {
+			__u32 alloc = mydata->ext_alloc ? 2 * mydata->ext_alloc
+				: 64;
+
+			ext = realloc(mydata->ext, alloc * sizeof(*ext));
+			if (!ext) {
+				mydata->ext_start = INVALID_CLUSTER;
+				return NULL;
+			}
+			mydata->ext = ext;
+			mydata->ext_alloc = alloc;
+		}
+
+		/* Combine clusters to one extent as long as they are in
+		   sequence */
+		ext = &mydata->ext[mydata->ext_count];
+		ext->cluster = cluster;
+		ext->count = 0;
+		do {
+			prev = cluster;
+			ext->count++;
+			cluster = get_fatent(mydata, prev);
+		} while ((cluster == prev + 1)
+			 && (cluster < mydata->max_cluster));
+
+		mydata->ext_next = cluster;
+		mydata->ext_count++;
+	}
+
+	return &mydata->ext[index];
+}
 
 /**
  * fat_dir_preload() - Load the next chunk of the directory
@@ -537,8 +627,8 @@ static int fat_read_at(struct wc_dirinfo *wdi, struct wc_fileinfo *wfi,
 	unsigned long bytes_per_cluster;
 	unsigned long sect_size;
 	int warning = 0;
-	__u32 cluster;
-	__u32 tmp;
+	struct fat_extent *ext;
+	__u32 index = 0;
 	__u32 sector_count;
 	__u32 sector;
 
@@ -554,28 +644,27 @@ static int fat_read_at(struct wc_dirinfo *wdi, struct wc_fileinfo *wfi,
 
 	sect_size = mydata->sect_size;
 	bytes_per_cluster = mydata->clust_size * sect_size;
-	cluster = wfi->reference;
 
 	do {
-		/* Combine sectors to a long chunk if they are in sequence */
-		sector = clust2sect(mydata, cluster);
-		bytes_next_chunk = 0;
-		do {
-			if (remaining <= bytes_per_cluster) {
-				bytes_next_chunk += remaining;
-				remaining = 0;
-				break;
-			}
-			bytes_next_chunk += bytes_per_cluster;
-			remaining -= bytes_per_cluster;
+		/* Each extent of consecutive clusters is loaded as one chunk */
+		ext = fat_get_extent(mydata, wfi->reference, index++);
+		if (!ext)
+			goto out;
+		bytes_next_chunk = ext->count * bytes_per_cluster;
+
+		/* Skip whole extents in front of the requested data */
+		if (skip >= bytes_next_chunk) {
+			skip -= bytes_next_chunk;
+			remaining -= bytes_next_chunk;
+			continue;
+		}
 
-			tmp = cluster;
-			cluster = get_fatent(mydata, cluster);
-
-			/* Return on unexpected EOF or invalid cluster */
-			if ((cluster < 2) || (cluster >= mydata->max_cluster))
-				goto out;
-		} while (cluster == tmp + 1);
+		sector = clust2sect(mydata, ext->cluster);
+		if (remaining <= bytes_next_chunk) {
+			bytes_next_chunk = remaining;
+			remaining = 0;
+		} else
+			remaining -= bytes_next_chunk;
 
 		debug("Next chunk: 0x%lx bytes at sector 0x%x\n",
 		      bytes_next_chunk, sector);
@@ -794,8 +883,12 @@ int fat_set_blk_dev(struct blk_desc *dev_desc, struct disk_partition *info)
 	__u32 clusters;
 	struct volume_info *vistart;
 	struct fsdata *mydata = &myfsdata;
+	int i;
 	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, buffer, dev_desc->blksz);
 
+	/* Directory snapshots of the previous device are not valid anymore */
+	wildcard_flush();
+
 	cur_dev = dev_desc;
 	cur_part_info = *info;
 
@@ -893,8 +986,15 @@ int fat_set_blk_dev(struct blk_desc *dev_desc, struct disk_partition *info)
 		cur_dev = NULL;		  /* Unknown FAT type (exFAT?) */
 		return -1;
 	}
-	mydata->fatbufnum = (__u32)-1;
+	for (i = 0; i < CONFIG_SYS_FAT_PRELOAD_SLOTS; i++) {
+		mydata->fatbufnum[i] = (__u32)-1;
+		mydata->fatbuf_used[i] = 0;
+	}
+	mydata->fatbuf_tick = 0;
+	mydata->fatbuf_last = 0;
 	mydata->fatbuf = fat_buffer;
+	mydata->ext_start = INVALID_CLUSTER;
+	mydata->ext_count = 0;
 	mydata->dirbuf = dir_buffer;
 	mydata->max_cluster = clusters + 2;
 
@@ -964,4 +1064,6 @@ int fat_size(const char *filename, loff_t *size)
 
 void fat_close(void)
 {
+	/* Release memory of directory snapshots */
+	wildcard_flush();
 }
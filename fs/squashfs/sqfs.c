@@ -92,138 +92,493 @@ static int sqfs_calc_n_blks(__le64 start, __le64 end, u64 *offset)
 	return DIV_ROUND_UP(table_size + *offset, ctxt.cur_dev->blksz);
 }
 
+/* Number of device blocks needed to read any metadata block with its header */
+static u32 sqfs_metablock_n_blks(void)
+{
+	return DIV_ROUND_UP(SQFS_HEADER_SIZE + SQFS_METADATA_BLOCK_SIZE - 1,
+			    ctxt.cur_dev->blksz) + 1;
+}
+
 /*
- * Retrieves fragment block entry and returns true if the fragment block is
- * compressed
+ * Returns the decompressed metadata block whose header is at 'start' on disk.
+ * Blocks are kept in a small cache with LRU replacement, so the returned
+ * pointer is only valid until the next call.
  */
-static int sqfs_frag_lookup(u32 inode_fragment_index,
-			    struct squashfs_fragment_block_entry *e)
+static int sqfs_get_metablock(u64 start, struct squashfs_metablock **blockp)
 {
-	u64 start, n_blks, src_len, table_offset, start_block;
-	unsigned char *metadata_buffer, *metadata, *table;
-	struct squashfs_fragment_block_entry *entries;
-	struct squashfs_super_block *sblk = ctxt.sblk;
+	struct squashfs_metablock *mb, *victim = NULL;
+	u64 sect, table_offset;
 	unsigned long dest_len;
-	int block, offset, ret;
+	u32 n_blks, src_len;
+	unsigned char *src;
 	u16 header;
+	int i, ret;
+
+	for (i = 0; i < SQFS_METADATA_CACHE_SIZE; i++) {
+		mb = &ctxt.meta_cache[i];
+		if (mb->size && mb->start == start) {
+			mb->last_used = ++ctxt.meta_tick;
+			*blockp = mb;
+			return 0;
+		}
+		if (!victim || mb->last_used < victim->last_used)
+			victim = mb;
+	}
 
-	metadata_buffer = NULL;
-	entries = NULL;
-	table = NULL;
+	/* Read the header and the largest possible block behind it */
+	sect = start / ctxt.cur_dev->blksz;
+	table_offset = start - (sect * ctxt.cur_dev->blksz);
+	n_blks = DIV_ROUND_UP(table_offset + SQFS_HEADER_SIZE +
+			      SQFS_METADATA_BLOCK_SIZE, ctxt.cur_dev->blksz);
+	if (ctxt.cur_part_info.size) {
+		if (sect >= ctxt.cur_part_info.size)
+			return -EINVAL;
+		n_blks = min_t(u64, n_blks, ctxt.cur_part_info.size - sect);
+	}
 
-	if (inode_fragment_index >= get_unaligned_le32(&sblk->fragments))
+	if (sqfs_disk_read(sect, n_blks, ctxt.meta_buf) < 0)
 		return -EINVAL;
 
-	start = get_unaligned_le64(&sblk->fragment_table_start) /
-		ctxt.cur_dev->blksz;
-	n_blks = sqfs_calc_n_blks(sblk->fragment_table_start,
-				  sblk->export_table_start,
-				  &table_offset);
+	/* Every metadata block starts with a 16-bit header */
+	header = get_unaligned_le16(ctxt.meta_buf + table_offset);
+	src_len = SQFS_METADATA_SIZE(header);
+	if (!header || src_len > SQFS_METADATA_BLOCK_SIZE ||
+	    table_offset + SQFS_HEADER_SIZE + src_len >
+	    n_blks * ctxt.cur_dev->blksz) {
+		printf("Invalid metadata block at 0x%llx.\n", start);
+		return -EINVAL;
+	}
+	src = ctxt.meta_buf + table_offset + SQFS_HEADER_SIZE;
 
-	/* Allocate a proper sized buffer to store the fragment index table */
-	table = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-	if (!table) {
-		ret = -ENOMEM;
-		goto out;
+	victim->size = 0;
+	if (SQFS_COMPRESSED_METADATA(header)) {
+		dest_len = SQFS_METADATA_BLOCK_SIZE;
+		ret = sqfs_decompress(&ctxt, victim->data, &dest_len, src,
+				      src_len);
+		if (ret || !dest_len)
+			return -EINVAL;
+	} else {
+		memcpy(victim->data, src, src_len);
+		dest_len = src_len;
 	}
 
-	if (sqfs_disk_read(start, n_blks, table) < 0) {
-		ret = -EINVAL;
-		goto out;
+	victim->start = start;
+	victim->next = start + SQFS_HEADER_SIZE + src_len;
+	victim->size = dest_len;
+	victim->last_used = ++ctxt.meta_tick;
+	*blockp = victim;
+
+	return 0;
+}
+
+/*
+ * Copies 'len' bytes of metadata (inode or directory table) to 'dest'. The
+ * data starts at 'offset' in the decompressed metadata block at 'start' and
+ * may continue in the following blocks. Both are advanced past the data.
+ */
+static int sqfs_read_metadata(u64 *start, u32 *offset, void *dest, u32 len)
+{
+	struct squashfs_metablock *mb;
+	u32 count;
+	int ret;
+
+	while (len) {
+		ret = sqfs_get_metablock(*start, &mb);
+		if (ret)
+			return ret;
+
+		if (*offset >= mb->size) {
+			/* Continue in the following block */
+			*offset -= mb->size;
+			*start = mb->next;
+			continue;
+		}
+
+		count = min(len, mb->size - *offset);
+		memcpy(dest, mb->data + *offset, count);
+		dest += count;
+		len -= count;
+		*offset += count;
 	}
 
-	block = SQFS_FRAGMENT_INDEX(inode_fragment_index);
-	offset = SQFS_FRAGMENT_INDEX_OFFSET(inode_fragment_index);
+	return 0;
+}
 
-	/*
-	 * Get the start offset of the metadata block that contains the right
-	 * fragment block entry
-	 */
-	start_block = get_unaligned_le64(table + table_offset + block *
-					 sizeof(u64));
+/*
+ * Reads an inode given its reference, i.e. the position of its metadata block
+ * relative to the inode table start in the upper bits and the offset into the
+ * decompressed block in the lower 16 bits. The inode is returned in an
+ * allocated buffer.
+ */
+static int sqfs_read_inode(u64 ref, void **inodep)
+{
+	struct squashfs_super_block *sblk = ctxt.sblk;
+	struct squashfs_directory_index di;
+	u64 start, pos;
+	u32 offset, offs;
+	int i, size, ret;
+	union {
+		struct squashfs_base_inode base;
+		struct squashfs_dir_inode dir;
+		struct squashfs_ldir_inode ldir;
+		struct squashfs_reg_inode reg;
+		struct squashfs_lreg_inode lreg;
+		struct squashfs_symlink_inode symlink;
+	} hdr;
+
+	*inodep = NULL;
+	start = get_unaligned_le64(&sblk->inode_table_start) + (ref >> 16);
+	offset = ref & 0xFFFF;
+
+	/* Get the fixed part of the inode to calculate its total size */
+	pos = start;
+	offs = offset;
+	ret = sqfs_read_metadata(&pos, &offs, &hdr, sizeof(hdr));
+	if (ret)
+		return ret;
+
+	if (get_unaligned_le16(&hdr.base.inode_type) == SQFS_LDIR_TYPE) {
+		/* The directory index entries have variable length names */
+		size = sizeof(hdr.ldir);
+		pos = start;
+		offs = offset + size;
+		for (i = 0; i < get_unaligned_le16(&hdr.ldir.i_count); i++) {
+			ret = sqfs_read_metadata(&pos, &offs, &di, sizeof(di));
+			if (ret)
+				return ret;
+			offs += get_unaligned_le32(&di.size) + 1;
+			size += sizeof(di) + get_unaligned_le32(&di.size) + 1;
+		}
+	} else {
+		size = sqfs_inode_size(&hdr.base,
+				       get_unaligned_le32(&sblk->block_size));
+		if (size < 0)
+			return -EINVAL;
+	}
 
-	start = start_block / ctxt.cur_dev->blksz;
-	n_blks = sqfs_calc_n_blks(cpu_to_le64(start_block),
-				  sblk->fragment_table_start, &table_offset);
+	*inodep = malloc(size);
+	if (!*inodep)
+		return -ENOMEM;
 
-	metadata_buffer = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-	if (!metadata_buffer) {
-		ret = -ENOMEM;
-		goto out;
+	ret = sqfs_read_metadata(&start, &offset, *inodep, size);
+	if (ret) {
+		free(*inodep);
+		*inodep = NULL;
 	}
 
-	if (sqfs_disk_read(start, n_blks, metadata_buffer) < 0) {
-		ret = -EINVAL;
-		goto out;
+	return ret;
+}
+
+/* Drops all cached data and fragment blocks */
+void sqfs_cache_flush(void)
+{
+	int i;
+
+	for (i = 0; i < SQFS_DATA_CACHE_SIZE; i++) {
+		free(ctxt.data_cache[i].data);
+		ctxt.data_cache[i].data = NULL;
+		ctxt.data_cache[i].size = 0;
 	}
+	ctxt.data_dev = NULL;
+}
 
-	/* Every metadata block starts with a 16-bit header */
-	header = get_unaligned_le16(metadata_buffer + table_offset);
-	metadata = metadata_buffer + table_offset + SQFS_HEADER_SIZE;
+void sqfs_cache_stats(struct sqfs_cache_stats *stats)
+{
+	int i;
 
-	if (!metadata || !header) {
-		ret = -ENOMEM;
-		goto out;
+	stats->hits = ctxt.data_hits;
+	stats->misses = ctxt.data_misses;
+	stats->entries = 0;
+	stats->max_entries = SQFS_DATA_CACHE_SIZE;
+	for (i = 0; i < SQFS_DATA_CACHE_SIZE; i++) {
+		if (ctxt.data_cache[i].size)
+			stats->entries++;
 	}
 
-	entries = malloc(SQFS_METADATA_BLOCK_SIZE);
-	if (!entries) {
-		ret = -ENOMEM;
+	ctxt.data_hits = 0;
+	ctxt.data_misses = 0;
+}
+
+/*
+ * The block cache survives sqfs_close(), so check on each probe that it still
+ * belongs to the filesystem found on the device and flush it otherwise.
+ */
+static void sqfs_cache_validate(void)
+{
+	if (ctxt.data_dev == ctxt.cur_dev &&
+	    ctxt.data_part_start == ctxt.cur_part_info.start &&
+	    !memcmp(&ctxt.data_sblk, ctxt.sblk, sizeof(ctxt.data_sblk)))
+		return;
+
+	sqfs_cache_flush();
+	ctxt.data_dev = ctxt.cur_dev;
+	ctxt.data_part_start = ctxt.cur_part_info.start;
+	memcpy(&ctxt.data_sblk, ctxt.sblk, sizeof(ctxt.data_sblk));
+}
+
+/*
+ * Looks up the block at 'start' in a cache of 'count' entries. On a hit, the
+ * entry is marked as most recently used. On a miss, the least recently used
+ * entry is emptied and returned, so that the caller can load the block into
+ * it and set its start, size and tick.
+ */
+struct squashfs_datablock *sqfs_cache_get(struct squashfs_datablock *cache,
+					  int count, u64 start, ulong *tick,
+					  bool *hit)
+{
+	struct squashfs_datablock *db, *victim = NULL;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		db = &cache[i];
+		if (db->size && db->start == start) {
+			db->last_used = ++(*tick);
+			*hit = true;
+			return db;
+		}
+		if (!victim || db->last_used < victim->last_used)
+			victim = db;
+	}
+
+	victim->size = 0;
+	*hit = false;
+
+	return victim;
+}
+
+/*
+ * Small files go through the block cache. Larger ones are read directly, as
+ * they would replace all cached blocks without ever reusing them.
+ */
+bool sqfs_cache_file(int datablk_count)
+{
+	return datablk_count <= SQFS_DATA_CACHE_SIZE / 2;
+}
+
+/*
+ * Returns the decompressed data or fragment block at 'start' on disk. 'size'
+ * is the on-disk size as found in the inode or fragment entry, including the
+ * "uncompressed" flag. Blocks are kept in a small cache with LRU replacement,
+ * so the returned pointer is only valid until the next call.
+ */
+static int sqfs_get_datablock(u64 start, u32 size,
+			      struct squashfs_datablock **blockp)
+{
+	struct squashfs_datablock *victim;
+	u32 blksz = get_unaligned_le32(&ctxt.sblk->block_size);
+	u32 src_len = SQFS_BLOCK_SIZE(size);
+	unsigned char *buffer;
+	u64 sect, table_offset;
+	unsigned long dest_len;
+	u32 n_blks;
+	bool hit;
+	int ret;
+
+	victim = sqfs_cache_get(ctxt.data_cache, SQFS_DATA_CACHE_SIZE, start,
+				&ctxt.data_tick, &hit);
+	if (hit) {
+		ctxt.data_hits++;
+		*blockp = victim;
+		return 0;
+	}
+
+	ctxt.data_misses++;
+	if (!src_len || src_len > blksz)
+		return -EINVAL;
+
+	if (!victim->data) {
+		victim->data = malloc(blksz);
+		if (!victim->data)
+			return -ENOMEM;
+	}
+
+	sect = start / ctxt.cur_dev->blksz;
+	table_offset = start - (sect * ctxt.cur_dev->blksz);
+	n_blks = DIV_ROUND_UP(table_offset + src_len, ctxt.cur_dev->blksz);
+
+	buffer = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
+	if (!buffer)
+		return -ENOMEM;
+
+	if (sqfs_disk_read(sect, n_blks, buffer) < 0) {
+		ret = -EINVAL;
 		goto out;
 	}
 
-	if (SQFS_COMPRESSED_METADATA(header)) {
-		src_len = SQFS_METADATA_SIZE(header);
-		dest_len = SQFS_METADATA_BLOCK_SIZE;
-		ret = sqfs_decompress(&ctxt, entries, &dest_len, metadata,
-				      src_len);
-		if (ret) {
-			ret = -EINVAL;
+	if (SQFS_COMPRESSED_BLOCK(size)) {
+		dest_len = blksz;
+		ret = sqfs_decompress(&ctxt, victim->data, &dest_len,
+				      buffer + table_offset, src_len);
+		if (ret)
 			goto out;
-		}
 	} else {
-		memcpy(entries, metadata, SQFS_METADATA_SIZE(header));
+		memcpy(victim->data, buffer + table_offset, src_len);
+		dest_len = src_len;
 	}
 
-	*e = entries[offset];
-	ret = SQFS_COMPRESSED_BLOCK(e->size);
+	victim->start = start;
+	victim->size = dest_len;
+	victim->last_used = ++ctxt.data_tick;
+	*blockp = victim;
+	ret = 0;
 
 out:
-	free(entries);
-	free(metadata_buffer);
-	free(table);
+	free(buffer);
 
 	return ret;
 }
 
+/*
+ * Retrieves fragment block entry and returns true if the fragment block is
+ * compressed
+ */
+static int sqfs_frag_lookup(u32 inode_fragment_index,
+			    struct squashfs_fragment_block_entry *e)
+{
+	struct squashfs_super_block *sblk = ctxt.sblk;
+	u64 start, n_blks, table_offset, index_size;
+	unsigned char *table;
+	u32 offset;
+	int ret;
+
+	if (inode_fragment_index >= get_unaligned_le32(&sblk->fragments))
+		return -EINVAL;
+
+	/*
+	 * The fragment index table lists the positions of the metadata blocks
+	 * holding the fragment entries. Read it once per probe.
+	 */
+	if (!ctxt.frag_index) {
+		index_size = DIV_ROUND_UP(get_unaligned_le32(&sblk->fragments),
+					  SQFS_MAX_ENTRIES) * sizeof(u64);
+		start = get_unaligned_le64(&sblk->fragment_table_start);
+		n_blks = sqfs_calc_n_blks(cpu_to_le64(start),
+					  cpu_to_le64(start + index_size),
+					  &table_offset);
+
+		table = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
+		if (!table)
+			return -ENOMEM;
+
+		if (sqfs_disk_read(start / ctxt.cur_dev->blksz, n_blks,
+				   table) < 0) {
+			free(table);
+			return -EINVAL;
+		}
+
+		ctxt.frag_index = malloc(index_size);
+		if (ctxt.frag_index)
+			memcpy(ctxt.frag_index, table + table_offset,
+			       index_size);
+		free(table);
+		if (!ctxt.frag_index)
+			return -ENOMEM;
+	}
+
+	/* Get the entry through the metadata cache */
+	start = get_unaligned_le64(&ctxt.frag_index[
+				   SQFS_FRAGMENT_INDEX(inode_fragment_index)]);
+	offset = SQFS_FRAGMENT_INDEX_OFFSET(inode_fragment_index) * sizeof(*e);
+	ret = sqfs_read_metadata(&start, &offset, e, sizeof(*e));
+	if (ret)
+		return ret;
+
+	return SQFS_COMPRESSED_BLOCK(e->size);
+}
+
 /*
  * The entry name is a flexible array member, and we don't know its size before
  * actually reading the entry. So we need a first copy to retrieve this size so
  * we can finally copy the whole struct.
  */
-static int sqfs_read_entry(struct squashfs_directory_entry **dest, void *src)
+static int sqfs_read_entry(struct squashfs_dir_stream *dirs,
+			   struct squashfs_directory_entry **dest)
 {
-	struct squashfs_directory_entry *tmp;
+	struct squashfs_directory_entry tmp;
+	int ret;
 	u16 sz;
 
-	tmp = src;
-	sz = get_unaligned_le16(src + sizeof(*tmp) - sizeof(u16));
+	ret = sqfs_read_metadata(&dirs->dir_start, &dirs->dir_offset, &tmp,
+				 sizeof(tmp));
+	if (ret)
+		return ret;
+
 	/*
-	 * 'src' points to the begin of a directory entry, and 'sz' gets its
-	 * 'name_size' member's value. name_size is actually the string
-	 * length - 1, so adding 2 compensates this difference and adds space
-	 * for the trailling null byte.
+	 * 'sz' gets the 'name_size' member's value. name_size is actually the
+	 * string length - 1, so adding 2 compensates this difference and adds
+	 * space for the trailling null byte.
 	 */
-	*dest = malloc(sizeof(*tmp) + sz + 2);
+	sz = get_unaligned_le16(&tmp.name_size);
+	*dest = malloc(sizeof(tmp) + sz + 2);
 	if (!*dest)
 		return -ENOMEM;
 
-	memcpy(*dest, src, sizeof(*tmp) + sz + 1);
+	memcpy(*dest, &tmp, sizeof(tmp));
+	ret = sqfs_read_metadata(&dirs->dir_start, &dirs->dir_offset,
+				 (*dest)->name, sz + 1);
+	if (ret) {
+		free(*dest);
+		*dest = NULL;
+		return ret;
+	}
 	(*dest)->name[sz + 1] = '\0';
 
 	return 0;
 }
 
+/* Returns the inode reference of the current directory entry */
+static u64 sqfs_entry_ref(struct squashfs_dir_stream *dirs)
+{
+	return ((u64)get_unaligned_le32(&dirs->dir_header->start) << 16) |
+	       get_unaligned_le16(&dirs->entry->offset);
+}
+
+/*
+ * Sets up the directory stream to list the directory with the given inode,
+ * and reads the first directory header.
+ */
+static int sqfs_dir_begin(struct squashfs_dir_stream *dirs, void *dir_i)
+{
+	struct squashfs_super_block *sblk = ctxt.sblk;
+	struct squashfs_ldir_inode *ldir = dir_i;
+	struct squashfs_dir_inode *dir = dir_i;
+	u32 start_block;
+	int ret;
+
+	if (get_unaligned_le16(&dir->inode_type) == SQFS_LDIR_TYPE) {
+		start_block = get_unaligned_le32(&ldir->start_block);
+		dirs->dir_offset = get_unaligned_le16(&ldir->offset);
+		dirs->size = get_unaligned_le32(&ldir->file_size);
+		memcpy(&dirs->i_ldir, ldir, sizeof(*ldir));
+	} else {
+		start_block = get_unaligned_le32(&dir->start_block);
+		dirs->dir_offset = get_unaligned_le16(&dir->offset);
+		dirs->size = get_unaligned_le16(&dir->file_size);
+		memcpy(&dirs->i_dir, dir, sizeof(*dir));
+	}
+	dirs->dir_start = get_unaligned_le64(&sblk->directory_table_start) +
+		start_block;
+	free(dirs->entry);
+	dirs->entry = NULL;
+
+	if (dirs->size <= SQFS_EMPTY_FILE_SIZE) {
+		dirs->size = 0;
+		return SQFS_EMPTY_DIR;
+	}
+
+	ret = sqfs_read_metadata(&dirs->dir_start, &dirs->dir_offset,
+				 dirs->dir_header, SQFS_DIR_HEADER_SIZE);
+	if (ret) {
+		dirs->size = 0;
+		return ret;
+	}
+
+	dirs->entry_count = dirs->dir_header->count + 1;
+	dirs->size -= SQFS_DIR_HEADER_SIZE;
+
+	return 0;
+}
+
 static int sqfs_get_tokens_length(char **tokens, int count)
 {
 	int length = 0, i;
@@ -437,22 +792,20 @@ static char *sqfs_resolve_symlink(struct squashfs_symlink_inode *sym,
 }
 
 /*
- * m_list contains each metadata block's position, and m_count is the number of
- * elements of m_list. Those metadata blocks come from the compressed directory
- * table.
+ * Looks up the directory given by the token list, starting at the root inode.
+ * On success, the directory stream is set up to list the directory.
  */
 static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
-			   int token_count, u32 *m_list, int m_count)
+			   int token_count)
 {
 	struct squashfs_super_block *sblk = ctxt.sblk;
 	char *path, *target, **sym_tokens, *res, *rem;
-	int j, ret = 0, new_inode_number, offset;
 	struct squashfs_symlink_inode *sym;
-	struct squashfs_ldir_inode *ldir;
 	struct squashfs_dir_inode *dir;
 	struct fs_dir_stream *dirsp;
 	struct fs_dirent *dent;
-	unsigned char *table;
+	void *inode;
+	int j, ret = 0;
 
 	res = NULL;
 	rem = NULL;
@@ -463,68 +816,56 @@ static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
 	dirsp = (struct fs_dir_stream *)dirs;
 
 	/* Start by root inode */
-	table = sqfs_find_inode(dirs->inode_table, le32_to_cpu(sblk->inodes),
-				sblk->inodes, sblk->block_size);
-
-	dir = (struct squashfs_dir_inode *)table;
-	ldir = (struct squashfs_ldir_inode *)table;
+	ret = sqfs_read_inode(get_unaligned_le64(&sblk->root_inode), &inode);
+	if (ret)
+		return ret;
 
-	/* get directory offset in directory table */
-	offset = sqfs_dir_offset(table, m_list, m_count);
-	dirs->table = &dirs->dir_table[offset];
+	dir = (struct squashfs_dir_inode *)inode;
 
 	/* Setup directory header */
-	dirs->dir_header = malloc(SQFS_DIR_HEADER_SIZE);
-	if (!dirs->dir_header)
-		return -ENOMEM;
-
-	memcpy(dirs->dir_header, dirs->table, SQFS_DIR_HEADER_SIZE);
-
-	/* Initialize squashfs_dir_stream members */
-	dirs->table += SQFS_DIR_HEADER_SIZE;
-	dirs->size = get_unaligned_le16(&dir->file_size) - SQFS_DIR_HEADER_SIZE;
-	dirs->entry_count = dirs->dir_header->count + 1;
+	if (!dirs->dir_header) {
+		dirs->dir_header = malloc(SQFS_DIR_HEADER_SIZE);
+		if (!dirs->dir_header) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
 
 	/* No path given -> root directory */
-	if (!strcmp(token_list[0], "/")) {
-		dirs->table = &dirs->dir_table[offset];
-		memcpy(&dirs->i_dir, dir, sizeof(*dir));
-		return 0;
-	}
+	if (!strcmp(token_list[0], "/"))
+		token_count = 0;
 
 	for (j = 0; j < token_count; j++) {
-		if (!sqfs_is_dir(get_unaligned_le16(&dir->inode_type))) {
+		if (!sqfs_is_dir(get_unaligned_le16(&dir->inode_type)) ||
+		    sqfs_dir_begin(dirs, dir)) {
 			printf("** Cannot find directory. **\n");
 			ret = -EINVAL;
 			goto out;
 		}
 
+		ret = -EINVAL;
 		while (!sqfs_readdir(dirsp, &dent)) {
-			ret = strcmp(dent->name, token_list[j]);
-			if (!ret)
+			if (!strcmp(dent->name, token_list[j])) {
+				ret = 0;
 				break;
-			free(dirs->entry);
-			dirs->entry = NULL;
+			}
 		}
 
 		if (ret) {
 			printf("** Cannot find directory. **\n");
-			ret = -EINVAL;
 			goto out;
 		}
 
 		/* Redefine inode as the found token */
-		new_inode_number = dirs->entry->inode_offset +
-			dirs->dir_header->inode_number;
-
-		/* Get reference to inode in the inode table */
-		table = sqfs_find_inode(dirs->inode_table, new_inode_number,
-					sblk->inodes, sblk->block_size);
-		dir = (struct squashfs_dir_inode *)table;
+		free(inode);
+		ret = sqfs_read_inode(sqfs_entry_ref(dirs), &inode);
+		if (ret)
+			goto out;
+		dir = (struct squashfs_dir_inode *)inode;
 
 		/* Check for symbolic link and inode type sanity */
 		if (get_unaligned_le16(&dir->inode_type) == SQFS_SYMLINK_TYPE) {
-			sym = (struct squashfs_symlink_inode *)table;
+			sym = (struct squashfs_symlink_inode *)inode;
 			/* Get first j + 1 tokens */
 			path = sqfs_concat_tokens(token_list, j + 1);
 			if (!path) {
@@ -545,7 +886,7 @@ static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
 				goto out;
 			}
 			/* Concatenate remaining tokens and symlink's target */
-			res = malloc(strlen(rem) + strlen(target) + 1);
+			res = malloc(strlen(rem) + strlen(target) + 2);
 			if (!res) {
 				ret = -ENOMEM;
 				goto out;
@@ -575,55 +916,22 @@ static int sqfs_search_dir(struct squashfs_dir_stream *dirs, char **token_list,
 			free(dirs->entry);
 			dirs->entry = NULL;
 
-			ret = sqfs_search_dir(dirs, sym_tokens, token_count,
-					      m_list, m_count);
+			ret = sqfs_search_dir(dirs, sym_tokens, token_count);
 			goto out;
 		} else if (!sqfs_is_dir(get_unaligned_le16(&dir->inode_type))) {
 			printf("** Cannot find directory. **\n");
-			free(dirs->entry);
-			dirs->entry = NULL;
 			ret = -EINVAL;
 			goto out;
 		}
-
-		/* Check if it is an extended dir. */
-		if (get_unaligned_le16(&dir->inode_type) == SQFS_LDIR_TYPE)
-			ldir = (struct squashfs_ldir_inode *)table;
-
-		/* Get dir. offset into the directory table */
-		offset = sqfs_dir_offset(table, m_list, m_count);
-		dirs->table = &dirs->dir_table[offset];
-
-		/* Copy directory header */
-		memcpy(dirs->dir_header, &dirs->dir_table[offset],
-		       SQFS_DIR_HEADER_SIZE);
-
-		/* Check for empty directory */
-		if (sqfs_is_empty_dir(table)) {
-			printf("Empty directory.\n");
-			free(dirs->entry);
-			dirs->entry = NULL;
-			ret = SQFS_EMPTY_DIR;
-			goto out;
-		}
-
-		dirs->table += SQFS_DIR_HEADER_SIZE;
-		dirs->size = get_unaligned_le16(&dir->file_size);
-		dirs->entry_count = dirs->dir_header->count + 1;
-		dirs->size -= SQFS_DIR_HEADER_SIZE;
-		free(dirs->entry);
-		dirs->entry = NULL;
 	}
 
-	offset = sqfs_dir_offset(table, m_list, m_count);
-	dirs->table = &dirs->dir_table[offset];
-
-	if (get_unaligned_le16(&dir->inode_type) == SQFS_DIR_TYPE)
-		memcpy(&dirs->i_dir, dir, sizeof(*dir));
-	else
-		memcpy(&dirs->i_ldir, ldir, sizeof(*ldir));
+	/* Set up the stream for listing the directory */
+	ret = sqfs_dir_begin(dirs, dir);
+	if (ret == SQFS_EMPTY_DIR)
+		printf("Empty directory.\n");
 
 out:
+	free(inode);
 	free(res);
 	free(rem);
 	free(path);
@@ -632,249 +940,11 @@ out:
 	return ret;
 }
 
-/*
- * Inode and directory tables are stored as a series of metadata blocks, and
- * given the compressed size of this table, we can calculate how much metadata
- * blocks are needed to store the result of the decompression, since a
- * decompressed metadata block should have a size of 8KiB.
- */
-static int sqfs_count_metablks(void *table, u32 offset, int table_size)
-{
-	int count = 0, cur_size = 0, ret;
-	u32 data_size;
-	bool comp;
-
-	do {
-		ret = sqfs_read_metablock(table, offset + cur_size, &comp,
-					  &data_size);
-		if (ret)
-			return -EINVAL;
-		cur_size += data_size + SQFS_HEADER_SIZE;
-		count++;
-	} while (cur_size < table_size);
-
-	return count;
-}
-
-/*
- * Storing the metadata blocks header's positions will be useful while looking
- * for an entry in the directory table, using the reference (index and offset)
- * given by its inode.
- */
-static int sqfs_get_metablk_pos(u32 *pos_list, void *table, u32 offset,
-				int metablks_count)
-{
-	u32 data_size, cur_size = 0;
-	int j, ret = 0;
-	bool comp;
-
-	if (!metablks_count)
-		return -EINVAL;
-
-	for (j = 0; j < metablks_count; j++) {
-		ret = sqfs_read_metablock(table, offset + cur_size, &comp,
-					  &data_size);
-		if (ret)
-			return -EINVAL;
-
-		cur_size += data_size + SQFS_HEADER_SIZE;
-		pos_list[j] = cur_size;
-	}
-
-	return ret;
-}
-
-static int sqfs_read_inode_table(unsigned char **inode_table)
-{
-	struct squashfs_super_block *sblk = ctxt.sblk;
-	u64 start, n_blks, table_offset, table_size;
-	int j, ret = 0, metablks_count;
-	unsigned char *src_table, *itb;
-	u32 src_len, dest_offset = 0;
-	unsigned long dest_len = 0;
-	bool compressed;
-
-	table_size = get_unaligned_le64(&sblk->directory_table_start) -
-		get_unaligned_le64(&sblk->inode_table_start);
-	start = get_unaligned_le64(&sblk->inode_table_start) /
-		ctxt.cur_dev->blksz;
-	n_blks = sqfs_calc_n_blks(sblk->inode_table_start,
-				  sblk->directory_table_start, &table_offset);
-
-	/* Allocate a proper sized buffer (itb) to store the inode table */
-	itb = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-	if (!itb)
-		return -ENOMEM;
-
-	if (sqfs_disk_read(start, n_blks, itb) < 0) {
-		ret = -EINVAL;
-		goto free_itb;
-	}
-
-	/* Parse inode table (metadata block) header */
-	ret = sqfs_read_metablock(itb, table_offset, &compressed, &src_len);
-	if (ret) {
-		ret = -EINVAL;
-		goto free_itb;
-	}
-
-	/* Calculate size to store the whole decompressed table */
-	metablks_count = sqfs_count_metablks(itb, table_offset, table_size);
-	if (metablks_count < 1) {
-		ret = -EINVAL;
-		goto free_itb;
-	}
-
-	*inode_table = malloc(metablks_count * SQFS_METADATA_BLOCK_SIZE);
-	if (!*inode_table) {
-		ret = -ENOMEM;
-		goto free_itb;
-	}
-
-	src_table = itb + table_offset + SQFS_HEADER_SIZE;
-
-	/* Extract compressed Inode table */
-	for (j = 0; j < metablks_count; j++) {
-		sqfs_read_metablock(itb, table_offset, &compressed, &src_len);
-		if (compressed) {
-			dest_len = SQFS_METADATA_BLOCK_SIZE;
-			ret = sqfs_decompress(&ctxt, *inode_table +
-					      dest_offset, &dest_len,
-					      src_table, src_len);
-			if (ret) {
-				free(*inode_table);
-				*inode_table = NULL;
-				goto free_itb;
-			}
-
-			dest_offset += dest_len;
-		} else {
-			memcpy(*inode_table + (j * SQFS_METADATA_BLOCK_SIZE),
-			       src_table, src_len);
-		}
-
-		/*
-		 * Offsets to the decompression destination, to the metadata
-		 * buffer 'itb' and to the decompression source, respectively.
-		 */
-
-		table_offset += src_len + SQFS_HEADER_SIZE;
-		src_table += src_len + SQFS_HEADER_SIZE;
-	}
-
-free_itb:
-	free(itb);
-
-	return ret;
-}
-
-static int sqfs_read_directory_table(unsigned char **dir_table, u32 **pos_list)
-{
-	u64 start, n_blks, table_offset, table_size;
-	struct squashfs_super_block *sblk = ctxt.sblk;
-	int j, ret = 0, metablks_count = -1;
-	unsigned char *src_table, *dtb;
-	u32 src_len, dest_offset = 0;
-	unsigned long dest_len = 0;
-	bool compressed;
-
-	*dir_table = NULL;
-	*pos_list = NULL;
-	/* DIRECTORY TABLE */
-	table_size = get_unaligned_le64(&sblk->fragment_table_start) -
-		get_unaligned_le64(&sblk->directory_table_start);
-	start = get_unaligned_le64(&sblk->directory_table_start) /
-		ctxt.cur_dev->blksz;
-	n_blks = sqfs_calc_n_blks(sblk->directory_table_start,
-				  sblk->fragment_table_start, &table_offset);
-
-	/* Allocate a proper sized buffer (dtb) to store the directory table */
-	dtb = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-	if (!dtb)
-		return -ENOMEM;
-
-	if (sqfs_disk_read(start, n_blks, dtb) < 0)
-		goto out;
-
-	/* Parse directory table (metadata block) header */
-	ret = sqfs_read_metablock(dtb, table_offset, &compressed, &src_len);
-	if (ret)
-		goto out;
-
-	/* Calculate total size to store the whole decompressed table */
-	metablks_count = sqfs_count_metablks(dtb, table_offset, table_size);
-	if (metablks_count < 1)
-		goto out;
-
-	*dir_table = malloc(metablks_count * SQFS_METADATA_BLOCK_SIZE);
-	if (!*dir_table)
-		goto out;
-
-	*pos_list = malloc(metablks_count * sizeof(u32));
-	if (!*pos_list)
-		goto out;
-
-	ret = sqfs_get_metablk_pos(*pos_list, dtb, table_offset,
-				   metablks_count);
-	if (ret) {
-		metablks_count = -1;
-		goto out;
-	}
-
-	src_table = dtb + table_offset + SQFS_HEADER_SIZE;
-
-	/* Extract compressed Directory table */
-	dest_offset = 0;
-	for (j = 0; j < metablks_count; j++) {
-		sqfs_read_metablock(dtb, table_offset, &compressed, &src_len);
-		if (compressed) {
-			dest_len = SQFS_METADATA_BLOCK_SIZE;
-			ret = sqfs_decompress(&ctxt, *dir_table +
-					      (j * SQFS_METADATA_BLOCK_SIZE),
-					      &dest_len, src_table, src_len);
-			if (ret) {
-				metablks_count = -1;
-				goto out;
-			}
-
-			if (dest_len < SQFS_METADATA_BLOCK_SIZE) {
-				dest_offset += dest_len;
-				break;
-			}
-
-			dest_offset += dest_len;
-		} else {
-			memcpy(*dir_table + (j * SQFS_METADATA_BLOCK_SIZE),
-			       src_table, src_len);
-		}
-
-		/*
-		 * Offsets to the decompression destination, to the metadata
-		 * buffer 'dtb' and to the decompression source, respectively.
-		 */
-		table_offset += src_len + SQFS_HEADER_SIZE;
-		src_table += src_len + SQFS_HEADER_SIZE;
-	}
-
-out:
-	if (metablks_count < 1) {
-		free(*dir_table);
-		free(*pos_list);
-		*dir_table = NULL;
-		*pos_list = NULL;
-	}
-	free(dtb);
-
-	return metablks_count;
-}
-
 int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 {
-	unsigned char *inode_table = NULL, *dir_table = NULL;
-	int j, token_count = 0, ret = 0, metablks_count;
 	struct squashfs_dir_stream *dirs;
 	char **token_list = NULL, *path = NULL;
-	u32 *pos_list = NULL;
+	int j, token_count = 0, ret = 0;
 
 	dirs = malloc(sizeof(*dirs));
 	if (!dirs)
@@ -883,21 +953,7 @@ int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 	/* these should be set to NULL to prevent dangling pointers */
 	dirs->dir_header = NULL;
 	dirs->entry = NULL;
-	dirs->table = NULL;
-	dirs->inode_table = NULL;
-	dirs->dir_table = NULL;
-
-	ret = sqfs_read_inode_table(&inode_table);
-	if (ret) {
-		ret = -EINVAL;
-		goto out;
-	}
-
-	metablks_count = sqfs_read_directory_table(&dir_table, &pos_list);
-	if (metablks_count < 1) {
-		ret = -EINVAL;
-		goto out;
-	}
+	dirs->size = 0;
 
 	/* Tokenize filename */
 	token_count = sqfs_count_tokens(filename);
@@ -922,41 +978,25 @@ int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 	ret = sqfs_tokenize(token_list, token_count, path);
 	if (ret)
 		goto out;
+
 	/*
-	 * ldir's (extended directory) size is greater than dir, so it works as
-	 * a general solution for the malloc size, since 'i' is a union.
+	 * Only the metadata blocks that are needed for the lookup are read
+	 * and decompressed, see sqfs_get_metablock().
 	 */
-	dirs->inode_table = inode_table;
-	dirs->dir_table = dir_table;
-	ret = sqfs_search_dir(dirs, token_list, token_count, pos_list,
-			      metablks_count);
+	ret = sqfs_search_dir(dirs, token_list, token_count);
 	if (ret)
 		goto out;
 
-	if (le16_to_cpu(dirs->i_dir.inode_type) == SQFS_DIR_TYPE)
-		dirs->size = le16_to_cpu(dirs->i_dir.file_size);
-	else
-		dirs->size = le32_to_cpu(dirs->i_ldir.file_size);
-
-	/* Setup directory header */
-	memcpy(dirs->dir_header, dirs->table, SQFS_DIR_HEADER_SIZE);
-	dirs->entry_count = dirs->dir_header->count + 1;
-	dirs->size -= SQFS_DIR_HEADER_SIZE;
-
-	/* Setup entry */
-	dirs->entry = NULL;
-	dirs->table += SQFS_DIR_HEADER_SIZE;
-
 	*dirsp = (struct fs_dir_stream *)dirs;
 
 out:
 	for (j = 0; j < token_count; j++)
 		free(token_list[j]);
 	free(token_list);
-	free(pos_list);
 	free(path);
 	if (ret) {
-		free(inode_table);
+		free(dirs->dir_header);
+		free(dirs->entry);
 		free(dirs);
 	}
 
@@ -965,14 +1005,13 @@ out:
 
 int sqfs_readdir(struct fs_dir_stream *fs_dirs, struct fs_dirent **dentp)
 {
-	struct squashfs_super_block *sblk = ctxt.sblk;
 	struct squashfs_dir_stream *dirs;
 	struct squashfs_lreg_inode *lreg;
 	struct squashfs_base_inode *base;
 	struct squashfs_reg_inode *reg;
-	int i_number, offset = 0, ret;
+	int offset = 0, ret;
 	struct fs_dirent *dent;
-	unsigned char *ipos;
+	void *ipos;
 
 	dirs = (struct squashfs_dir_stream *)fs_dirs;
 	if (!dirs->size) {
@@ -981,9 +1020,11 @@ int sqfs_readdir(struct fs_dir_stream *fs_dirs, struct fs_dirent **dentp)
 	}
 
 	dent = &dirs->dentp;
+	free(dirs->entry);
+	dirs->entry = NULL;
 
 	if (!dirs->entry_count) {
-		if (dirs->size > SQFS_DIR_HEADER_SIZE) {
+		if (dirs->size > SQFS_DIR_HEADER_SIZE + SQFS_EMPTY_FILE_SIZE) {
 			dirs->size -= SQFS_DIR_HEADER_SIZE;
 		} else {
 			*dentp = NULL;
@@ -991,29 +1032,18 @@ int sqfs_readdir(struct fs_dir_stream *fs_dirs, struct fs_dirent **dentp)
 			return -SQFS_STOP_READDIR;
 		}
 
-		if (dirs->size > SQFS_EMPTY_FILE_SIZE) {
-			/* Read follow-up (emitted) dir. header */
-			memcpy(dirs->dir_header, dirs->table,
-			       SQFS_DIR_HEADER_SIZE);
-			dirs->entry_count = dirs->dir_header->count + 1;
-			ret = sqfs_read_entry(&dirs->entry, dirs->table +
-					      SQFS_DIR_HEADER_SIZE);
-			if (ret)
-				return -SQFS_STOP_READDIR;
-
-			dirs->table += SQFS_DIR_HEADER_SIZE;
-		}
-	} else {
-		ret = sqfs_read_entry(&dirs->entry, dirs->table);
+		/* Read follow-up (emitted) dir. header */
+		ret = sqfs_read_metadata(&dirs->dir_start, &dirs->dir_offset,
+					 dirs->dir_header,
+					 SQFS_DIR_HEADER_SIZE);
 		if (ret)
 			return -SQFS_STOP_READDIR;
+		dirs->entry_count = dirs->dir_header->count + 1;
 	}
 
-	i_number = dirs->dir_header->inode_number + dirs->entry->inode_offset;
-	ipos = sqfs_find_inode(dirs->inode_table, i_number, sblk->inodes,
-			       sblk->block_size);
-
-	base = (struct squashfs_base_inode *)ipos;
+	ret = sqfs_read_entry(dirs, &dirs->entry);
+	if (ret)
+		return -SQFS_STOP_READDIR;
 
 	/* Set entry type and size */
 	switch (dirs->entry->type) {
@@ -1023,6 +1053,12 @@ int sqfs_readdir(struct fs_dir_stream *fs_dirs, struct fs_dirent **dentp)
 		break;
 	case SQFS_REG_TYPE:
 	case SQFS_LREG_TYPE:
+		/* The size is only found in the inode */
+		ret = sqfs_read_inode(sqfs_entry_ref(dirs), &ipos);
+		if (ret)
+			return -SQFS_STOP_READDIR;
+		base = (struct squashfs_base_inode *)ipos;
+
 		/*
 		 * Entries do not differentiate extended from regular types, so
 		 * it needs to be verified manually.
@@ -1034,6 +1070,7 @@ int sqfs_readdir(struct fs_dir_stream *fs_dirs, struct fs_dirent **dentp)
 			reg = (struct squashfs_reg_inode *)ipos;
 			dent->size = get_unaligned_le32(&reg->file_size);
 		}
+		free(ipos);
 
 		dent->type = FS_DT_REG;
 		break;
@@ -1068,9 +1105,6 @@ int sqfs_readdir(struct fs_dir_stream *fs_dirs, struct fs_dirent **dentp)
 	else
 		dirs->size = 0;
 
-	/* Keep a reference to the current entry before incrementing it */
-	dirs->table += offset;
-
 	*dentp = dent;
 
 	return 0;
@@ -1102,8 +1136,24 @@ int sqfs_probe(struct blk_desc *fs_dev_desc, struct disk_partition *fs_partition
 		goto error;
 	}
 
+	ctxt.meta_cache = calloc(SQFS_METADATA_CACHE_SIZE,
+				 sizeof(*ctxt.meta_cache));
+	ctxt.meta_buf = malloc_cache_aligned(sqfs_metablock_n_blks() *
+					     ctxt.cur_dev->blksz);
+	if (!ctxt.meta_cache || !ctxt.meta_buf) {
+		sqfs_decompressor_cleanup(&ctxt);
+		ret = -ENOMEM;
+		goto error;
+	}
+	ctxt.meta_tick = 0;
+	sqfs_cache_validate();
+
 	return 0;
 error:
+	free(ctxt.meta_cache);
+	free(ctxt.meta_buf);
+	ctxt.meta_cache = NULL;
+	ctxt.meta_buf = NULL;
 	ctxt.cur_dev = NULL;
 	free(ctxt.sblk);
 	ctxt.sblk = NULL;
@@ -1308,12 +1358,13 @@ static int sqfs_get_lregfile_info(struct squashfs_lreg_inode *lreg,
 int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 	      loff_t *actread)
 {
-	char *dir = NULL, *fragment_block, *datablock = NULL, *data_buffer = NULL;
-	char *fragment = NULL, *file = NULL, *resolved, *data;
+	char *dir = NULL, *datablock = NULL, *data_buffer = NULL;
+	char *file = NULL, *resolved, *data;
 	u64 start, n_blks, table_size, data_offset, table_offset, sparse_size;
-	int ret, j, i_number, datablk_count = 0;
+	int ret, j, datablk_count = 0;
 	struct squashfs_super_block *sblk = ctxt.sblk;
 	struct squashfs_fragment_block_entry frag_entry;
+	struct squashfs_datablock *db;
 	struct squashfs_file_info finfo = {0};
 	struct squashfs_symlink_inode *symlink;
 	struct fs_dir_stream *dirsp = NULL;
@@ -1323,7 +1374,8 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 	struct squashfs_reg_inode *reg;
 	unsigned long dest_len;
 	struct fs_dirent *dent;
-	unsigned char *ipos;
+	unsigned char *ipos = NULL;
+	bool cached;
 
 	*actread = 0;
 
@@ -1336,8 +1388,8 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 	}
 
 	/*
-	 * sqfs_opendir will uncompress inode and directory tables, and will
-	 * return a pointer to the directory that contains the requested file.
+	 * sqfs_opendir will look up the directory that contains the requested
+	 * file and return a stream to list it.
 	 */
 	sqfs_split_path(&file, &dir, filename);
 	ret = sqfs_opendir(dir, &dirsp);
@@ -1364,9 +1416,9 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 		goto out;
 	}
 
-	i_number = dirs->dir_header->inode_number + dirs->entry->inode_offset;
-	ipos = sqfs_find_inode(dirs->inode_table, i_number, sblk->inodes,
-			       sblk->block_size);
+	ret = sqfs_read_inode(sqfs_entry_ref(dirs), (void **)&ipos);
+	if (ret)
+		goto out;
 
 	base = (struct squashfs_base_inode *)ipos;
 	switch (get_unaligned_le16(&base->inode_type)) {
@@ -1437,20 +1489,35 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 		}
 	}
 
+	cached = sqfs_cache_file(datablk_count);
+
 	for (j = 0; j < datablk_count; j++) {
-		start = data_offset / ctxt.cur_dev->blksz;
 		table_size = SQFS_BLOCK_SIZE(finfo.blk_sizes[j]);
-		table_offset = data_offset - (start * ctxt.cur_dev->blksz);
-		n_blks = DIV_ROUND_UP(table_size + table_offset,
-				      ctxt.cur_dev->blksz);
 
-		/* Don't load any data for sparse blocks */
 		if (finfo.blk_sizes[j] == 0) {
-			n_blks = 0;
-			table_offset = 0;
-			data_buffer = NULL;
-			data = NULL;
+			/* This is a sparse block, don't load any data */
+			sparse_size = get_unaligned_le32(&sblk->block_size);
+			if ((*actread + sparse_size) > len)
+				sparse_size = len - *actread;
+			memset(buf + *actread, 0, sparse_size);
+			*actread += sparse_size;
+		} else if (cached) {
+			ret = sqfs_get_datablock(data_offset, finfo.blk_sizes[j],
+						 &db);
+			if (ret)
+				goto out;
+
+			dest_len = db->size;
+			if ((*actread + dest_len) > len)
+				dest_len = len - *actread;
+			memcpy(buf + *actread, db->data, dest_len);
+			*actread += dest_len;
 		} else {
+			start = data_offset / ctxt.cur_dev->blksz;
+			table_offset = data_offset - (start * ctxt.cur_dev->blksz);
+			n_blks = DIV_ROUND_UP(table_size + table_offset,
+					      ctxt.cur_dev->blksz);
+
 			data_buffer = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
 
 			if (!data_buffer) {
@@ -1470,107 +1537,73 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 			}
 
 			data = data_buffer + table_offset;
-		}
 
-		/* Load the data */
-		if (finfo.blk_sizes[j] == 0) {
-			/* This is a sparse block */
-			sparse_size = get_unaligned_le32(&sblk->block_size);
-			if ((*actread + sparse_size) > len)
-				sparse_size = len - *actread;
-			memset(buf + *actread, 0, sparse_size);
-			*actread += sparse_size;
-		} else if (SQFS_COMPRESSED_BLOCK(finfo.blk_sizes[j])) {
 			dest_len = get_unaligned_le32(&sblk->block_size);
-			ret = sqfs_decompress(&ctxt, datablock, &dest_len,
-					      data, table_size);
-			if (ret)
-				goto out;
+			if (SQFS_COMPRESSED_BLOCK(finfo.blk_sizes[j]) &&
+			    len - *actread >= dest_len) {
+				/* A whole block fits, decompress it in place */
+				ret = sqfs_decompress(&ctxt, buf + *actread,
+						      &dest_len, data, table_size);
+				if (ret)
+					goto out;
+
+				*actread += dest_len;
+			} else if (SQFS_COMPRESSED_BLOCK(finfo.blk_sizes[j])) {
+				ret = sqfs_decompress(&ctxt, datablock, &dest_len,
+						      data, table_size);
+				if (ret)
+					goto out;
+
+				if ((*actread + dest_len) > len)
+					dest_len = len - *actread;
+				memcpy(buf + *actread, datablock, dest_len);
+				*actread += dest_len;
+			} else {
+				if ((*actread + table_size) > len)
+					table_size = len - *actread;
+				memcpy(buf + *actread, data, table_size);
+				*actread += table_size;
+			}
 
-			if ((*actread + dest_len) > len)
-				dest_len = len - *actread;
-			memcpy(buf + *actread, datablock, dest_len);
-			*actread += dest_len;
-		} else {
-			if ((*actread + table_size) > len)
-				table_size = len - *actread;
-			memcpy(buf + *actread, data, table_size);
-			*actread += table_size;
+			free(data_buffer);
+			data_buffer = NULL;
 		}
 
-		data_offset += table_size;
-		if (data_buffer)
-			free(data_buffer);
-		data_buffer = NULL;
+		data_offset += SQFS_BLOCK_SIZE(finfo.blk_sizes[j]);
 		if (*actread >= len)
 			break;
 	}
 
 	/*
-	 * There is no need to continue if the file is not fragmented.
+	 * There is no need to continue if the file is not fragmented or the
+	 * requested length ended before the fragment.
 	 */
-	if (!finfo.frag) {
+	if (!finfo.frag || *actread >= finfo.size) {
 		ret = 0;
 		goto out;
 	}
 
-	start = frag_entry.start / ctxt.cur_dev->blksz;
-	table_size = SQFS_BLOCK_SIZE(frag_entry.size);
-	table_offset = frag_entry.start - (start * ctxt.cur_dev->blksz);
-	n_blks = DIV_ROUND_UP(table_size + table_offset, ctxt.cur_dev->blksz);
-
-	fragment = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-
-	if (!fragment) {
-		ret = -ENOMEM;
+	/* The tail of the file is at finfo.offset in the fragment block */
+	ret = sqfs_get_datablock(frag_entry.start, frag_entry.size, &db);
+	if (ret)
 		goto out;
-	}
 
-	ret = sqfs_disk_read(start, n_blks, fragment);
-	if (ret < 0)
+	if (finfo.offset + finfo.size - *actread > db->size) {
+		ret = -EINVAL;
 		goto out;
-
-	/* File compressed and fragmented */
-	if (finfo.frag && finfo.comp) {
-		dest_len = get_unaligned_le32(&sblk->block_size);
-		fragment_block = malloc(dest_len);
-		if (!fragment_block) {
-			ret = -ENOMEM;
-			goto out;
-		}
-
-		ret = sqfs_decompress(&ctxt, fragment_block, &dest_len,
-				      (void *)fragment  + table_offset,
-				      frag_entry.size);
-		if (ret) {
-			free(fragment_block);
-			goto out;
-		}
-
-		for (j = *actread; j < finfo.size; j++) {
-			memcpy(buf + j, &fragment_block[finfo.offset + j], 1);
-			(*actread)++;
-		}
-
-		free(fragment_block);
-
-	} else if (finfo.frag && !finfo.comp) {
-		fragment_block = (void *)fragment + table_offset;
-
-		for (j = *actread; j < finfo.size; j++) {
-			memcpy(buf + j, &fragment_block[finfo.offset + j], 1);
-			(*actread)++;
-		}
 	}
 
+	memcpy(buf + *actread, db->data + finfo.offset, finfo.size - *actread);
+	*actread = finfo.size;
+
 out:
-	free(fragment);
 	if (datablk_count) {
 		free(data_buffer);
 		free(datablock);
 	}
 	free(file);
 	free(dir);
+	free(ipos);
 	free(finfo.blk_sizes);
 	sqfs_closedir(dirsp);
 
@@ -1579,7 +1612,6 @@ out:
 
 int sqfs_size(const char *filename, loff_t *size)
 {
-	struct squashfs_super_block *sblk = ctxt.sblk;
 	struct squashfs_symlink_inode *symlink;
 	struct fs_dir_stream *dirsp = NULL;
 	struct squashfs_base_inode *base;
@@ -1589,12 +1621,12 @@ int sqfs_size(const char *filename, loff_t *size)
 	char *dir, *file, *resolved;
 	struct fs_dirent *dent;
 	unsigned char *ipos;
-	int ret, i_number;
+	int ret;
 
 	sqfs_split_path(&file, &dir, filename);
 	/*
-	 * sqfs_opendir will uncompress inode and directory tables, and will
-	 * return a pointer to the directory that contains the requested file.
+	 * sqfs_opendir will look up the directory that contains the requested
+	 * file and return a stream to list it.
 	 */
 	ret = sqfs_opendir(dir, &dirsp);
 	if (ret) {
@@ -1619,11 +1651,11 @@ int sqfs_size(const char *filename, loff_t *size)
 		goto free_strings;
 	}
 
-	i_number = dirs->dir_header->inode_number + dirs->entry->inode_offset;
-	ipos = sqfs_find_inode(dirs->inode_table, i_number, sblk->inodes,
-			       sblk->block_size);
+	ret = sqfs_read_inode(sqfs_entry_ref(dirs), (void **)&ipos);
 	free(dirs->entry);
 	dirs->entry = NULL;
+	if (ret)
+		goto free_strings;
 
 	base = (struct squashfs_base_inode *)ipos;
 	switch (get_unaligned_le16(&base->inode_type)) {
@@ -1656,6 +1688,7 @@ int sqfs_size(const char *filename, loff_t *size)
 		ret = -EINVAL;
 		break;
 	}
+	free(ipos);
 
 free_strings:
 	free(dir);
@@ -1676,8 +1709,8 @@ int sqfs_exists(const char *filename)
 
 	sqfs_split_path(&file, &dir, filename);
 	/*
-	 * sqfs_opendir will uncompress inode and directory tables, and will
-	 * return a pointer to the directory that contains the requested file.
+	 * sqfs_opendir will look up the directory that contains the requested
+	 * file and return a stream to list it.
 	 */
 	ret = sqfs_opendir(dir, &dirsp);
 	if (ret) {
@@ -1707,6 +1740,12 @@ free_strings:
 void sqfs_close(void)
 {
 	sqfs_decompressor_cleanup(&ctxt);
+	free(ctxt.meta_cache);
+	free(ctxt.meta_buf);
+	ctxt.meta_cache = NULL;
+	ctxt.meta_buf = NULL;
+	free(ctxt.frag_index);
+	ctxt.frag_index = NULL;
 	free(ctxt.sblk);
 	ctxt.sblk = NULL;
 	ctxt.cur_dev = NULL;
@@ -1720,8 +1759,7 @@ void sqfs_closedir(struct fs_dir_stream *dirs)
 		return;
 
 	sqfs_dirs = (struct squashfs_dir_stream *)dirs;
-	free(sqfs_dirs->inode_table);
-	free(sqfs_dirs->dir_table);
+	free(sqfs_dirs->entry);
 	free(sqfs_dirs->dir_header);
 	free(sqfs_dirs);
 }
@@ -10,6 +10,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#if IS_ENABLED(CONFIG_LZ4)
+#include <lz4.h>
+#endif
+
 #if IS_ENABLED(CONFIG_LZO)
 #include <linux/lzo.h>
 #endif
@@ -30,6 +34,10 @@ int sqfs_decompressor_init(struct squashfs_ctxt *ctxt)
 	u16 comp_type = get_unaligned_le16(&ctxt->sblk->compression);
 
 	switch (comp_type) {
+#if IS_ENABLED(CONFIG_LZ4)
+	case SQFS_COMP_LZ4:
+		break;
+#endif
 #if IS_ENABLED(CONFIG_LZO)
 	case SQFS_COMP_LZO:
 		break;
@@ -43,6 +51,14 @@ int sqfs_decompressor_init(struct squashfs_ctxt *ctxt)
 		ctxt->zstd_workspace = malloc(ZSTD_DCtxWorkspaceBound());
 		if (!ctxt->zstd_workspace)
 			return -ENOMEM;
+		/* The context is reused for all blocks of the filesystem */
+		ctxt->zstd_dctx = ZSTD_initDCtx(ctxt->zstd_workspace,
+						ZSTD_DCtxWorkspaceBound());
+		if (!ctxt->zstd_dctx) {
+			free(ctxt->zstd_workspace);
+			ctxt->zstd_workspace = NULL;
+			return -ENOMEM;
+		}
 		break;
 #endif
 	default:
@@ -58,6 +74,10 @@ void sqfs_decompressor_cleanup(struct squashfs_ctxt *ctxt)
 	u16 comp_type = get_unaligned_le16(&ctxt->sblk->compression);
 
 	switch (comp_type) {
+#if IS_ENABLED(CONFIG_LZ4)
+	case SQFS_COMP_LZ4:
+		break;
+#endif
 #if IS_ENABLED(CONFIG_LZO)
 	case SQFS_COMP_LZO:
 		break;
@@ -69,6 +89,8 @@ void sqfs_decompressor_cleanup(struct squashfs_ctxt *ctxt)
 #if IS_ENABLED(CONFIG_ZSTD)
 	case SQFS_COMP_ZSTD:
 		free(ctxt->zstd_workspace);
+		ctxt->zstd_workspace = NULL;
+		ctxt->zstd_dctx = NULL;
 		break;
 #endif
 	}
@@ -93,17 +115,21 @@ static void zlib_decompression_status(int ret)
 
 #if IS_ENABLED(CONFIG_ZSTD)
 static int sqfs_zstd_decompress(struct squashfs_ctxt *ctxt, void *dest,
-				unsigned long dest_len, void *source, u32 src_len)
+				unsigned long *dest_len, void *source,
+				u32 src_len)
 {
-	ZSTD_DCtx *ctx;
-	size_t wsize;
-	int ret;
+	size_t ret;
+
+	ret = ZSTD_decompressDCtx(ctxt->zstd_dctx, dest, *dest_len, source,
+				  src_len);
+	if (ZSTD_isError(ret)) {
+		printf("ZSTD Error code: %d\n", ZSTD_getErrorCode(ret));
+		return -EINVAL;
+	}
 
-	wsize = ZSTD_DCtxWorkspaceBound();
-	ctx = ZSTD_initDCtx(ctxt->zstd_workspace, wsize);
-	ret = ZSTD_decompressDCtx(ctx, dest, dest_len, source, src_len);
+	*dest_len = ret;
 
-	return ZSTD_isError(ret);
+	return 0;
 }
 #endif /* CONFIG_ZSTD */
 
@@ -114,6 +140,18 @@ int sqfs_decompress(struct squashfs_ctxt *ctxt, void *dest,
 	int ret = 0;
 
 	switch (comp_type) {
+#if IS_ENABLED(CONFIG_LZ4)
+	case SQFS_COMP_LZ4:
+		ret = LZ4_decompress_safe(source, dest, src_len, *dest_len);
+		if (ret < 0) {
+			printf("LZ4 decompression failed. Error code: %d\n", ret);
+			return -EINVAL;
+		}
+
+		*dest_len = ret;
+		ret = 0;
+		break;
+#endif
 #if IS_ENABLED(CONFIG_LZO)
 	case SQFS_COMP_LZO: {
 		size_t lzo_dest_len = *dest_len;
@@ -123,6 +161,7 @@ int sqfs_decompress(struct squashfs_ctxt *ctxt, void *dest,
 			return -EINVAL;
 		}
 
+		*dest_len = lzo_dest_len;
 		break;
 	}
 #endif
@@ -138,11 +177,10 @@ int sqfs_decompress(struct squashfs_ctxt *ctxt, void *dest,
 #endif
 #if IS_ENABLED(CONFIG_ZSTD)
 	case SQFS_COMP_ZSTD:
-		ret = sqfs_zstd_decompress(ctxt, dest, *dest_len, source, src_len);
-		if (ret) {
-			printf("ZSTD Error code: %d\n", ZSTD_getErrorCode(ret));
-			return -EINVAL;
-		}
+		ret = sqfs_zstd_decompress(ctxt, dest, dest_len, source,
+					   src_len);
+		if (ret)
+			return ret;
 
 		break;
 #endif
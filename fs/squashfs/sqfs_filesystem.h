@@ -19,6 +19,10 @@
 #define SQFS_DIR_INDEX_BASE_LENGTH 12
 /* size of metadata (inode and directory) blocks */
 #define SQFS_METADATA_BLOCK_SIZE 8192
+/* Number of decompressed metadata blocks kept in the cache */
+#define SQFS_METADATA_CACHE_SIZE 16
+/* Number of decompressed data and fragment blocks kept in the cache */
+#define SQFS_DATA_CACHE_SIZE 8
 /* Max. number of fragment entries in a metadata block is 512 */
 #define SQFS_MAX_ENTRIES 512
 /* Metadata blocks start by a 2-byte length header */
@@ -73,13 +77,56 @@ struct squashfs_super_block {
 	__le64 export_table_start;
 };
 
+/* A decompressed metadata block in the cache */
+struct squashfs_metablock {
+	/* Position of the block header on disk */
+	u64 start;
+	/* Position of the following block on disk */
+	u64 next;
+	/* Decompressed size, 0 if the entry is unused */
+	u32 size;
+	/* Tick of the last access, for LRU replacement */
+	ulong last_used;
+	unsigned char data[SQFS_METADATA_BLOCK_SIZE];
+};
+
+/* A decompressed data or fragment block in the cache */
+struct squashfs_datablock {
+	/* Position of the block on disk */
+	u64 start;
+	/* Decompressed size, 0 if the entry is unused */
+	u32 size;
+	/* Tick of the last access, for LRU replacement */
+	ulong last_used;
+	/* Buffer of the filesystem's block size */
+	unsigned char *data;
+};
+
 struct squashfs_ctxt {
 	struct disk_partition cur_part_info;
 	struct blk_desc *cur_dev;
 	struct squashfs_super_block *sblk;
 #if IS_ENABLED(CONFIG_ZSTD)
 	void *zstd_workspace;
+	void *zstd_dctx;
 #endif
+	/* Metadata cache, valid from sqfs_probe() to sqfs_close() */
+	struct squashfs_metablock *meta_cache;
+	unsigned char *meta_buf;
+	ulong meta_tick;
+	/* Fragment index table, read on first use */
+	u64 *frag_index;
+	/*
+	 * Data and fragment block cache. Unlike the above, it is kept after
+	 * sqfs_close() and only flushed when a different filesystem is probed.
+	 */
+	struct squashfs_datablock data_cache[SQFS_DATA_CACHE_SIZE];
+	struct squashfs_super_block data_sblk;
+	struct blk_desc *data_dev;
+	lbaint_t data_part_start;
+	ulong data_tick;
+	ulong data_hits;
+	ulong data_misses;
 };
 
 struct squashfs_directory_index {
@@ -264,20 +311,16 @@ struct squashfs_dir_stream {
 	struct squashfs_directory_header *dir_header;
 	struct squashfs_directory_entry *entry;
 	/*
-	 * 'table' points to a position into the directory table. Both 'table'
-	 * and 'inode' are defined for the first time in sqfs_opendir().
-	 * 'table's value changes in sqfs_readdir().
+	 * Position in the directory table: 'dir_start' is the position of a
+	 * metadata block on disk and 'dir_offset' the offset into its
+	 * decompressed data. Both are defined for the first time in
+	 * sqfs_opendir() and advanced in sqfs_readdir().
 	 */
-	unsigned char *table;
+	u64 dir_start;
+	u32 dir_offset;
 	union squashfs_inode i;
 	struct squashfs_dir_inode i_dir;
 	struct squashfs_ldir_inode i_ldir;
-	/*
-	 * References to the tables' beginnings. They are assigned in
-	 * sqfs_opendir() and freed in sqfs_closedir().
-	 */
-	unsigned char *inode_table;
-	unsigned char *dir_table;
 };
 
 struct squashfs_file_info {
@@ -295,16 +338,14 @@ struct squashfs_file_info {
 	bool comp;
 };
 
-void *sqfs_find_inode(void *inode_table, int inode_number, __le32 inode_count,
-		      __le32 block_size);
+int sqfs_inode_size(struct squashfs_base_inode *inode, u32 blk_size);
 
-int sqfs_dir_offset(void *dir_i, u32 *m_list, int m_count);
-
-int sqfs_read_metablock(unsigned char *file_mapping, int offset,
-			bool *compressed, u32 *data_size);
+bool sqfs_is_dir(u16 type);
 
-bool sqfs_is_empty_dir(void *dir_i);
+struct squashfs_datablock *sqfs_cache_get(struct squashfs_datablock *cache,
+					  int count, u64 start, ulong *tick,
+					  bool *hit);
 
-bool sqfs_is_dir(u16 type);
+bool sqfs_cache_file(int datablk_count);
 
 #endif /* SQFS_FILESYSTEM_H */
@@ -14,10 +14,45 @@
 #include <wildcard.h>
 #include <fat.h>
 #include <errno.h>
+#include <malloc.h>
+
+/* Number of hash buckets in a directory snapshot, must be a power of 2 */
+#define WC_SNAP_HASH_SIZE	256
+
+/* Number of unused directory snapshots to keep */
+#define WC_SNAP_MAX		8
+
+/* One entry of a directory snapshot */
+struct wc_snap_entry {
+	unsigned long reference;	/* File reference, e.g. FAT cluster */
+	loff_t file_size;		/* File size */
+	enum wc_file_type file_type;	/* File type */
+	unsigned int hash;		/* Hash of file name */
+	unsigned int name;		/* Offset of file name in names[] */
+	int next;			/* Next entry with same hash, -1: end */
+};
+
+/* Snapshot of a directory; entries are in the order of the directory */
+struct wc_snapshot {
+	struct wc_snapshot *next;	/* Next snapshot in cache (LRU order) */
+	const struct wc_fsops *ops;	/* Filesystem, NULL if flushed */
+	unsigned long reference;	/* Directory reference */
+	unsigned int users;		/* Number of wc_dirinfo using it */
+	unsigned int count;		/* Number of entries */
+	unsigned int alloc;		/* Number of allocated entries */
+	unsigned int names_size;	/* Used bytes in names[] */
+	unsigned int names_alloc;	/* Allocated bytes in names[] */
+	struct wc_snap_entry *entries;	/* Directory entries */
+	char *names;			/* File names of all entries */
+	int hash[WC_SNAP_HASH_SIZE];	/* First entry for each hash value */
+};
 
 /* Pointer to file system calls for data access */
 static const struct wc_fsops *fs_ops;
 
+/* Cache of directory snapshots, most recently used first */
+static struct wc_snapshot *snap_cache;
+
 /**
  * skip_dir_delim() - Remove all leading directory delimiters
  * @pattern: String to check
@@ -85,6 +120,387 @@ static const char *wildcard_match(const char *filename, const char *pattern)
 	return pattern - 1;
 }
 
+/**
+ * wildcard_hash() - Compute hash value of a file name
+ * @name: File name, does not need to be 0-terminated
+ * @len:  Length of the file name
+ *
+ * Return:
+ * Hash value
+ */
+static unsigned int wildcard_hash(const char *name, unsigned int len)
+{
+	unsigned int hash = 5381;
+
+	while (len--)
+		hash = hash * 33 + (unsigned char)*name++;
+
+	return hash;
+}
+
+/**
+ * wildcard_compile() - Prepare the first path element of a pattern
+ * @pat:     Structure where to store the compiled pattern
+ * @pattern: Pattern to compile; stops at '/' or '\0'
+ *
+ * Most patterns are either plain names or have only one '*', like "*.dtb".
+ * These can be matched without recursion, and plain names can even be
+ * looked up by their hash value.
+ */
+static void wildcard_compile(struct wc_pattern *pat, const char *pattern)
+{
+	unsigned int stars = 0;
+	unsigned int i;
+	bool qmark = false;
+	char c;
+
+	for (i = 0; ((c = pattern[i]) != '\0') && (c != '/'); i++) {
+		if (c == '*') {
+			if (!stars)
+				pat->prefix = i;
+			stars++;
+		} else if (c == '?')
+			qmark = true;
+	}
+	pat->len = i;
+
+	if (qmark || (stars > 1))
+		pat->type = WC_PATTERN_GENERIC;
+	else if (stars) {
+		pat->type = WC_PATTERN_STAR;
+		pat->suffix = i - pat->prefix - 1;
+	} else {
+		pat->type = WC_PATTERN_LITERAL;
+		pat->hash = wildcard_hash(pattern, i);
+	}
+}
+
+/**
+ * wildcard_match_compiled() - Check if a filename matches a compiled pattern
+ * @filename: Filename to check
+ * @pat:      Compiled pattern
+ * @pattern:  Pattern that was compiled into pat
+ *
+ * Return:
+ * Same as wildcard_match().
+ */
+static const char *wildcard_match_compiled(const char *filename,
+					   const struct wc_pattern *pat,
+					   const char *pattern)
+{
+	unsigned int len;
+
+	switch (pat->type) {
+	case WC_PATTERN_LITERAL:
+		if (strncmp(filename, pattern, pat->len) || filename[pat->len])
+			return NULL;
+		break;
+	case WC_PATTERN_STAR:
+		len = strlen(filename);
+		if ((len < pat->prefix + pat->suffix)
+		    || strncmp(filename, pattern, pat->prefix)
+		    || strncmp(filename + len - pat->suffix,
+			       pattern + pat->len - pat->suffix, pat->suffix))
+			return NULL;
+		break;
+	default:
+		return wildcard_match(filename, pattern);
+	}
+
+	return pattern + pat->len;
+}
+
+/**
+ * wildcard_snap_free() - Free a directory snapshot
+ * @snap: Pointer to snapshot
+ */
+static void wildcard_snap_free(struct wc_snapshot *snap)
+{
+	free(snap->entries);
+	free(snap->names);
+	free(snap);
+}
+
+/**
+ * wildcard_snap_trim() - Drop unused snapshots beyond the cache size
+ */
+static void wildcard_snap_trim(void)
+{
+	struct wc_snapshot **psnap = &snap_cache;
+	struct wc_snapshot *snap;
+	unsigned int unused = 0;
+
+	while ((snap = *psnap) != NULL) {
+		if (!snap->users && (!snap->ops || (++unused > WC_SNAP_MAX))) {
+			*psnap = snap->next;
+			wildcard_snap_free(snap);
+		} else
+			psnap = &snap->next;
+	}
+}
+
+/**
+ * wildcard_snap_add() - Add a file to a directory snapshot
+ * @snap: Pointer to snapshot
+ * @wfi:  File information to add
+ *
+ * Return:
+ * 0 on success, -ENOMEM if out of memory.
+ */
+static int wildcard_snap_add(struct wc_snapshot *snap,
+			     const struct wc_fileinfo *wfi)
+{
+	struct wc_snap_entry *entry;
+	unsigned int len = strlen(wfi->file_name);
+
+	if (snap->count >= snap->alloc) {
+		unsigned int alloc = snap->alloc ? 2 * snap->alloc : 64;
+
+		entry = realloc(snap->entries, alloc * sizeof(*entry));
+		if (!entry)
+			return -ENOMEM;
+		snap->entries = entry;
+		snap->alloc = alloc;
+	}
+
+	if (snap->names_size + len + 1 > snap->names_alloc) {
+		unsigned int alloc = snap->names_alloc ? 2 * snap->names_alloc
+			: 2048;
+		char *names;
+
+		while (snap->names_size + len + 1 > alloc)
+			alloc *= 2;
+		names = realloc(snap->names, alloc);
+		if (!names)
+			return -ENOMEM;
+		snap->names = names;
+		snap->names_alloc = alloc;
+	}
+
+	entry = &snap->entries[snap->count++];
+	entry->reference = wfi->reference;
+	entry->file_size = wfi->file_size;
+	entry->file_type = wfi->file_type;
+	entry->hash = wildcard_hash(wfi->file_name, len);
+	entry->name = snap->names_size;
+	memcpy(snap->names + snap->names_size, wfi->file_name, len + 1);
+	snap->names_size += len + 1;
+
+	return 0;
+}
+
+/**
+ * wildcard_snap_attach() - Attach a snapshot of the directory contents
+ * @wdi:    Pointer to directory entry
+ *
+ * Take the directory snapshot from the cache or read the whole directory
+ * once to create it. All further accesses to this directory are answered
+ * from memory. If there is not enough memory for a snapshot, set flag
+ * WC_FLAGS_DIRECT so that the directory is read from the device as before.
+ *
+ * Return:
+ * 0 on success (even without snapshot), <0 on I/O error.
+ */
+static int wildcard_snap_attach(struct wc_dirinfo *wdi)
+{
+	struct wc_snapshot **psnap = &snap_cache;
+	struct wc_snapshot *snap;
+	struct wc_fileinfo wfi;
+	int ret;
+	int i;
+
+	/* Look in cache; move snapshot to front if found */
+	while ((snap = *psnap) != NULL) {
+		if ((snap->ops == fs_ops) && (snap->reference == wdi->reference)) {
+			*psnap = snap->next;
+			goto found;
+		}
+		psnap = &snap->next;
+	}
+
+	/* Not found, read the whole directory */
+	snap = calloc(1, sizeof(*snap));
+	if (!snap)
+		goto direct;
+
+	wdi->flags |= WC_FLAGS_REWIND | WC_FLAGS_RELOAD;
+	while ((ret = fs_ops->get_fileinfo(wdi, &wfi)) > 0) {
+		if (wildcard_snap_add(snap, &wfi)) {
+			wildcard_snap_free(snap);
+			goto direct;
+		}
+	}
+	if (ret < 0) {
+		wildcard_snap_free(snap);
+		return ret;
+	}
+
+	/* Link entries with the same hash, keep directory order */
+	for (i = 0; i < WC_SNAP_HASH_SIZE; i++)
+		snap->hash[i] = -1;
+	for (i = (int)snap->count - 1; i >= 0; i--) {
+		struct wc_snap_entry *entry = &snap->entries[i];
+		int *head = &snap->hash[entry->hash & (WC_SNAP_HASH_SIZE - 1)];
+
+		entry->next = *head;
+		*head = i;
+	}
+	snap->ops = fs_ops;
+	snap->reference = wdi->reference;
+
+found:
+	snap->next = snap_cache;
+	snap_cache = snap;
+	snap->users++;
+	wdi->snap = snap;
+	wdi->snap_index = 0;
+	wildcard_snap_trim();
+
+	return 0;
+
+direct:
+	wdi->flags |= WC_FLAGS_DIRECT | WC_FLAGS_REWIND | WC_FLAGS_RELOAD;
+
+	return 0;
+}
+
+/**
+ * wildcard_snap_release() - Release the snapshot of a directory
+ * @wdi:    Pointer to directory entry
+ */
+static void wildcard_snap_release(struct wc_dirinfo *wdi)
+{
+	if (wdi->snap) {
+		wdi->snap->users--;
+		wdi->snap = NULL;
+		wildcard_snap_trim();
+	}
+}
+
+/**
+ * wildcard_snap_prepare() - Make sure the directory snapshot can be used
+ * @wdi:    Pointer to directory entry
+ *
+ * Attach the snapshot if not done yet and handle WC_FLAGS_REWIND.
+ *
+ * Return:
+ * 0 on success, <0 on I/O error.
+ */
+static int wildcard_snap_prepare(struct wc_dirinfo *wdi)
+{
+	int ret;
+
+	if (!wdi->snap && !(wdi->flags & WC_FLAGS_DIRECT)) {
+		ret = wildcard_snap_attach(wdi);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (wdi->snap) {
+		if (wdi->flags & WC_FLAGS_REWIND)
+			wdi->snap_index = 0;
+		wdi->flags &= ~(WC_FLAGS_REWIND | WC_FLAGS_RELOAD);
+	}
+
+	return 0;
+}
+
+/**
+ * wildcard_snap_get() - Fill file information from a snapshot entry
+ * @wdi:    Pointer to directory entry with snapshot
+ * @index:  Index of the entry in the snapshot
+ * @wfi:    Structure where to store file information
+ */
+static void wildcard_snap_get(struct wc_dirinfo *wdi, unsigned int index,
+			      struct wc_fileinfo *wfi)
+{
+	struct wc_snapshot *snap = wdi->snap;
+	struct wc_snap_entry *entry = &snap->entries[index];
+
+	wfi->reference = entry->reference;
+	wfi->file_size = entry->file_size;
+	wfi->file_type = entry->file_type;
+	strcpy(wfi->file_name, snap->names + entry->name);
+	wdi->snap_index = index + 1;
+}
+
+/**
+ * wildcard_get_fileinfo() - Get next directory entry
+ * @wdi: Pointer to directory entry (data will be updated)
+ * @wfi: Pointer to structure where to store file information
+ *
+ * Like get_fileinfo() of the filesystem, but use the directory snapshot.
+ *
+ * Return:
+ *  1 - OK, found another entry;
+ *  0 - Done, no more entries;
+ * -1 - Error while reading data from device
+ */
+static int wildcard_get_fileinfo(struct wc_dirinfo *wdi,
+				 struct wc_fileinfo *wfi)
+{
+	int ret;
+
+	ret = wildcard_snap_prepare(wdi);
+	if (ret < 0)
+		return ret;
+
+	if (!wdi->snap)
+		return fs_ops->get_fileinfo(wdi, wfi);
+
+	if (wdi->snap_index >= wdi->snap->count)
+		return 0;
+
+	wildcard_snap_get(wdi, wdi->snap_index, wfi);
+
+	return 1;
+}
+
+/**
+ * wildcard_find_literal() - Return next file match for a plain name
+ * @wdi:    Directory entry with snapshot; wdi->dir_pattern has no wildcards
+ * @wfi:    Structure where to store file information if a file is found
+ *
+ * Look up the name in the hash table of the snapshot instead of comparing
+ * all directory entries.
+ *
+ * Return:
+ *  1 - Found a file match;
+ *  0 - No more matches
+ */
+static int wildcard_find_literal(struct wc_dirinfo *wdi,
+				 struct wc_fileinfo *wfi)
+{
+	struct wc_snapshot *snap = wdi->snap;
+	struct wc_snap_entry *entry;
+	const char *pattern = wdi->dir_pattern;
+	unsigned int len = wdi->pat.len;
+	const char *name;
+	int i;
+
+	i = snap->hash[wdi->pat.hash & (WC_SNAP_HASH_SIZE - 1)];
+	for (; i >= 0; i = entry->next) {
+		entry = &snap->entries[i];
+		if ((i < wdi->snap_index) || (entry->hash != wdi->pat.hash))
+			continue;
+		name = snap->names + entry->name;
+		if (strncmp(name, pattern, len) || name[len])
+			continue;
+
+		/* Dummy directories . and .. should never match */
+		if (!strcmp(name, ".") || !strcmp(name, ".."))
+			break;
+
+		wildcard_snap_get(wdi, i, wfi);
+		wfi->pattern = pattern + len;
+
+		return 1;
+	}
+	wdi->snap_index = snap->count;
+
+	return 0;
+}
+
 /**
  * wildcard_find_file() - Return next file match for a pattern
  * @wdi:    Directory entry; wdi->dir_pattern is the pattern to search for
@@ -102,14 +518,22 @@ static int wildcard_find_file(struct wc_dirinfo *wdi, struct wc_fileinfo *wfi)
 	int ret;
 	const char *pattern;
 
-	while ((ret = fs_ops->get_fileinfo(wdi, wfi)) > 0) {
+	ret = wildcard_snap_prepare(wdi);
+	if (ret < 0)
+		return ret;
+
+	if (wdi->snap && (wdi->pat.type == WC_PATTERN_LITERAL))
+		return wildcard_find_literal(wdi, wfi);
+
+	while ((ret = wildcard_get_fileinfo(wdi, wfi)) > 0) {
 		/* Dummy directories . and .. should never match */
 		if (!strcmp(wfi->file_name, ".")
 		    || !strcmp(wfi->file_name, ".."))
 			continue;
 
 		/* Try the pattern */
-		pattern = wildcard_match(wfi->file_name, wdi->dir_pattern);
+		pattern = wildcard_match_compiled(wfi->file_name, &wdi->pat,
+						  wdi->dir_pattern);
 		if (pattern) {
 			wfi->pattern = pattern;
 			break;
@@ -265,6 +689,7 @@ static struct wc_dirinfo *wildcard_free_dir(struct wc_dirinfo *wdi)
 {
 	struct wc_dirinfo *parent_wdi = wdi->parent;
 
+	wildcard_snap_release(wdi);
 	fs_ops->free_dir(wdi);
 
 	return parent_wdi;
@@ -312,6 +737,9 @@ static struct wc_dirinfo *wildcard_alloc_dir(struct wc_dirinfo *parent_wdi,
 		wdi->flags = WC_FLAGS_REWIND | WC_FLAGS_RELOAD;
 		wdi->dir_pattern = skip_dir_delim(wfi->pattern);
 		strcpy(wdi->dir_name, wfi->file_name);
+		wildcard_compile(&wdi->pat, wdi->dir_pattern);
+		wdi->snap = NULL;
+		wdi->snap_index = 0;
 	} else {
 		if (parent_wdi) {
 			wildcard_print_path(parent_wdi);
@@ -373,7 +801,7 @@ static int wildcard_list_dir(struct wc_dirinfo *wdi, struct wc_fileinfo *wfi)
 	if (wdi->dir_pattern[0])
 		get_fileinfo = wildcard_find_file;
 	else
-		get_fileinfo = fs_ops->get_fileinfo;
+		get_fileinfo = wildcard_get_fileinfo;
 
 
 	while ((ret = get_fileinfo(wdi, wfi)) > 0) {
@@ -699,6 +1127,9 @@ int wildcard_write(struct wc_fileinfo *wfi, const struct wc_fsops *ops,
 
 	wildcard_path_done(wdi);
 
+	/* Directory contents have changed */
+	wildcard_flush();
+
 	return err;
 }
 
@@ -720,8 +1151,26 @@ int wildcard_exists(struct wc_fileinfo *wfi, const struct wc_fsops *ops)
 
 	/* Find path and file */
 	wdi = wildcard_find_unique(wfi);
-	if (wdi && (wfi->file_type != WC_TYPE_NONE))
-		return 1;
+	if (!wdi)
+		return 0;
 
-	return 0;
+	wildcard_path_done(wdi);
+
+	return (wfi->file_type != WC_TYPE_NONE);
+}
+
+/**
+ * wildcard_flush() - Drop all directory snapshots
+ *
+ * Must be called whenever the directory contents may have changed, e.g. if a
+ * new device is set or if a file was written.
+ */
+void wildcard_flush(void)
+{
+	struct wc_snapshot *snap;
+
+	/* Snapshots still in use are freed when they are released */
+	for (snap = snap_cache; snap; snap = snap->next)
+		snap->ops = NULL;
+	wildcard_snap_trim();
 }
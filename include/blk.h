@@ -8,6 +8,7 @@
 #define BLK_H
 
 #include <efi.h>
+#include <linux/list.h>
 
 #ifdef CONFIG_SYS_64BIT_LBA
 typedef uint64_t lbaint_t;
@@ -113,6 +114,10 @@ struct blk_desc {
 #define PAD_TO_BLOCKSIZE(size, blk_desc) \
 	(PAD_SIZE(size, blk_desc->blksz))
 
+/* Function to read blocks from the device if they are not in the cache */
+typedef ulong (*blkcache_read_t)(struct blk_desc *block_dev, lbaint_t start,
+				 lbaint_t blkcnt, void *buffer);
+
 #if CONFIG_IS_ENABLED(BLOCK_CACHE)
 
 /**
@@ -152,6 +157,24 @@ void blkcache_fill(int iftype, int dev,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer);
 
+/**
+ * blkcache_miss() - read blocks that were not found in the cache
+ *
+ * Small reads are extended to whole cache lines and, if the access is
+ * sequential, by the configured number of read-ahead lines. The data is
+ * stored in the cache. Large reads bypass the cache.
+ *
+ * @param block_dev - block device to read from
+ * @param start - starting block number
+ * @param blkcnt - number of blocks to read
+ * @param buffer - buffer for the requested blocks
+ * @param read - function to read blocks from the device
+ *
+ * @return - number of blocks read
+ */
+ulong blkcache_miss(struct blk_desc *block_dev, lbaint_t start,
+		    lbaint_t blkcnt, void *buffer, blkcache_read_t read);
+
 /**
  * blkcache_invalidate() - discard the cache for a set of blocks
  * because of a write or device (re)initialization.
@@ -164,10 +187,11 @@ void blkcache_invalidate(int iftype, int dev);
 /**
  * blkcache_configure() - configure block cache
  *
- * @param blocks - maximum blocks per entry
+ * @param blocks - blocks per entry (cache line), rounded to a power of 2
  * @param entries - maximum entries in cache
+ * @param readahead - entries to read ahead on sequential access
  */
-void blkcache_configure(unsigned blocks, unsigned entries);
+void blkcache_configure(unsigned blocks, unsigned entries, unsigned readahead);
 
 /*
  * statistics of the block cache
@@ -178,6 +202,9 @@ struct block_cache_stats {
 	unsigned entries; /* current entry count */
 	unsigned max_blocks_per_entry;
 	unsigned max_entries;
+	unsigned readahead; /* entries to read ahead */
+	unsigned ra_lines; /* entries filled by read-ahead */
+	unsigned ra_used; /* ... of which were used later */
 };
 
 /**
@@ -200,12 +227,64 @@ static inline void blkcache_fill(int iftype, int dev,
 				 lbaint_t start, lbaint_t blkcnt,
 				 unsigned long blksz, void const *buffer) {}
 
+static inline ulong blkcache_miss(struct blk_desc *block_dev, lbaint_t start,
+				  lbaint_t blkcnt, void *buffer,
+				  blkcache_read_t read)
+{
+	return read(block_dev, start, blkcnt, buffer);
+}
+
 static inline void blkcache_invalidate(int iftype, int dev) {}
 
 #endif
 
 #if CONFIG_IS_ENABLED(BLK)
 struct udevice;
+struct blk_req;
+
+/* State of an asynchronous block request */
+enum blk_req_state {
+	BLK_REQ_QUEUED,		/* Waiting for the device */
+	BLK_REQ_ACTIVE,		/* Started on the device */
+	BLK_REQ_DONE,		/* Complete, result is valid */
+};
+
+/* Completion callback, called from blk_poll() */
+typedef void (*blk_req_done_t)(struct blk_req *req);
+
+/**
+ * struct blk_req - an asynchronous block request
+ *
+ * The caller fills in the fields up to @priv and passes the request to
+ * blk_submit(). The request and the buffer must stay valid until the request
+ * is complete. Requests on overlapping blocks must not be in flight at the
+ * same time.
+ *
+ * @desc:	Block device to access
+ * @start:	Start block number (0=first)
+ * @blkcnt:	Number of blocks to transfer
+ * @buffer:	Buffer for the data
+ * @write:	true to write to the device, false to read
+ * @done:	Function to call on completion, or NULL
+ * @priv:	Private data for the caller, e.g. for @done
+ * @result:	Number of blocks transferred, or -ve error number
+ * @state:	State of the request, see enum blk_req_state
+ * @drv_data:	Private data for the driver while the request is active
+ * @node:	Entry in the list of requests in flight
+ */
+struct blk_req {
+	struct blk_desc *desc;
+	lbaint_t start;
+	lbaint_t blkcnt;
+	void *buffer;
+	bool write;
+	blk_req_done_t done;
+	void *priv;
+	long result;
+	enum blk_req_state state;
+	ulong drv_data;
+	struct list_head node;
+};
 
 /* Operations on block devices */
 struct blk_ops {
@@ -265,6 +344,33 @@ struct blk_ops {
 	 * @return 0 if OK, -ve on error
 	 */
 	int (*select_hwpart)(struct udevice *dev, int hwpart);
+
+	/**
+	 * submit() - start a request without waiting for it to complete
+	 *
+	 * This is optional. Devices without it execute requests
+	 * synchronously in blk_submit().
+	 *
+	 * @dev:	Device to access
+	 * @req:	Request to start, @req->drv_data may be used by the
+	 *		driver until poll() reports the request as complete
+	 * @return 0 if started, -EBUSY if the device can not take another
+	 * request at the moment, -ENOSYS if the request must be executed
+	 * synchronously, other -ve error number on failure
+	 */
+	int (*submit)(struct udevice *dev, struct blk_req *req);
+
+	/**
+	 * poll() - check whether a started request is complete
+	 *
+	 * This is required if submit() is provided.
+	 *
+	 * @dev:	Device to check
+	 * @req:	Request that was started by submit()
+	 * @return -EINPROGRESS if the request is still running, otherwise
+	 * number of blocks transferred, or -ve error number
+	 */
+	long (*poll)(struct udevice *dev, struct blk_req *req);
 };
 
 #define blk_get_ops(dev)	((struct blk_ops *)(dev)->driver->ops)
@@ -282,6 +388,47 @@ unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
 			 lbaint_t blkcnt);
 
+/**
+ * blk_submit() - submit an asynchronous block request
+ *
+ * The request is started on the device if possible, or queued until the
+ * device can take it. Reads that hit the block cache and requests to devices
+ * without native support are executed immediately. In any case the
+ * completion callback is only called from blk_poll() or blk_wait().
+ *
+ * When the device is removed, requests that it has started are completed
+ * first. Requests that are still queued fail with -ENODEV. The callbacks of
+ * all requests on the device are then called during the removal; they must
+ * not submit new requests to it.
+ *
+ * @req:	Request to submit
+ * @return 0 if submitted, -ve error number on failure (the request is
+ * not submitted then)
+ */
+int blk_submit(struct blk_req *req);
+
+/**
+ * blk_poll() - advance all requests in flight
+ *
+ * This starts queued requests, checks active requests and calls the
+ * completion callbacks of requests that are done. Callbacks may submit new
+ * requests but must not call blk_poll() or blk_wait().
+ *
+ * @return number of requests that are not complete yet
+ */
+int blk_poll(void);
+
+/**
+ * blk_wait() - wait for a request to complete
+ *
+ * This polls all requests in flight until @req is complete and its
+ * callback was called.
+ *
+ * @req:	Request to wait for
+ * @return number of blocks transferred, or -ve error number
+ */
+long blk_wait(struct blk_req *req);
+
 /**
  * blk_find_device() - Find a block device
  *
@@ -435,7 +582,6 @@ struct blk_desc *blk_get_by_device(struct udevice *dev);
 static inline ulong blk_dread(struct blk_desc *block_dev, lbaint_t start,
 			      lbaint_t blkcnt, void *buffer)
 {
-	ulong blks_read;
 	if (blkcache_read(block_dev->if_type, block_dev->devnum,
 			  start, blkcnt, block_dev->blksz, buffer))
 		return blkcnt;
@@ -445,12 +591,8 @@ static inline ulong blk_dread(struct blk_desc *block_dev, lbaint_t start,
 	 * bloats the code slightly (cause some board to fail to build), and
 	 * it would be an error to try an operation that does not exist.
 	 */
-	blks_read = block_dev->block_read(block_dev, start, blkcnt, buffer);
-	if (blks_read == blkcnt)
-		blkcache_fill(block_dev->if_type, block_dev->devnum,
-			      start, blkcnt, block_dev->blksz, buffer);
-
-	return blks_read;
+	return blkcache_miss(block_dev, start, blkcnt, buffer,
+			     block_dev->block_read);
 }
 
 static inline ulong blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
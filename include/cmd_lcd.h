@@ -36,6 +36,7 @@ typedef int XYPOS;
 #define XLCD_DRAW_FILL   0x0080		  /* fill, clear */
 #define XLCD_DRAW_PROG   0x0100		  /* pbr, pbt, prog */
 #define XLCD_DRAW_TEST   0x0200		  /* test */
+#define XLCD_DRAW_BENCH  0x0400		  /* bench */
 #define XLCD_DRAW_ALL    0xFFFF		  /* All of the above */
 
 /* Supported test images, combine with | in CONFIG_XLCD_TEST */
@@ -85,6 +86,10 @@ typedef int XYPOS;
 /* PWM value for maximum voltage */
 #define MAX_PWM 4096
 
+/* Number of dirty regions that are tracked separately per window; if more
+   regions are changed, the closest regions are merged */
+#define XLCD_DIRTY_RECTS 4
+
 /* These appear so often that a macro seems appropriate */
 #define lcd_set_fg(pwi, rgba) lcd_set_col(pwi, rgba, &pwi->fg)
 #define lcd_set_bg(pwi, rgba) lcd_set_col(pwi, rgba, &pwi->bg)
@@ -108,6 +113,14 @@ typedef struct colinfo {
 	RGBA A256;			  /* 256-Alpha (8 bits) */
 } colinfo_t;
 
+/* Region of a window that was changed since the last sync or flip */
+typedef struct dirtyrect {
+	XYPOS left;			  /* Changed region (inclusive) */
+	XYPOS top;
+	XYPOS right;
+	XYPOS bottom;
+} dirtyrect_t;
+
 /* Structure to store window specific alpha information; from, to and now are
    only valid if time != 0. */
 typedef struct alphainfo {
@@ -247,6 +260,10 @@ struct wininfo
 	XYPOS hoffs;			  /* Offset within framebuffer (>=0) */
 	XYPOS voffs;
 
+	/* Regions of buffer fbdraw changed since the last sync or flip */
+	dirtyrect_t dirty[XLCD_DIRTY_RECTS];
+	u_char dirtycount;		  /* Number of valid dirty regions */
+
 	/* Drawing information, only accessed by draw commands */
 	colinfo_t fg;			  /* Foreground color info */
 	colinfo_t bg;			  /* Foreground color info */
@@ -259,6 +276,7 @@ struct wininfo
 	XYPOS horigin;			  /* Current drawing origin */
 	XYPOS vorigin;
 	pbinfo_t pbi;			  /* Progress bar info */
+	struct glyphcache *pgc;		  /* Pre-rendered glyphs or NULL */
 
 	/* Alpha and color keying information */
 	alphainfo_t ai[2];		  /* Alpha info for A=0 and A=1 */
@@ -310,7 +328,7 @@ extern void console_init(wininfo_t *pwi, RGBA fg, RGBA bg);
 extern void console_update(wininfo_t *pwi, RGBA fg, RGBA bg);
 #endif
 
-extern void console_cls(const wininfo_t *pwi, COLOR32 col);
+extern void console_cls(wininfo_t *pwi, COLOR32 col);
 extern void lcd_putc(const struct stdio_dev *pdev, const char c);
 extern void lcd_puts(const struct stdio_dev *pdev, const char *s);
 
@@ -327,6 +345,18 @@ extern int setfbuf(wininfo_t *pwi, XYPOS hres, XYPOS vres,
 /* If not locked, update window hardware and set environment variable */
 extern void set_wininfo(const wininfo_t *pwi);
 
+/* Mark region as changed in the draw buffer; the region is clipped to the
+   framebuffer, coordinates must be sorted (x1 <= x2, y1 <= y2) */
+extern void lcd_add_dirty(wininfo_t *pwi, XYPOS x1, XYPOS y1,
+			  XYPOS x2, XYPOS y2);
+
+/* Write back all changed regions of the draw buffer to memory */
+extern void lcd_sync(wininfo_t *pwi);
+
+/* Show buffer fbshow and continue drawing to buffer fbdraw; only the changed
+   regions are written back and copied to the new draw buffer (win flip) */
+extern void lcd_flip(wininfo_t *pwi, u_char fbshow, u_char fbdraw);
+
 /* Get a pointer to the wininfo structure */
 extern wininfo_t *lcd_get_wininfo_p(const vidinfo_t *pvi, WINDOW win);
 
@@ -309,14 +309,12 @@
 #define CONFIG_CMD_LCD			/* Support lcd settings command */
 #define CONFIG_CMD_WIN			/* Window layers, alpha blending */
 #define CONFIG_CMD_CMAP			/* Support CLUT pixel formats */
-#define CONFIG_CMD_DRAW			/* Support draw command */
 #define CONFIG_CMD_ADRAW		/* Support alpha draw commands */
 #define CONFIG_CMD_BMINFO		/* Provide bminfo command */
 #define CONFIG_XLCD_PNG			/* Support for PNG bitmaps */
 #define CONFIG_XLCD_BMP			/* Support for BMP bitmaps */
 #define CONFIG_XLCD_JPG			/* Support for JPG bitmaps */
 #define CONFIG_XLCD_EXPR		/* Allow expressions in coordinates */
-#define CONFIG_XLCD_CONSOLE		/* Support console on LCD */
 #define CONFIG_XLCD_CONSOLE_MULTI	/* Define a console on each window */
 #define CONFIG_XLCD_FBSIZE 0x00100000	/* 1 MB default framebuffer pool */
 #define CONFIG_S3C64XX_XLCD		/* Use S3C64XX lcd driver */
@@ -30,13 +30,17 @@
 
 struct disk_partition;
 
+#define EXT4_ENCRYPT_FL		0x00000800 /* Encrypted file */
 #define EXT4_INDEX_FL		0x00001000 /* Inode uses hash tree index */
 #define EXT4_EXTENTS_FL		0x00080000 /* Inode uses extents */
+#define EXT4_CASEFOLD_FL	0x40000000 /* Casefolded directory */
 #define EXT4_EXT_MAGIC			0xf30a
+#define EXT4_FEATURE_COMPAT_DIR_INDEX	0x0020
 #define EXT4_FEATURE_RO_COMPAT_GDT_CSUM	0x0010
 #define EXT4_FEATURE_RO_COMPAT_METADATA_CSUM 0x0400
 #define EXT4_FEATURE_INCOMPAT_EXTENTS	0x0040
 #define EXT4_FEATURE_INCOMPAT_64BIT	0x0080
+#define EXT4_FEATURE_INCOMPAT_LARGEDIR	0x4000
 #define EXT4_INDIRECT_BLOCKS		12
 
 #define EXT4_BG_INODE_UNINIT		0x0001
@@ -81,6 +85,44 @@ struct ext4_extent_header {
 	__le32	eh_generation;	/* generation of the tree */
 };
 
+/* Superblock flags selecting the signedness of directory hashes */
+#define EXT2_FLAGS_SIGNED_HASH		0x0001
+#define EXT2_FLAGS_UNSIGNED_HASH	0x0002
+
+/* Hash versions of hashed (htree) directories */
+#define DX_HASH_LEGACY			0
+#define DX_HASH_HALF_MD4		1
+#define DX_HASH_TEA			2
+#define DX_HASH_LEGACY_UNSIGNED		3
+#define DX_HASH_HALF_MD4_UNSIGNED	4
+#define DX_HASH_TEA_UNSIGNED		5
+
+#define DX_HASH_EOF			0x7fffffffU
+
+/*
+ * Hashed directories keep an index tree in their blocks. The root in block
+ * 0 follows the "." and ".." entries, interior nodes follow a fake empty
+ * directory entry covering the whole block. The first dx_entry of each node
+ * holds a dx_countlimit instead of a hash.
+ */
+struct dx_root_info {
+	__le32	reserved_zero;
+	__u8	hash_version;
+	__u8	info_length;	/* 8 */
+	__u8	indirect_levels;
+	__u8	unused_flags;
+};
+
+struct dx_countlimit {
+	__le16	limit;
+	__le16	count;
+};
+
+struct dx_entry {
+	__le32	hash;
+	__le32	block;
+};
+
 struct ext_filesystem {
 	/* Total Sector of partition */
 	uint64_t total_sect;
@@ -108,11 +150,20 @@ struct ext_filesystem {
 	long int curr_blkno;
 	uint16_t first_pass_bbmap;
 
+	/* Blocks reserved by ext4fs_allocate_blocks(), not handed out yet */
+	long int resv_blkno;
+	uint32_t resv_count;
+	/* Blocks ext4fs_allocate_blocks() still has to allocate */
+	uint32_t resv_want;
+
 	/* Inode Bitmap Related */
 	unsigned char **inode_bmaps;
 	int curr_inode_no;
 	uint16_t first_pass_ibmap;
 
+	/* Block groups with modified bitmaps, EXT4FS_*BMAP_DIRTY flags */
+	unsigned char *bg_dirty;
+
 	/* Journal Related */
 
 	/* Block Device Descriptor */
@@ -203,6 +203,9 @@ struct ext2fs_node {
 	struct ext2_inode inode;
 	int ino;
 	int inode_read;
+	/* Decoded extent tree, built on the first read of the node */
+	struct ext4_extent_map *extent_map;
+	int extent_count;
 };
 
 /* Information about a "mounted" ext2 filesystem. */
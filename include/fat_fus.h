@@ -19,6 +19,12 @@
 #define TOUPPER(c)	if ((c) >= 'a' && (c) <= 'z') \
 				(c) -= ('a' - 'A');
 
+/* Run of consecutive clusters of a file */
+struct fat_extent {
+	__u32	cluster;	/* First cluster of the run */
+	__u32	count;		/* Number of clusters in the run */
+};
+
 /*
  * Private filesystem parameters
  *
@@ -27,9 +33,14 @@
  */
 struct fsdata {
 	__u8	*dirbuf;	/* Pointer to directory preload buffer */
-	__u8	*fatbuf;	/* Pointer to FAT preload buffer */
-	__u32	fatbufnum;	/* Currently loaded FAT chunk present in
-				   fatbuf; used by get_fatent(), init to -1 */
+	__u8	*fatbuf;	/* Pointer to FAT preload buffer (all slots) */
+	__u32	fatbufnum[CONFIG_SYS_FAT_PRELOAD_SLOTS];
+				/* FAT chunk loaded to each slot of fatbuf;
+				   used by get_fatent(), init to -1 */
+	__u32	fatbuf_used[CONFIG_SYS_FAT_PRELOAD_SLOTS];
+				/* Time of last access to each slot (LRU) */
+	__u32	fatbuf_tick;	/* Access counter for fatbuf_used[] */
+	__u32	fatbuf_last;	/* Most recently used slot */
 	__u32	fatbuf_sectors;	/* Usable size of fatbuf (in sectors) */
 	__u32	fatbuf_entries;	/* Number of FAT entries in fatbuf */
 	__u32	fatsize;	/* FAT type (12, 16 or 32) */
@@ -46,6 +57,11 @@ struct fsdata {
 	__u32   max_cluster;	/* First cluster outside of file system */
 	__u32   eof;		/* First cluster number accepted as EOF */
 	char    volume_name[13];/* Volume name read from boot sector */
+	struct fat_extent *ext;	/* Extent map of the last file read */
+	__u32	ext_alloc;	/* Number of allocated entries in ext */
+	__u32	ext_count;	/* Number of valid entries in ext */
+	__u32	ext_start;	/* Start cluster of the file in ext */
+	__u32	ext_next;	/* Next cluster to add to ext */
 };
 
 typedef int (file_detectfs_func)(void);
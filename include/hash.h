@@ -18,6 +18,15 @@ struct cmd_tbl;
 #define HASH_MAX_DIGEST_SIZE	32
 #endif
 
+/* Maximum number of algorithms hash_multi() can run at once */
+#define HASH_MULTI_MAX		4
+
+/*
+ * hash_multi() hands each block of this size to all algorithms before
+ * moving on, so it should comfortably fit into the L1 data cache
+ */
+#define HASH_MULTI_BLOCK	(8 * 1024)
+
 enum {
 	HASH_FLAG_VERIFY	= 1 << 0,	/* Enable verify mode */
 	HASH_FLAG_ENV		= 1 << 1,	/* Allow env vars */
@@ -145,6 +154,85 @@ int hash_lookup_algo(const char *algo_name, struct hash_algo **algop);
 int hash_progressive_lookup_algo(const char *algo_name,
 				 struct hash_algo **algop);
 
+/**
+ * struct hash_multi_ctx - Several algorithms hashing the same data
+ *
+ * @algos:	Algorithms in use
+ * @ctx:	Progressive hashing context of each algorithm
+ * @count:	Number of algorithms, 0 if not active
+ */
+struct hash_multi_ctx {
+	struct hash_algo *algos[HASH_MULTI_MAX];
+	void *ctx[HASH_MULTI_MAX];
+	int count;
+};
+
+/**
+ * hash_multi_init() - Start hashing with several algorithms at once
+ *
+ * This is the progressive variant of hash_multi(), for data that arrives
+ * in pieces, e.g. while it is being loaded. If any of the functions fails,
+ * all contexts are freed and @mctx becomes inactive.
+ *
+ * @mctx:	Context to set up
+ * @algos:	Algorithms to use, they must support progressive hashing
+ * @count:	Number of algorithms, at most HASH_MULTI_MAX
+ *
+ * @return 0 if ok, -EINVAL for a bad count, -EPROTONOSUPPORT if an algorithm
+ * has no progressive hashing, -EBUSY if the algorithms cannot run side by
+ * side (hardware hash engine), -EIO if an algorithm failed
+ */
+int hash_multi_init(struct hash_multi_ctx *mctx,
+		    struct hash_algo *const algos[], int count);
+
+/**
+ * hash_multi_update() - Feed the next piece of data to all algorithms
+ *
+ * @mctx:	Context from hash_multi_init()
+ * @data:	Data to hash
+ * @len:	Length of data in bytes
+ * @is_last:	1 if this is the last piece of data, 0 otherwise
+ *
+ * @return 0 if ok, -EINVAL if @mctx is not active, -EIO if an algorithm
+ * failed
+ */
+int hash_multi_update(struct hash_multi_ctx *mctx, const void *data,
+		      unsigned int len, int is_last);
+
+/**
+ * hash_multi_finish() - Get the digests and free the contexts
+ *
+ * @mctx:	Context from hash_multi_init()
+ * @outputs:	One buffer per algorithm for the digest, each must hold
+ *		algos[i]->digest_size bytes. NULL to drop the digests and
+ *		just free the contexts.
+ *
+ * @return 0 if ok, -EINVAL if @mctx is not active, -EIO if an algorithm
+ * failed
+ */
+int hash_multi_finish(struct hash_multi_ctx *mctx, uint8_t *const outputs[]);
+
+/**
+ * hash_multi() - Hash a buffer with several algorithms in one pass
+ *
+ * The data is read in blocks of HASH_MULTI_BLOCK bytes, and each block is
+ * fed to all algorithms while it is still in the cache. This is faster than
+ * calling the hash_func_ws() of each algorithm on the whole buffer, and
+ * gives the same digests.
+ *
+ * @algos:	Algorithms to use, they must support progressive hashing
+ * @count:	Number of algorithms, at most HASH_MULTI_MAX
+ * @data:	Data to hash
+ * @len:	Length of data in bytes
+ * @outputs:	One buffer per algorithm for the digest, each must hold
+ *		algos[i]->digest_size bytes
+ *
+ * @return 0 if ok, -EINVAL for a bad count, -EPROTONOSUPPORT if an algorithm
+ * has no progressive hashing, -EIO if an algorithm failed
+ */
+int hash_multi(struct hash_algo *const algos[], int count, const void *data,
+	       unsigned int len, uint8_t *const outputs[]);
+
 /**
  * hash_parse_string() - Parse hash string into a binary array
  *
@@ -1041,7 +1041,39 @@ int booti_setup(ulong image, ulong *relocated_addr, ulong *size,
 
 #define FIT_MAX_HASH_LEN	HASH_MAX_DIGEST_SIZE
 
+/* Hash nodes covering the same data can be computed in one pass */
+#if defined(USE_HOSTCC)
+# define FIT_IMAGE_ENABLE_MULTI_HASH	1
+#elif defined(CONFIG_SPL_BUILD)
+# define FIT_IMAGE_ENABLE_MULTI_HASH	CONFIG_IS_ENABLED(HASH_SUPPORT)
+#else
+# define FIT_IMAGE_ENABLE_MULTI_HASH	IS_ENABLED(CONFIG_HASH)
+#endif
+
+/* Maximum number of hash nodes of an image computed in one pass */
+#define FIT_MULTI_HASH_MAX	HASH_MULTI_MAX
+
+/*
+ * Images are loaded and hashed in pieces of this size, so that each piece
+ * is still in the cache when it is hashed
+ */
+#define FIT_HASH_CHUNK_SIZE	(64 * 1024)
+
 #if IMAGE_ENABLE_FIT
+/* Digest of a hash node, computed ahead of checking the node */
+struct fit_hash_result {
+	int noffset;
+	int len;
+	uint8_t value[FIT_MAX_HASH_LEN];
+};
+
+/* Hash nodes of an image computed while its data is being loaded */
+struct fit_load_hash {
+	struct hash_multi_ctx mctx;
+	struct fit_hash_result res[FIT_MULTI_HASH_MAX];
+	int count;
+};
+
 /* cmdline argument format parsing */
 int fit_parse_conf(const char *spec, ulong addr_curr,
 		ulong *addr, const char **conf_name);
@@ -1145,6 +1177,57 @@ int fit_add_verification_data(const char *keydir, void *keydest, void *fit,
 
 int fit_image_verify_with_data(const void *fit, int image_noffset,
 			       const void *data, size_t size);
+
+/**
+ * fit_image_hash_start() - start hashing an image while it is loaded
+ *
+ * Instead of loading an image and then reading it all again to check its
+ * hashes, the loader passes each piece to fit_image_hash_update() as soon
+ * as it has arrived, while it is still in the cache. When the image is
+ * complete, fit_image_hash_verify() checks the digests like
+ * fit_image_verify_with_data() does. Hash nodes which cannot be computed
+ * on the fly are handled there as well.
+ *
+ * @fit:		Pointer to the FIT format image header
+ * @image_noffset:	Component image node offset
+ * @lh:			Returns the hashing state
+ * @return number of hash nodes computed on the fly, may be 0
+ */
+int fit_image_hash_start(const void *fit, int image_noffset,
+			 struct fit_load_hash *lh);
+
+/**
+ * fit_image_hash_update() - hash the next piece of a loaded image
+ *
+ * @lh:		Hashing state from fit_image_hash_start()
+ * @data:	Image data following the previous piece
+ * @len:	Length of data in bytes
+ * @is_last:	1 if this is the end of the image data, 0 otherwise
+ */
+void fit_image_hash_update(struct fit_load_hash *lh, const void *data,
+			   size_t len, int is_last);
+
+/**
+ * fit_image_hash_verify() - check the hashes of a loaded image
+ *
+ * @fit:		Pointer to the FIT format image header
+ * @image_noffset:	Component image node offset
+ * @lh:			Hashing state from fit_image_hash_start()
+ * @data:		Complete image data
+ * @size:		Size of image data
+ * @return 1 if all hashes are valid, 0 otherwise (or on error)
+ */
+int fit_image_hash_verify(const void *fit, int image_noffset,
+			  struct fit_load_hash *lh, const void *data,
+			  size_t size);
+
+/**
+ * fit_image_hash_abort() - stop hashing an image that is not loaded
+ *
+ * @lh:		Hashing state from fit_image_hash_start()
+ */
+void fit_image_hash_abort(struct fit_load_hash *lh);
+
 int fit_image_verify(const void *fit, int noffset);
 int fit_config_verify(const void *fit, int conf_noffset);
 int fit_all_image_verify(const void *fit);
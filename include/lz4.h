@@ -21,4 +21,17 @@
  */
 int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn);
 
+/**
+ * LZ4_decompress_safe() - Decompress a raw LZ4 block (without frame header)
+ *
+ * @source: Source data to decompress
+ * @dest: Destination for uncompressed data
+ * @inputSize: Length of source data
+ * @maxDecompressedSize: Size of the destination buffer
+ * @return number of bytes written to @dest, or a negative value if the
+ *	compressed data is malformed or does not fit into @dest
+ */
+int LZ4_decompress_safe(const char *source, char *dest, int inputSize,
+			int maxDecompressedSize);
+
 #endif
@@ -125,6 +125,8 @@ int nand_get_lock_status(struct mtd_info *mtd, loff_t offset);
 
 u32 nand_spl_adjust_offset(u32 sector, u32 offs);
 int nand_spl_load_image(uint32_t offs, unsigned int size, void *dst);
+int nand_spl_load_image_skip(uint32_t offs, unsigned int size, void *dst,
+			      unsigned int *skip);
 int nand_spl_read_block(int block, int offset, int len, void *dst);
 void nand_deselect(void);
 
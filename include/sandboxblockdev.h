@@ -12,6 +12,7 @@ struct host_block_dev {
 #endif
 	char *filename;
 	int fd;
+	int active;	/* Number of asynchronous requests started */
 };
 
 int host_dev_bind(int dev, char *filename);
@@ -12,6 +12,21 @@
 
 struct disk_partition;
 
+/**
+ * struct sqfs_cache_stats - statistics of the data and fragment block cache
+ *
+ * @hits:	Number of blocks found in the cache
+ * @misses:	Number of blocks read and decompressed
+ * @entries:	Number of cached blocks
+ * @max_entries: Maximum number of cached blocks
+ */
+struct sqfs_cache_stats {
+	unsigned long hits;
+	unsigned long misses;
+	unsigned int entries;
+	unsigned int max_entries;
+};
+
 int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp);
 int sqfs_readdir(struct fs_dir_stream *dirs, struct fs_dirent **dentp);
 int sqfs_probe(struct blk_desc *fs_dev_desc,
@@ -23,4 +38,16 @@ int sqfs_exists(const char *filename);
 void sqfs_close(void);
 void sqfs_closedir(struct fs_dir_stream *dirs);
 
+/**
+ * sqfs_cache_stats() - return and reset the block cache statistics
+ *
+ * @stats:	Filled with the current statistics
+ */
+void sqfs_cache_stats(struct sqfs_cache_stats *stats);
+
+/**
+ * sqfs_cache_flush() - drop all cached data and fragment blocks
+ */
+void sqfs_cache_flush(void);
+
 #endif /* SQFS_H  */
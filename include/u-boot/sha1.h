@@ -94,6 +94,19 @@ void sha1_hmac(const unsigned char *key, int keylen,
 		const unsigned char *input, unsigned int ilen,
 		unsigned char *output);
 
+/**
+ * \brief	   SHA-1 process blocks with the ARMv8 Crypto Extensions
+ *
+ * \param ctx	   SHA-1 context
+ * \param data	   input data, a multiple of 64 bytes
+ * \param blocks   number of 64-byte blocks
+ *
+ * \return	   0 if successful, or -ENOSYS if the CPU does not
+ *		   implement the SHA-1 instructions
+ */
+int sha1_ce_process(sha1_context *ctx, const unsigned char *data,
+		    unsigned int blocks);
+
 /**
  * \brief	   Checkup routine
  *
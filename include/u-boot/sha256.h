@@ -22,6 +22,13 @@ void sha256_finish(sha256_context * ctx, uint8_t digest[SHA256_SUM_LEN]);
 void sha256_csum_wd(const unsigned char *input, unsigned int ilen,
 		unsigned char *output, unsigned int chunk_sz);
 
+/*
+ * Process 64-byte blocks with the ARMv8 SHA-256 instructions. Returns
+ * -ENOSYS if the CPU does not implement them.
+ */
+int sha256_ce_process(sha256_context *ctx, const uint8_t *data,
+		      unsigned int blocks);
+
 void sha256_hmac(const unsigned char *key, int keylen,
 		const unsigned char *input, unsigned int ilen,
 		unsigned char *output);
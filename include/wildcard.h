@@ -21,6 +21,7 @@
    must clear them after they have taken effect once. */
 #define WC_FLAGS_REWIND 0x01		/* (Re)start at beginning of dir */
 #define WC_FLAGS_RELOAD	0x02		/* Resume dir after handling subdir */
+#define WC_FLAGS_DIRECT	0x04		/* No snapshot, read dir directly */
 
 /* Filesystem doing the call; used as index into the wc_filesystem_ops array */
 enum wc_filesystem {
@@ -39,6 +40,25 @@ enum wc_file_type {
 	WC_TYPE_SYMLINK
 };
 
+/* Kind of compiled pattern */
+enum wc_pattern_type {
+	WC_PATTERN_LITERAL,		/* No wildcards at all */
+	WC_PATTERN_STAR,		/* One '*', no '?' */
+	WC_PATTERN_GENERIC		/* Anything else */
+};
+
+/* Path element of a pattern (up to the next '/'), prepared for matching */
+struct wc_pattern {
+	enum wc_pattern_type type;	/* WC_PATTERN_* */
+	unsigned int len;		/* Length of the path element */
+	unsigned int prefix;		/* Characters in front of '*' */
+	unsigned int suffix;		/* Characters behind '*' */
+	unsigned int hash;		/* Name hash if WC_PATTERN_LITERAL */
+};
+
+/* Snapshot of directory contents, only used internally by wildcard.c */
+struct wc_snapshot;
+
 /* Directory info; we never create an instance of this structure directly, it
    is only meant to be embedded by a file system into its own specific
    structure (like a derived object). A new instance of such an object is
@@ -50,6 +70,9 @@ struct wc_dirinfo {
 	const char *dir_pattern;	/* Pattern to search this directory */
 	unsigned int flags;		/* WC_FLAGS_* */
 	char dir_name[WC_NAME_MAX];	/* Name of this directory */
+	struct wc_pattern pat;		/* Compiled dir_pattern */
+	struct wc_snapshot *snap;	/* Snapshot of directory contents */
+	unsigned int snap_index;	/* Next entry in snapshot */
 };
 
 /* File info. The reference is file system specific. It must refer the file
@@ -95,4 +118,7 @@ int wildcard_write(struct wc_fileinfo *wfi, const struct wc_fsops *ops,
 
 /* Check for existence of a file */
 int wildcard_exists(struct wc_fileinfo *wfi, const struct wc_fsops *ops);
+
+/* Drop all directory snapshots, e.g. when the device changes */
+void wildcard_flush(void);
 #endif /*!_WILDCARD_H_*/
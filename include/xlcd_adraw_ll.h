@@ -61,4 +61,10 @@ extern void adraw_ll_row_BGR(imginfo_t *pii, COLOR32 *p);
 /* Draw bitmap row for 24bpp BGR value with 8bpp alpha value */
 extern void adraw_ll_row_BGRA(imginfo_t *pii, COLOR32 *p);
 
+/* Specialized versions of the above for 32bpp without horizontal scaling */
+extern void adraw_ll_row_PAL8_32(imginfo_t *pii, COLOR32 *p);
+extern void adraw_ll_row_GA_32(imginfo_t *pii, COLOR32 *p);
+extern void adraw_ll_row_RGBA_32(imginfo_t *pii, COLOR32 *p);
+extern void adraw_ll_row_BGRA_32(imginfo_t *pii, COLOR32 *p);
+
 #endif	/* !_XLCD_ADRAW_LL_H_ */
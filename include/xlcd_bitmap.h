@@ -45,7 +45,7 @@ enum bitmap_types {
 	BT_BMP,
 #endif
 #ifdef CONFIG_XLCD_JPG
-	BT_JPG,				  /* ### Not supported yet ### */
+	BT_JPG,
 #endif
 };
 
@@ -91,6 +91,7 @@ struct imginfo
 	const wininfo_t *pwi;		  /* Pointer to windo info */
 
 	/* Bitmap source data info */
+	u_long end;			  /* End of bitmap data (from scan) */
 	u_int rowmask;			  /* Mask used in bitmap data */
 	u_int rowbitdepth;		  /* Bitmap bitdepth */
 	u_int rowshift;			  /* Shift value for current pos */
@@ -105,6 +106,7 @@ struct imginfo
 	u_int multiheight;		  /* Height factor (1..4) */
 	RGBA trans_rgba;		  /* Transparent color if truecolor */
 	RGBA *palette;			  /* Pointer to bitmap palette */
+	colinfo_t *palci;		  /* Pre-multiplied palette or NULL */
 	bminfo_t bi;			  /* Generic bitmap information */
 };
 
@@ -60,4 +60,12 @@ extern void draw_ll_row_BGR(imginfo_t *pii, COLOR32 *p);
 /* Draw bitmap row for 24bpp BGR value with 8bpp alpha value */
 extern void draw_ll_row_BGRA(imginfo_t *pii, COLOR32 *p);
 
+/* Specialized versions of the above for 32bpp without horizontal scaling */
+extern void draw_ll_row_PAL8_32(imginfo_t *pii, COLOR32 *p);
+extern void draw_ll_row_GA_32(imginfo_t *pii, COLOR32 *p);
+extern void draw_ll_row_RGB_32(imginfo_t *pii, COLOR32 *p);
+extern void draw_ll_row_RGBA_32(imginfo_t *pii, COLOR32 *p);
+extern void draw_ll_row_BGR_32(imginfo_t *pii, COLOR32 *p);
+extern void draw_ll_row_BGRA_32(imginfo_t *pii, COLOR32 *p);
+
 #endif	/* !_XLCD_DRAW_LL_H_ */
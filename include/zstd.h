@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * U-Boot interface to the Zstandard decompressor in lib/zstd
+ */
+
+#ifndef __ZSTD_H
+#define __ZSTD_H
+
+#include <linux/types.h>
+
+struct blk_desc;
+
+/**
+ * zstd_decompress() - Decompress a series of zstd frames in one go
+ *
+ * The whole output is in memory, so it serves as the window and no extra
+ * window buffer is needed, whatever the window size of the frames is.
+ *
+ * @dst:	Destination for uncompressed data
+ * @dstlen:	Size of destination buffer
+ * @src:	Source data to decompress
+ * @srclen:	Exact length of the compressed data
+ * @lenp:	Returns length of uncompressed data
+ * @return 0 if OK, -ENOMEM if out of memory, -ENOSPC if the output does not
+ *	fit into @dstlen bytes, -EINVAL if the data is corrupt
+ */
+int zstd_decompress(void *dst, size_t dstlen, const void *src, size_t srclen,
+		    size_t *lenp);
+
+/**
+ * zstdwrite() - decompress and write zstd image from memory to block device
+ *
+ * The data is decompressed in a stream through a buffer of @szwritebuf
+ * bytes, so neither the whole output nor a second copy of it needs to fit
+ * into memory. The window of the frames is kept in an extra buffer, its size
+ * is limited by CONFIG_ZSTD_MAX_WINDOW.
+ *
+ * @src:	compressed image address
+ * @len:	compressed image length in bytes
+ * @dev:	block device descriptor
+ * @szwritebuf:	bytes per write (pad to erase size)
+ * @startoffs:	offset in bytes of first write
+ * @szexpected:	expected uncompressed length, may be zero to use the content
+ *		size from the frame headers, if present
+ * @return 0 if OK, -1 on error
+ */
+int zstdwrite(const void *src, size_t len, struct blk_desc *dev,
+	      ulong szwritebuf, u64 startoffs, u64 szexpected);
+
+#endif
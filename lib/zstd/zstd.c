@@ -0,0 +1,252 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * U-Boot interface to the Zstandard decompressor
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <console.h>
+#include <div64.h>
+#include <malloc.h>
+#include <memalign.h>
+#include <watchdog.h>
+#include <zstd.h>
+#include <linux/errno.h>
+#include <linux/zstd.h>
+
+int zstd_decompress(void *dst, size_t dstlen, const void *src, size_t srclen,
+		    size_t *lenp)
+{
+	ZSTD_DCtx *dctx;
+	void *workspace;
+	size_t wsize;
+	size_t ret;
+	int err = 0;
+
+	wsize = ZSTD_DCtxWorkspaceBound();
+	workspace = malloc(wsize);
+	if (!workspace) {
+		debug("%s: cannot allocate workspace of size %zu\n", __func__,
+		      wsize);
+		return -ENOMEM;
+	}
+
+	dctx = ZSTD_initDCtx(workspace, wsize);
+	if (!dctx) {
+		printf("%s: ZSTD_initDCtx failed\n", __func__);
+		err = -ENOMEM;
+		goto out;
+	}
+
+	ret = ZSTD_decompressDCtx(dctx, dst, dstlen, src, srclen);
+	if (ZSTD_isError(ret)) {
+		printf("%s: ZSTD_decompressDCtx error %d\n", __func__,
+		       ZSTD_getErrorCode(ret));
+		if (ZSTD_getErrorCode(ret) == ZSTD_error_dstSize_tooSmall)
+			err = -ENOSPC;
+		else
+			err = -EINVAL;
+		goto out;
+	}
+	*lenp = ret;
+
+out:
+	free(workspace);
+
+	return err;
+}
+
+#if defined(CONFIG_CMD_UNZSTD) && !defined(CONFIG_SPL_BUILD)
+/*
+ * Walk the frame headers to check that the input is complete and to find the
+ * largest window and the total content size, if all frames record it.
+ */
+static int zstd_scan_frames(const u8 *src, size_t len, size_t *windowp,
+			    u64 *sizep)
+{
+	ZSTD_frameParams params;
+	size_t window = 1U << ZSTD_WINDOWLOG_MIN;
+	u64 size = 0;
+	size_t ret;
+
+	while (len) {
+		ret = ZSTD_getFrameParams(&params, src, len);
+		if (ret)
+			return -EINVAL;
+
+		/* A zero window size marks a skippable frame */
+		if (params.windowSize) {
+			window = max_t(size_t, window, params.windowSize);
+			if (!params.frameContentSize)
+				sizep = NULL;
+			else
+				size += params.frameContentSize;
+		}
+
+		ret = ZSTD_findFrameCompressedSize(src, len);
+		if (ZSTD_isError(ret))
+			return -EINVAL;
+		src += ret;
+		len -= ret;
+	}
+
+	*windowp = window;
+	if (sizep)
+		*sizep = size;
+
+	return 0;
+}
+
+int zstdwrite(const void *src, size_t len, struct blk_desc *dev,
+	      ulong szwritebuf, u64 startoffs, u64 szexpected)
+{
+	ZSTD_DStream *dstream;
+	ZSTD_inBuffer in_buf;
+	ZSTD_outBuffer out_buf;
+	void *workspace;
+	u8 *writebuf;
+	size_t window, wsize;
+	size_t pending = 1;
+	u64 totalfilled = 0;
+	u64 szcontent = 0;
+	lbaint_t outblock;
+	int iteration = 0;
+	int r = -1;
+
+	if (!szwritebuf ||
+	    (szwritebuf % dev->blksz) ||
+	    (szwritebuf < dev->blksz)) {
+		printf("%s: size %lu not a multiple of %lu\n",
+		       __func__, szwritebuf, dev->blksz);
+		return -1;
+	}
+
+	if (startoffs & (dev->blksz - 1)) {
+		printf("%s: start offset %llu not a multiple of %lu\n",
+		       __func__, startoffs, dev->blksz);
+		return -1;
+	}
+
+	outblock = lldiv(startoffs, dev->blksz);
+
+	if (zstd_scan_frames(src, len, &window, &szcontent)) {
+		puts("Error: Bad or truncated zstd data\n");
+		return -1;
+	}
+	if (window > CONFIG_ZSTD_MAX_WINDOW) {
+		printf("%s: window size %#zx exceeds limit of %#x\n",
+		       __func__, window, CONFIG_ZSTD_MAX_WINDOW);
+		return -1;
+	}
+
+	if (szexpected == 0) {
+		szexpected = szcontent;
+	} else if (szcontent && szcontent != szexpected) {
+		printf("size of %llx doesn't match frame content size %llx\n",
+		       szexpected, szcontent);
+		return -1;
+	}
+	if (lldiv(szexpected + dev->blksz - 1, dev->blksz) >
+	    (dev->lba - outblock)) {
+		printf("%s: uncompressed size %llu exceeds device size\n",
+		       __func__, szexpected);
+		return -1;
+	}
+
+	wsize = ZSTD_DStreamWorkspaceBound(window);
+	workspace = malloc(wsize);
+	writebuf = malloc_cache_aligned(szwritebuf);
+	if (!workspace || !writebuf) {
+		printf("%s: cannot allocate %zu + %lu bytes\n", __func__,
+		       wsize, szwritebuf);
+		goto out;
+	}
+
+	dstream = ZSTD_initDStream(window, workspace, wsize);
+	if (!dstream) {
+		printf("%s: ZSTD_initDStream failed\n", __func__);
+		goto out;
+	}
+
+	in_buf.src = src;
+	in_buf.pos = 0;
+	in_buf.size = len;
+
+	out_buf.dst = writebuf;
+	out_buf.size = szwritebuf;
+
+	putc('\n');
+
+	/*
+	 * Fill the write buffer completely before writing it, even across
+	 * frame boundaries, so that only the last write may be padded.
+	 */
+	do {
+		lbaint_t writeblocks;
+		ulong blocks_written;
+
+		out_buf.pos = 0;
+		while (out_buf.pos < out_buf.size &&
+		       (in_buf.pos < in_buf.size || pending)) {
+			size_t in_pos = in_buf.pos;
+			size_t out_pos = out_buf.pos;
+
+			pending = ZSTD_decompressStream(dstream, &out_buf,
+							&in_buf);
+			if (ZSTD_isError(pending)) {
+				printf("Error: ZSTD_decompressStream() returned %d\n",
+				       ZSTD_getErrorCode(pending));
+				goto out;
+			}
+			/* No progress, the last frame is incomplete */
+			if (in_buf.pos == in_pos && out_buf.pos == out_pos)
+				break;
+		}
+
+		if (!out_buf.pos)
+			break;
+
+		totalfilled += out_buf.pos;
+		writeblocks = (out_buf.pos + dev->blksz - 1) / dev->blksz;
+		memset(writebuf + out_buf.pos, 0,
+		       writeblocks * dev->blksz - out_buf.pos);
+
+		if (0 == (iteration++ & 3))
+			printf("%llu/%llu\r", totalfilled, szexpected);
+
+		blocks_written = blk_dwrite(dev, outblock, writeblocks,
+					    writebuf);
+		if (blocks_written != writeblocks) {
+			printf("\n%s: write failed at block " LBAF "\n",
+			       __func__, outblock);
+			goto out;
+		}
+		outblock += blocks_written;
+		if (ctrlc()) {
+			puts("abort\n");
+			goto out;
+		}
+		WATCHDOG_RESET();
+	} while (out_buf.pos == out_buf.size);
+
+	if (pending) {
+		printf("\n%s: truncated input\n", __func__);
+		goto out;
+	}
+
+	if (szexpected && szexpected != totalfilled) {
+		printf("\n\tuncompressed %llu of %llu\n", totalfilled,
+		       szexpected);
+		goto out;
+	}
+
+	printf("\n\t%llu bytes\n", totalfilled);
+	r = 0;
+
+out:
+	free(writebuf);
+	free(workspace);
+
+	return r;
+}
+#endif
@@ -4,6 +4,7 @@
  */
 
 #include <common.h>
+#include <blk.h>
 #include <bootm.h>
 #include <command.h>
 #include <gzip.h>
@@ -12,6 +13,9 @@
 #include <lz4.h>
 #include <malloc.h>
 #include <mapmem.h>
+#include <os.h>
+#include <sandboxblockdev.h>
+#include <zstd.h>
 #include <asm/io.h>
 
 #include <u-boot/zlib.h>
@@ -21,6 +25,7 @@
 #include <lzma/LzmaDec.h>
 #include <lzma/LzmaTools.h>
 
+#include <linux/log2.h>
 #include <linux/lzo.h>
 #include <test/compression.h>
 #include <test/suites.h>
@@ -121,6 +126,25 @@ static const char lz4_compressed[] =
 	"\x9d\x12\x8c\x9d";
 static const unsigned long lz4_compressed_size = 276;
 
+#if CONFIG_IS_ENABLED(ZSTD)
+/* zstd -19 /tmp/plain.txt -o /tmp/plain.zst */
+static const char zstd_compressed[] =
+	"\x28\xb5\x2f\xfd\x64\x5e\x00\xad\x05\x00\x42\x4e\x26\x17\x90\x3b"
+	"\x07\x04\x5a\x13\x8b\xa7\x65\x34\x12\x21\x6d\xb0\x39\xbb\xae\xe8"
+	"\xba\xc9\xcd\x5e\x02\x49\xd0\x2b\xa9\xfa\x96\x92\xe7\x1f\x19\x19"
+	"\x7c\x8f\xf1\x9d\x54\x37\xfc\xd6\x0a\xf3\x0c\x93\x56\xc7\x52\x4f"
+	"\x0a\x62\x3e\xd1\xa5\x83\x17\x31\xab\x5d\x8f\x57\xf3\xcc\x3b\x58"
+	"\xf8\x91\x8c\xf1\x2a\x5c\x89\xdd\xf2\x9b\x15\xb7\x92\x5b\xbe\xba"
+	"\xab\xd5\xd1\x34\xdf\xf0\x02\x0e\x61\xcd\x7b\xd6\x01\xfc\xc2\xa7"
+	"\xd4\xd1\x3d\x26\x9c\x10\x49\xb8\x5b\xcd\xba\x7c\xf7\xac\x4b\xad"
+	"\xb7\x31\x1c\xbc\xf9\xcb\x62\x8e\x2e\x9b\x0f\xd3\x87\x57\x45\x12"
+	"\x16\xfa\x3a\x79\xde\x65\xf8\xcc\x48\xd5\x43\xa6\xbd\xc3\x91\x29"
+	"\x65\x29\xa7\x5b\x9a\x08\x08\x00\x60\x13\x00\x63\xa3\x8e\x28\x94"
+	"\x79\x41\x2a\x78\xc2\x91\x70\x9f\xaa\x6a\x21\x7a\xa1\xaa\x0c\xe4"
+	"\xf4\x6e\xfa";
+static const unsigned long zstd_compressed_size = 195;
+#endif
+
 
 #define TEST_BUFFER_SIZE	512
 
@@ -296,6 +320,42 @@ static int uncompress_using_lz4(struct unit_test_state *uts,
 	return (ret != 0);
 }
 
+#if CONFIG_IS_ENABLED(ZSTD)
+static int compress_using_zstd(struct unit_test_state *uts,
+			       void *in, unsigned long in_size,
+			       void *out, unsigned long out_max,
+			       unsigned long *out_size)
+{
+	/* There is no zstd compression in u-boot, so fake it. */
+	ut_asserteq(in_size,  strlen(plain));
+	ut_asserteq_mem(plain, in, in_size);
+
+	if (zstd_compressed_size > out_max)
+		return -1;
+
+	memcpy(out, zstd_compressed, zstd_compressed_size);
+	if (out_size)
+		*out_size = zstd_compressed_size;
+
+	return 0;
+}
+
+static int uncompress_using_zstd(struct unit_test_state *uts,
+				 void *in, unsigned long in_size,
+				 void *out, unsigned long out_max,
+				 unsigned long *out_size)
+{
+	size_t output_size;
+	int ret;
+
+	ret = zstd_decompress(out, out_max, in, in_size, &output_size);
+	if (out_size)
+		*out_size = ret ? 0 : output_size;
+
+	return ret != 0;
+}
+#endif
+
 #define errcheck(statement) if (!(statement)) { \
 	fprintf(stderr, "\tFailed: %s\n", #statement); \
 	ret = 1; \
@@ -440,6 +500,15 @@ static int compression_test_lz4(struct unit_test_state *uts)
 }
 COMPRESSION_TEST(compression_test_lz4, 0);
 
+#if CONFIG_IS_ENABLED(ZSTD)
+static int compression_test_zstd(struct unit_test_state *uts)
+{
+	return run_test(uts, "zstd", compress_using_zstd,
+			uncompress_using_zstd);
+}
+COMPRESSION_TEST(compression_test_zstd, 0);
+#endif
+
 static int compress_using_none(struct unit_test_state *uts,
 			       void *in, unsigned long in_size,
 			       void *out, unsigned long out_max,
@@ -530,6 +599,97 @@ static int compression_test_bootm_lz4(struct unit_test_state *uts)
 }
 COMPRESSION_TEST(compression_test_bootm_lz4, 0);
 
+#if CONFIG_IS_ENABLED(ZSTD)
+static int compression_test_bootm_zstd(struct unit_test_state *uts)
+{
+	return run_bootm_test(uts, IH_COMP_ZSTD, compress_using_zstd);
+}
+COMPRESSION_TEST(compression_test_bootm_zstd, 0);
+
+#if defined(CONFIG_CMD_UNZSTD) && defined(CONFIG_SANDBOX)
+/* A skippable frame */
+static const char zstd_skippable[] = "\x50\x2a\x4d\x18\x04\x00\x00\x00skip";
+
+/* A frame with one raw block and without content size, window 1 KiB */
+static const char zstd_raw[] = "\x28\xb5\x2f\xfd\x00\x00\x19\x00\x00" "end";
+
+/* Stream several frames to a block device */
+static int compression_test_zstdwrite(struct unit_test_state *uts)
+{
+	const char *fname = "zstdwrite.img";
+	const ulong blksz = 512;
+	static char src[4 * 195 + sizeof(zstd_skippable) + sizeof(zstd_raw)];
+	static char expect[8 * 512], img[8 * 512];
+	char large[sizeof(zstd_raw)];
+	size_t plain_len = strlen(plain);
+	size_t len = 0, out_len = 0, end;
+	struct blk_desc *desc;
+	int fd, i;
+
+	memset(img, 'x', sizeof(img));
+	fd = os_open(fname, OS_O_RDWR | OS_O_CREAT | OS_O_TRUNC);
+	ut_assert(fd >= 0);
+	ut_asserteq(sizeof(img), os_write(fd, img, sizeof(img)));
+	os_close(fd);
+	ut_assertok(host_dev_bind(0, (char *)fname));
+	desc = blk_get_devnum_by_type(IF_TYPE_HOST, 0);
+	ut_assertnonnull(desc);
+
+	/* Four frames with content size, two of them after a skippable one */
+	memcpy(expect, img, sizeof(expect));
+	for (i = 0; i < 4; i++) {
+		if (i == 2) {
+			memcpy(src + len, zstd_skippable,
+			       sizeof(zstd_skippable) - 1);
+			len += sizeof(zstd_skippable) - 1;
+		}
+		memcpy(src + len, zstd_compressed, zstd_compressed_size);
+		len += zstd_compressed_size;
+		memcpy(expect + blksz + out_len, plain, plain_len);
+		out_len += plain_len;
+	}
+	end = ALIGN(blksz + out_len, blksz);
+	memset(expect + blksz + out_len, '\0', end - blksz - out_len);
+
+	/* The write buffer is smaller than a frame and spans frames */
+	ut_assertok(zstdwrite(src, len, desc, blksz, blksz, 0));
+	ut_asserteq(8, blk_dread(desc, 0, 8, img));
+	ut_asserteq_mem(expect, img, sizeof(img));
+
+	/* The size must match the content size, the input must be complete */
+	ut_asserteq(-1, zstdwrite(src, len, desc, blksz, 0, out_len + 1));
+	ut_asserteq(-1, zstdwrite(src, len - 1, desc, blksz, 0, 0));
+
+	/* Without content size in the last frame, the given size is used */
+	memcpy(src + len, zstd_raw, sizeof(zstd_raw) - 1);
+	len += sizeof(zstd_raw) - 1;
+	memcpy(expect + blksz + out_len, "end", 3);
+	out_len += 3;
+	ut_assertok(zstdwrite(src, len, desc, 2 * blksz, blksz, out_len));
+	ut_asserteq(8, blk_dread(desc, 0, 8, img));
+	ut_asserteq_mem(expect, img, blksz + out_len);
+	ut_asserteq(-1, zstdwrite(src, len, desc, blksz, blksz, out_len + 1));
+
+	/* Output beyond the end of the device is refused */
+	ut_asserteq(-1, zstdwrite(src, len, desc, blksz, 6 * blksz, out_len));
+
+	/* Frames with a window above the limit are refused */
+	memcpy(large, zstd_raw, sizeof(zstd_raw));
+	large[5] = (ilog2(CONFIG_ZSTD_MAX_WINDOW) + 1 - 10) << 3;
+	ut_asserteq(-1, zstdwrite(large, sizeof(large) - 1, desc, blksz, 0,
+				  3));
+	large[5] = (ilog2(CONFIG_ZSTD_MAX_WINDOW) - 10) << 3;
+	ut_assertok(zstdwrite(large, sizeof(large) - 1, desc, blksz, 0, 3));
+
+	ut_assertok(host_dev_bind(0, NULL));
+	os_unlink(fname);
+
+	return 0;
+}
+COMPRESSION_TEST(compression_test_zstdwrite, 0);
+#endif
+#endif
+
 static int compression_test_bootm_none(struct unit_test_state *uts)
 {
 	return run_bootm_test(uts, IH_COMP_NONE, compress_using_none);
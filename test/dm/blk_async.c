@@ -0,0 +1,233 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for asynchronous block requests
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <dm.h>
+#include <os.h>
+#include <sandboxblockdev.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+static void blk_async_done(struct blk_req *req)
+{
+	int *count = req->priv;
+
+	(*count)++;
+}
+
+/* Submit a request for two blocks */
+static int blk_async_submit(struct blk_req *req, struct blk_desc *desc,
+			    lbaint_t start, void *buffer, bool write,
+			    int *count)
+{
+	memset(req, '\0', sizeof(*req));
+	req->desc = desc;
+	req->start = start;
+	req->blkcnt = 2;
+	req->buffer = buffer;
+	req->write = write;
+	req->done = blk_async_done;
+	req->priv = count;
+
+	return blk_submit(req);
+}
+
+/* Test asynchronous requests on a device that supports them */
+static int dm_test_blk_async(struct unit_test_state *uts)
+{
+	const char *fname = "blk_async.img";
+	static char wbuf[4][1024], rbuf[4][1024];
+	struct blk_req req[4], sreq;
+	struct blk_desc *desc;
+	int count = 0;
+	int fd, i;
+
+	fd = os_open(fname, OS_O_RDWR | OS_O_CREAT | OS_O_TRUNC);
+	ut_assert(fd >= 0);
+	memset(wbuf, '\0', sizeof(wbuf));
+	ut_asserteq(sizeof(wbuf), os_write(fd, wbuf, sizeof(wbuf)));
+	os_close(fd);
+	ut_assertok(host_dev_bind(0, (char *)fname));
+	desc = blk_get_devnum_by_type(IF_TYPE_HOST, 0);
+	ut_assertnonnull(desc);
+
+	/* Callbacks are only called when polling */
+	for (i = 0; i < 4; i++) {
+		memset(wbuf[i], 'a' + i, sizeof(wbuf[i]));
+		ut_assertok(blk_async_submit(&req[i], desc, i * 2, wbuf[i],
+					     true, &count));
+		ut_asserteq(BLK_REQ_ACTIVE, req[i].state);
+	}
+	ut_asserteq(0, count);
+	ut_asserteq(0, blk_poll());
+	ut_asserteq(4, count);
+
+	/* Waiting for the last request completes the others, too */
+	for (i = 0; i < 4; i++)
+		ut_assertok(blk_async_submit(&req[i], desc, i * 2, rbuf[i],
+					     false, &count));
+	ut_asserteq(2, blk_wait(&req[3]));
+	ut_asserteq(8, count);
+	for (i = 0; i < 4; i++) {
+		ut_asserteq(BLK_REQ_DONE, req[i].state);
+		ut_asserteq(2, req[i].result);
+	}
+	ut_asserteq_mem(wbuf, rbuf, sizeof(wbuf));
+
+	/* A synchronous read sees the data of a pending write */
+	memset(wbuf[0], 'x', sizeof(wbuf[0]));
+	ut_assertok(blk_async_submit(&sreq, desc, 0, wbuf[0], true, &count));
+	ut_asserteq(2, blk_dread(desc, 0, 2, rbuf[0]));
+	ut_asserteq_mem(wbuf[0], rbuf[0], sizeof(rbuf[0]));
+	ut_asserteq(8, count);
+	ut_asserteq(2, blk_wait(&sreq));
+	ut_asserteq(9, count);
+
+	/* Requests beyond the end of the device fail */
+	ut_assertok(blk_async_submit(&sreq, desc, 7, rbuf[0], false, &count));
+	ut_asserteq(-EINVAL, blk_wait(&sreq));
+
+	ut_assertok(host_dev_bind(0, NULL));
+	os_unlink(fname);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_async, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+/* Test that removing a device completes its requests */
+static int dm_test_blk_async_remove(struct unit_test_state *uts)
+{
+	const char *fname = "blk_async.img";
+	static char wbuf[5][1024], rbuf[4 * 1024];
+	struct blk_req req[5];
+	struct blk_desc *desc;
+	int count = 0;
+	int fd, i;
+
+	fd = os_open(fname, OS_O_RDWR | OS_O_CREAT | OS_O_TRUNC);
+	ut_assert(fd >= 0);
+	memset(wbuf, '\0', sizeof(wbuf));
+	ut_asserteq(sizeof(wbuf), os_write(fd, wbuf, sizeof(wbuf)));
+	os_close(fd);
+	ut_assertok(host_dev_bind(0, (char *)fname));
+	desc = blk_get_devnum_by_type(IF_TYPE_HOST, 0);
+	ut_assertnonnull(desc);
+
+	/* The device takes four requests, the fifth one waits */
+	for (i = 0; i < 5; i++) {
+		memset(wbuf[i], 'a' + i, sizeof(wbuf[i]));
+		ut_assertok(blk_async_submit(&req[i], desc, i * 2, wbuf[i],
+					     true, &count));
+	}
+	ut_asserteq(BLK_REQ_ACTIVE, req[3].state);
+	ut_asserteq(BLK_REQ_QUEUED, req[4].state);
+
+	/* Started requests complete, the waiting one fails */
+	ut_assertok(host_dev_bind(0, NULL));
+	ut_asserteq(5, count);
+	for (i = 0; i < 4; i++)
+		ut_asserteq(2, req[i].result);
+	ut_asserteq(-ENODEV, req[4].result);
+	ut_asserteq(0, blk_poll());
+	ut_asserteq(5, count);
+
+	/* Only the started requests were written */
+	ut_assertok(host_dev_bind(0, (char *)fname));
+	desc = blk_get_devnum_by_type(IF_TYPE_HOST, 0);
+	ut_assertnonnull(desc);
+	ut_asserteq(8, blk_dread(desc, 0, 8, rbuf));
+	ut_asserteq_mem(wbuf, rbuf, sizeof(rbuf));
+	ut_asserteq(2, blk_dread(desc, 8, 2, rbuf));
+	for (i = 0; i < 1024; i++)
+		ut_asserteq(0, rbuf[i]);
+
+	ut_assertok(host_dev_bind(0, NULL));
+	os_unlink(fname);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_async_remove, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+/* Test that devices of one controller wait for each other's requests */
+static int dm_test_blk_async_shared(struct unit_test_state *uts)
+{
+	const char *fname0 = "blk_async0.img", *fname1 = "blk_async1.img";
+	static char wbuf[1024], rbuf[1024];
+	struct blk_desc *desc0, *desc1;
+	struct blk_req req;
+	int count = 0;
+	int fd;
+
+	fd = os_open(fname0, OS_O_RDWR | OS_O_CREAT | OS_O_TRUNC);
+	ut_assert(fd >= 0);
+	memset(wbuf, '\0', sizeof(wbuf));
+	ut_asserteq(sizeof(wbuf), os_write(fd, wbuf, sizeof(wbuf)));
+	os_close(fd);
+	fd = os_open(fname1, OS_O_RDWR | OS_O_CREAT | OS_O_TRUNC);
+	ut_assert(fd >= 0);
+	ut_asserteq(sizeof(wbuf), os_write(fd, wbuf, sizeof(wbuf)));
+	os_close(fd);
+	ut_assertok(host_dev_bind(0, (char *)fname0));
+	ut_assertok(host_dev_bind(1, (char *)fname1));
+	desc0 = blk_get_devnum_by_type(IF_TYPE_HOST, 0);
+	ut_assertnonnull(desc0);
+	desc1 = blk_get_devnum_by_type(IF_TYPE_HOST, 1);
+	ut_assertnonnull(desc1);
+
+	/* Both host devices have the same parent, like NVMe namespaces */
+	ut_asserteq_ptr(dev_get_parent(desc0->bdev),
+			dev_get_parent(desc1->bdev));
+
+	/* Synchronous access to one device completes requests on the other */
+	memset(wbuf, 'z', sizeof(wbuf));
+	ut_assertok(blk_async_submit(&req, desc0, 0, wbuf, true, &count));
+	ut_asserteq(BLK_REQ_ACTIVE, req.state);
+	ut_asserteq(2, blk_dread(desc1, 0, 2, rbuf));
+	ut_asserteq(BLK_REQ_DONE, req.state);
+	ut_asserteq(2, req.result);
+	ut_asserteq(0, count);
+	ut_asserteq(0, blk_poll());
+	ut_asserteq(1, count);
+
+	ut_assertok(host_dev_bind(1, NULL));
+	ut_assertok(host_dev_bind(0, NULL));
+	os_unlink(fname1);
+	os_unlink(fname0);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_async_shared, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+/* Test that asynchronous requests work with devices that do not support them */
+static int dm_test_blk_async_sync(struct unit_test_state *uts)
+{
+	static char wbuf[1024], rbuf[1024];
+	struct udevice *dev, *blk;
+	struct blk_desc *desc;
+	struct blk_req req;
+	int count = 0;
+
+	ut_assertok(uclass_get_device(UCLASS_MMC, 0, &dev));
+	ut_assertok(blk_get_from_parent(dev, &blk));
+	desc = dev_get_uclass_plat(blk);
+
+	memset(wbuf, 'y', sizeof(wbuf));
+	ut_assertok(blk_async_submit(&req, desc, 4, wbuf, true, &count));
+	ut_asserteq(BLK_REQ_DONE, req.state);
+	ut_asserteq(0, count);
+	ut_asserteq(2, blk_wait(&req));
+	ut_asserteq(1, count);
+
+	ut_assertok(blk_async_submit(&req, desc, 4, rbuf, false, &count));
+	ut_asserteq(0, blk_poll());
+	ut_asserteq(2, count);
+	ut_asserteq(2, req.result);
+	ut_asserteq_mem(wbuf, rbuf, sizeof(rbuf));
+
+	return 0;
+}
+DM_TEST(dm_test_blk_async_sync, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
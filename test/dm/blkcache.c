@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the block cache
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <dm.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define TEST_BLKSZ	16
+
+/* Device reads that reached the fake device */
+static int blkcache_reads;
+static lbaint_t blkcache_last_start, blkcache_last_count;
+
+/* Each block is filled with the low byte of its block number */
+static ulong blkcache_test_read(struct blk_desc *desc, lbaint_t start,
+				lbaint_t blkcnt, void *buffer)
+{
+	lbaint_t i;
+
+	blkcache_reads++;
+	blkcache_last_start = start;
+	blkcache_last_count = blkcnt;
+	for (i = 0; i < blkcnt; i++)
+		memset(buffer + i * desc->blksz, (start + i) & 0xff,
+		       desc->blksz);
+
+	return blkcnt;
+}
+
+/* Read blocks like blk_dread() does and check the data */
+static int blkcache_test_dread(struct unit_test_state *uts,
+			       struct blk_desc *desc, lbaint_t start,
+			       lbaint_t blkcnt)
+{
+	static u8 buf[64 * TEST_BLKSZ];
+	lbaint_t i;
+
+	memset(buf, 0xaa, sizeof(buf));
+	if (!blkcache_read(desc->if_type, desc->devnum, start, blkcnt,
+			   desc->blksz, buf))
+		ut_asserteq(blkcnt, blkcache_miss(desc, start, blkcnt, buf,
+						  blkcache_test_read));
+	for (i = 0; i < blkcnt; i++)
+		ut_asserteq((start + i) & 0xff, buf[i * TEST_BLKSZ]);
+
+	return 0;
+}
+
+/* Test hits, misses, read-ahead, invalidation and partial hits */
+static int dm_test_blkcache(struct unit_test_state *uts)
+{
+	struct block_cache_stats stats;
+	struct blk_desc desc = {
+		.if_type = IF_TYPE_HOST,
+		.devnum = 99,
+		.blksz = TEST_BLKSZ,
+		.lba = 1024,
+	};
+
+	/* Lines of 8 blocks, 32 lines, 2 lines of read-ahead */
+	blkcache_configure(8, 32, 2);
+	blkcache_invalidate(IF_TYPE_HOST, 99);
+	blkcache_stats(&stats);
+	blkcache_reads = 0;
+
+	/* The first read is extended to a whole line */
+	ut_assertok(blkcache_test_dread(uts, &desc, 3, 1));
+	ut_asserteq(1, blkcache_reads);
+	ut_asserteq(0, blkcache_last_start);
+	ut_asserteq(8, blkcache_last_count);
+
+	/* So the rest of the line comes from the cache */
+	ut_assertok(blkcache_test_dread(uts, &desc, 5, 2));
+	ut_asserteq(1, blkcache_reads);
+
+	/*
+	 * The first block is in the cache, but not the second one; the whole
+	 * request is read again. It continues the last one, so two lines are
+	 * read ahead.
+	 */
+	ut_assertok(blkcache_test_dread(uts, &desc, 7, 2));
+	ut_asserteq(2, blkcache_reads);
+	ut_asserteq(0, blkcache_last_start);
+	ut_asserteq(32, blkcache_last_count);
+
+	/* Use one of the lines that were read ahead */
+	ut_assertok(blkcache_test_dread(uts, &desc, 16, 4));
+	ut_asserteq(2, blkcache_reads);
+
+	blkcache_stats(&stats);
+	ut_asserteq(2, stats.hits);
+	ut_asserteq(2, stats.misses);
+	ut_asserteq(4, stats.entries);
+	ut_asserteq(2, stats.ra_lines);
+	ut_asserteq(1, stats.ra_used);
+
+	/* Statistics are reset after reading them */
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.hits);
+	ut_asserteq(0, stats.misses);
+
+	/* Other devices are not affected by invalidation */
+	blkcache_invalidate(IF_TYPE_HOST, 98);
+	ut_assertok(blkcache_test_dread(uts, &desc, 24, 8));
+	ut_asserteq(2, blkcache_reads);
+
+	/* After invalidation, the data comes from the device again */
+	blkcache_invalidate(IF_TYPE_HOST, 99);
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.entries);
+	ut_assertok(blkcache_test_dread(uts, &desc, 16, 4));
+	ut_asserteq(3, blkcache_reads);
+	ut_asserteq(16, blkcache_last_start);
+	ut_asserteq(8, blkcache_last_count);
+
+	/* Large requests are not cached */
+	ut_assertok(blkcache_test_dread(uts, &desc, 64, 40));
+	ut_asserteq(4, blkcache_reads);
+	ut_assertok(blkcache_test_dread(uts, &desc, 64, 8));
+	ut_asserteq(5, blkcache_reads);
+
+	/* The large request was not looked up in the cache */
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.hits);
+	ut_asserteq(2, stats.misses);
+
+	/* Restore the defaults */
+	blkcache_invalidate(IF_TYPE_HOST, 99);
+	blkcache_configure(8, 32, 2);
+
+	return 0;
+}
+DM_TEST(dm_test_blkcache, 0);
@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the squashfs data and fragment block cache
+ */
+
+#include <common.h>
+#include <test/fs.h>
+#include <test/ut.h>
+#include "../../fs/squashfs/sqfs_filesystem.h"
+
+/* Look up a block and, on a miss, pretend to load it like sqfs.c does */
+static bool sqfs_test_get(struct squashfs_datablock *cache, u64 start,
+			  ulong *tick, struct squashfs_datablock **dbp)
+{
+	struct squashfs_datablock *db;
+	bool hit;
+
+	db = sqfs_cache_get(cache, SQFS_DATA_CACHE_SIZE, start, tick, &hit);
+	if (!hit) {
+		db->start = start;
+		db->size = 0x1000;
+		db->last_used = ++(*tick);
+	}
+	if (dbp)
+		*dbp = db;
+
+	return hit;
+}
+
+/* Read blocks 0 to n-1 of a file and return the number of cache hits */
+static int sqfs_test_pass(struct squashfs_datablock *cache, int n,
+			  ulong *tick)
+{
+	int hits = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		hits += sqfs_test_get(cache, i * 0x1000, tick, NULL);
+
+	return hits;
+}
+
+/* Test that the least recently used block is replaced */
+static int fs_test_sqfs_cache_lru(struct unit_test_state *uts)
+{
+	struct squashfs_datablock cache[SQFS_DATA_CACHE_SIZE];
+	struct squashfs_datablock *db;
+	ulong tick = 0;
+	int i;
+
+	memset(cache, '\0', sizeof(cache));
+
+	/* Empty entries are used first, each block gets its own entry */
+	for (i = 0; i < SQFS_DATA_CACHE_SIZE; i++) {
+		ut_assert(!sqfs_test_get(cache, i * 0x1000, &tick, &db));
+		ut_asserteq_ptr(&cache[i], db);
+	}
+	ut_asserteq(SQFS_DATA_CACHE_SIZE,
+		    sqfs_test_pass(cache, SQFS_DATA_CACHE_SIZE, &tick));
+
+	/* Block 0 is used again, so a new block replaces block 1 */
+	ut_assert(sqfs_test_get(cache, 0, &tick, &db));
+	ut_asserteq_ptr(&cache[0], db);
+	ut_assert(!sqfs_test_get(cache, 0x100000, &tick, &db));
+	ut_asserteq_ptr(&cache[1], db);
+
+	/* Block 1 is gone and replaces block 2, block 0 is still there */
+	ut_assert(!sqfs_test_get(cache, 0x1000, &tick, &db));
+	ut_asserteq_ptr(&cache[2], db);
+	ut_assert(sqfs_test_get(cache, 0, &tick, &db));
+	ut_asserteq_ptr(&cache[0], db);
+	ut_assert(sqfs_test_get(cache, 0x100000, &tick, NULL));
+
+	return 0;
+}
+FS_TEST(fs_test_sqfs_cache_lru, 0);
+
+/* Test which files go through the cache and why large ones do not */
+static int fs_test_sqfs_cache_file(struct unit_test_state *uts)
+{
+	struct squashfs_datablock cache[SQFS_DATA_CACHE_SIZE];
+	int small = SQFS_DATA_CACHE_SIZE / 2;
+	int large = SQFS_DATA_CACHE_SIZE + 1;
+	ulong tick = 0;
+
+	ut_assert(sqfs_cache_file(0));
+	ut_assert(sqfs_cache_file(small));
+	ut_assert(!sqfs_cache_file(small + 1));
+	ut_assert(!sqfs_cache_file(large));
+
+	/* A small file is read from the cache the second time */
+	memset(cache, '\0', sizeof(cache));
+	ut_asserteq(0, sqfs_test_pass(cache, small, &tick));
+	ut_asserteq(small, sqfs_test_pass(cache, small, &tick));
+
+	/* A file larger than the cache evicts each block before it is reused */
+	memset(cache, '\0', sizeof(cache));
+	ut_asserteq(0, sqfs_test_pass(cache, large, &tick));
+	ut_asserteq(0, sqfs_test_pass(cache, large, &tick));
+
+	return 0;
+}
+FS_TEST(fs_test_sqfs_cache_file, 0);
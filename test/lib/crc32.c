@@ -0,0 +1,130 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests and throughput benchmark for the CRC32 implementation
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <time.h>
+#include <u-boot/crc.h>
+#include <test/lib.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define CRC32_BENCH_SIZE	(1 << 20)
+#define CRC32_BENCH_MS		500
+
+/* Bit-wise reference implementation */
+static uint32_t crc32_ref(uint32_t crc, const unsigned char *buf, uint len)
+{
+	int k;
+
+	crc = ~crc;
+	while (len--) {
+		crc ^= *buf++;
+		for (k = 0; k < 8; k++)
+			crc = crc & 1 ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+	}
+
+	return ~crc;
+}
+
+static void crc32_fill(unsigned char *buf, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = i * 37 + (i >> 8);
+}
+
+static int lib_test_crc32_vectors(struct unit_test_state *uts)
+{
+	const unsigned char *check = (const unsigned char *)"123456789";
+	const unsigned char *fox = (const unsigned char *)
+		"The quick brown fox jumps over the lazy dog";
+
+	ut_asserteq(0, crc32(0, check, 0));
+	ut_asserteq(0xcbf43926, crc32(0, check, 9));
+	ut_asserteq(0x414fa339, crc32(0, fox, 43));
+	ut_asserteq(0x2dfd2d88, crc32_no_comp(0, check, 9));
+
+	return 0;
+}
+LIB_TEST(lib_test_crc32_vectors, 0);
+
+/* Compare with the reference for all alignments and for chained calls */
+static int lib_test_crc32_ref(struct unit_test_state *uts)
+{
+	unsigned char buf[300];
+	uint32_t crc;
+	int off, len;
+
+	crc32_fill(buf, sizeof(buf));
+	for (off = 0; off < 8; off++) {
+		for (len = 0; len <= 72; len++)
+			ut_asserteq(crc32_ref(0x12345678, buf + off, len),
+				    crc32(0x12345678, buf + off, len));
+	}
+	ut_asserteq(crc32_ref(0, buf, sizeof(buf)),
+		    crc32(0, buf, sizeof(buf)));
+
+	for (len = 0; len < 20; len++) {
+		crc = crc32(0, buf, len);
+		crc = crc32(crc, buf + len, sizeof(buf) - len);
+		ut_asserteq(crc32(0, buf, sizeof(buf)), crc);
+	}
+
+	return 0;
+}
+LIB_TEST(lib_test_crc32_ref, 0);
+
+/*
+ * Calls with a single byte only go through the byte-wise loop, so compare
+ * them with the wide loop on unaligned buffers and odd lengths
+ */
+static int lib_test_crc32_bytewise(struct unit_test_state *uts)
+{
+	unsigned char buf[1040];
+	uint32_t crc;
+	int off, len, i;
+
+	crc32_fill(buf, sizeof(buf));
+	for (off = 1; off < 8; off += 2) {
+		for (len = 1; len <= 1031; len += 6) {
+			crc = 0;
+			for (i = 0; i < len; i++)
+				crc = crc32(crc, buf + off + i, 1);
+			ut_asserteq(crc, crc32(0, buf + off, len));
+		}
+	}
+
+	return 0;
+}
+LIB_TEST(lib_test_crc32_bytewise, 0);
+
+static int lib_test_crc32_speed(struct unit_test_state *uts)
+{
+	unsigned char *buf;
+	ulong start, ms;
+	uint32_t crc = 0;
+	int loops = 0;
+
+	buf = malloc(CRC32_BENCH_SIZE);
+	ut_assertnonnull(buf);
+	crc32_fill(buf, CRC32_BENCH_SIZE);
+	ut_asserteq(crc32_ref(0, buf, 65536), crc32(0, buf, 65536));
+
+	start = get_timer(0);
+	do {
+		crc = crc32(crc, buf, CRC32_BENCH_SIZE);
+		loops++;
+		ms = get_timer(start);
+	} while (ms < CRC32_BENCH_MS);
+	free(buf);
+
+	printf("crc32: %d MiB in %lu ms, %lu MiB/s\n", loops, ms,
+	       loops * 1000UL / ms);
+
+	return 0;
+}
+LIB_TEST(lib_test_crc32_speed, 0);
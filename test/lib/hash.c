@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for hashing a buffer with several algorithms in one pass
+ */
+
+#include <common.h>
+#include <hash.h>
+#include <malloc.h>
+#include <test/lib.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define HASH_TEST_SIZE		(3 * HASH_MULTI_BLOCK + 123)
+
+static int lib_test_hash_multi(struct unit_test_state *uts)
+{
+	static const char *const names[] = {
+		"crc32", "sha256", "sha1", "crc16-ccitt"
+	};
+	static const unsigned int lens[] = {
+		0, 1, 63, HASH_MULTI_BLOCK, HASH_MULTI_BLOCK + 1, HASH_TEST_SIZE
+	};
+	uint8_t digest[HASH_MULTI_MAX][HASH_MAX_DIGEST_SIZE];
+	uint8_t expect[HASH_MAX_DIGEST_SIZE];
+	struct hash_algo *algos[HASH_MULTI_MAX];
+	uint8_t *outputs[HASH_MULTI_MAX];
+	struct hash_multi_ctx mctx;
+	unsigned char *buf;
+	int count = 0;
+	int i, j, chunk;
+
+	/* Only use the algorithms which are enabled */
+	for (i = 0; i < ARRAY_SIZE(names); i++) {
+		if (hash_progressive_lookup_algo(names[i], &algos[count]))
+			continue;
+		outputs[count] = digest[count];
+		count++;
+	}
+	ut_assert(count >= 2);
+
+	buf = malloc(HASH_TEST_SIZE);
+	ut_assertnonnull(buf);
+	for (i = 0; i < HASH_TEST_SIZE; i++)
+		buf[i] = i * 13 + (i >> 9);
+
+	/* The digests must match those of each algorithm on its own */
+	for (j = 0; j < ARRAY_SIZE(lens); j++) {
+		ut_assertok(hash_multi(algos, count, buf, lens[j], outputs));
+		for (i = 0; i < count; i++) {
+			algos[i]->hash_func_ws(buf, lens[j], expect,
+					       algos[i]->chunk_size);
+			ut_asserteq_mem(expect, digest[i],
+					algos[i]->digest_size);
+		}
+	}
+
+	/* The same in pieces, as when hashing while loading */
+	ut_assertok(hash_multi_init(&mctx, algos, count));
+	for (j = 0; j < HASH_TEST_SIZE; j += chunk) {
+		chunk = min(HASH_TEST_SIZE - j, 1000 + j % 3001);
+		ut_assertok(hash_multi_update(&mctx, buf + j, chunk,
+					      j + chunk == HASH_TEST_SIZE));
+	}
+	ut_assertok(hash_multi_finish(&mctx, outputs));
+	for (i = 0; i < count; i++) {
+		algos[i]->hash_func_ws(buf, HASH_TEST_SIZE, expect,
+				       algos[i]->chunk_size);
+		ut_asserteq_mem(expect, digest[i], algos[i]->digest_size);
+	}
+
+	ut_asserteq(-EINVAL, hash_multi(algos, 0, buf, 1, outputs));
+	ut_asserteq(-EINVAL, hash_multi(algos, HASH_MULTI_MAX + 1, buf, 1,
+					outputs));
+	free(buf);
+
+	return 0;
+}
+LIB_TEST(lib_test_hash_multi, 0);
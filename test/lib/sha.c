@@ -0,0 +1,130 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test vectors and throughput benchmark for SHA-1 and SHA-256
+ */
+
+#include <common.h>
+#include <hash.h>
+#include <hexdump.h>
+#include <malloc.h>
+#include <time.h>
+#include <test/lib.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define SHA_BENCH_SIZE		(1 << 20)
+#define SHA_BENCH_MS		500
+
+struct sha_test_vector {
+	const char *algo;
+	const char *msg;
+	int repeat;		/* Number of times msg is hashed */
+	const char *digest;
+};
+
+/* From FIPS 180-2 */
+static const struct sha_test_vector sha_test_vectors[] = {
+	{ "sha1", "abc", 1,
+	  "a9993e364706816aba3e25717850c26c9cd0d89d" },
+	{ "sha1", "", 1,
+	  "da39a3ee5e6b4b0d3255bfef95601890afd80709" },
+	{ "sha1", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+	  1, "84983e441c3bd26ebaae4aa1f95129e5e54670f1" },
+	{ "sha1", "a", 1000000,
+	  "34aa973cd4c4daa4f61eeb2bdbad27316534016f" },
+	{ "sha256", "abc", 1,
+	  "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+	{ "sha256", "", 1,
+	  "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+	{ "sha256", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+	  1, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+	{ "sha256", "a", 1000000,
+	  "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+};
+
+static int sha_test_vector(struct unit_test_state *uts,
+			   const struct sha_test_vector *tv)
+{
+	struct hash_algo *algo;
+	uint8_t digest[HASH_MAX_DIGEST_SIZE];
+	uint8_t expect[HASH_MAX_DIGEST_SIZE];
+	unsigned char *buf;
+	int len = strlen(tv->msg) * tv->repeat;
+	int i, chunk;
+	void *ctx;
+
+	/* The algorithms are only there if enabled */
+	if (hash_progressive_lookup_algo(tv->algo, &algo))
+		return 0;
+
+	ut_assertok(hex2bin(expect, tv->digest, algo->digest_size));
+	buf = malloc(len + 1);
+	ut_assertnonnull(buf);
+	for (i = 0; i < tv->repeat; i++)
+		strcpy((char *)buf + i * strlen(tv->msg), tv->msg);
+
+	/* In one go */
+	algo->hash_func_ws(buf, len, digest, algo->chunk_size);
+	ut_asserteq_mem(expect, digest, algo->digest_size);
+
+	/* In pieces not aligned to the block size */
+	ut_assertok(algo->hash_init(algo, &ctx));
+	for (i = 0; i < len; i += chunk) {
+		chunk = min(len - i, 1 + i % 197);
+		ut_assertok(algo->hash_update(algo, ctx, buf + i, chunk,
+					      i + chunk == len));
+	}
+	ut_assertok(algo->hash_finish(algo, ctx, digest, sizeof(digest)));
+	ut_asserteq_mem(expect, digest, algo->digest_size);
+
+	free(buf);
+
+	return 0;
+}
+
+static int lib_test_sha_vectors(struct unit_test_state *uts)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(sha_test_vectors); i++)
+		ut_assertok(sha_test_vector(uts, &sha_test_vectors[i]));
+
+	return 0;
+}
+LIB_TEST(lib_test_sha_vectors, 0);
+
+static int lib_test_sha_speed(struct unit_test_state *uts)
+{
+	static const char *const algos[] = { "sha1", "sha256" };
+	uint8_t digest[HASH_MAX_DIGEST_SIZE];
+	struct hash_algo *algo;
+	unsigned char *buf;
+	ulong start, ms;
+	int i, loops;
+
+	buf = malloc(SHA_BENCH_SIZE);
+	ut_assertnonnull(buf);
+	for (i = 0; i < SHA_BENCH_SIZE; i++)
+		buf[i] = i * 37 + (i >> 8);
+
+	for (i = 0; i < ARRAY_SIZE(algos); i++) {
+		if (hash_lookup_algo(algos[i], &algo))
+			continue;
+
+		loops = 0;
+		start = get_timer(0);
+		do {
+			algo->hash_func_ws(buf, SHA_BENCH_SIZE, digest,
+					   algo->chunk_size);
+			loops++;
+			ms = get_timer(start);
+		} while (ms < SHA_BENCH_MS);
+
+		printf("%s: %d MiB in %lu ms, %lu MiB/s\n", algo->name, loops,
+		       ms, loops * 1000UL / ms);
+	}
+	free(buf);
+
+	return 0;
+}
+LIB_TEST(lib_test_sha_speed, 0);
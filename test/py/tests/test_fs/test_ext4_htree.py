@@ -0,0 +1,72 @@
+# SPDX-License-Identifier: GPL-2.0+
+#
+# U-Boot File System: ext4 hashed directory test
+
+"""
+This test looks up files in a directory with 10000 entries, once with the
+htree index and once with the index feature disabled (linear scan). The time
+taken by both runs is logged to compare them.
+"""
+
+import os
+import pytest
+import time
+from subprocess import check_call
+
+NUM_FILES = 10000
+LOOKUPS = [0, 1, 4999, 9998, 9999]
+
+def file_name(i):
+    # vary the length so entries spread over the leaf blocks differently
+    return 'file_%05d_%s' % (i, 'x' * (i % 37))
+
+def mk_htree_image(build_dir, name, dir_index):
+    src = os.path.join(build_dir, 'htree-src')
+    img = os.path.join(build_dir, name)
+    if not os.path.exists(src):
+        os.makedirs(os.path.join(src, 'big'))
+        for i in range(NUM_FILES):
+            with open(os.path.join(src, 'big', file_name(i)), 'w') as f:
+                f.write('x' * (i % 50))
+    features = '' if dir_index else '-O ^dir_index'
+    check_call('rm -f %s' % img, shell=True)
+    check_call('mkfs.ext4 -q -b 1024 %s -d %s %s 64M'
+               % (features, src, img), shell=True)
+    if dir_index:
+        # mkfs.ext4 -d fills directories linearly, index them
+        check_call('e2fsck -fyD %s >/dev/null 2>&1 || test $? -le 1'
+                   % img, shell=True)
+    return img
+
+def lookup_all(u_boot_console, img):
+    u_boot_console.run_command('host bind 0 %s' % img)
+    tstart = time.time()
+    for i in LOOKUPS:
+        output = u_boot_console.run_command_list([
+            'ext4size host 0 /big/%s' % file_name(i),
+            'printenv filesize'])
+        assert 'filesize=%x' % (i % 50) in ''.join(output)
+    output = u_boot_console.run_command(
+        'ext4size host 0 /big/file_99999 || echo missing')
+    assert 'missing' in output
+    return time.time() - tstart
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_ext4')
+@pytest.mark.requiredtool('mkfs.ext4')
+@pytest.mark.requiredtool('e2fsck')
+@pytest.mark.slow
+def test_ext4_htree(u_boot_console):
+    build_dir = u_boot_console.config.build_dir
+    htree = mk_htree_image(build_dir, 'htree.ext4.img', True)
+    linear = mk_htree_image(build_dir, 'linear.ext4.img', False)
+    try:
+        elapsed_htree = lookup_all(u_boot_console, htree)
+        elapsed_linear = lookup_all(u_boot_console, linear)
+        u_boot_console.log.info('%d lookups in %d entries: htree %f s, '
+                                'linear %f s' % (len(LOOKUPS) + 1, NUM_FILES,
+                                elapsed_htree, elapsed_linear))
+    finally:
+        u_boot_console.run_command('host bind 0')
+        check_call('rm -rf %s %s %s' % (htree, linear,
+                   os.path.join(build_dir, 'htree-src')), shell=True)
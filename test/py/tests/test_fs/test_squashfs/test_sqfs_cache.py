@@ -0,0 +1,56 @@
+# SPDX-License-Identifier: GPL-2.0
+
+import os
+import pytest
+from sqfs_common import *
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_fs_generic')
+@pytest.mark.buildconfigspec('cmd_squashfs')
+@pytest.mark.buildconfigspec('fs_squashfs')
+@pytest.mark.requiredtool('mksquashfs')
+def test_sqfs_cache(u_boot_console):
+    build_dir = u_boot_console.config.build_dir
+    command = "sqfsload host 0 $kernel_addr_r "
+
+    # both images put the tails of blks_frag and frag_only in one fragment
+    for opt in [gzip, zstd]:
+        try:
+            opt.gen_image(build_dir)
+        except RuntimeError:
+            opt.clean_source(build_dir)
+            # skip unsupported compression types
+            continue
+
+        path = os.path.join(build_dir, "sqfs-" + opt.name)
+        output = u_boot_console.run_command("host bind 0 " + path)
+
+        try:
+            u_boot_console.run_command("sqfscache flush")
+            u_boot_console.run_command("sqfscache show")
+
+            # the fragment block is decompressed once
+            output = u_boot_console.run_command(command + "frag_only")
+            assert "100 bytes read" in output
+            output = u_boot_console.run_command("sqfscache show")
+            assert "hits: 0" in output
+            assert "misses: 1" in output
+
+            # and then found in the cache by later commands
+            output = u_boot_console.run_command(command + "frag_only")
+            assert "100 bytes read" in output
+            output = u_boot_console.run_command("sqfscache show")
+            assert "hits: 1" in output
+            assert "misses: 0" in output
+
+            # the data block is new, the tail shares the fragment block
+            output = u_boot_console.run_command(command + "blks_frag")
+            assert "5100 bytes read" in output
+            output = u_boot_console.run_command("sqfscache show")
+            assert "hits: 1" in output
+            assert "misses: 1" in output
+            assert "entries: 2" in output
+        except:
+            opt.cleanup(build_dir)
+            assert False
+        opt.cleanup(build_dir)